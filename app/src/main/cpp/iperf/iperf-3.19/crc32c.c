@@ -0,0 +1,176 @@
+/*
+ * CRC32C (Castagnoli) checksum used by --verify-payload.
+ *
+ * The receiver checksums every block it reads, so this has to keep up
+ * with line rate on a phone.  Both x86 (SSE4.2) and ARMv8 (the CRC32
+ * extension, present on practically every 64-bit Android device) have
+ * an instruction for exactly this polynomial; we pick it at run time
+ * and fall back to a slicing-by-8 table when it isn't there.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define CRC32C_X86 1
+#elif defined(__aarch64__) && defined(__linux__)
+#include <sys/auxv.h>
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#define CRC32C_ARM64 1
+#endif
+
+#include "crc32c.h"
+
+#define CRC32C_POLY 0x82f63b78	/* Castagnoli polynomial, bit-reversed */
+
+static uint32_t crc32c_table[8][256];
+static uint32_t (*crc32c_fn)(uint32_t crc, const unsigned char *p, size_t len);
+static const char *crc32c_name;
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Portable slicing-by-8.  The words are assembled byte by byte so this
+ * also works on big-endian hosts; compilers turn it back into a plain
+ * load where that is possible.
+ */
+static uint32_t
+crc32c_sw(uint32_t crc, const unsigned char *p, size_t len)
+{
+    uint32_t lo, hi;
+
+    while (len >= 8) {
+	lo = crc ^ ((uint32_t) p[0] | (uint32_t) p[1] << 8 |
+		    (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24);
+	hi = (uint32_t) p[4] | (uint32_t) p[5] << 8 |
+	     (uint32_t) p[6] << 16 | (uint32_t) p[7] << 24;
+	crc = crc32c_table[7][lo & 0xff] ^ crc32c_table[6][(lo >> 8) & 0xff] ^
+	      crc32c_table[5][(lo >> 16) & 0xff] ^ crc32c_table[4][lo >> 24] ^
+	      crc32c_table[3][hi & 0xff] ^ crc32c_table[2][(hi >> 8) & 0xff] ^
+	      crc32c_table[1][(hi >> 16) & 0xff] ^ crc32c_table[0][hi >> 24];
+	p += 8;
+	len -= 8;
+    }
+    while (len--)
+	crc = crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+#if defined(CRC32C_X86)
+__attribute__((target("sse4.2")))
+static uint32_t
+crc32c_sse42(uint32_t crc, const unsigned char *p, size_t len)
+{
+#if defined(__x86_64__)
+    uint64_t crc64 = crc, w;
+
+    while (len >= 8) {
+	memcpy(&w, p, sizeof(w));
+	crc64 = _mm_crc32_u64(crc64, w);
+	p += 8;
+	len -= 8;
+    }
+    crc = (uint32_t) crc64;
+#endif /* __x86_64__ */
+    while (len >= 4) {
+	uint32_t w32;
+
+	memcpy(&w32, p, sizeof(w32));
+	crc = _mm_crc32_u32(crc, w32);
+	p += 4;
+	len -= 4;
+    }
+    while (len--)
+	crc = _mm_crc32_u8(crc, *p++);
+    return crc;
+}
+#endif /* CRC32C_X86 */
+
+#if defined(CRC32C_ARM64)
+/*
+ * The CRC32 instructions are optional in ARMv8.0, so the NDK's default
+ * target doesn't enable them; compile just this function for them and
+ * only call it when HWCAP says the CPU has them.
+ */
+#if defined(__clang__)
+#define CRC32C_TARGET_CRC __attribute__((target("crc")))
+#define crc32c_u64(crc, v) __builtin_arm_crc32cd((crc), (v))
+#define crc32c_u8(crc, v) __builtin_arm_crc32cb((crc), (v))
+#else
+#define CRC32C_TARGET_CRC __attribute__((target("arch=armv8-a+crc")))
+#define crc32c_u64(crc, v) __builtin_aarch64_crc32cx((crc), (v))
+#define crc32c_u8(crc, v) __builtin_aarch64_crc32cb((crc), (v))
+#endif
+
+CRC32C_TARGET_CRC
+static uint32_t
+crc32c_armv8(uint32_t crc, const unsigned char *p, size_t len)
+{
+    uint64_t w;
+
+    while (len >= 8) {
+	memcpy(&w, p, sizeof(w));
+	crc = crc32c_u64(crc, w);
+	p += 8;
+	len -= 8;
+    }
+    while (len--)
+	crc = crc32c_u8(crc, *p++);
+    return crc;
+}
+#endif /* CRC32C_ARM64 */
+
+static void
+crc32c_init(void)
+{
+    uint32_t c;
+    int i, j;
+
+    for (i = 0; i < 256; i++) {
+	c = i;
+	for (j = 0; j < 8; j++)
+	    c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+	crc32c_table[0][i] = c;
+    }
+    for (i = 0; i < 256; i++)
+	for (j = 1; j < 8; j++)
+	    crc32c_table[j][i] = (crc32c_table[j - 1][i] >> 8) ^
+		crc32c_table[0][crc32c_table[j - 1][i] & 0xff];
+
+    crc32c_fn = crc32c_sw;
+    crc32c_name = "software";
+
+#if defined(CRC32C_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+	crc32c_fn = crc32c_sse42;
+	crc32c_name = "sse4.2";
+    }
+#elif defined(CRC32C_ARM64)
+    if (getauxval(AT_HWCAP) & HWCAP_CRC32) {
+	crc32c_fn = crc32c_armv8;
+	crc32c_name = "armv8-crc";
+    }
+#endif
+}
+
+uint32_t
+crc32c(uint32_t crc, const void *buf, size_t len)
+{
+    pthread_once(&crc32c_once, crc32c_init);
+    return ~crc32c_fn(~crc, (const unsigned char *) buf, len);
+}
+
+const char *
+crc32c_impl(void)
+{
+    pthread_once(&crc32c_once, crc32c_init);
+    return crc32c_name;
+}
@@ -0,0 +1,27 @@
+/*
+ * CRC32C (Castagnoli) checksum used by --verify-payload.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __CRC32C_H
+#define __CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Extend a CRC32C over len bytes of buf.  Start with crc == 0; the
+ * result of one call can be passed back in to checksum data that
+ * arrives in pieces, i.e. crc32c(crc32c(0, a, n), b, m) is the CRC of
+ * a followed by b.
+ *
+ * The hardware CRC instructions (SSE4.2 on x86, the CRC32 extension on
+ * ARMv8) are used when the CPU has them, with a table driven fallback.
+ */
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len);
+
+/* Name of the implementation crc32c() dispatches to, for diagnostics. */
+const char *crc32c_impl(void);
+
+#endif /* __CRC32C_H */
@@ -90,6 +90,160 @@ struct iperf_sctp_info {
     uint32_t cwnd;
 };
 
+/* --perf-counters, see perf_counters.c */
+enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_CONTEXT_SWITCHES,
+    PERF_PAGE_FAULTS,
+    PERF_NUM_COUNTERS
+};
+
+/* -b pacing statistics, see iperf_pacer.c */
+struct iperf_pacer_stats {
+    int64_t messages;       /* messages covered by gap samples */
+    uint64_t gap_ns;        /* time those messages took */
+    uint64_t error_ns;      /* |gap - target gap|, summed over the messages */
+    uint64_t min_gap_ns;
+    uint64_t max_gap_ns;
+    int64_t sleeps;         /* times the bucket ran dry and we slept */
+};
+
+/* --txtime statistics, see iperf_udp.c */
+struct iperf_txtime_stats {
+    int64_t packets;        /* sent with a transmit time */
+    int64_t reported;       /* whose actual send time the kernel reported */
+    int64_t error_ns;       /* actual - scheduled, summed over those */
+    uint64_t abs_error_ns;  /* |actual - scheduled|, summed */
+    uint64_t max_error_ns;  /* largest |actual - scheduled| */
+    int64_t early;          /* left more than TXTIME_EARLY_USECS before schedule */
+    int64_t dropped;        /* refused by the qdisc (SO_EE_ORIGIN_TXTIME) */
+};
+
+/*
+ * UDP receive: a packet is reordered if it fills a gap in the last
+ * SEQ_WINDOW sequence numbers, a duplicate if its number was already
+ * seen there, and late if it is older than that (see iperf_udp.c).
+ */
+#define SEQ_WINDOW_BITS 12
+#define SEQ_WINDOW (1 << SEQ_WINDOW_BITS)
+/* Reorder distances 1, 2-3, 4-7, ... up to the window */
+#define SEQ_REORDER_BUCKETS (SEQ_WINDOW_BITS + 1)
+
+struct iperf_seq_stats {
+    int64_t duplicates;
+    int64_t late;
+    int64_t reorder_distance_sum;       /* over the out-of-order packets */
+    int64_t reorder_distance_max;
+    int64_t reorder_distance[SEQ_REORDER_BUCKETS];
+};
+
+#if defined(__linux__) && defined(TCP_INFO)
+/*
+ * The Linux struct tcp_info, as far as tcpi_sndbuf_limited (4.10).  The
+ * kernel only ever appends to it, but glibc's copy stops at
+ * tcpi_total_retrans, so the fields after that are read through this.
+ */
+struct iperf_tcp_info_linux {
+    uint8_t state;
+    uint8_t ca_state;
+    uint8_t retransmits;
+    uint8_t probes;
+    uint8_t backoff;
+    uint8_t options;
+    uint8_t snd_wscale : 4, rcv_wscale : 4;
+    uint8_t delivery_rate_app_limited : 1, fastopen_client_fail : 2;
+
+    uint32_t rto;
+    uint32_t ato;
+    uint32_t snd_mss;
+    uint32_t rcv_mss;
+
+    uint32_t unacked;
+    uint32_t sacked;
+    uint32_t lost;
+    uint32_t retrans;
+    uint32_t fackets;
+
+    uint32_t last_data_sent;
+    uint32_t last_ack_sent;
+    uint32_t last_data_recv;
+    uint32_t last_ack_recv;
+
+    uint32_t pmtu;
+    uint32_t rcv_ssthresh;
+    uint32_t rtt;
+    uint32_t rttvar;
+    uint32_t snd_ssthresh;
+    uint32_t snd_cwnd;
+    uint32_t advmss;
+    uint32_t reordering;
+
+    uint32_t rcv_rtt;
+    uint32_t rcv_space;
+
+    uint32_t total_retrans;
+
+    uint64_t pacing_rate;
+    uint64_t max_pacing_rate;
+    uint64_t bytes_acked;
+    uint64_t bytes_received;
+    uint32_t segs_out;
+    uint32_t segs_in;
+
+    uint32_t notsent_bytes;
+    uint32_t min_rtt;
+    uint32_t data_segs_in;
+    uint32_t data_segs_out;
+
+    uint64_t delivery_rate;
+
+    uint64_t busy_time;
+    uint64_t rwnd_limited;
+    uint64_t sndbuf_limited;
+};
+
+/* Did the kernel fill in field?  len is what getsockopt() returned */
+#define TCPINFO_HAS(len, field) \
+    ((len) >= (int) (offsetof(struct iperf_tcp_info_linux, field) + sizeof(((struct iperf_tcp_info_linux *) 0)->field)))
+#endif /* __linux__ && TCP_INFO */
+
+/*
+ * TCP_INFO time counters of the sending socket (Linux 4.10 and later),
+ * in usec: busy is time with data to send, part of which the receive
+ * window or our send buffer held it back.  See tcp_info.c.
+ */
+struct iperf_tcp_limits {
+    uint64_t busy_us;
+    uint64_t rwnd_limited_us;
+    uint64_t sndbuf_limited_us;
+    uint64_t bytes_acked;
+};
+
+/* --rx-timestamps statistics, see iperf_udp.c */
+struct iperf_rxts_stats {
+    int64_t packets;        /* received with a kernel timestamp */
+    uint64_t latency_ns;    /* kernel arrival to our own arrival time, summed */
+    uint64_t max_latency_ns;
+};
+
+struct iperf_pacer {
+    double rate;            /* bytes per second, 0 if not pacing */
+    double depth;           /* bucket size in bytes, at least a burst and a block */
+    double tokens;          /* bytes that may be sent right now */
+    int64_t refill_ns;      /* CLOCK_MONOTONIC time tokens were last added */
+    int64_t target_gap_ns;  /* time one block takes at rate */
+    int64_t sample_ns;      /* time of the last gap sample */
+    int sent;               /* messages sent since then */
+    struct iperf_settings *settings;    /* block size, burst and bucket the depth comes from */
+    uint64_t new_rate;      /* bits/s from iperf_pacer_set_rate(), 0 if none pending */
+
+    /* Written by the sending thread with __atomic builtins */
+    struct iperf_pacer_stats total;
+    uint64_t interval_min_gap_ns;
+    uint64_t interval_max_gap_ns;
+};
+
 struct iperf_interval_results {
     atomic_iperf_size_t bytes_transferred; /* bytes transferred in this interval */
     struct iperf_time interval_start_time;
@@ -104,6 +258,46 @@ struct iperf_interval_results {
     double jitter;
     int64_t outoforder_packets;
     int64_t cnt_error;
+    int64_t interval_duplicate_packets;
+    int64_t interval_late_packets;
+    int64_t duplicate_packets;
+    int64_t late_packets;
+
+    /* for --verify-payload */
+    int64_t interval_verified_blocks;
+    int64_t interval_corrupted_blocks;
+    int64_t verified_blocks;
+    int64_t corrupted_blocks;
+
+    /* for -F */
+    iperf_size_t interval_diskfile_bytes;
+    uint64_t interval_diskfile_usecs;
+    int64_t interval_diskfile_stalls;
+    iperf_size_t diskfile_bytes;
+    uint64_t diskfile_usecs;
+    int64_t diskfile_stalls;
+    /* -F receive through the disk writer thread */
+    uint64_t interval_diskfile_wait_usecs;
+    uint64_t diskfile_wait_usecs;
+    int diskfile_queue_max;        /* most blocks queued during the interval */
+    int diskfile_backlog_bytes;    /* bytes not yet on disk at the interval's end */
+
+    /* CPU time of the stream's worker thread */
+    uint64_t interval_cpu_usecs;
+    uint64_t cpu_usecs;
+    uint64_t interval_perf_count[PERF_NUM_COUNTERS];
+    uint64_t perf_count[PERF_NUM_COUNTERS];
+
+    /* -b pacing, sending side */
+    struct iperf_pacer_stats interval_pacer;
+    struct iperf_pacer_stats pacer;
+    /* --txtime, sending side */
+    struct iperf_txtime_stats interval_txtime;
+    struct iperf_txtime_stats txtime;
+    /* --rx-timestamps, receiving side */
+    double kernel_jitter;
+    struct iperf_rxts_stats interval_rxts;
+    struct iperf_rxts_stats rxts;
 
     int omitted;
 #if (defined(linux) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)) && \
@@ -124,6 +318,11 @@ struct iperf_interval_results {
     long rtt;
     long rttvar;
     long pmtu;
+    /* TCP sender, if the kernel has them: see save_tcpinfo() */
+    int tcp_limits_valid;
+    struct iperf_tcp_limits tcp_limits;             /* totals from the socket */
+    struct iperf_tcp_limits interval_tcp_limits;
+    uint64_t delivery_rate;                         /* bytes/s, the kernel's latest estimate */
 };
 
 struct iperf_stream_result {
@@ -140,6 +339,10 @@ struct iperf_stream_result {
     int stream_count_rtt;
     long stream_max_snd_cwnd;
     long stream_max_snd_wnd;
+    int stream_tcp_limits_valid;
+    struct iperf_tcp_limits stream_prev_tcp_limits;    /* socket totals at the last interval */
+    struct iperf_tcp_limits stream_tcp_limits;         /* since the end of -O */
+    double stream_tcp_limits_secs;                     /* wall time stream_tcp_limits cover */
     struct iperf_time start_time;
     struct iperf_time end_time;
     struct iperf_time start_time_fixed;
@@ -160,6 +363,7 @@ struct iperf_settings {
     int bitrate_limit_stats_per_interval;     /* calculated number of stats periods for averaging total data rate */
     uint64_t fqrate;               /* target data rate for FQ pacing*/
     int pacing_timer;        /* pacing timer in microseconds */
+    int pacing_bucket;       /* -b token bucket depth in bytes, 0 for automatic */
     int burst;                /* packets per burst */
     int mss;                  /* for TCP MSS */
     int ttl;                  /* IP TTL option */
@@ -194,6 +398,14 @@ struct iperf_stream {
 
     pthread_t thr;
     int thread_created;
+    clockid_t thread_cpu_clock;    /* CPU-time clock of thr */
+    int thread_cpu_clock_valid;
+    uint64_t thread_cpu_usecs;    /* CPU time used by thr at the last sample */
+    uint64_t omitted_thread_cpu_usecs;
+    int perf_fd[PERF_NUM_COUNTERS];    /* --perf-counters, -1 if not open */
+    int perf_user_only;    /* kernel time is not counted */
+    uint64_t perf_count[PERF_NUM_COUNTERS];    /* at the last read */
+    uint64_t omitted_perf_count[PERF_NUM_COUNTERS];
     int done;
 
     /* configurable members */
@@ -209,12 +421,29 @@ struct iperf_stream {
     /* non configurable members */
     struct iperf_stream_result *result;    /* structure pointer to result */
     Timer *send_timer;
-    int green_light;
+    struct iperf_pacer pacer;    /* -b token bucket, sending side */
+    struct iperf_pacer_stats omitted_pacer;
+    struct iperf_txtime *txtime;    /* --txtime UDP sender, NULL if not in use */
+    struct iperf_txtime_stats omitted_txtime;
+    int rx_timestamps;    /* --rx-timestamps: receiving, or the receiver's results had them */
+    struct iperf_rxts_stats rxts;    /* updated by the receiving thread */
+    struct iperf_rxts_stats omitted_rxts;
+    uint64_t interval_max_rx_latency_ns;
+    struct iperf_udp_histograms *histograms;    /* --udp-histograms receiver (or its results), NULL if not in use */
     int buffer_fd;    /* data to send, file descriptor */
     char *buffer;        /* data to send, mmapped */
     int pending_size;     /* pending data to send */
     int diskfile_fd;    /* file to send, file descriptor */
-    int diskfile_left;    /* remaining file data on disk */
+    off_t diskfile_offset;    /* file offset of the next read or write */
+    int diskfile_pipe[2];    /* -F -Z receive: socket -> pipe -> file with splice() */
+    iperf_size_t diskfile_bytes;    /* bytes read from or written to the file */
+    uint64_t diskfile_usecs;    /* time spent blocked in file I/O */
+    uint64_t diskfile_max_usecs;    /* longest single file I/O call */
+    int64_t diskfile_stalls;    /* file I/O calls of DISKFILE_STALL_USECS or longer */
+    struct iperf_diskwriter *diskwriter;    /* -F receive: writes the file on its own thread */
+    struct iperf_tcpinfo_ring *tcpinfo;    /* --tcpinfo-sample TCP stream, NULL if not in use */
+    int thread_cpu;    /* --thread-affinity: the worker's CPU, -1 if not pinned */
+    int thread_cpu_error;    /* errno if pinning it failed */
 
     /*
      * for udp measurements - This can be a structure outside stream, and
@@ -226,12 +455,28 @@ struct iperf_stream {
     int64_t omitted_packet_count;
     double jitter;
     double prev_transit;
+    double kernel_jitter;                 /* jitter of the kernel's arrival times */
+    int64_t prev_kernel_transit_ns;
     int64_t outoforder_packets;
     int64_t omitted_outoforder_packets;
     int64_t cnt_error;
     int64_t omitted_cnt_error;
+    uint64_t seq_window[SEQ_WINDOW / 64];    /* which recent sequence numbers have arrived */
+    struct iperf_seq_stats seq;
+    struct iperf_seq_stats omitted_seq;
+    int seq_valid;                        /* seq is known: receiving, or from the receiver's results */
     uint64_t target;
 
+    /* for --verify-payload */
+    uint32_t verify_crc;          /* CRC32C of one whole reference block */
+    uint32_t verify_udp_crc;      /* same, excluding the UDP header */
+    uint32_t verify_partial_crc;  /* TCP: CRC32C of the block received so far */
+    int verify_offset;            /* TCP: bytes of the current block received so far */
+    int64_t verified_blocks;
+    int64_t omitted_verified_blocks;
+    int64_t corrupted_blocks;
+    int64_t omitted_corrupted_blocks;
+
     struct sockaddr_storage local_addr;
     struct sockaddr_storage remote_addr;
 
@@ -294,6 +539,29 @@ enum debug_level {
 };
 
 
+/* Most CPUs --thread-affinity can be given */
+#define MAX_THREAD_CPUS 256
+
+/*
+ * UI frames: the interval sums of one or more intervals, handed to
+ * on_ui_frame at most ui_frame_hz times a second of test time, for a
+ * display that can't keep up with every interval line.
+ */
+struct iperf_ui_frame_direction {
+    iperf_size_t bytes;
+    int64_t retransmits;
+    int64_t packets, lost;          /* UDP */
+    double jitter_ms;               /* UDP; of the frame's last interval */
+    int active;                     /* this direction had streams in the frame */
+};
+
+struct iperf_ui_frame {
+    double start, end;              /* seconds into the test */
+    int intervals;                  /* how many went into the frame */
+    int omitted;                    /* some of them were in the -O period */
+    struct iperf_ui_frame_direction tx, rx;
+};
+
 struct iperf_test {
     pthread_mutex_t print_mutex;
 
@@ -313,7 +581,31 @@ struct iperf_test {
     int omit;                             /* duration of omit period (-O flag) */
     int duration;                         /* total duration of test (-t flag) */
     char *diskfile_name;            /* -F option */
+    int diskfile_direct;            /* --direct-io option */
+    int perf_counters;              /* --perf-counters option */
+    int txtime;                     /* --txtime option */
+    int rx_timestamps;              /* --rx-timestamps option */
+    int udp_histograms;             /* --udp-histograms option */
+    int tcpinfo_sample_ms;          /* --tcpinfo-sample option, 0 if off */
+    struct iperf_tcpinfo_sampler *tcpinfo_sampler;    /* running while the stream threads are */
+    uint64_t tcpinfo_overruns;      /* sampler periods skipped, once it has stopped */
     int affinity, server_affinity;    /* -A option */
+    int thread_cpus[MAX_THREAD_CPUS];    /* --thread-affinity, in the order streams take them */
+    int num_thread_cpus;
+    double rate_search_loss;        /* --rate-search option, -1 if off */
+    struct iperf_rate_search *rate_search;    /* on the sending side */
+    cJSON *peer_rate_search;        /* the sending side's search, from its results */
+    int phases;                     /* --phases option: measurements per control connection */
+    int phase;                      /* the one running now, from 1 */
+    double phase_gap;               /* --phase-gap option, seconds; client only */
+    int max_clients;                /* --max-clients option; server only */
+    int accept_threads;             /* --accept-threads option; server only */
+    struct iperf_server_session *server_session;    /* one of --max-clients' tests, or NULL */
+    char *history_dir;              /* --history option */
+    struct iperf_history *history;  /* this test's (or phase's) entry while it runs */
+    int ui_frame_hz;                /* 0: no UI frames */
+    struct iperf_ui_frame ui_frame; /* the one being gathered */
+    double ui_frame_sent;           /* end of the last one handed over */
 #if defined(HAVE_CPUSET_SETAFFINITY)
     cpuset_t cpumask;
 #endif /* HAVE_CPUSET_SETAFFINITY */
@@ -360,6 +652,7 @@ struct iperf_test {
     int forceflush; /* --forceflush - flushing output at every interval */
     int multisend;
     int repeating_payload;                /* --repeating-payload */
+    int verify_payload;                   /* --verify-payload */
     int timestamps;            /* --timestamps */
     char *timestamp_format;
     int mptcp;                /* -m, --mptcp */
@@ -422,12 +715,15 @@ struct iperf_test {
 
     void (*on_test_finish)(struct iperf_test *);
 
+    void (*on_ui_frame)(struct iperf_test *, const struct iperf_ui_frame *);
+
     /* cJSON handles for use when in -J mode */\
     cJSON *json_top;
     cJSON *json_start;
     cJSON *json_connected;
     cJSON *json_intervals;
     cJSON *json_end;
+    cJSON *json_phases;             /* with --phases, each finished phase's intervals and end */
 
     /* Server output (use on client side only) */
     char *server_output_text;
@@ -442,6 +738,7 @@ struct iperf_test {
 #define PORT 5201  /* default port to listen on (don't use the same port as iperf2) */
 #define uS_TO_NS 1000
 #define mS_TO_US 1000
+#define mS_TO_NS 1000000
 #define SEC_TO_mS 1000
 #define SEC_TO_US 1000000LL
 #define UDP_RATE (1024 * 1024) /* 1 Mbps */
@@ -470,10 +767,27 @@ struct iperf_test {
 #define MAX_BURST 1000
 #define MAX_MSS (9 * 1024)
 #define MAX_STREAMS 128
+#define TCPINFO_SAMPLE_MAX_MS 1000
+#define MAX_PHASES 10000
+#define MAX_PHASE_GAP 3600
+#define MAX_SERVER_SESSIONS 64
+#define MAX_ACCEPT_THREADS 16
+
+/* A -F read or write that blocks this long counts as a disk stall */
+#define DISKFILE_STALL_USECS 10000
+
+/* The disk limited a -F receive if it waited on the disk writer this much */
+#define DISKFILE_BOUND_PERCENT 10
+
+/* A stream whose thread used this much of a core was probably CPU-bound */
+#define STREAM_CPU_BOUND_PERCENT 90
+
+/* Default -b bucket depth: this much time at the target rate, or two blocks */
+#define PACER_DEFAULT_DEPTH_USECS 1000
 
 #define TIMESTAMP_FORMAT "%c "
 
-extern int gerror; /* error value from getaddrinfo(3), for use in internal error handling */
+extern _Thread_local int gerror; /* error value from getaddrinfo(3), for use in internal error handling */
 
 /* UDP "connect" message and reply (textual value for Wireshark, etc. readability - legacy was numeric) */
 
@@ -83,6 +83,15 @@
 #include "units.h"
 #include "iperf_util.h"
 #include "iperf_locale.h"
+#include "crc32c.h"
+#include "iperf_diskwriter.h"
+#include "perf_counters.h"
+#include "iperf_pacer.h"
+#include "iperf_rate_search.h"
+#include "iperf_history.h"
+#include "iperf_histogram.h"
+#include "iperf_tcpinfo_sampler.h"
+#include "iperf_server_pool.h"
 #include "version.h"
 #if defined(HAVE_SSL)
 #include <openssl/bio.h>
@@ -97,8 +106,11 @@ static int send_results(struct iperf_test *test);
 static int get_results(struct iperf_test *test);
 static int diskfile_send(struct iperf_stream *sp);
 static int diskfile_recv(struct iperf_stream *sp);
+static int diskfile_sendfile(struct iperf_stream *sp);
+static int diskfile_splice_recv(struct iperf_stream *sp);
 static int JSON_write(int fd, cJSON *json);
 static void print_interval_results(struct iperf_test *test, struct iperf_stream *sp, cJSON *json_interval_streams);
+static void ui_frame_send(struct iperf_test *test, int force);
 static cJSON *JSON_read(int fd, int max_size);
 static int JSONStream_Output(struct iperf_test *test, const char* event_name, cJSON* obj);
 
@@ -193,6 +205,12 @@ iperf_get_test_pacing_timer(struct iperf_test *ipt)
     return ipt->settings->pacing_timer;
 }
 
+int
+iperf_get_test_pacing_bucket(struct iperf_test *ipt)
+{
+    return ipt->settings->pacing_bucket;
+}
+
 uint64_t
 iperf_get_test_bytes(struct iperf_test *ipt)
 {
@@ -265,6 +283,42 @@ iperf_get_test_num_streams(struct iperf_test *ipt)
     return ipt->num_streams;
 }
 
+int
+iperf_get_test_phases(struct iperf_test *ipt)
+{
+    return ipt->phases;
+}
+
+int
+iperf_get_test_phase(struct iperf_test *ipt)
+{
+    return ipt->phase;
+}
+
+int
+iperf_get_test_max_clients(struct iperf_test *ipt)
+{
+    return ipt->max_clients;
+}
+
+int
+iperf_get_test_accept_threads(struct iperf_test *ipt)
+{
+    return ipt->accept_threads;
+}
+
+char *
+iperf_get_test_history_dir(struct iperf_test *ipt)
+{
+    return ipt->history_dir;
+}
+
+int
+iperf_get_test_ui_frame_hz(struct iperf_test *ipt)
+{
+    return ipt->ui_frame_hz;
+}
+
 int
 iperf_get_test_timestamps(struct iperf_test *ipt)
 {
@@ -283,6 +337,12 @@ iperf_get_test_repeating_payload(struct iperf_test *ipt)
     return ipt->repeating_payload;
 }
 
+int
+iperf_get_test_verify_payload(struct iperf_test *ipt)
+{
+    return ipt->verify_payload;
+}
+
 int
 iperf_get_test_bind_port(struct iperf_test *ipt)
 {
@@ -536,6 +596,12 @@ iperf_set_test_pacing_timer(struct iperf_test *ipt, int pacing_timer)
     ipt->settings->pacing_timer = pacing_timer;
 }
 
+void
+iperf_set_test_pacing_bucket(struct iperf_test *ipt, int pacing_bucket)
+{
+    ipt->settings->pacing_bucket = pacing_bucket;
+}
+
 void
 iperf_set_test_bytes(struct iperf_test *ipt, uint64_t bytes)
 {
@@ -578,12 +644,50 @@ iperf_set_test_num_streams(struct iperf_test *ipt, int num_streams)
     ipt->num_streams = num_streams;
 }
 
+void
+iperf_set_test_phases(struct iperf_test *ipt, int phases)
+{
+    ipt->phases = phases;
+}
+
+void
+iperf_set_test_phase_gap(struct iperf_test *ipt, double phase_gap)
+{
+    ipt->phase_gap = phase_gap;
+}
+
+void
+iperf_set_test_max_clients(struct iperf_test *ipt, int max_clients)
+{
+    ipt->max_clients = max_clients;
+}
+
+void
+iperf_set_test_accept_threads(struct iperf_test *ipt, int accept_threads)
+{
+    ipt->accept_threads = accept_threads;
+}
+
+void
+iperf_set_test_history_dir(struct iperf_test *ipt, const char *dir)
+{
+    if (ipt->history_dir)
+        free(ipt->history_dir);
+    ipt->history_dir = strdup(dir);
+}
+
 void
 iperf_set_test_repeating_payload(struct iperf_test *ipt, int repeating_payload)
 {
     ipt->repeating_payload = repeating_payload;
 }
 
+void
+iperf_set_test_verify_payload(struct iperf_test *ipt, int verify_payload)
+{
+    ipt->verify_payload = verify_payload;
+}
+
 void
 iperf_set_test_timestamps(struct iperf_test *ipt, int timestamps)
 {
@@ -626,6 +730,16 @@ iperf_set_on_test_finish_callback(struct iperf_test* ipt, void (*callback)(struc
         ipt->on_test_finish = callback;
 }
 
+void
+iperf_set_test_ui_frames(struct iperf_test *ipt, int hz,
+                         void (*callback)(struct iperf_test *, const struct iperf_ui_frame *))
+{
+    ipt->ui_frame_hz = callback != NULL && hz > 0 ? hz : 0;
+    ipt->on_ui_frame = callback;
+    memset(&ipt->ui_frame, 0, sizeof(ipt->ui_frame));
+    ipt->ui_frame_sent = 0;
+}
+
 static void
 check_sender_has_retransmits(struct iperf_test *ipt)
 {
@@ -658,6 +772,7 @@ iperf_set_test_role(struct iperf_test *ipt, char role)
 void
 iperf_set_test_server_hostname(struct iperf_test *ipt, const char *server_hostname)
 {
+    free(ipt->server_hostname);
     ipt->server_hostname = strdup(server_hostname);
 }
 
@@ -768,12 +883,14 @@ iperf_set_test_server_rsa_privkey(struct iperf_test *ipt, const char *server_rsa
 void
 iperf_set_test_bind_address(struct iperf_test *ipt, const char *bnd_address)
 {
+    free(ipt->bind_address);
     ipt->bind_address = strdup(bnd_address);
 }
 
 void
 iperf_set_test_bind_dev(struct iperf_test *ipt, const char *bnd_dev)
 {
+    free(ipt->bind_dev);
     ipt->bind_dev = strdup(bnd_dev);
 }
 
@@ -798,6 +915,7 @@ iperf_set_test_tos(struct iperf_test *ipt, int tos)
 void
 iperf_set_test_extra_data(struct iperf_test *ipt, const char *dat)
 {
+    free(ipt->extra_data);
     ipt->extra_data = strdup(dat);
 }
 
@@ -839,12 +957,13 @@ void
 iperf_set_test_rcv_timeout(struct iperf_test* ipt, struct iperf_time* to)
 {
     ipt->settings->rcv_timeout.secs = to->secs;
-    ipt->settings->rcv_timeout.usecs = to->usecs;
+    ipt->settings->rcv_timeout.nsecs = to->nsecs;
 }
 
 void
 iperf_set_test_congestion_control(struct iperf_test* ipt, char* cc)
 {
+    free(ipt->congestion);
     ipt->congestion = strdup(cc);
 }
 
@@ -901,6 +1020,12 @@ iperf_on_new_stream(struct iperf_stream *sp)
 void
 iperf_on_test_start(struct iperf_test *test)
 {
+    iperf_history_begin(test);
+    if (test->phases > 1 && !test->json_output)
+        iperf_printf(test, report_phase, test->phase, test->phases);
+    /* The rest describes the settings, which all phases share */
+    if (test->phase > 1)
+        return;
     if (test->json_output) {
 	cJSON_AddItemToObject(test->json_start, "test_start", iperf_json_printf("protocol: %s  num_streams: %d  blksize: %d  omit: %d  duration: %d  bytes: %d  blocks: %d  reverse: %d  tos: %d  target_bitrate: %d bidir: %d fqrate: %d interval: %f", test->protocol->name, (int64_t) test->num_streams, (int64_t) test->settings->blksize, (int64_t) test->omit, (int64_t) test->duration, (int64_t) test->settings->bytes, (int64_t) test->settings->blocks, test->reverse?(int64_t)1:(int64_t)0, (int64_t) test->settings->tos, (int64_t) test->settings->rate, (int64_t) test->bidirectional, (uint64_t) test->settings->fqrate, test->stats_interval));
     } else {
@@ -957,9 +1082,11 @@ iperf_on_connect(struct iperf_test *test)
     now_secs = time((time_t*) 0);
     (void) strftime(now_str, sizeof(now_str), rfc1123_fmt, gmtime(&now_secs));
     if (test->json_output)
-	cJSON_AddItemToObject(test->json_start, "timestamp", iperf_json_printf("time: %s  timesecs: %d", now_str, (int64_t) now_secs));
-    else if (test->verbose)
+	cJSON_AddItemToObject(test->json_start, "timestamp", iperf_json_printf("time: %s  timesecs: %d  clock_source: %s", now_str, (int64_t) now_secs, iperf_time_source()));
+    else if (test->verbose) {
 	iperf_printf(test, report_time, now_str);
+	iperf_printf(test, report_clock_source, iperf_time_source());
+    }
 
     if (test->role == 'c') {
 	if (test->json_output)
@@ -1117,7 +1244,18 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
         {"zerocopy", no_argument, NULL, 'Z'},
         {"omit", required_argument, NULL, 'O'},
         {"file", required_argument, NULL, 'F'},
+        {"direct-io", no_argument, NULL, OPT_DIRECT_IO},
+        {"perf-counters", no_argument, NULL, OPT_PERF_COUNTERS},
+        {"txtime", no_argument, NULL, OPT_TXTIME},
+        {"rx-timestamps", no_argument, NULL, OPT_RX_TIMESTAMPS},
+        {"udp-histograms", no_argument, NULL, OPT_UDP_HISTOGRAMS},
+        {"tcpinfo-sample", required_argument, NULL, OPT_TCPINFO_SAMPLE},
+        {"thread-affinity", required_argument, NULL, OPT_THREAD_AFFINITY},
+        {"rate-search", required_argument, NULL, OPT_RATE_SEARCH},
+        {"phases", required_argument, NULL, OPT_PHASES},
+        {"phase-gap", required_argument, NULL, OPT_PHASE_GAP},
         {"repeating-payload", no_argument, NULL, OPT_REPEATING_PAYLOAD},
+        {"verify-payload", no_argument, NULL, OPT_VERIFY_PAYLOAD},
         {"timestamps", optional_argument, NULL, OPT_TIMESTAMPS},
 #if defined(HAVE_CPU_AFFINITY)
         {"affinity", required_argument, NULL, 'A'},
@@ -1154,8 +1292,12 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
 #endif /* HAVE_SSL */
 	{"fq-rate", required_argument, NULL, OPT_FQ_RATE},
 	{"pacing-timer", required_argument, NULL, OPT_PACING_TIMER},
+	{"pacing-bucket", required_argument, NULL, OPT_PACING_BUCKET},
 	{"connect-timeout", required_argument, NULL, OPT_CONNECT_TIMEOUT},
         {"idle-timeout", required_argument, NULL, OPT_IDLE_TIMEOUT},
+        {"max-clients", required_argument, NULL, OPT_MAX_CLIENTS},
+        {"accept-threads", required_argument, NULL, OPT_ACCEPT_THREADS},
+        {"history", required_argument, NULL, OPT_HISTORY},
         {"rcv-timeout", required_argument, NULL, OPT_RCV_TIMEOUT},
         {"snd-timeout", required_argument, NULL, OPT_SND_TIMEOUT},
 #if defined(HAVE_TCP_KEEPALIVE)
@@ -1271,8 +1413,6 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
 
                 if (iperf_parse_hostname(test, optarg, &p, &p1)) {
 #if defined(HAVE_SO_BINDTODEVICE)
-                    /* Get rid of the hostname we saved earlier. */
-                    free(iperf_get_test_server_hostname(test));
                     iperf_set_test_server_hostname(test, p);
                     iperf_set_test_bind_dev(test, p1);
 #else /* HAVE_SO_BINDTODEVICE */
@@ -1397,8 +1537,6 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
 
                 if (iperf_parse_hostname(test, optarg, &p, &p1)) {
 #if defined(HAVE_SO_BINDTODEVICE)
-                    /* Get rid of the hostname we saved earlier. */
-                    free(iperf_get_test_bind_address(test));
                     iperf_set_test_bind_address(test, p);
                     iperf_set_test_bind_dev(test, p1);
 #else /* HAVE_SO_BINDTODEVICE */
@@ -1500,6 +1638,10 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
                 test->repeating_payload = 1;
                 client_flag = 1;
                 break;
+            case OPT_VERIFY_PAYLOAD:
+                test->verify_payload = 1;
+                client_flag = 1;
+                break;
             case OPT_TIMESTAMPS:
                 iperf_set_test_timestamps(test, 1);
 		if (optarg) {
@@ -1518,7 +1660,61 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
 		client_flag = 1;
                 break;
             case 'F':
-                test->diskfile_name = optarg;
+                test->diskfile_name = strdup(optarg);
+                break;
+            case OPT_DIRECT_IO:
+                test->diskfile_direct = 1;
+                break;
+            case OPT_PERF_COUNTERS:
+                test->perf_counters = 1;
+                break;
+            case OPT_TXTIME:
+                test->txtime = 1;
+		client_flag = 1;
+                break;
+            case OPT_RX_TIMESTAMPS:
+                test->rx_timestamps = 1;
+		client_flag = 1;
+                break;
+            case OPT_UDP_HISTOGRAMS:
+                test->udp_histograms = 1;
+		client_flag = 1;
+                break;
+            case OPT_THREAD_AFFINITY:
+                if (iperf_parse_thread_affinity(test, optarg) < 0)
+                    return -1;
+                break;
+            case OPT_RATE_SEARCH:
+                test->rate_search_loss = atof(optarg);
+                if (test->rate_search_loss < 0 || test->rate_search_loss > 100) {
+                    i_errno = IERATESEARCH;
+                    return -1;
+                }
+		client_flag = 1;
+                break;
+            case OPT_PHASES:
+                test->phases = atoi(optarg);
+                if (test->phases < 1 || test->phases > MAX_PHASES) {
+                    i_errno = IEPHASES;
+                    return -1;
+                }
+		client_flag = 1;
+                break;
+            case OPT_PHASE_GAP:
+                test->phase_gap = atof(optarg);
+                if (test->phase_gap < 0 || test->phase_gap > MAX_PHASE_GAP) {
+                    i_errno = IEPHASES;
+                    return -1;
+                }
+		client_flag = 1;
+                break;
+            case OPT_TCPINFO_SAMPLE:
+                test->tcpinfo_sample_ms = atoi(optarg);
+                if (test->tcpinfo_sample_ms < 1 || test->tcpinfo_sample_ms > TCPINFO_SAMPLE_MAX_MS ||
+                    !iperf_tcpinfo_sampler_supported()) {
+                    i_errno = IETCPINFOSAMPLE;
+                    return -1;
+                }
                 break;
             case OPT_IDLE_TIMEOUT:
                 test->settings->idle_timeout = atoi(optarg);
@@ -1528,6 +1724,36 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
                 }
 		server_flag = 1;
 	        break;
+            case OPT_MAX_CLIENTS:
+                test->max_clients = atoi(optarg);
+                if (test->max_clients < 1 || test->max_clients > MAX_SERVER_SESSIONS) {
+                    i_errno = IEMAXCLIENTS;
+                    return -1;
+                }
+		server_flag = 1;
+                break;
+            case OPT_ACCEPT_THREADS:
+                test->accept_threads = atoi(optarg);
+#if defined(SO_REUSEPORT)
+                if (test->accept_threads < 1 || test->accept_threads > MAX_ACCEPT_THREADS) {
+                    i_errno = IEACCEPTTHREADS;
+                    return -1;
+                }
+#else /* SO_REUSEPORT */
+                i_errno = IEACCEPTTHREADS;
+                return -1;
+#endif /* SO_REUSEPORT */
+		server_flag = 1;
+                break;
+            case OPT_HISTORY:
+                if (access(optarg, W_OK) < 0) {
+                    i_errno = IEHISTORY;
+                    return -1;
+                }
+                if (test->history_dir)
+                    free(test->history_dir);
+                test->history_dir = strdup(optarg);
+                break;
             case OPT_RCV_TIMEOUT:
                 rcv_timeout_in = atoi(optarg);
                 if (rcv_timeout_in < MIN_NO_MSG_RCVD_TIMEOUT || rcv_timeout_in > MAX_TIME * SEC_TO_mS) {
@@ -1535,7 +1761,7 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
                     return -1;
                 }
                 test->settings->rcv_timeout.secs = rcv_timeout_in / SEC_TO_mS;
-                test->settings->rcv_timeout.usecs = (rcv_timeout_in % SEC_TO_mS) * mS_TO_US;
+                test->settings->rcv_timeout.nsecs = (rcv_timeout_in % SEC_TO_mS) * mS_TO_NS;
                 rcv_timeout_flag = 1;
 	        break;
 #if defined(HAVE_TCP_USER_TIMEOUT)
@@ -1700,6 +1926,14 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
 		test->settings->pacing_timer = unit_atoi(optarg);
 		client_flag = 1;
 		break;
+	    case OPT_PACING_BUCKET:
+		test->settings->pacing_bucket = unit_atoi(optarg);
+		if (test->settings->pacing_bucket <= 0) {
+		    i_errno = IEPACINGBUCKET;
+		    return -1;
+		}
+		client_flag = 1;
+		break;
 	    case OPT_CONNECT_TIMEOUT:
 		test->settings->connect_timeout = unit_atoi(optarg);
 		client_flag = 1;
@@ -1805,6 +2039,18 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
 
 #endif //HAVE_SSL
 
+    // Payload verification needs every block to come straight from the stream's own buffer
+    if (test->role == 'c' && test->verify_payload &&
+        (test->diskfile_name != (char*) 0 || test->zerocopy || test->settings->skip_rx_copy)) {
+        i_errno = IEVERIFYPAYLOAD;
+        return -1;
+    }
+
+    if (test->diskfile_direct && test->diskfile_name == (char*) 0) {
+        i_errno = IEDIRECTIO;
+        return -1;
+    }
+
     // File cannot be transferred using UDP because of the UDP packets header (packet number, etc.)
     if(test->role == 'c' && test->diskfile_name != (char*) 0 && test->protocol->id == Pudp) {
         i_errno = IEUDPFILETRANSFER;
@@ -1835,6 +2081,42 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
     if (!rate_flag)
 	test->settings->rate = test->protocol->id == Pudp ? UDP_RATE : 0;
 
+    if (test->txtime && (test->protocol->id != Pudp || test->settings->rate == 0)) {
+        i_errno = IETXTIME;
+        return -1;
+    }
+
+    if (test->rx_timestamps && test->protocol->id != Pudp) {
+        i_errno = IERXTIMESTAMPS;
+        return -1;
+    }
+
+    if (test->udp_histograms && test->protocol->id != Pudp) {
+        i_errno = IEUDPHISTOGRAMS;
+        return -1;
+    }
+
+    if (test->tcpinfo_sample_ms > 0 && test->role == 'c' && test->protocol->id != Ptcp) {
+        i_errno = IETCPINFOSAMPLE;
+        return -1;
+    }
+
+    if (test->rate_search_loss >= 0) {
+        /* It steps at interval boundaries, of which -i 0 has none */
+        if (test->protocol->id != Pudp || test->bidirectional || test->txtime || test->stats_interval == 0) {
+            i_errno = IERATESEARCH;
+            return -1;
+        }
+        /* The search starts from -b, and needs something to pace */
+        if (test->settings->rate == 0)
+            test->settings->rate = UDP_RATE;
+    }
+
+    if (test->phase_gap > 0 && test->phases < 2) {
+        i_errno = IEPHASES;
+        return -1;
+    }
+
     /* if no bytes or blocks specified, nor a duration_flag, and we have -F,
     ** get the file-size as the bytes count to be transferred
     */
@@ -1938,81 +2220,6 @@ iperf_set_send_state(struct iperf_test *test, signed char state)
     return 0;
 }
 
-void
-iperf_check_throttle(struct iperf_stream *sp, struct iperf_time *nowP)
-{
-    struct iperf_time temp_time;
-    double seconds;
-    uint64_t bits_per_second;
-    int64_t missing_rate;
-    uint64_t bits_sent;
-    
-#if defined(HAVE_CLOCK_NANOSLEEP) || defined(HAVE_NANOSLEEP)
-    struct timespec nanosleep_time;
-    int64_t time_to_green_light, delta_bits;
-    int ret;
-#endif /* HAVE_CLOCK_NANOSLEEP || HAVE_NANOSLEEP) */
-#if defined(HAVE_CLOCK_NANOSLEEP)
-    int64_t ns;
-#endif /* HAVE_CLOCK_NANOSLEEP */
-
-    if (sp->test->done || sp->test->settings->rate == 0)
-        return;
-    iperf_time_diff(&sp->result->start_time_fixed, nowP, &temp_time);
-    seconds = iperf_time_in_secs(&temp_time);
-    bits_sent = sp->result->bytes_sent * 8;
-    bits_per_second = bits_sent / seconds;
-    missing_rate = sp->test->settings->rate - bits_per_second;
-
-    if (missing_rate > 0) {
-        sp->green_light = 1;
-    } else {
-        sp->green_light = 0;
-    }
-
-#if defined(HAVE_CLOCK_NANOSLEEP) || defined(HAVE_NANOSLEEP)
-    // If estimated time to next send is large enough, sleep instead of just CPU looping until green light is set
-    if (missing_rate < 0) {
-        delta_bits = bits_sent - (seconds * sp->test->settings->rate);
-        // Calclate time until next data send is required
-        time_to_green_light = (SEC_TO_NS * delta_bits / sp->test->settings->rate);
-        // Whether should wait before next send
-        if (time_to_green_light >= 0) {
-#if defined(HAVE_CLOCK_NANOSLEEP)
-            if (clock_gettime(CLOCK_MONOTONIC, &nanosleep_time) == 0) {
-                // Calculate absolute end of sleep time
-                ns = nanosleep_time.tv_nsec + time_to_green_light;
-                if (ns < SEC_TO_NS) {
-                    nanosleep_time.tv_nsec = ns;
-                } else {
-                    nanosleep_time.tv_sec += ns / SEC_TO_NS;
-                    nanosleep_time.tv_nsec = ns % SEC_TO_NS;
-                }
-                // Sleep until average baud rate reaches the target value
-                while((ret = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &nanosleep_time, NULL)) == EINTR);
-                if (ret == 0) {
-                    sp->green_light = 1;
-                }
-            }
-
-#else /* HAVE_NANOSLEEP */
-            nanosleep_time.tv_sec = 0;
-            // Sleep until average baud rate reaches the target value or intrupt / error
-            do {
-                // nansleep() time should be less than 1 sec
-                nanosleep_time.tv_nsec = (time_to_green_light >= SEC_TO_NS) ? SEC_TO_NS - 1 : time_to_green_light;
-                time_to_green_light -= nanosleep_time.tv_nsec;
-                ret = nanosleep(&nanosleep_time, NULL);
-            } while (ret == 0 && time_to_green_light > 0);
-            if (ret == 0) {
-                sp->green_light = 1;
-            }
-#endif /* HAVE_CLOCK_NANOSLEEP else HAVE_NANOSLEEP */
-        }
-    }
-#endif /* HAVE_CLOCK_NANOSLEEP || HAVE_NANOSLEEP */
-}
-
 /* Verify that average traffic is not greater than the specified limit */
 void
 iperf_check_total_rate(struct iperf_test *test, iperf_size_t last_interval_bytes_transferred)
@@ -2020,7 +2227,8 @@ iperf_check_total_rate(struct iperf_test *test, iperf_size_t last_interval_bytes
     double seconds;
     uint64_t bits_per_second;
     iperf_size_t total_bytes;
-    int i;
+    uint64_t all_bits_per_second;
+    int i, sessions;
 
     if (test->done || test->settings->bitrate_limit == 0)    // Continue only if check should be done
         return;
@@ -2046,6 +2254,22 @@ iperf_check_total_rate(struct iperf_test *test, iperf_size_t last_interval_bytes
         iperf_printf(test,"Interval %" PRIu64 " - throughput %" PRIu64 " bps (limit %" PRIu64 ")\n", test->bitrate_limit_stats_count, bits_per_second, test->settings->bitrate_limit);
     }
 
+    /*
+     * With --max-clients the limit is on all the clients together.  Going
+     * over it stops whichever clients are above their even share, not the
+     * ones that happened to be measured last.
+     */
+    if (test->server_session != NULL) {
+        all_bits_per_second = iperf_server_session_rate(test->server_session, bits_per_second, &sessions);
+        if (all_bits_per_second > test->settings->bitrate_limit &&
+            bits_per_second > test->settings->bitrate_limit / sessions) {
+            if (iperf_get_verbose(test))
+                iperf_err(test, "Total throughput of %" PRIu64 " bps from %d clients exceeded %" PRIu64 " bps limit", all_bits_per_second, sessions, test->settings->bitrate_limit);
+            test->bitrate_limit_exceeded = 1;
+        }
+        return;
+    }
+
     if (bits_per_second  > test->settings->bitrate_limit) {
         if (iperf_get_verbose(test))
             iperf_err(test, "Total throughput of %" PRIu64 " bps exceeded %" PRIu64 " bps limit", bits_per_second, test->settings->bitrate_limit);
@@ -2056,13 +2280,11 @@ iperf_check_total_rate(struct iperf_test *test, iperf_size_t last_interval_bytes
 int
 iperf_send_mt(struct iperf_stream *sp)
 {
-    register int multisend, r, message_sent;
+    register int multisend, r;
     register struct iperf_test *test = sp->test;
-    struct iperf_time now;
-    int throttle_check_per_message;
-#if defined(HAVE_CLOCK_NANOSLEEP) || defined(HAVE_NANOSLEEP)
-    int throttle_check;
-#endif /* HAVE_CLOCK_NANOSLEEP, HAVE_NANOSLEEP */
+    struct iperf_pacer *pacer = &sp->pacer;
+    /* --txtime streams leave the pacing to the kernel */
+    int paced = pacer->rate > 0 && sp->txtime == NULL;
 
     /* Can we do multisend mode? */
     if (test->settings->burst != 0)
@@ -2072,53 +2294,32 @@ iperf_send_mt(struct iperf_stream *sp)
     else
         multisend = 1;	/* nope */
 
-    /* Should bitrate throttle be checked for every send */
-#if defined(HAVE_CLOCK_NANOSLEEP) || defined(HAVE_NANOSLEEP)
-    if (test->settings->rate != 0) {
-        throttle_check = 1;
-        if (test->settings->burst == 0)
-            throttle_check_per_message = 1;
-        else
-            throttle_check_per_message = 0;
-    } else {
-        throttle_check = 0;
-        throttle_check_per_message = 0;
-    }
-#else /* !HAVE_CLOCK_NANOSLEEP && !HAVE_NANOSLEEP */
-    throttle_check_per_message = test->settings->rate != 0 && test->settings->burst == 0;
-#endif /* HAVE_CLOCK_NANOSLEEP, HAVE_NANOSLEEP */
+    /* With -b rate/n the bucket must hold the whole burst before it goes */
+    if (paced && test->settings->burst != 0)
+        iperf_pacer_wait(pacer, multisend * test->settings->blksize);
 
-    for (message_sent = 0; sp->green_light && multisend > 0; --multisend) {
+    for (; multisend > 0; --multisend) {
         // XXX If we hit one of these ending conditions maybe
         // want to stop even trying to send something?
         if (multisend > 1 && test->settings->bytes != 0 && test->bytes_sent >= test->settings->bytes)
             break;
         if (multisend > 1 && test->settings->blocks != 0 && test->blocks_sent >= test->settings->blocks)
             break;
+        if (paced && test->settings->burst == 0)
+            iperf_pacer_wait(pacer, test->settings->blksize);
         if ((r = sp->snd(sp)) < 0) {
             if (r == NET_SOFTERROR)
                 break;
             i_errno = IESTREAMWRITE;
             return r;
         }
+        if (paced)
+            iperf_pacer_spend(pacer, r);
         test->bytes_sent += r;
-        if (!sp->pending_size)
+        if (sp->txtime != NULL)
+            test->blocks_sent += r / test->settings->blksize;    /* a batch */
+        else if (!sp->pending_size)
             ++test->blocks_sent;
-        if (throttle_check_per_message) {
-            if (message_sent == 0)
-                iperf_time_now(&now);
-            iperf_check_throttle(sp, &now);
-        }
-        message_sent = 1;
-    }
-#if defined(HAVE_CLOCK_NANOSLEEP) || defined(HAVE_NANOSLEEP)
-     /* Should check if green light can be set, as pacing timer is not supported in this case */
-    if (throttle_check && (!throttle_check_per_message || message_sent == 0)) {
-#else /* !HAVE_CLOCK_NANOSLEEP && !HAVE_NANOSLEEP */
-    if (!throttle_check_per_message || message_sent == 0) {   /* Throttle check if was not checked for each send */
-#endif /* HAVE_CLOCK_NANOSLEEP, HAVE_NANOSLEEP */
-	iperf_time_now(&now);
-        iperf_check_throttle(sp, &now);
     }
     return 0;
 }
@@ -2145,6 +2346,185 @@ iperf_recv_mt(struct iperf_stream *sp)
     return 0;
 }
 
+/**************************************************************************/
+
+/*
+ * --rate-search.  The receiving side reports each stats interval over the
+ * control connection as RATE_FEEDBACK and a JSON object; the sending side
+ * reads it in place of a state change and moves its pacers on.
+ */
+
+static void
+rate_search_clear(struct iperf_test *test)
+{
+    iperf_rate_search_free(test->rate_search);
+    test->rate_search = NULL;
+    if (test->peer_rate_search) {
+        cJSON_Delete(test->peer_rate_search);
+        test->peer_rate_search = NULL;
+    }
+}
+
+int
+iperf_rate_search_send_feedback(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    struct iperf_interval_results *irp;
+    signed char state = RATE_FEEDBACK;
+    iperf_size_t bytes = 0;
+    int64_t packets = 0, lost = 0;
+    double seconds = 0.0;
+    cJSON *j;
+    int r = 0;
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+        if (sp->sender)
+            continue;
+        irp = TAILQ_LAST(&sp->result->interval_results, irlisthead);
+        if (irp == NULL)
+            continue;
+        bytes += irp->bytes_transferred;
+        packets += irp->interval_packet_count;
+        lost += irp->interval_cnt_error;
+        if (irp->interval_duration > seconds)
+            seconds = irp->interval_duration;
+    }
+    if (seconds <= 0.0)
+        return 0;
+
+    j = iperf_json_printf("bytes: %d  packets: %d  lost: %d  seconds: %f",
+                          (int64_t) bytes, packets, lost, seconds);
+    if (j == NULL) {
+        i_errno = IESENDMESSAGE;
+        return -1;
+    }
+    if (Nwrite(test->ctrl_sck, (char *) &state, sizeof(state), Ptcp) < 0 ||
+        JSON_write(test->ctrl_sck, j) < 0) {
+        i_errno = IESENDMESSAGE;
+        r = -1;
+    }
+    cJSON_Delete(j);
+    return r;
+}
+
+static void
+rate_search_apply(struct iperf_test *test, int64_t bytes, int64_t packets, int64_t lost, double seconds)
+{
+    struct iperf_rate_search *rs = test->rate_search;
+    struct iperf_rate_search_step *st;
+    struct iperf_stream *sp;
+    struct iperf_time now, diff;
+    double sent_bps, received_bps, lost_percent, time = 0.0;
+    uint64_t rate, old_rate = rs->rate;
+    int streams = 0, num_steps = rs->num_steps;
+    char rbuf[UNIT_LEN], gbuf[UNIT_LEN], nbuf[UNIT_LEN];
+
+    SLIST_FOREACH(sp, &test->streams, streams)
+        if (sp->sender)
+            streams++;
+    if (streams == 0)
+        return;
+    sp = SLIST_FIRST(&test->streams);
+    if (iperf_time_now(&now) == 0 && iperf_time_diff(&now, &sp->result->start_time, &diff) == 0)
+        time = iperf_time_in_secs(&diff);
+    /*
+     * The receiver counts packets by sequence number, lost ones included,
+     * so this is what we sent over the very interval the loss is from.
+     */
+    sent_bps = packets * 8.0 * test->settings->blksize / seconds;
+    received_bps = bytes * 8.0 / seconds;
+    /* Out-of-order packets can make an interval's loss negative */
+    lost_percent = packets > 0 && lost > 0 ? 100.0 * lost / packets : 0.0;
+
+    rate = iperf_rate_search_step(rs, time, streams, sent_bps, received_bps, lost_percent);
+    if (rate != old_rate)
+        SLIST_FOREACH(sp, &test->streams, streams)
+            if (sp->sender)
+                iperf_pacer_set_rate(&sp->pacer, rate);
+
+    if (rs->num_steps > num_steps && !test->json_output) {
+        st = &rs->steps[rs->num_steps - 1];
+        unit_snprintf(rbuf, UNIT_LEN, st->rate / 8.0, test->settings->unit_format);
+        unit_snprintf(gbuf, UNIT_LEN, st->received_bps / 8.0, test->settings->unit_format);
+        if (rs->done)
+            snprintf(nbuf, UNIT_LEN, "%s", rs->converged ? "converged" : "gave up");
+        else {
+            unit_snprintf(nbuf, UNIT_LEN, rate / 8.0, test->settings->unit_format);
+            strncat(nbuf, "s/sec", UNIT_LEN - strlen(nbuf) - 1);
+        }
+        iperf_printf(test, report_rate_search_step, st->time, rbuf, gbuf, st->lost_percent,
+                     st->good ? "good" : st->sender_limited ? "sender-limited" : "lossy", nbuf);
+    }
+}
+
+int
+iperf_rate_search_recv_feedback(struct iperf_test *test)
+{
+    cJSON *j, *j_bytes, *j_packets, *j_lost, *j_seconds;
+    int r = 0;
+
+    j = JSON_read(test->ctrl_sck, MAX_PARAMS_JSON_STRING);
+    if (j == NULL) {
+        i_errno = IERECVMESSAGE;
+        return -1;
+    }
+    j_bytes = iperf_cJSON_GetObjectItemType(j, "bytes", cJSON_Number);
+    j_packets = iperf_cJSON_GetObjectItemType(j, "packets", cJSON_Number);
+    j_lost = iperf_cJSON_GetObjectItemType(j, "lost", cJSON_Number);
+    j_seconds = iperf_cJSON_GetObjectItemType(j, "seconds", cJSON_Number);
+    if (j_bytes == NULL || j_packets == NULL || j_lost == NULL || j_seconds == NULL) {
+        i_errno = IERECVMESSAGE;
+        r = -1;
+    } else if (test->rate_search != NULL && !test->done && j_seconds->valuedouble > 0) {
+        /* Feedback that crossed our TEST_END on the wire is dropped */
+        rate_search_apply(test, (int64_t) j_bytes->valuedouble, (int64_t) j_packets->valuedouble,
+                          (int64_t) j_lost->valuedouble, j_seconds->valuedouble);
+    }
+    cJSON_Delete(j);
+    return r;
+}
+
+/* The search's outcome at the end of the test, from whichever side ran it */
+static void
+print_rate_search(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    cJSON *j, *j_rate, *j_total, *j_converged, *j_steps;
+    char rbuf[UNIT_LEN], tbuf[UNIT_LEN];
+    int streams = 0;
+
+    if (test->rate_search != NULL) {
+        SLIST_FOREACH(sp, &test->streams, streams)
+            if (sp->sender)
+                streams++;
+        j = iperf_rate_search_json(test->rate_search, streams);
+    } else if (test->peer_rate_search != NULL)
+        j = cJSON_Duplicate(test->peer_rate_search, 1);
+    else
+        return;
+    if (j == NULL)
+        return;
+
+    if (test->json_output) {
+        cJSON_AddItemToObject(test->json_end, "rate_search", j);
+        return;
+    }
+    j_rate = iperf_cJSON_GetObjectItemType(j, "rate", cJSON_Number);
+    j_total = iperf_cJSON_GetObjectItemType(j, "total_rate", cJSON_Number);
+    j_converged = cJSON_GetObjectItem(j, "converged");
+    j_steps = iperf_cJSON_GetObjectItemType(j, "steps", cJSON_Array);
+    if (j_rate != NULL && j_total != NULL && j_converged != NULL) {
+        unit_snprintf(rbuf, UNIT_LEN, j_rate->valuedouble / 8.0, test->settings->unit_format);
+        unit_snprintf(tbuf, UNIT_LEN, j_total->valuedouble / 8.0, test->settings->unit_format);
+        iperf_printf(test, report_rate_search, rbuf, tbuf, test->rate_search_loss,
+                     cJSON_IsTrue(j_converged) ? "converged" : "not converged",
+                     j_steps != NULL ? cJSON_GetArraySize(j_steps) : 0);
+    }
+    cJSON_Delete(j);
+}
+
+/**************************************************************************/
+
 int
 iperf_init_test(struct iperf_test *test)
 {
@@ -2165,6 +2545,16 @@ iperf_init_test(struct iperf_test *test)
 	sp->result->start_time = sp->result->start_time_fixed = now;
     }
 
+    /* --rate-search runs where the packets are sent from */
+    if (test->rate_search_loss >= 0 && test->mode == SENDER) {
+        rate_search_clear(test);
+        test->rate_search = iperf_rate_search_new(test->rate_search_loss, test->settings->rate);
+        if (test->rate_search == NULL) {
+            i_errno = IEINITTEST;
+            return -1;
+        }
+    }
+
     if (test->on_test_start)
         test->on_test_start(test);
 
@@ -2175,12 +2565,9 @@ iperf_init_test(struct iperf_test *test)
 int
 iperf_create_send_timers(struct iperf_test * test)
 {
-    // Note: No times for the multi-thread versions
-    struct iperf_stream *sp;
-
-    SLIST_FOREACH(sp, &test->streams, streams) {
-        sp->green_light = 1;
-    }
+    // Note: No timers for the multi-thread versions; -b is paced by
+    // each stream's own thread, see iperf_pacer.c
+    (void) test;
     return 0;
 }
 
@@ -2226,8 +2613,9 @@ int test_is_authorized(struct iperf_test *test){
 int
 iperf_exchange_parameters(struct iperf_test *test)
 {
-    int s;
+#if defined(HAVE_SSL)
     int32_t err;
+#endif //HAVE_SSL
 
     if (test->role == 'c') {
 
@@ -2258,28 +2646,7 @@ iperf_exchange_parameters(struct iperf_test *test)
         }
 #endif //HAVE_SSL
 
-        if ((s = test->protocol->listen(test)) < 0) {
-	    if (iperf_set_send_state(test, SERVER_ERROR) != 0)
-                return -1;
-            err = htonl(i_errno);
-            if (Nwrite(test->ctrl_sck, (char*) &err, sizeof(err), Ptcp) < 0) {
-                i_errno = IECTRLWRITE;
-                return -1;
-            }
-            err = htonl(errno);
-            if (Nwrite(test->ctrl_sck, (char*) &err, sizeof(err), Ptcp) < 0) {
-                i_errno = IECTRLWRITE;
-                return -1;
-            }
-            return -1;
-        }
-
-        FD_SET(s, &test->read_set);
-        test->max_fd = (s > test->max_fd) ? s : test->max_fd;
-        test->prot_listener = s;
-
-        // Send the control message to create streams and start the test
-	if (iperf_set_send_state(test, CREATE_STREAMS) != 0)
+        if (iperf_listen_streams(test) < 0)
             return -1;
 
     }
@@ -2289,6 +2656,41 @@ iperf_exchange_parameters(struct iperf_test *test)
 
 /*************************************************************/
 
+int
+iperf_listen_streams(struct iperf_test *test)
+{
+    int s;
+    int32_t err;
+
+    if ((s = test->protocol->listen(test)) < 0) {
+        if (iperf_set_send_state(test, SERVER_ERROR) != 0)
+            return -1;
+        err = htonl(i_errno);
+        if (Nwrite(test->ctrl_sck, (char*) &err, sizeof(err), Ptcp) < 0) {
+            i_errno = IECTRLWRITE;
+            return -1;
+        }
+        err = htonl(errno);
+        if (Nwrite(test->ctrl_sck, (char*) &err, sizeof(err), Ptcp) < 0) {
+            i_errno = IECTRLWRITE;
+            return -1;
+        }
+        return -1;
+    }
+
+    FD_SET(s, &test->read_set);
+    test->max_fd = (s > test->max_fd) ? s : test->max_fd;
+    test->prot_listener = s;
+
+    // Send the control message to create streams and start the test
+    if (iperf_set_send_state(test, CREATE_STREAMS) != 0)
+        return -1;
+
+    return 0;
+}
+
+/*************************************************************/
+
 int
 iperf_exchange_results(struct iperf_test *test)
 {
@@ -2358,6 +2760,8 @@ send_parameters(struct iperf_test *test)
 	    cJSON_AddNumberToObject(j, "fqrate", test->settings->fqrate);
 	if (test->settings->pacing_timer)
 	    cJSON_AddNumberToObject(j, "pacing_timer", test->settings->pacing_timer);
+	if (test->settings->pacing_bucket)
+	    cJSON_AddNumberToObject(j, "pacing_bucket", test->settings->pacing_bucket);
 	if (test->settings->burst)
 	    cJSON_AddNumberToObject(j, "burst", test->settings->burst);
 	if (test->settings->tos)
@@ -2378,6 +2782,18 @@ send_parameters(struct iperf_test *test)
 	    cJSON_AddNumberToObject(j, "udp_counters_64bit", iperf_get_test_udp_counters_64bit(test));
 	if (test->repeating_payload)
 	    cJSON_AddNumberToObject(j, "repeating_payload", test->repeating_payload);
+	if (test->verify_payload)
+	    cJSON_AddNumberToObject(j, "verify_payload", test->verify_payload);
+	if (test->txtime)
+	    cJSON_AddTrueToObject(j, "txtime");
+	if (test->rx_timestamps)
+	    cJSON_AddTrueToObject(j, "rx_timestamps");
+	if (test->udp_histograms)
+	    cJSON_AddTrueToObject(j, "udp_histograms");
+	if (test->rate_search_loss >= 0)
+	    cJSON_AddNumberToObject(j, "rate_search", test->rate_search_loss);
+	if (test->phases > 1)
+	    cJSON_AddNumberToObject(j, "phases", test->phases);
 	if (test->zerocopy)
 	    cJSON_AddNumberToObject(j, "zerocopy", test->zerocopy);
 #if defined(HAVE_DONT_FRAGMENT)
@@ -2480,6 +2896,8 @@ get_parameters(struct iperf_test *test)
 	    test->settings->fqrate = j_p->valueint;
 	if ((j_p = iperf_cJSON_GetObjectItemType(j, "pacing_timer", cJSON_Number)) != NULL)
 	    test->settings->pacing_timer = j_p->valueint;
+	if ((j_p = iperf_cJSON_GetObjectItemType(j, "pacing_bucket", cJSON_Number)) != NULL)
+	    test->settings->pacing_bucket = j_p->valueint;
 	if ((j_p = iperf_cJSON_GetObjectItemType(j, "burst", cJSON_Number)) != NULL)
 	    test->settings->burst = j_p->valueint;
 	if ((j_p = iperf_cJSON_GetObjectItemType(j, "TOS", cJSON_Number)) != NULL)
@@ -2500,6 +2918,24 @@ get_parameters(struct iperf_test *test)
 	    iperf_set_test_udp_counters_64bit(test, 1);
 	if ((j_p = iperf_cJSON_GetObjectItemType(j, "repeating_payload", cJSON_Number)) != NULL)
 	    test->repeating_payload = 1;
+	if ((j_p = iperf_cJSON_GetObjectItemType(j, "txtime", cJSON_True)) != NULL)
+	    test->txtime = 1;
+	if ((j_p = iperf_cJSON_GetObjectItemType(j, "rx_timestamps", cJSON_True)) != NULL)
+	    test->rx_timestamps = 1;
+	if ((j_p = iperf_cJSON_GetObjectItemType(j, "udp_histograms", cJSON_True)) != NULL)
+	    test->udp_histograms = 1;
+	if ((j_p = iperf_cJSON_GetObjectItemType(j, "rate_search", cJSON_Number)) != NULL)
+	    test->rate_search_loss = j_p->valuedouble;
+	if ((j_p = iperf_cJSON_GetObjectItemType(j, "phases", cJSON_Number)) != NULL)
+	    test->phases = j_p->valueint;
+	if ((j_p = iperf_cJSON_GetObjectItemType(j, "verify_payload", cJSON_Number)) != NULL) {
+	    test->verify_payload = 1;
+	    /* A server-side -F would replace the payload we are supposed to send */
+	    if (test->diskfile_name != (char*) 0) {
+		i_errno = IEVERIFYPAYLOAD;
+		r = -1;
+	    }
+	}
 	if ((j_p = iperf_cJSON_GetObjectItemType(j, "zerocopy", cJSON_Number)) != NULL)
 	    test->zerocopy = j_p->valueint;
 #if defined(HAVE_DONT_FRAGMENT)
@@ -2553,6 +2989,13 @@ send_results(struct iperf_test *test)
 	if ( test->congestion_used ) {
 	    cJSON_AddStringToObject(j, "congestion_used", test->congestion_used);
 	}
+	if (test->rate_search != NULL) {
+	    int streams = 0;
+	    SLIST_FOREACH(sp, &test->streams, streams)
+		if (sp->sender)
+		    streams++;
+	    cJSON_AddItemToObject(j, "rate_search", iperf_rate_search_json(test->rate_search, streams));
+	}
 
 	/* If on the server and sending server output, then do this */
 	if (test->role == 's' && test->get_server_output) {
@@ -2605,6 +3048,37 @@ send_results(struct iperf_test *test)
                     cJSON_AddNumberToObject(j_stream, "omitted_errors", sp->omitted_cnt_error);
 		    cJSON_AddNumberToObject(j_stream, "packets", sp->packet_count);
                     cJSON_AddNumberToObject(j_stream, "omitted_packets", sp->omitted_packet_count);
+		    if (test->verify_payload) {
+			cJSON_AddNumberToObject(j_stream, "verified_blocks", sp->verified_blocks - sp->omitted_verified_blocks);
+			cJSON_AddNumberToObject(j_stream, "corrupted_blocks", sp->corrupted_blocks - sp->omitted_corrupted_blocks);
+		    }
+		    if (sp->sender && sp->result->stream_tcp_limits_valid) {
+			struct iperf_tcp_limits *l = &sp->result->stream_tcp_limits;
+
+			cJSON_AddItemToObject(j_stream, "tcp_limits", iperf_json_printf("busy_us: %d  rwnd_limited_us: %d  sndbuf_limited_us: %d  bytes_acked: %d  seconds: %f", (int64_t) l->busy_us, (int64_t) l->rwnd_limited_us, (int64_t) l->sndbuf_limited_us, (int64_t) l->bytes_acked, sp->result->stream_tcp_limits_secs));
+		    }
+		    if (sp->rx_timestamps && !sp->sender) {
+			struct iperf_rxts_stats rxts;
+
+			iperf_udp_rxts_read(sp, &rxts, NULL);
+			iperf_udp_rxts_diff(&rxts, &sp->omitted_rxts, &rxts);
+			cJSON_AddItemToObject(j_stream, "rx_timestamps", iperf_json_printf("kernel_jitter: %f  packets: %d  latency_ns: %d  max_latency_ns: %d", sp->kernel_jitter, (int64_t) rxts.packets, (int64_t) rxts.latency_ns, (int64_t) rxts.max_latency_ns));
+		    }
+		    if (sp->seq_valid && !sp->sender) {
+			struct iperf_seq_stats seq;
+
+			iperf_udp_seq_diff(&sp->seq, &sp->omitted_seq, &seq);
+			cJSON_AddItemToObject(j_stream, "sequence", iperf_udp_seq_json(&seq, sp->outoforder_packets - sp->omitted_outoforder_packets));
+		    }
+		    if (sp->histograms != NULL && !sp->sender) {
+			struct iperf_udp_histogram_set *hset = malloc(sizeof(*hset));
+
+			if (hset != NULL) {
+			    iperf_udp_histograms_result(sp->histograms, hset);
+			    cJSON_AddItemToObject(j_stream, "histograms", iperf_udp_histogram_set_to_results(hset));
+			    free(hset);
+			}
+		    }
 
 		    iperf_time_diff(&sp->result->start_time, &sp->result->start_time, &temp_time);
 		    start_time = iperf_time_in_secs(&temp_time);
@@ -2632,6 +3106,61 @@ send_results(struct iperf_test *test)
 
 /*************************************************************/
 
+/* --rx-timestamps results from the receiving peer, omitted packets already out */
+static void
+get_peer_rx_timestamps(struct iperf_stream *sp, cJSON *j)
+{
+    cJSON *j_kernel_jitter = iperf_cJSON_GetObjectItemType(j, "kernel_jitter", cJSON_Number);
+    cJSON *j_packets = iperf_cJSON_GetObjectItemType(j, "packets", cJSON_Number);
+    cJSON *j_latency = iperf_cJSON_GetObjectItemType(j, "latency_ns", cJSON_Number);
+    cJSON *j_max_latency = iperf_cJSON_GetObjectItemType(j, "max_latency_ns", cJSON_Number);
+
+    if (j_kernel_jitter == NULL || j_packets == NULL || j_latency == NULL || j_max_latency == NULL)
+	return;
+    sp->rx_timestamps = 1;
+    sp->kernel_jitter = j_kernel_jitter->valuedouble;
+    sp->rxts.packets = (int64_t) j_packets->valuedouble;
+    sp->rxts.latency_ns = (uint64_t) j_latency->valuedouble;
+    sp->rxts.max_latency_ns = (uint64_t) j_max_latency->valuedouble;
+    memset(&sp->omitted_rxts, 0, sizeof(sp->omitted_rxts));
+}
+
+/* The sending peer's TCP_INFO time counters, for the verdict */
+static void
+get_peer_tcp_limits(struct iperf_stream *sp, cJSON *j)
+{
+    cJSON *j_busy, *j_rwnd, *j_sndbuf, *j_acked, *j_seconds;
+    struct iperf_stream_result *rp = sp->result;
+
+    j_busy = iperf_cJSON_GetObjectItemType(j, "busy_us", cJSON_Number);
+    j_rwnd = iperf_cJSON_GetObjectItemType(j, "rwnd_limited_us", cJSON_Number);
+    j_sndbuf = iperf_cJSON_GetObjectItemType(j, "sndbuf_limited_us", cJSON_Number);
+    j_acked = iperf_cJSON_GetObjectItemType(j, "bytes_acked", cJSON_Number);
+    j_seconds = iperf_cJSON_GetObjectItemType(j, "seconds", cJSON_Number);
+    if (j_busy == NULL || j_rwnd == NULL || j_sndbuf == NULL || j_acked == NULL || j_seconds == NULL)
+	return;
+    rp->stream_tcp_limits.busy_us = (uint64_t) j_busy->valuedouble;
+    rp->stream_tcp_limits.rwnd_limited_us = (uint64_t) j_rwnd->valuedouble;
+    rp->stream_tcp_limits.sndbuf_limited_us = (uint64_t) j_sndbuf->valuedouble;
+    rp->stream_tcp_limits.bytes_acked = (uint64_t) j_acked->valuedouble;
+    rp->stream_tcp_limits_secs = j_seconds->valuedouble;
+    rp->stream_tcp_limits_valid = 1;
+}
+
+/* --udp-histograms from the receiving peer, omitted packets already out */
+static void
+get_peer_udp_histograms(struct iperf_stream *sp, cJSON *j)
+{
+    if (sp->histograms == NULL && (sp->histograms = iperf_udp_histograms_new()) == NULL)
+	return;
+    if (iperf_udp_histogram_set_from_results(&sp->histograms->total, j) < 0) {
+	free(sp->histograms);
+	sp->histograms = NULL;
+	return;
+    }
+    memset(&sp->histograms->omitted, 0, sizeof(sp->histograms->omitted));
+}
+
 static int
 get_results(struct iperf_test *test)
 {
@@ -2640,6 +3169,7 @@ get_results(struct iperf_test *test)
     cJSON *j_cpu_util_total;
     cJSON *j_cpu_util_user;
     cJSON *j_cpu_util_system;
+    cJSON *j_rate_search;
     cJSON *j_remote_congestion_used;
     cJSON *j_sender_has_retransmits;
     int result_has_retransmits;
@@ -2654,6 +3184,11 @@ get_results(struct iperf_test *test)
     cJSON *j_omitted_errors;
     cJSON *j_packets;
     cJSON *j_omitted_packets;
+    cJSON *j_verified_blocks, *j_corrupted_blocks;
+    cJSON *j_rx_timestamps;
+    cJSON *j_histograms;
+    cJSON *j_sequence;
+    cJSON *j_tcp_limits;
     cJSON *j_server_output;
     cJSON *j_start_time, *j_end_time;
     int sid;
@@ -2686,6 +3221,12 @@ get_results(struct iperf_test *test)
 	    test->remote_cpu_util[1] = j_cpu_util_user->valuedouble;
 	    test->remote_cpu_util[2] = j_cpu_util_system->valuedouble;
 	    result_has_retransmits = j_sender_has_retransmits->valueint;
+	    j_rate_search = iperf_cJSON_GetObjectItemType(j, "rate_search", cJSON_Object);
+	    if (j_rate_search != NULL && test->rate_search == NULL) {
+		if (test->peer_rate_search)
+		    cJSON_Delete(test->peer_rate_search);
+		test->peer_rate_search = cJSON_Duplicate(j_rate_search, 1);
+	    }
 	    if ( test->mode == RECEIVER ) {
 	        test->sender_has_retransmits = result_has_retransmits;
 	        test->other_side_has_retransmits = 0;
@@ -2715,6 +3256,12 @@ get_results(struct iperf_test *test)
                         j_omitted_packets = iperf_cJSON_GetObjectItemType(j_stream, "omitted_packets", cJSON_Number);
 			j_start_time = iperf_cJSON_GetObjectItemType(j_stream, "start_time", cJSON_Number);
 			j_end_time = iperf_cJSON_GetObjectItemType(j_stream, "end_time", cJSON_Number);
+			j_verified_blocks = iperf_cJSON_GetObjectItemType(j_stream, "verified_blocks", cJSON_Number);
+			j_corrupted_blocks = iperf_cJSON_GetObjectItemType(j_stream, "corrupted_blocks", cJSON_Number);
+			j_rx_timestamps = iperf_cJSON_GetObjectItemType(j_stream, "rx_timestamps", cJSON_Object);
+			j_histograms = iperf_cJSON_GetObjectItemType(j_stream, "histograms", cJSON_Object);
+			j_sequence = iperf_cJSON_GetObjectItemType(j_stream, "sequence", cJSON_Object);
+			j_tcp_limits = iperf_cJSON_GetObjectItemType(j_stream, "tcp_limits", cJSON_Object);
 			if (j_id == NULL || j_bytes == NULL || j_retransmits == NULL || j_jitter == NULL || j_errors == NULL || j_packets == NULL) {
 			    i_errno = IERECVRESULTS;
 			    r = -1;
@@ -2744,6 +3291,24 @@ get_results(struct iperf_test *test)
 				    sp->cnt_error = cerror;
 				    sp->peer_packet_count = pcount;
 				    sp->result->bytes_received = bytes_transferred;
+				    if (j_verified_blocks && j_corrupted_blocks) {
+					/* The peer already took its omitted blocks out */
+					sp->verified_blocks = j_verified_blocks->valueint;
+					sp->corrupted_blocks = j_corrupted_blocks->valueint;
+					sp->omitted_verified_blocks = 0;
+					sp->omitted_corrupted_blocks = 0;
+				    }
+				    if (j_rx_timestamps != NULL)
+					get_peer_rx_timestamps(sp, j_rx_timestamps);
+				    if (j_histograms != NULL)
+					get_peer_udp_histograms(sp, j_histograms);
+				    if (j_sequence != NULL && iperf_udp_seq_from_json(&sp->seq, j_sequence) == 0) {
+					/* The peer already took its omitted packets out */
+					sp->seq_valid = 1;
+					memset(&sp->omitted_seq, 0, sizeof(sp->omitted_seq));
+					sp->outoforder_packets = (int64_t) cJSON_GetObjectItem(j_sequence, "out_of_order")->valuedouble;
+					sp->omitted_outoforder_packets = 0;
+				    }
                                     if (j_omitted_packets != NULL) {
                                         sp->omitted_cnt_error = omitted_cerror;
                                         sp->peer_omitted_packet_count = omitted_pcount;
@@ -2775,6 +3340,8 @@ get_results(struct iperf_test *test)
 				    sp->peer_packet_count = pcount;
 				    sp->result->bytes_sent = bytes_transferred;
 				    sp->result->stream_retrans = retransmits;
+				    if (j_tcp_limits != NULL)
+					get_peer_tcp_limits(sp, j_tcp_limits);
                                     if (j_omitted_packets != NULL) {
                                         sp->peer_omitted_packet_count = omitted_pcount;
                                     } else {
@@ -3021,6 +3588,9 @@ iperf_new_test()
     /* initialize everything to zero */
     memset(test, 0, sizeof(struct iperf_test));
 
+    /* Not on the first iperf_time_now(), which may be timing something */
+    iperf_time_calibrate();
+
     /* Initialize mutex for printing output */
     pthread_mutexattr_t mutexattr;
     pthread_mutexattr_init(&mutexattr);
@@ -3093,6 +3663,19 @@ iperf_defaults(struct iperf_test *testp)
     testp->omit = OMIT;
     testp->duration = DURATION;
     testp->diskfile_name = (char*) 0;
+    testp->diskfile_direct = 0;
+    testp->perf_counters = 0;
+    testp->txtime = 0;
+    testp->rx_timestamps = 0;
+    testp->udp_histograms = 0;
+    testp->tcpinfo_sample_ms = 0;
+    testp->num_thread_cpus = 0;
+    testp->rate_search_loss = -1;
+    testp->phases = 1;
+    testp->phase = 1;
+    testp->phase_gap = 0;
+    testp->max_clients = 1;
+    testp->accept_threads = 1;
     testp->affinity = -1;
     testp->server_affinity = -1;
     TAILQ_INIT(&testp->xbind_addrs);
@@ -3126,13 +3709,14 @@ iperf_defaults(struct iperf_test *testp)
     testp->settings->bitrate_limit_stats_per_interval = 0;
     testp->settings->fqrate = 0;
     testp->settings->pacing_timer = DEFAULT_PACING_TIMER;
+    testp->settings->pacing_bucket = 0;
     testp->settings->burst = 0;
     testp->settings->mss = 0;
     testp->settings->bytes = 0;
     testp->settings->blocks = 0;
     testp->settings->connect_timeout = -1;
     testp->settings->rcv_timeout.secs = DEFAULT_NO_MSG_RCVD_TIMEOUT / SEC_TO_mS;
-    testp->settings->rcv_timeout.usecs = (DEFAULT_NO_MSG_RCVD_TIMEOUT % SEC_TO_mS) * mS_TO_US;
+    testp->settings->rcv_timeout.nsecs = (DEFAULT_NO_MSG_RCVD_TIMEOUT % SEC_TO_mS) * mS_TO_NS;
     testp->zerocopy = 0;
     testp->settings->skip_rx_copy = 0;
     testp->settings->cntl_ka = 0;
@@ -3213,6 +3797,140 @@ iperf_defaults(struct iperf_test *testp)
     return 0;
 }
 
+/* *dst = a copy of src, or NULL for NULL; -1 if out of memory */
+static int
+clone_string(char **dst, const char *src)
+{
+    free(*dst);
+    *dst = NULL;
+    if (src == NULL)
+        return 0;
+    *dst = strdup(src);
+    return *dst == NULL ? -1 : 0;
+}
+
+/**************************************************************************/
+struct iperf_test *
+iperf_clone_test(struct iperf_test *src)
+{
+    struct iperf_test *test;
+    struct xbind_entry *xbe, *copy;
+
+    test = iperf_new_test();
+    if (test == NULL)
+        return NULL;
+    if (iperf_defaults(test) < 0)
+        goto fail;
+
+    test->role = src->role;
+    test->mode = src->mode;
+    test->sender_has_retransmits = src->sender_has_retransmits;
+    set_protocol(test, src->protocol->id);
+    test->bind_port = src->bind_port;
+    test->server_port = src->server_port;
+    test->omit = src->omit;
+    test->duration = src->duration;
+    test->diskfile_direct = src->diskfile_direct;
+    test->perf_counters = src->perf_counters;
+    test->txtime = src->txtime;
+    test->rx_timestamps = src->rx_timestamps;
+    test->udp_histograms = src->udp_histograms;
+    test->tcpinfo_sample_ms = src->tcpinfo_sample_ms;
+    test->affinity = src->affinity;
+    test->server_affinity = src->server_affinity;
+    memcpy(test->thread_cpus, src->thread_cpus, sizeof(test->thread_cpus));
+    test->num_thread_cpus = src->num_thread_cpus;
+    test->rate_search_loss = src->rate_search_loss;
+    test->phases = src->phases;
+    test->phase_gap = src->phase_gap;
+    test->max_clients = src->max_clients;
+    test->accept_threads = src->accept_threads;
+    test->ui_frame_hz = src->ui_frame_hz;
+#if defined(HAVE_CPUSET_SETAFFINITY)
+    test->cpumask = src->cpumask;
+#endif /* HAVE_CPUSET_SETAFFINITY */
+    test->daemon = src->daemon;
+    test->one_off = src->one_off;
+    test->no_delay = src->no_delay;
+    test->reverse = src->reverse;
+    test->bidirectional = src->bidirectional;
+    test->verbose = src->verbose;
+    test->json_output = src->json_output;
+    test->json_stream = src->json_stream;
+    test->zerocopy = src->zerocopy;
+    test->debug = src->debug;
+    test->debug_level = src->debug_level;
+    test->get_server_output = src->get_server_output;
+    test->udp_counters_64bit = src->udp_counters_64bit;
+    test->forceflush = src->forceflush;
+    test->multisend = src->multisend;
+    test->repeating_payload = src->repeating_payload;
+    test->verify_payload = src->verify_payload;
+    test->timestamps = src->timestamps;
+    test->mptcp = src->mptcp;
+    test->stats_interval = src->stats_interval;
+    test->reporter_interval = src->reporter_interval;
+    test->num_streams = src->num_streams;
+
+    test->json_callback = src->json_callback;
+    test->stats_callback = src->stats_callback;
+    test->reporter_callback = src->reporter_callback;
+    test->on_new_stream = src->on_new_stream;
+    test->on_test_start = src->on_test_start;
+    test->on_connect = src->on_connect;
+    test->on_test_finish = src->on_test_finish;
+    test->on_ui_frame = src->on_ui_frame;
+
+    /* A --logfile is opened by each run for itself */
+    if (src->logfile == NULL)
+        test->outfile = src->outfile;
+
+    *test->settings = *src->settings;
+#if defined(HAVE_SSL)
+    test->settings->authtoken = test->settings->client_username = test->settings->client_password = NULL;
+    test->settings->client_rsa_pubkey = NULL;
+    if (src->settings->client_rsa_pubkey != NULL && EVP_PKEY_up_ref(src->settings->client_rsa_pubkey))
+        test->settings->client_rsa_pubkey = src->settings->client_rsa_pubkey;
+    if (src->server_rsa_private_key != NULL && EVP_PKEY_up_ref(src->server_rsa_private_key))
+        test->server_rsa_private_key = src->server_rsa_private_key;
+    test->server_authorized_users = src->server_authorized_users;
+    test->server_skew_threshold = src->server_skew_threshold;
+    test->use_pkcs1_padding = src->use_pkcs1_padding;
+    if (clone_string(&test->settings->authtoken, src->settings->authtoken) < 0 ||
+        clone_string(&test->settings->client_username, src->settings->client_username) < 0 ||
+        clone_string(&test->settings->client_password, src->settings->client_password) < 0)
+        goto fail;
+#endif /* HAVE_SSL */
+
+    if (clone_string(&test->server_hostname, src->server_hostname) < 0 ||
+        clone_string(&test->tmp_template, src->tmp_template) < 0 ||
+        clone_string(&test->bind_address, src->bind_address) < 0 ||
+        clone_string(&test->bind_dev, src->bind_dev) < 0 ||
+        clone_string(&test->diskfile_name, src->diskfile_name) < 0 ||
+        clone_string(&test->history_dir, src->history_dir) < 0 ||
+        clone_string(&test->title, src->title) < 0 ||
+        clone_string(&test->extra_data, src->extra_data) < 0 ||
+        clone_string(&test->congestion, src->congestion) < 0 ||
+        clone_string(&test->pidfile, src->pidfile) < 0 ||
+        clone_string(&test->logfile, src->logfile) < 0 ||
+        clone_string(&test->timestamp_format, src->timestamp_format) < 0)
+        goto fail;
+    TAILQ_FOREACH(xbe, &src->xbind_addrs, link) {
+        copy = calloc(1, sizeof(*copy));
+        if (copy == NULL || (copy->name = strdup(xbe->name)) == NULL) {
+            free(copy);
+            goto fail;
+        }
+        TAILQ_INSERT_TAIL(&test->xbind_addrs, copy, link);
+    }
+    return test;
+
+fail:
+    iperf_free_test(test);
+    i_errno = IENEWTEST;
+    return NULL;
+}
+
 
 /**************************************************************************/
 void
@@ -3221,6 +3939,10 @@ iperf_free_test(struct iperf_test *test)
     struct protocol *prot;
     struct iperf_stream *sp;
 
+    iperf_history_end(test, 0);
+    iperf_tcpinfo_sampler_stop(test);
+    rate_search_clear(test);
+
     /* Free streams */
     while (!SLIST_EMPTY(&test->streams)) {
         sp = SLIST_FIRST(&test->streams);
@@ -3231,6 +3953,8 @@ iperf_free_test(struct iperf_test *test)
 	free(test->server_hostname);
     if (test->tmp_template)
 	free(test->tmp_template);
+    if (test->diskfile_name)
+	free(test->diskfile_name);
     if (test->bind_address)
 	free(test->bind_address);
     if (test->bind_dev)
@@ -3273,6 +3997,8 @@ iperf_free_test(struct iperf_test *test)
 	free(test->title);
     if (test->extra_data)
 	free(test->extra_data);
+    if (test->history_dir)
+	free(test->history_dir);
     if (test->congestion)
 	free(test->congestion);
     if (test->congestion_used)
@@ -3360,7 +4086,12 @@ iperf_reset_test(struct iperf_test *test)
     struct iperf_stream *sp;
     int i;
 
+    iperf_history_end(test, 0);
+    memset(&test->ui_frame, 0, sizeof(test->ui_frame));
+    test->ui_frame_sent = 0;
     iperf_close_logfile(test);
+    iperf_tcpinfo_sampler_stop(test);
+    rate_search_clear(test);
 
     /* Free streams */
     while (!SLIST_EMPTY(&test->streams)) {
@@ -3438,10 +4169,19 @@ iperf_reset_test(struct iperf_test *test)
     test->settings->rate = 0;
     test->settings->fqrate = 0;
     test->settings->burst = 0;
+    test->settings->pacing_bucket = 0;
     test->settings->mss = 0;
     test->settings->tos = 0;
     test->settings->dont_fragment = 0;
     test->zerocopy = 0;
+    test->verify_payload = 0;
+    test->txtime = 0;
+    test->rx_timestamps = 0;
+    test->udp_histograms = 0;
+    test->rate_search_loss = -1;
+    test->phases = 1;
+    test->phase = 1;
+    test->phase_gap = 0;
     test->settings->skip_rx_copy = 0;
 
 #if defined(HAVE_SSL)
@@ -3486,6 +4226,174 @@ iperf_reset_test(struct iperf_test *test)
 }
 
 
+/*
+ * --phases: file the phase that just ended as one element of "phases",
+ * with its own "intervals" and "end".  With --json-stream the end goes
+ * out as an event instead, like the last one does.  Unless it was the
+ * last phase, the next one gets fresh "intervals" and "end".
+ */
+static int
+iperf_json_end_phase(struct iperf_test *test, int last)
+{
+    cJSON *j_phase, *j;
+
+    if (test->json_top == NULL || test->phases < 2)
+        return 0;
+
+    if (test->json_stream) {
+        if (last)
+            return 0;
+        if (test->json_server_output) {
+            JSONStream_Output(test, "server_output_json", test->json_server_output);
+            cJSON_Delete(test->json_server_output);
+            test->json_server_output = NULL;
+        }
+        if (test->server_output_text) {
+            j = cJSON_CreateString(test->server_output_text);
+            if (j != NULL) {
+                JSONStream_Output(test, "server_output_text", j);
+                cJSON_Delete(j);
+            }
+            free(test->server_output_text);
+            test->server_output_text = NULL;
+        }
+        JSONStream_Output(test, "end", test->json_end);
+        cJSON_DeleteItemFromObject(test->json_top, "intervals");
+        cJSON_DeleteItemFromObject(test->json_top, "end");
+    } else {
+        if (test->json_phases == NULL) {
+            test->json_phases = cJSON_CreateArray();
+            if (test->json_phases == NULL)
+                return -1;
+            cJSON_AddItemToObject(test->json_top, "phases", test->json_phases);
+        }
+        j_phase = cJSON_CreateObject();
+        if (j_phase == NULL)
+            return -1;
+        cJSON_AddNumberToObject(j_phase, "phase", test->phase);
+        cJSON_AddItemToObject(j_phase, "intervals", cJSON_DetachItemFromObject(test->json_top, "intervals"));
+        cJSON_AddItemToObject(j_phase, "end", cJSON_DetachItemFromObject(test->json_top, "end"));
+        if (test->json_server_output) {
+            cJSON_AddItemToObject(j_phase, "server_output_json", test->json_server_output);
+            test->json_server_output = NULL;
+        }
+        if (test->server_output_text) {
+            cJSON_AddStringToObject(j_phase, "server_output_text", test->server_output_text);
+            free(test->server_output_text);
+            test->server_output_text = NULL;
+        }
+        cJSON_AddItemToArray(test->json_phases, j_phase);
+    }
+    test->json_intervals = test->json_end = NULL;
+    if (last)
+        return 0;
+
+    test->json_intervals = cJSON_CreateArray();
+    if (test->json_intervals == NULL)
+        return -1;
+    cJSON_AddItemToObject(test->json_top, "intervals", test->json_intervals);
+    test->json_end = cJSON_CreateObject();
+    if (test->json_end == NULL)
+        return -1;
+    cJSON_AddItemToObject(test->json_top, "end", test->json_end);
+    return 0;
+}
+
+int
+iperf_reset_phase(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    struct iperf_textline *t;
+    int i, rc;
+
+    iperf_history_end(test, 0);
+    memset(&test->ui_frame, 0, sizeof(test->ui_frame));
+    test->ui_frame_sent = 0;
+    iperf_tcpinfo_sampler_stop(test);
+    SLIST_FOREACH(sp, &test->streams, streams) {
+        sp->done = 1;
+        if (sp->thread_created == 1) {
+            rc = pthread_cancel(sp->thr);
+            if (rc != 0 && rc != ESRCH) {
+                i_errno = IEPTHREADCANCEL;
+                errno = rc;
+                return -1;
+            }
+            rc = pthread_join(sp->thr, NULL);
+            if (rc != 0 && rc != ESRCH) {
+                i_errno = IEPTHREADJOIN;
+                errno = rc;
+                return -1;
+            }
+            sp->thread_created = 0;
+        }
+        /* Both sides have closed the sockets by now */
+        FD_CLR(sp->socket, &test->read_set);
+        FD_CLR(sp->socket, &test->write_set);
+    }
+
+    if (iperf_json_end_phase(test, 0) < 0) {
+        i_errno = IEINITTEST;
+        return -1;
+    }
+    rate_search_clear(test);
+
+    while (!SLIST_EMPTY(&test->streams)) {
+        sp = SLIST_FIRST(&test->streams);
+        SLIST_REMOVE_HEAD(&test->streams, streams);
+        iperf_free_stream(sp);
+    }
+    SLIST_INIT(&test->streams);
+
+    if (test->omit_timer != NULL) {
+        tmr_cancel(test->omit_timer);
+        test->omit_timer = NULL;
+    }
+    if (test->timer != NULL) {
+        tmr_cancel(test->timer);
+        test->timer = NULL;
+    }
+    if (test->stats_timer != NULL) {
+        tmr_cancel(test->stats_timer);
+        test->stats_timer = NULL;
+    }
+    if (test->reporter_timer != NULL) {
+        tmr_cancel(test->reporter_timer);
+        test->reporter_timer = NULL;
+    }
+    test->done = 0;
+    test->omitting = 0;
+
+    test->bytes_sent = 0;
+    test->blocks_sent = 0;
+    test->bytes_received = 0;
+    test->blocks_received = 0;
+
+    test->bitrate_limit_stats_count = 0;
+    test->bitrate_limit_last_interval_index = 0;
+    for (i = 0; i < MAX_INTERVAL; i++)
+        test->bitrate_limit_intervals_traffic_bytes[i] = 0;
+
+    /* Back to what each side knows before the results exchange */
+    check_sender_has_retransmits(test);
+    test->other_side_has_retransmits = 0;
+    test->remote_cpu_util[0] = test->remote_cpu_util[1] = test->remote_cpu_util[2] = 0;
+    if (test->remote_congestion_used) {
+        free(test->remote_congestion_used);
+        test->remote_congestion_used = NULL;
+    }
+    while (!TAILQ_EMPTY(&test->server_output_list)) {
+        t = TAILQ_FIRST(&test->server_output_list);
+        TAILQ_REMOVE(&test->server_output_list, t, textlineentries);
+        free(t->line);
+        free(t);
+    }
+
+    test->phase++;
+    return 0;
+}
+
+
 /* Reset all of a test's stats back to zero.  Called when the omitting
 ** period is over.
 */
@@ -3496,6 +4404,11 @@ iperf_reset_stats(struct iperf_test *test)
     struct iperf_stream *sp;
     struct iperf_stream_result *rp;
 
+    /* The -O period's frame goes now; times start over from here */
+    if (test->ui_frame_hz > 0)
+        ui_frame_send(test, 1);
+    test->ui_frame_sent = 0;
+
     test->bytes_sent = 0;
     test->blocks_sent = 0;
     iperf_time_now(&now);
@@ -3503,7 +4416,26 @@ iperf_reset_stats(struct iperf_test *test)
 	sp->omitted_packet_count = sp->packet_count;
         sp->omitted_cnt_error = sp->cnt_error;
         sp->omitted_outoforder_packets = sp->outoforder_packets;
+        sp->omitted_seq = sp->seq;
+        sp->seq.reorder_distance_max = 0;
+        sp->omitted_verified_blocks = sp->verified_blocks;
+        sp->omitted_corrupted_blocks = sp->corrupted_blocks;
+        iperf_stream_sample_cpu(sp);
+        sp->omitted_thread_cpu_usecs = sp->thread_cpu_usecs;
+        if (test->perf_counters) {
+            perf_counters_read(sp);
+            memcpy(sp->omitted_perf_count, sp->perf_count, sizeof(sp->perf_count));
+        }
+        if (sp->pacer.rate > 0)
+            iperf_pacer_omit(&sp->pacer, &sp->omitted_pacer);
+        if (sp->txtime != NULL)
+            iperf_udp_txtime_omit(sp, &sp->omitted_txtime);
+        if (sp->rx_timestamps)
+            iperf_udp_rxts_omit(sp, &sp->omitted_rxts);
+        if (sp->histograms != NULL)
+            iperf_udp_histograms_omit(sp->histograms);
 	sp->jitter = 0;
+	sp->kernel_jitter = 0;
 	rp = sp->result;
         rp->bytes_sent_omit = rp->bytes_sent;
         rp->bytes_received = 0;
@@ -3512,13 +4444,61 @@ iperf_reset_stats(struct iperf_test *test)
 	    struct iperf_interval_results ir; /* temporary results structure */
 	    save_tcpinfo(sp, &ir);
 	    rp->stream_prev_total_retrans = get_total_retransmits(&ir);
+	    if (ir.tcp_limits_valid)
+		rp->stream_prev_tcp_limits = ir.tcp_limits;
 	}
 	rp->stream_retrans = 0;
+	memset(&rp->stream_tcp_limits, 0, sizeof(rp->stream_tcp_limits));
+	rp->stream_tcp_limits_secs = 0;
 	rp->start_time = now;
     }
 }
 
 
+/**************************************************************************/
+
+/*
+ * Per-stream CPU accounting.  cpu_util() only sees the whole process,
+ * UI and JNI threads included; reading each worker thread's CPU-time
+ * clock shows whether one stream has a core to itself saturated.
+ * Called on the main thread once the worker has been started.
+ */
+void
+iperf_stream_init_cpu_clock(struct iperf_stream *sp)
+{
+#if defined(_POSIX_THREAD_CPUTIME) && _POSIX_THREAD_CPUTIME >= 0
+    sp->thread_cpu_clock_valid = (pthread_getcpuclockid(sp->thr, &sp->thread_cpu_clock) == 0);
+#else /* _POSIX_THREAD_CPUTIME */
+    sp->thread_cpu_clock_valid = 0;
+#endif /* _POSIX_THREAD_CPUTIME */
+    sp->thread_cpu_usecs = sp->omitted_thread_cpu_usecs = 0;
+}
+
+/*
+ * Take a CPU-time sample of the stream's thread.  The clock goes away
+ * with the thread, so callers sample before cancelling it; after that
+ * the last sample stands.
+ */
+void
+iperf_stream_sample_cpu(struct iperf_stream *sp)
+{
+    struct timespec ts;
+
+    if (!sp->thread_cpu_clock_valid || !sp->thread_created)
+        return;
+    if (clock_gettime(sp->thread_cpu_clock, &ts) == 0)
+        sp->thread_cpu_usecs = (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Share of one core used by the stream's thread over seconds, or -1 if unknown */
+static double
+stream_cpu_percent(struct iperf_stream *sp, uint64_t usecs, double seconds)
+{
+    if (!sp->thread_cpu_clock_valid || seconds <= 0)
+        return -1.0;
+    return 100.0 * (usecs / 1000000.0) / seconds;
+}
+
 /**************************************************************************/
 
 /**
@@ -3538,6 +4518,7 @@ iperf_stats_callback(struct iperf_test *test)
 #endif /* HAVE_SCTP_H */
 
     temp.omitted = test->omitting;
+    temp.tcp_limits_valid = 0;
     temp.rtt = 0;
     temp.rttvar = 0;
     temp.pmtu = 0;
@@ -3592,23 +4573,112 @@ iperf_stats_callback(struct iperf_test *test)
 		    temp.rttvar = get_rttvar(&temp);
 		    temp.pmtu = get_pmtu(&temp);
 		}
+		if (sp->sender && temp.tcp_limits_valid) {
+		    struct iperf_tcp_limits *l = &rp->stream_tcp_limits;
+
+		    get_tcp_limits_diff(&temp.tcp_limits, &rp->stream_prev_tcp_limits, &temp.interval_tcp_limits);
+		    rp->stream_prev_tcp_limits = temp.tcp_limits;
+		    l->busy_us += temp.interval_tcp_limits.busy_us;
+		    l->rwnd_limited_us += temp.interval_tcp_limits.rwnd_limited_us;
+		    l->sndbuf_limited_us += temp.interval_tcp_limits.sndbuf_limited_us;
+		    l->bytes_acked += temp.interval_tcp_limits.bytes_acked;
+		    rp->stream_tcp_limits_secs += temp.interval_duration;
+		    rp->stream_tcp_limits_valid = 1;
+		} else
+		    temp.tcp_limits_valid = 0;
 	    }
 	} else {
 	    if (irp == NULL) {
 		temp.interval_packet_count = sp->packet_count;
 		temp.interval_outoforder_packets = sp->outoforder_packets;
 		temp.interval_cnt_error = sp->cnt_error;
+		temp.interval_duplicate_packets = sp->seq.duplicates;
+		temp.interval_late_packets = sp->seq.late;
 	    } else {
 		temp.interval_packet_count = sp->packet_count - irp->packet_count;
 		temp.interval_outoforder_packets = sp->outoforder_packets - irp->outoforder_packets;
 		temp.interval_cnt_error = sp->cnt_error - irp->cnt_error;
+		temp.interval_duplicate_packets = sp->seq.duplicates - irp->duplicate_packets;
+		temp.interval_late_packets = sp->seq.late - irp->late_packets;
 	    }
+	    temp.duplicate_packets = sp->seq.duplicates;
+	    temp.late_packets = sp->seq.late;
 	    temp.packet_count = sp->packet_count;
 	    temp.jitter = sp->jitter;
+	    temp.kernel_jitter = sp->kernel_jitter;
 	    temp.outoforder_packets = sp->outoforder_packets;
 	    temp.cnt_error = sp->cnt_error;
 	}
 
+	if (irp == NULL) {
+	    temp.interval_verified_blocks = sp->verified_blocks;
+	    temp.interval_corrupted_blocks = sp->corrupted_blocks;
+	} else {
+	    temp.interval_verified_blocks = sp->verified_blocks - irp->verified_blocks;
+	    temp.interval_corrupted_blocks = sp->corrupted_blocks - irp->corrupted_blocks;
+	}
+	temp.verified_blocks = sp->verified_blocks;
+	temp.corrupted_blocks = sp->corrupted_blocks;
+
+	/* The disk counters belong to the writer thread, when there is one */
+	temp.diskfile_bytes = __atomic_load_n(&sp->diskfile_bytes, __ATOMIC_RELAXED);
+	temp.diskfile_usecs = __atomic_load_n(&sp->diskfile_usecs, __ATOMIC_RELAXED);
+	temp.diskfile_stalls = __atomic_load_n(&sp->diskfile_stalls, __ATOMIC_RELAXED);
+	if (irp == NULL) {
+	    temp.interval_diskfile_bytes = temp.diskfile_bytes;
+	    temp.interval_diskfile_usecs = temp.diskfile_usecs;
+	    temp.interval_diskfile_stalls = temp.diskfile_stalls;
+	} else {
+	    temp.interval_diskfile_bytes = temp.diskfile_bytes - irp->diskfile_bytes;
+	    temp.interval_diskfile_usecs = temp.diskfile_usecs - irp->diskfile_usecs;
+	    temp.interval_diskfile_stalls = temp.diskfile_stalls - irp->diskfile_stalls;
+	}
+	iperf_stream_sample_cpu(sp);
+	temp.cpu_usecs = sp->thread_cpu_usecs;
+	if (irp == NULL)
+	    temp.interval_cpu_usecs = sp->thread_cpu_usecs;
+	else
+	    temp.interval_cpu_usecs = sp->thread_cpu_usecs - irp->cpu_usecs;
+
+	if (test->perf_counters) {
+	    int i;
+
+	    perf_counters_read(sp);
+	    for (i = 0; i < PERF_NUM_COUNTERS; i++) {
+		temp.perf_count[i] = sp->perf_count[i];
+		temp.interval_perf_count[i] = sp->perf_count[i] - (irp == NULL ? 0 : irp->perf_count[i]);
+	    }
+	}
+
+	if (sp->sender && sp->pacer.rate > 0 && sp->txtime == NULL) {
+	    iperf_pacer_read(&sp->pacer, &temp.pacer, &temp.interval_pacer);
+	    iperf_pacer_diff(&temp.pacer, irp == NULL ? NULL : &irp->pacer, &temp.interval_pacer);
+	}
+	if (sp->txtime != NULL) {
+	    iperf_udp_txtime_read(sp, &temp.txtime, &temp.interval_txtime);
+	    iperf_udp_txtime_diff(&temp.txtime, irp == NULL ? NULL : &irp->txtime, &temp.interval_txtime);
+	}
+	if (sp->rx_timestamps && !sp->sender) {
+	    iperf_udp_rxts_read(sp, &temp.rxts, &temp.interval_rxts);
+	    iperf_udp_rxts_diff(&temp.rxts, irp == NULL ? NULL : &irp->rxts, &temp.interval_rxts);
+	}
+	if (sp->histograms != NULL && !sp->sender)
+	    iperf_udp_histograms_interval(sp->histograms);
+
+	if (sp->diskwriter != NULL) {
+	    struct iperf_diskwriter *dw = sp->diskwriter;
+	    int queued = __atomic_load_n(&dw->queued_blocks, __ATOMIC_RELAXED);
+
+	    temp.diskfile_wait_usecs = __atomic_load_n(&dw->wait_usecs, __ATOMIC_RELAXED);
+	    if (irp == NULL)
+		temp.interval_diskfile_wait_usecs = temp.diskfile_wait_usecs;
+	    else
+		temp.interval_diskfile_wait_usecs = temp.diskfile_wait_usecs - irp->diskfile_wait_usecs;
+	    /* Restart the high-water mark from what is queued right now */
+	    temp.diskfile_queue_max = __atomic_exchange_n(&dw->max_queued_blocks, queued, __ATOMIC_RELAXED);
+	    temp.diskfile_backlog_bytes = __atomic_load_n(&dw->queued_bytes, __ATOMIC_RELAXED);
+	}
+
 #if defined(HAVE_SCTP_H)
 	if (test->protocol->id == Psctp) {
             if (iperf_sctp_get_info(sp, &sctp_info) >= 0) {;
@@ -3648,6 +4718,85 @@ iperf_stats_callback(struct iperf_test *test)
     }
 }
 
+/* --history: one direction's sum over the streams, for the interval just ended */
+static void
+history_interval(struct iperf_test *test, int sender, iperf_size_t bytes, int64_t retransmits,
+                 int64_t packets, int64_t lost, double jitter_sum)
+{
+    struct iperf_history_record r;
+    struct iperf_stream *sp = SLIST_FIRST(&test->streams);
+    struct iperf_interval_results *irp;
+    struct iperf_time temp_time;
+
+    if (sp == NULL || (irp = TAILQ_LAST(&sp->result->interval_results, irlisthead)) == NULL)
+        return;
+    iperf_time_diff(&sp->result->start_time, &irp->interval_start_time, &temp_time);
+    r.v[HISTORY_START_MS] = iperf_time_in_usecs(&temp_time) / 1000;
+    iperf_time_diff(&sp->result->start_time, &irp->interval_end_time, &temp_time);
+    r.v[HISTORY_END_MS] = iperf_time_in_usecs(&temp_time) / 1000;
+    r.v[HISTORY_BYTES] = bytes;
+    r.v[HISTORY_RETRANSMITS] = retransmits;
+    r.v[HISTORY_PACKETS] = packets;
+    r.v[HISTORY_LOST] = lost;
+    r.v[HISTORY_JITTER_US] = test->num_streams > 0 ? jitter_sum / test->num_streams * 1000000 : 0;
+    r.v[HISTORY_FLAGS] = (sender ? HISTORY_FLAG_SENDER : 0) | (test->omitting ? HISTORY_FLAG_OMITTED : 0);
+    iperf_history_add(test, &r);
+}
+
+/* UI frames: add one direction's sum over the streams to the frame being gathered */
+static void
+ui_frame_interval(struct iperf_test *test, int sender, iperf_size_t bytes, int64_t retransmits,
+                  int64_t packets, int64_t lost, double jitter_sum)
+{
+    struct iperf_ui_frame *f = &test->ui_frame;
+    struct iperf_ui_frame_direction *d = sender ? &f->tx : &f->rx;
+    struct iperf_stream *sp = SLIST_FIRST(&test->streams);
+    struct iperf_interval_results *irp;
+    struct iperf_time temp_time;
+    double end;
+
+    if (sp == NULL || (irp = TAILQ_LAST(&sp->result->interval_results, irlisthead)) == NULL)
+        return;
+    iperf_time_diff(&sp->result->start_time, &irp->interval_end_time, &temp_time);
+    end = iperf_time_in_secs(&temp_time);
+    /* With --bidir both directions come in for each interval */
+    if (f->intervals == 0 || end > f->end) {
+        if (f->intervals == 0) {
+            iperf_time_diff(&sp->result->start_time, &irp->interval_start_time, &temp_time);
+            f->start = iperf_time_in_secs(&temp_time);
+        }
+        f->end = end;
+        f->intervals++;
+    }
+    if (test->omitting)
+        f->omitted = 1;
+    d->bytes += bytes;
+    d->retransmits += retransmits;
+    d->packets += packets;
+    d->lost += lost;
+    d->jitter_ms = test->num_streams > 0 ? jitter_sum / test->num_streams * 1000 : 0;
+    d->active = 1;
+}
+
+/*
+ * Hand the frame over if it is due, or if force and it has anything in it.
+ * Due allows a tenth of a tick's slack, so that -i 0.25 at 4 Hz gives
+ * every interval its own frame rather than every other one.
+ */
+static void
+ui_frame_send(struct iperf_test *test, int force)
+{
+    struct iperf_ui_frame *f = &test->ui_frame;
+
+    if (test->on_ui_frame == NULL || f->intervals == 0)
+        return;
+    if (!force && f->end - test->ui_frame_sent < 0.9 / test->ui_frame_hz)
+        return;
+    test->on_ui_frame(test, f);
+    test->ui_frame_sent = f->end;
+    memset(f, 0, sizeof(*f));
+}
+
 /**
  * Print intermediate results during a test (interval report).
  * Uses print_interval_results to print the results for each stream,
@@ -3769,6 +4918,8 @@ iperf_print_intermediate(struct iperf_test *test)
         double start_time, end_time;
 
         int64_t total_packets = 0, lost_packets = 0;
+        int64_t verified_blocks = 0, corrupted_blocks = 0;
+        double cpu_percent, cpu_percent_max = -1.0, cpu_percent_sum = 0.0;
         double avg_jitter = 0.0, lost_percent;
         int stream_must_be_sender = current_mode * current_mode;
 
@@ -3803,9 +4954,22 @@ iperf_print_intermediate(struct iperf_test *test)
                     lost_packets += irp->interval_cnt_error;
                     avg_jitter += irp->jitter;
                 }
+                verified_blocks += irp->interval_verified_blocks;
+                corrupted_blocks += irp->interval_corrupted_blocks;
+                cpu_percent = stream_cpu_percent(sp, irp->interval_cpu_usecs, irp->interval_duration);
+                if (cpu_percent >= 0) {
+                    cpu_percent_sum += cpu_percent;
+                    if (cpu_percent > cpu_percent_max)
+                        cpu_percent_max = cpu_percent;
+                }
             }
         }
 
+        if (test->history != NULL)
+            history_interval(test, stream_must_be_sender, bytes, retransmits, total_packets, lost_packets, avg_jitter);
+        if (test->ui_frame_hz > 0)
+            ui_frame_interval(test, stream_must_be_sender, bytes, retransmits, total_packets, lost_packets, avg_jitter);
+
         /* next build string with sum of all streams */
         if (test->num_streams > 1 || test->json_output) {
             /*
@@ -3872,16 +5036,101 @@ iperf_print_intermediate(struct iperf_test *test)
                             iperf_printf(test, report_sum_bw_udp_format, mbuf, start_time, end_time, ubuf, nbuf, avg_jitter * 1000.0, lost_packets, total_packets, lost_percent, test->omitting?report_omitted:"");
                     }
                 }
+
+                if (test->verify_payload && !stream_must_be_sender) {
+                    if (test->json_output) {
+                        cJSON *json_sum = cJSON_GetObjectItem(json_interval, sum_name);
+                        if (json_sum != NULL) {
+                            cJSON_AddNumberToObject(json_sum, "verified_blocks", verified_blocks);
+                            cJSON_AddNumberToObject(json_sum, "corrupted_blocks", corrupted_blocks);
+                        }
+                    } else if (corrupted_blocks > 0)
+                        iperf_printf(test, report_sum_corrupted, mbuf, start_time, end_time, corrupted_blocks, verified_blocks);
+                }
+
+                if (test->json_output && cpu_percent_max >= 0) {
+                    cJSON *json_sum = cJSON_GetObjectItem(json_interval, sum_name);
+                    if (json_sum != NULL) {
+                        cJSON_AddNumberToObject(json_sum, "cpu_percent_max", cpu_percent_max);
+                        cJSON_AddNumberToObject(json_sum, "cpu_percent_sum", cpu_percent_sum);
+                    }
+                }
+
+                if (test->json_output && test->udp_histograms && !stream_must_be_sender) {
+                    cJSON *json_sum = cJSON_GetObjectItem(json_interval, sum_name);
+                    struct iperf_udp_histogram_set *hsum = calloc(1, sizeof(*hsum));
+                    if (json_sum != NULL && hsum != NULL) {
+                        SLIST_FOREACH(sp, &test->streams, streams)
+                            if (sp->sender == stream_must_be_sender && sp->histograms != NULL)
+                                iperf_udp_histogram_set_merge(hsum, &sp->histograms->interval);
+                        cJSON_AddItemToObject(json_sum, "histograms", iperf_udp_histogram_set_json(hsum));
+                    }
+                    free(hsum);
+                }
             }
         }
     }
 
+    if (test->ui_frame_hz > 0)
+        ui_frame_send(test, 0);
+
     if (test->json_stream)
         JSONStream_Output(test, "interval", json_interval);
     if (discard_json)
         cJSON_Delete(json_interval);
 }
 
+/* --udp-histograms: one line of percentiles, in ms like the jitter */
+static void
+print_udp_histograms(struct iperf_test *test, const char *format, int id, const char *mbuf, const struct iperf_udp_histogram_set *hset)
+{
+    const struct iperf_histogram *t = &hset->transit_delta, *a = &hset->interarrival;
+
+    if (iperf_histogram_count(t) == 0)
+	return;
+    if (id >= 0)
+	iperf_printf(test, format, id, mbuf,
+		     iperf_histogram_percentile(t, 50.0) / 1e6, iperf_histogram_percentile(t, 90.0) / 1e6,
+		     iperf_histogram_percentile(t, 99.0) / 1e6, iperf_histogram_percentile(t, 99.9) / 1e6,
+		     iperf_histogram_percentile(t, 100.0) / 1e6,
+		     iperf_histogram_percentile(a, 50.0) / 1e6, iperf_histogram_percentile(a, 99.0) / 1e6,
+		     iperf_histogram_percentile(a, 100.0) / 1e6);
+    else
+	iperf_printf(test, format, mbuf,
+		     iperf_histogram_percentile(t, 50.0) / 1e6, iperf_histogram_percentile(t, 90.0) / 1e6,
+		     iperf_histogram_percentile(t, 99.0) / 1e6, iperf_histogram_percentile(t, 99.9) / 1e6,
+		     iperf_histogram_percentile(t, 100.0) / 1e6,
+		     iperf_histogram_percentile(a, 50.0) / 1e6, iperf_histogram_percentile(a, 99.0) / 1e6,
+		     iperf_histogram_percentile(a, 100.0) / 1e6);
+}
+
+/* --udp-histograms: the streams of one direction merged, for the end summary */
+static void
+print_udp_histograms_sum(struct iperf_test *test, int stream_must_be_sender, const char *name, const char *mbuf)
+{
+    struct iperf_udp_histogram_set *sum, *one;
+    struct iperf_stream *sp;
+    int n = 0;
+
+    sum = calloc(1, sizeof(*sum));
+    one = malloc(sizeof(*one));
+    if (sum != NULL && one != NULL) {
+	SLIST_FOREACH(sp, &test->streams, streams) {
+	    if (sp->sender != stream_must_be_sender || sp->histograms == NULL)
+		continue;
+	    iperf_udp_histograms_result(sp->histograms, one);
+	    iperf_udp_histogram_set_merge(sum, one);
+	    n++;
+	}
+	if (n > 0 && test->json_output)
+	    cJSON_AddItemToObject(test->json_end, name, iperf_udp_histogram_set_json(sum));
+	else if (n > 1)
+	    print_udp_histograms(test, report_sum_histograms, -1, mbuf, sum);
+    }
+    free(one);
+    free(sum);
+}
+
 /**
  * Print overall summary statistics at the end of a test.
  */
@@ -3894,7 +5143,7 @@ iperf_print_results(struct iperf_test *test)
     int lower_mode, upper_mode;
     int current_mode;
 
-    char *sum_sent_name, *sum_received_name, *sum_name;
+    char *sum_sent_name, *sum_received_name, *sum_name, *sum_payload_name, *sum_histograms_name;
 
     int tmp_sender_has_retransmits = test->sender_has_retransmits;
 
@@ -3960,6 +5209,7 @@ iperf_print_results(struct iperf_test *test)
         int64_t sender_packet_count = 0, receiver_packet_count = 0; /* for this stream, this interval */
         int64_t sender_omitted_packet_count = 0, receiver_omitted_packet_count = 0; /* for this stream, this interval */
         int64_t sender_total_packets = 0, receiver_total_packets = 0; /* running total */
+        int64_t total_verified_blocks = 0, total_corrupted_blocks = 0;
         char ubuf[UNIT_LEN];
         char nbuf[UNIT_LEN];
         struct stat sb;
@@ -4171,6 +5421,43 @@ iperf_print_results(struct iperf_test *test)
                                 iperf_printf(test, report_diskfile, ubuf, sbuf, percent_received, test->diskfile_name);
                             }
                     }
+
+                    /*
+                     * Disk side of the transfer: throughput while the
+                     * stream was actually blocked on the file, so a slow
+                     * disk can be told apart from a slow network.
+                     */
+                    double disk_secs = sp->diskfile_usecs / 1000000.0;
+                    double disk_rate = disk_secs > 0 ? (double) sp->diskfile_bytes / disk_secs : 0.0;
+                    int disk_zerocopy = sp->snd == diskfile_sendfile || sp->rcv == diskfile_splice_recv;
+                    double wait_secs = 0.0, wait_percent = 0.0;
+                    if (sp->diskwriter != NULL) {
+                        wait_secs = __atomic_load_n(&sp->diskwriter->wait_usecs, __ATOMIC_RELAXED) / 1000000.0;
+                        if (end_time > 0)
+                            wait_percent = 100.0 * wait_secs / end_time;
+                    }
+                    if (test->json_output) {
+                        cJSON *json_diskfile_io = iperf_json_printf("bytes: %d  busy_seconds: %f  bits_per_second: %f  stalls: %d  max_stall_ms: %f  zerocopy: %b", (int64_t) sp->diskfile_bytes, disk_secs, disk_rate * 8, (int64_t) sp->diskfile_stalls, sp->diskfile_max_usecs / 1000.0, disk_zerocopy);
+                        if (json_diskfile_io != NULL && sp->diskwriter != NULL) {
+                            cJSON_AddNumberToObject(json_diskfile_io, "queue_peak", sp->diskwriter->peak_queued_blocks);
+                            cJSON_AddNumberToObject(json_diskfile_io, "queue_slots", sp->diskwriter->slots);
+                            cJSON_AddNumberToObject(json_diskfile_io, "backlog_bytes", __atomic_load_n(&sp->diskwriter->queued_bytes, __ATOMIC_RELAXED));
+                            cJSON_AddNumberToObject(json_diskfile_io, "wait_seconds", wait_secs);
+                            cJSON_AddBoolToObject(json_diskfile_io, "disk_bound", wait_percent >= DISKFILE_BOUND_PERCENT);
+                            cJSON_AddBoolToObject(json_diskfile_io, "direct_io", sp->diskwriter->direct);
+                        }
+                        cJSON_AddItemToObject(json_summary_stream, "diskfile_io", json_diskfile_io);
+                    }
+                    else {
+                        unit_snprintf(ubuf, UNIT_LEN, (double) sp->diskfile_bytes, 'A');
+                        unit_snprintf(nbuf, UNIT_LEN, disk_rate, test->settings->unit_format);
+                        iperf_printf(test, report_diskfile_io, ubuf, disk_secs, nbuf, sp->diskfile_stalls, sp->diskfile_max_usecs / 1000.0, disk_zerocopy ? report_diskfile_zerocopy : "");
+                        if (sp->diskwriter != NULL) {
+                            iperf_printf(test, report_diskfile_queue, sp->diskwriter->peak_queued_blocks, sp->diskwriter->slots, wait_secs, sp->diskwriter->direct ? report_diskfile_direct : "");
+                            if (wait_percent >= DISKFILE_BOUND_PERCENT)
+                                iperf_printf(test, report_diskfile_bound, wait_percent);
+                        }
+                    }
                 }
 
                 unit_snprintf(ubuf, UNIT_LEN, (double) bytes_received, 'A');
@@ -4221,10 +5508,169 @@ iperf_print_results(struct iperf_test *test)
                         }
                     }
                 }
+
+                if (test->verify_payload) {
+                    int64_t verified_blocks = sp->verified_blocks - sp->omitted_verified_blocks;
+                    int64_t corrupted_blocks = sp->corrupted_blocks - sp->omitted_corrupted_blocks;
+
+                    total_verified_blocks += verified_blocks;
+                    total_corrupted_blocks += corrupted_blocks;
+                    if (test->json_output)
+                        cJSON_AddItemToObject(json_summary_stream, "payload", iperf_json_printf("verified_blocks: %d  corrupted_blocks: %d", (int64_t) verified_blocks, (int64_t) corrupted_blocks));
+                    else if (!(test->role == 's' && sp->sender))
+                        iperf_printf(test, report_corrupted, sp->socket, mbuf, start_time, receiver_time, corrupted_blocks, verified_blocks);
+                }
+
+                if (sp->thread_cpu_clock_valid) {
+                    uint64_t cpu_usecs = sp->thread_cpu_usecs - sp->omitted_thread_cpu_usecs;
+                    double cpu_percent = stream_cpu_percent(sp, cpu_usecs, end_time);
+                    if (test->json_output)
+                        cJSON_AddItemToObject(json_summary_stream, "cpu", iperf_json_printf("seconds: %f  percent: %f", cpu_usecs / 1000000.0, cpu_percent));
+                    else if (test->verbose)
+                        iperf_printf(test, report_stream_cpu, sp->socket, mbuf, cpu_usecs / 1000000.0, cpu_percent);
+                }
+
+                if (sp->thread_cpu >= 0) {
+                    int capacity = iperf_cpu_capacity(sp->thread_cpu);
+
+                    if (test->json_output) {
+                        cJSON *json_affinity = iperf_json_printf("core: %d  pinned: %b", (int64_t) sp->thread_cpu, !sp->thread_cpu_error);
+
+                        if (json_affinity != NULL && capacity >= 0)
+                            cJSON_AddNumberToObject(json_affinity, "capacity", capacity);
+                        cJSON_AddItemToObject(json_summary_stream, "affinity", json_affinity);
+                    }
+                    else if (sp->thread_cpu_error)
+                        iperf_printf(test, report_thread_affinity_failed, sp->socket, mbuf, sp->thread_cpu, strerror(sp->thread_cpu_error));
+                    else if (capacity >= 0)
+                        iperf_printf(test, report_thread_affinity_capacity, sp->socket, mbuf, sp->thread_cpu, capacity);
+                    else
+                        iperf_printf(test, report_thread_affinity, sp->socket, mbuf, sp->thread_cpu);
+                }
+
+                if (sp->seq_valid) {
+                    struct iperf_seq_stats seq;
+                    int64_t outoforder = sp->outoforder_packets - sp->omitted_outoforder_packets;
+
+                    iperf_udp_seq_diff(&sp->seq, &sp->omitted_seq, &seq);
+                    if (test->json_output)
+                        cJSON_AddItemToObject(json_summary_stream, "sequence", iperf_udp_seq_json(&seq, outoforder));
+                    else if (seq.duplicates > 0 || seq.late > 0 || outoforder > 0)
+                        iperf_printf(test, report_sequence, sp->socket, mbuf, outoforder, outoforder > 0 ? (double) seq.reorder_distance_sum / outoforder : 0.0, seq.reorder_distance_max, seq.duplicates, seq.late);
+                }
+
+                if (sp->histograms != NULL) {
+                    struct iperf_udp_histogram_set *hset = malloc(sizeof(*hset));
+
+                    if (hset != NULL) {
+                        iperf_udp_histograms_result(sp->histograms, hset);
+                        if (test->json_output)
+                            cJSON_AddItemToObject(json_summary_stream, "histograms", iperf_udp_histogram_set_json(hset));
+                        else
+                            print_udp_histograms(test, report_histograms, sp->socket, mbuf, hset);
+                        free(hset);
+                    }
+                }
+
+                if (sp->rx_timestamps) {
+                    struct iperf_rxts_stats rxts;
+
+                    iperf_udp_rxts_read(sp, &rxts, NULL);
+                    iperf_udp_rxts_diff(&rxts, &sp->omitted_rxts, &rxts);
+                    if (test->json_output)
+                        cJSON_AddItemToObject(json_summary_stream, "rx_timestamps", iperf_udp_rxts_json(&rxts, sp->kernel_jitter, sp->jitter));
+                    else if (rxts.packets > 0)
+                        iperf_printf(test, report_rx_timestamps, sp->socket, mbuf, sp->kernel_jitter * 1000.0, sp->jitter * 1000.0, (sp->jitter - sp->kernel_jitter) * 1000.0, (double) rxts.latency_ns / rxts.packets / 1000.0, rxts.max_latency_ns / 1000.0);
+                }
+
+                if (sp->txtime != NULL) {
+                    struct iperf_txtime_stats txtime;
+
+                    iperf_udp_txtime_read(sp, &txtime, NULL);
+                    iperf_udp_txtime_diff(&txtime, &sp->omitted_txtime, &txtime);
+                    if (test->json_output)
+                        cJSON_AddItemToObject(json_summary_stream, "txtime", iperf_udp_txtime_json(&txtime));
+                    else {
+                        if (test->verbose && txtime.reported > 0)
+                            iperf_printf(test, report_txtime, sp->socket, mbuf, (double) txtime.error_ns / txtime.reported / 1000.0, (double) txtime.abs_error_ns / txtime.reported / 1000.0, txtime.max_error_ns / 1000.0, txtime.reported, txtime.packets, txtime.dropped);
+                        if (iperf_udp_txtime_ignored(&txtime))
+                            iperf_printf(test, report_txtime_ignored, sp->socket, mbuf);
+                    }
+                }
+                else if (sp->sender && sp->pacer.rate > 0) {
+                    struct iperf_pacer_stats pacer;
+
+                    iperf_pacer_read(&sp->pacer, &pacer, NULL);
+                    iperf_pacer_diff(&pacer, &sp->omitted_pacer, &pacer);
+                    if (test->json_output)
+                        cJSON_AddItemToObject(json_summary_stream, "pacing", iperf_pacer_json(&sp->pacer, &pacer));
+                    else if (test->verbose && pacer.messages > 0)
+                        iperf_printf(test, report_pacing, sp->socket, mbuf, (double) pacer.gap_ns / pacer.messages / 1000.0, sp->pacer.target_gap_ns / 1000.0, pacer.min_gap_ns / 1000.0, pacer.max_gap_ns / 1000.0, (double) pacer.error_ns / pacer.messages / 1000.0, pacer.sleeps, (int64_t) sp->pacer.depth);
+                }
+
+                if (sp->result->stream_tcp_limits_valid) {
+                    const struct iperf_tcp_limits *l = &sp->result->stream_tcp_limits;
+                    double limits_usecs = sp->result->stream_tcp_limits_secs * 1000000.0;
+
+                    if (test->json_output)
+                        cJSON_AddItemToObject(json_summary_stream, "limits", build_tcp_limits_json(l, sp->result->stream_tcp_limits_secs, 1));
+                    else if (test->verbose && limits_usecs > 0)
+                        iperf_printf(test, report_tcp_limits, sp->socket, mbuf, get_tcp_limits_verdict(l, sp->result->stream_tcp_limits_secs), l->busy_us * 100.0 / limits_usecs, l->rwnd_limited_us * 100.0 / limits_usecs, l->sndbuf_limited_us * 100.0 / limits_usecs);
+                }
+
+                if (sp->tcpinfo != NULL) {
+                    struct iperf_tcpinfo_sample min, max;
+                    char min_cwnd[UNIT_LEN], max_cwnd[UNIT_LEN], rate[UNIT_LEN];
+                    int samples;
+
+                    if (test->json_output)
+                        cJSON_AddItemToObject(json_summary_stream, "tcp_info_series", iperf_tcpinfo_ring_json(sp->tcpinfo, test->tcpinfo_sample_ms, test->tcpinfo_overruns));
+                    else if ((samples = iperf_tcpinfo_ring_range(sp->tcpinfo, &min, &max)) > 0) {
+                        unit_snprintf(min_cwnd, UNIT_LEN, min.snd_cwnd, 'A');
+                        unit_snprintf(max_cwnd, UNIT_LEN, max.snd_cwnd, 'A');
+                        unit_snprintf(rate, UNIT_LEN, max.delivery_rate * 8.0, test->settings->unit_format);
+                        iperf_printf(test, report_tcpinfo_series, sp->socket, mbuf, samples, test->tcpinfo_sample_ms, min_cwnd, max_cwnd, min.rtt_us / 1000.0, max.rtt_us / 1000.0, rate);
+                    }
+                }
+
+                if (test->perf_counters) {
+                    uint64_t perf_count[PERF_NUM_COUNTERS];
+                    iperf_size_t perf_bytes = sp->sender ? bytes_sent : bytes_received;
+                    int i;
+
+                    for (i = 0; i < PERF_NUM_COUNTERS; i++)
+                        perf_count[i] = sp->perf_count[i] - sp->omitted_perf_count[i];
+                    if (test->json_output) {
+                        if (perf_counters_available(sp))
+                            cJSON_AddItemToObject(json_summary_stream, "perf", perf_counters_json(sp, perf_count, perf_bytes));
+                        else
+                            cJSON_AddItemToObject(json_summary_stream, "perf", iperf_json_printf("available: %b", 0));
+                    }
+                    else if (!perf_counters_available(sp))
+                        iperf_printf(test, report_perf_unavailable, sp->socket, mbuf);
+                    else if (sp->perf_fd[PERF_CYCLES] >= 0 && sp->perf_fd[PERF_INSTRUCTIONS] >= 0 && perf_bytes > 0 && perf_count[PERF_CYCLES] > 0)
+                        iperf_printf(test, report_perf, sp->socket, mbuf, (double) perf_count[PERF_CYCLES] / perf_bytes, (double) perf_count[PERF_INSTRUCTIONS] / perf_count[PERF_CYCLES], perf_count[PERF_CONTEXT_SWITCHES], perf_count[PERF_PAGE_FAULTS], sp->perf_user_only ? report_perf_user_only : "");
+                    else
+                        iperf_printf(test, report_perf_sw, sp->socket, mbuf, perf_count[PERF_CONTEXT_SWITCHES], perf_count[PERF_PAGE_FAULTS]);
+                }
             }
         }
         }
 
+        if (test->history != NULL) {
+            struct iperf_history_direction hd;
+
+            hd.bytes_sent = total_sent;
+            hd.bytes_received = total_received;
+            hd.sender_ms = sender_time * 1000;
+            hd.receiver_ms = receiver_time * 1000;
+            hd.retransmits = total_retransmits;
+            hd.packets = total_packets;
+            hd.lost = lost_packets;
+            hd.jitter_us = test->num_streams > 0 ? avg_jitter / test->num_streams * 1000000 : 0;
+            iperf_history_set_direction(test, stream_must_be_sender, &hd);
+        }
+
         if (test->num_streams > 1 || test->json_output) {
             /*
              * With BIDIR give a different JSON object name to the one sent/receive sums.
@@ -4236,6 +5682,8 @@ iperf_print_results(struct iperf_test *test)
             sum_name = "sum";
             sum_sent_name = "sum_sent";
             sum_received_name = "sum_received";
+            sum_payload_name = "sum_payload";
+            sum_histograms_name = "sum_histograms";
             if (test->mode == BIDIRECTIONAL) {
                 if ((test->role == 'c' && !stream_must_be_sender) ||
                     (test->role != 'c' && stream_must_be_sender))
@@ -4243,6 +5691,8 @@ iperf_print_results(struct iperf_test *test)
                     sum_name = "sum_bidir_reverse";
                     sum_sent_name = "sum_sent_bidir_reverse";
                     sum_received_name = "sum_received_bidir_reverse";
+                    sum_payload_name = "sum_payload_bidir_reverse";
+                    sum_histograms_name = "sum_histograms_bidir_reverse";
                 }
 
             }
@@ -4350,10 +5800,42 @@ iperf_print_results(struct iperf_test *test)
                     }
                 }
             }
+
+            if (test->udp_histograms)
+                print_udp_histograms_sum(test, stream_must_be_sender, sum_histograms_name, mbuf);
+
+            if (test->verify_payload) {
+                if (test->json_output)
+                    cJSON_AddItemToObject(test->json_end, sum_payload_name, iperf_json_printf("verified_blocks: %d  corrupted_blocks: %d", (int64_t) total_verified_blocks, (int64_t) total_corrupted_blocks));
+                else if (!(test->role == 's' && stream_must_be_sender))
+                    iperf_printf(test, report_sum_corrupted, mbuf, start_time, receiver_time, total_corrupted_blocks, total_verified_blocks);
+            }
+        }
+
+        if (current_mode == upper_mode)
+            print_rate_search(test);
+
+        /* Busiest stream thread and all of them together, in both directions */
+        double stream_cpu_max = -1.0, stream_cpu_sum = 0.0;
+        if (current_mode == upper_mode) {
+            SLIST_FOREACH(sp, &test->streams, streams) {
+                double cpu_percent = stream_cpu_percent(sp, sp->thread_cpu_usecs - sp->omitted_thread_cpu_usecs, end_time);
+                if (cpu_percent >= 0) {
+                    stream_cpu_sum += cpu_percent;
+                    if (cpu_percent > stream_cpu_max)
+                        stream_cpu_max = cpu_percent;
+                }
+            }
         }
 
         if (test->json_output && current_mode == upper_mode) {
-            cJSON_AddItemToObject(test->json_end, "cpu_utilization_percent", iperf_json_printf("host_total: %f  host_user: %f  host_system: %f  remote_total: %f  remote_user: %f  remote_system: %f", (double) test->cpu_util[0], (double) test->cpu_util[1], (double) test->cpu_util[2], (double) test->remote_cpu_util[0], (double) test->remote_cpu_util[1], (double) test->remote_cpu_util[2]));
+            cJSON *json_cpu = iperf_json_printf("host_total: %f  host_user: %f  host_system: %f  remote_total: %f  remote_user: %f  remote_system: %f", (double) test->cpu_util[0], (double) test->cpu_util[1], (double) test->cpu_util[2], (double) test->remote_cpu_util[0], (double) test->remote_cpu_util[1], (double) test->remote_cpu_util[2]);
+            if (json_cpu != NULL && stream_cpu_max >= 0) {
+                cJSON_AddNumberToObject(json_cpu, "stream_max", stream_cpu_max);
+                cJSON_AddNumberToObject(json_cpu, "stream_sum", stream_cpu_sum);
+                cJSON_AddBoolToObject(json_cpu, "stream_cpu_bound", stream_cpu_max >= STREAM_CPU_BOUND_PERCENT);
+            }
+            cJSON_AddItemToObject(test->json_end, "cpu_utilization_percent", json_cpu);
             if (test->protocol->id == Ptcp) {
                 char *snd_congestion = NULL, *rcv_congestion = NULL;
                 if (stream_must_be_sender) {
@@ -4373,6 +5855,12 @@ iperf_print_results(struct iperf_test *test)
             }
         }
         else {
+            if (stream_cpu_max >= 0) {
+                if (test->verbose)
+                    iperf_printf(test, report_cpu_streams, stream_cpu_max, stream_cpu_sum);
+                if (stream_cpu_max >= STREAM_CPU_BOUND_PERCENT)
+                    iperf_printf(test, report_cpu_bound, stream_cpu_max);
+            }
             if (test->verbose) {
                 if (stream_must_be_sender) {
                     if (test->bidirectional) {
@@ -4443,6 +5931,8 @@ iperf_reporter_callback(struct iperf_test *test)
         case TEST_END:
         case DISPLAY_RESULTS:
             iperf_print_intermediate(test);
+            if (test->ui_frame_hz > 0)
+                ui_frame_send(test, 1);
             iperf_print_results(test);
             break;
     }
@@ -4466,6 +5956,7 @@ print_interval_results(struct iperf_test *test, struct iperf_stream *sp, cJSON *
     struct iperf_time temp_time;
     struct iperf_interval_results *irp = NULL;
     double bandwidth, lost_percent;
+    cJSON *json_stream;
 
     if (test->mode == BIDIRECTIONAL) {
         sprintf(mbuf, "[%s-%s]", sp->sender?"TX":"RX", test->role == 'c'?"C":"S");
@@ -4560,12 +6051,111 @@ print_interval_results(struct iperf_test *test, struct iperf_stream *sp, cJSON *
 		lost_percent = 0.0;
 	    }
 	    if (test->json_output)
-		cJSON_AddItemToArray(json_interval_streams, iperf_json_printf("socket: %d  start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  jitter_ms: %f  lost_packets: %d  packets: %d  lost_percent: %f  omitted: %b sender: %b", (int64_t) sp->socket, (double) st, (double) et, (double) irp->interval_duration, (int64_t) irp->bytes_transferred, bandwidth * 8, (double) irp->jitter * 1000.0, (int64_t) irp->interval_cnt_error, (int64_t) irp->interval_packet_count, (double) lost_percent, irp->omitted, sp->sender));
+		cJSON_AddItemToArray(json_interval_streams, iperf_json_printf("socket: %d  start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  jitter_ms: %f  lost_packets: %d  packets: %d  lost_percent: %f  out_of_order: %d  duplicates: %d  late: %d  omitted: %b sender: %b", (int64_t) sp->socket, (double) st, (double) et, (double) irp->interval_duration, (int64_t) irp->bytes_transferred, bandwidth * 8, (double) irp->jitter * 1000.0, (int64_t) irp->interval_cnt_error, (int64_t) irp->interval_packet_count, (double) lost_percent, (int64_t) irp->interval_outoforder_packets, (int64_t) irp->interval_duplicate_packets, (int64_t) irp->interval_late_packets, irp->omitted, sp->sender));
 	    else
 		iperf_printf(test, report_bw_udp_format, sp->socket, mbuf, st, et, ubuf, nbuf, irp->jitter * 1000.0, irp->interval_cnt_error, irp->interval_packet_count, lost_percent, irp->omitted?report_omitted:"");
 	}
     }
 
+    /* Payload verification results, receiving side only. */
+    if (test->verify_payload && !sp->sender) {
+	if (test->json_output) {
+	    json_stream = cJSON_GetArrayItem(json_interval_streams, cJSON_GetArraySize(json_interval_streams) - 1);
+	    if (json_stream != NULL) {
+		cJSON_AddNumberToObject(json_stream, "verified_blocks", irp->interval_verified_blocks);
+		cJSON_AddNumberToObject(json_stream, "corrupted_blocks", irp->interval_corrupted_blocks);
+	    }
+	} else if (irp->interval_corrupted_blocks > 0)
+	    iperf_printf(test, report_corrupted, sp->socket, mbuf, st, et, irp->interval_corrupted_blocks, irp->interval_verified_blocks);
+    }
+
+    /* CPU used by the stream's thread, as a share of one core */
+    if (test->json_output && sp->thread_cpu_clock_valid) {
+	json_stream = cJSON_GetArrayItem(json_interval_streams, cJSON_GetArraySize(json_interval_streams) - 1);
+	if (json_stream != NULL)
+	    cJSON_AddNumberToObject(json_stream, "cpu_percent", stream_cpu_percent(sp, irp->interval_cpu_usecs, irp->interval_duration));
+    }
+
+    if (test->json_output && perf_counters_available(sp)) {
+	json_stream = cJSON_GetArrayItem(json_interval_streams, cJSON_GetArraySize(json_interval_streams) - 1);
+	if (json_stream != NULL)
+	    cJSON_AddItemToObject(json_stream, "perf", perf_counters_json(sp, irp->interval_perf_count, irp->bytes_transferred));
+    }
+
+    /* -b: the inter-message gaps the pacer actually achieved */
+    if (test->json_output && sp->sender && sp->pacer.rate > 0 && sp->txtime == NULL) {
+	json_stream = cJSON_GetArrayItem(json_interval_streams, cJSON_GetArraySize(json_interval_streams) - 1);
+	if (json_stream != NULL)
+	    cJSON_AddItemToObject(json_stream, "pacing", iperf_pacer_json(&sp->pacer, &irp->interval_pacer));
+    }
+
+    /* --txtime: when packets left against when they were scheduled to */
+    if (test->json_output && sp->txtime != NULL) {
+	json_stream = cJSON_GetArrayItem(json_interval_streams, cJSON_GetArraySize(json_interval_streams) - 1);
+	if (json_stream != NULL)
+	    cJSON_AddItemToObject(json_stream, "txtime", iperf_udp_txtime_json(&irp->interval_txtime));
+    }
+
+    /* --rx-timestamps: jitter by the kernel's clock against our own */
+    if (test->json_output && sp->rx_timestamps && !sp->sender) {
+	json_stream = cJSON_GetArrayItem(json_interval_streams, cJSON_GetArraySize(json_interval_streams) - 1);
+	if (json_stream != NULL)
+	    cJSON_AddItemToObject(json_stream, "rx_timestamps", iperf_udp_rxts_json(&irp->interval_rxts, irp->kernel_jitter, irp->jitter));
+    }
+
+    /* TCP sender: what share of the interval the socket was busy, or held back */
+    if (test->json_output && sp->sender && irp->tcp_limits_valid) {
+	json_stream = cJSON_GetArrayItem(json_interval_streams, cJSON_GetArraySize(json_interval_streams) - 1);
+	if (json_stream != NULL) {
+	    cJSON *json_limits = build_tcp_limits_json(&irp->interval_tcp_limits, irp->interval_duration, 0);
+
+	    if (json_limits != NULL)
+		cJSON_AddNumberToObject(json_limits, "delivery_rate", irp->delivery_rate * 8.0);
+	    cJSON_AddItemToObject(json_stream, "limits", json_limits);
+	}
+    }
+
+    /* --udp-histograms: percentiles of this interval's packets */
+    if (test->json_output && sp->histograms != NULL && !sp->sender) {
+	json_stream = cJSON_GetArrayItem(json_interval_streams, cJSON_GetArraySize(json_interval_streams) - 1);
+	if (json_stream != NULL)
+	    cJSON_AddItemToObject(json_stream, "histograms", iperf_udp_histogram_set_json(&sp->histograms->interval));
+    }
+
+    /* -F: how much of the interval the stream spent waiting on the file */
+    if (sp->diskfile_fd >= 0) {
+	double disk_secs = irp->interval_diskfile_usecs / 1000000.0;
+	double disk_rate = disk_secs > 0 ? (double) irp->interval_diskfile_bytes / disk_secs : 0.0;
+	double busy_percent = irp->interval_duration > 0 ? 100.0 * disk_secs / irp->interval_duration : 0.0;
+
+	/* With the writer thread, the receive side only waits on a full queue */
+	double wait_secs = irp->interval_diskfile_wait_usecs / 1000000.0;
+	int disk_bound = irp->interval_duration > 0 && 100.0 * wait_secs / irp->interval_duration >= DISKFILE_BOUND_PERCENT;
+
+	if (test->json_output) {
+	    json_stream = cJSON_GetArrayItem(json_interval_streams, cJSON_GetArraySize(json_interval_streams) - 1);
+	    if (json_stream != NULL) {
+		cJSON *json_diskfile = iperf_json_printf("bytes: %d  busy_seconds: %f  busy_percent: %f  bits_per_second: %f  stalls: %d", (int64_t) irp->interval_diskfile_bytes, disk_secs, busy_percent, disk_rate * 8, (int64_t) irp->interval_diskfile_stalls);
+		if (json_diskfile != NULL && sp->diskwriter != NULL) {
+		    cJSON_AddNumberToObject(json_diskfile, "queue_max", irp->diskfile_queue_max);
+		    cJSON_AddNumberToObject(json_diskfile, "queue_slots", sp->diskwriter->slots);
+		    cJSON_AddNumberToObject(json_diskfile, "backlog_bytes", irp->diskfile_backlog_bytes);
+		    cJSON_AddNumberToObject(json_diskfile, "wait_seconds", wait_secs);
+		    cJSON_AddBoolToObject(json_diskfile, "disk_bound", disk_bound);
+		}
+		cJSON_AddItemToObject(json_stream, "diskfile", json_diskfile);
+	    }
+	} else {
+	    unit_snprintf(ubuf, UNIT_LEN, (double) irp->interval_diskfile_bytes, 'A');
+	    unit_snprintf(nbuf, UNIT_LEN, disk_rate, test->settings->unit_format);
+	    if (sp->diskwriter != NULL) {
+		unit_snprintf(cbuf, UNIT_LEN, (double) irp->diskfile_backlog_bytes, 'A');
+		iperf_printf(test, report_diskfile_queue_interval, sp->socket, mbuf, st, et, ubuf, nbuf, busy_percent, irp->interval_diskfile_stalls, irp->diskfile_queue_max, sp->diskwriter->slots, cbuf, disk_bound ? report_diskfile_disk_bound : "");
+	    } else
+		iperf_printf(test, report_diskfile_interval, sp->socket, mbuf, st, et, ubuf, nbuf, busy_percent, irp->interval_diskfile_stalls);
+	}
+    }
+
     if (test->logfile || test->forceflush)
         iflush(test);
 }
@@ -4579,8 +6169,18 @@ iperf_free_stream(struct iperf_stream *sp)
     /* XXX: need to free interval list too! */
     munmap(sp->buffer, sp->test->settings->blksize);
     close(sp->buffer_fd);
+    if (sp->diskwriter != NULL)
+	iperf_diskwriter_free(sp->diskwriter);
+    perf_counters_close(sp);
+    iperf_udp_txtime_free(sp);
+    free(sp->histograms);
+    free(sp->tcpinfo);
     if (sp->diskfile_fd >= 0)
 	close(sp->diskfile_fd);
+    if (sp->diskfile_pipe[0] >= 0) {
+	close(sp->diskfile_pipe[0]);
+	close(sp->diskfile_pipe[1]);
+    }
     for (irp = TAILQ_FIRST(&sp->result->interval_results); irp != NULL; irp = nirp) {
         nirp = TAILQ_NEXT(irp, irlistentries);
         free(irp);
@@ -4597,6 +6197,7 @@ iperf_new_stream(struct iperf_test *test, int s, int sender)
 {
     struct iperf_stream *sp;
     int ret = 0;
+    int i;
 
     char template[1024];
     if (test->tmp_template) {
@@ -4669,6 +6270,10 @@ iperf_new_stream(struct iperf_test *test, int s, int sender)
         return NULL;
     }
     sp->pending_size = 0;
+    sp->diskfile_pipe[0] = sp->diskfile_pipe[1] = -1;
+    for (i = 0; i < PERF_NUM_COUNTERS; i++)
+        sp->perf_fd[i] = -1;
+    iperf_pacer_init(sp);
 
     /* Set socket */
     sp->socket = s;
@@ -4677,7 +6282,21 @@ iperf_new_stream(struct iperf_test *test, int s, int sender)
     sp->rcv = test->protocol->recv;
 
     if (test->diskfile_name != (char*) 0) {
-	sp->diskfile_fd = open(test->diskfile_name, sender ? O_RDONLY : (O_WRONLY|O_CREAT|O_TRUNC), S_IRUSR|S_IWUSR);
+	int flags = sender ? O_RDONLY : (O_WRONLY|O_CREAT|O_TRUNC);
+	int direct = 0;
+#if defined(O_DIRECT)
+	if (!sender && test->diskfile_direct && !test->zerocopy) {
+	    sp->diskfile_fd = open(test->diskfile_name, flags | O_DIRECT, S_IRUSR|S_IWUSR);
+	    /* Some filesystems (tmpfs, for one) refuse O_DIRECT */
+	    if (sp->diskfile_fd >= 0)
+		direct = 1;
+	    else if (test->debug)
+		printf("O_DIRECT open of %s failed: %s\n", test->diskfile_name, strerror(errno));
+	} else
+	    sp->diskfile_fd = -1;
+	if (sp->diskfile_fd == -1)
+#endif /* O_DIRECT */
+	sp->diskfile_fd = open(test->diskfile_name, flags, S_IRUSR|S_IWUSR);
 	if (sp->diskfile_fd == -1) {
 	    i_errno = IEFILE;
             munmap(sp->buffer, sp->test->settings->blksize);
@@ -4689,11 +6308,43 @@ iperf_new_stream(struct iperf_test *test, int s, int sender)
 	sp->snd = diskfile_send;
 	sp->rcv2 = sp->rcv;
 	sp->rcv = diskfile_recv;
+	/* With -Z, keep TCP file data out of user space altogether */
+	if (test->zerocopy && test->protocol->id == Ptcp) {
+	    if (sender && has_sendfile())
+		sp->snd = diskfile_sendfile;
+	    else if (!sender && has_splice() && pipe(sp->diskfile_pipe) == 0) {
+#if defined(F_SETPIPE_SZ)
+		/* Best effort; a full block per splice() saves syscalls */
+		(void) fcntl(sp->diskfile_pipe[1], F_SETPIPE_SZ, test->settings->blksize);
+#endif /* F_SETPIPE_SZ */
+		sp->rcv = diskfile_splice_recv;
+	    }
+	}
+	/* Otherwise write received data from a thread of its own */
+	if (!sender && sp->rcv == diskfile_recv) {
+	    sp->diskwriter = iperf_diskwriter_new(sp, direct);
+	    if (sp->diskwriter == NULL && test->debug)
+		printf("no disk writer thread, writing %s synchronously\n", test->diskfile_name);
+	}
     } else
         sp->diskfile_fd = -1;
 
     /* Initialize stream */
-    if (test->repeating_payload)
+    if (test->verify_payload) {
+        /*
+         * Both ends derive the payload from the test cookie, so the
+         * receiver only needs the checksum of what the sender will put
+         * on the wire; its own buffer is overwritten by received data.
+         */
+        fill_with_seeded_pattern(sp->buffer, test->settings->blksize, test->cookie);
+        sp->verify_crc = crc32c(0, sp->buffer, test->settings->blksize);
+        if (test->protocol->id == Pudp) {
+            /* sec, usec and the packet count are rewritten into every datagram */
+            int hdrlen = 2 * sizeof(uint32_t) + (test->udp_counters_64bit ? sizeof(uint64_t) : sizeof(uint32_t));
+            sp->verify_udp_crc = crc32c(0, sp->buffer + hdrlen, test->settings->blksize - hdrlen);
+        }
+    }
+    else if (test->repeating_payload)
         fill_with_repeating_pattern(sp->buffer, test->settings->blksize);
     else
         ret = readentropy(sp->buffer, test->settings->blksize);
@@ -4705,6 +6356,31 @@ iperf_new_stream(struct iperf_test *test, int s, int sender)
         free(sp);
         return NULL;
     }
+
+    /* --txtime falls back to pacing in iperf_send_mt() if the socket can't */
+    if (test->txtime && sender && test->protocol->id == Pudp)
+        (void) iperf_udp_txtime_init(sp);
+    if (test->rx_timestamps && !sender && test->protocol->id == Pudp)
+        (void) iperf_udp_rxts_init(sp);
+    sp->seq_valid = !sender && test->protocol->id == Pudp;
+    if (test->udp_histograms && !sender && test->protocol->id == Pudp &&
+        (sp->histograms = iperf_udp_histograms_new()) == NULL)
+        warning("--udp-histograms: out of memory; no histograms for this stream");
+    if (test->tcpinfo_sample_ms > 0 && test->protocol->id == Ptcp &&
+        (sp->tcpinfo = iperf_tcpinfo_ring_new(test)) == NULL)
+        warning("--tcpinfo-sample: out of memory; no samples for this stream");
+
+    /* --thread-affinity: streams take the CPUs in turn */
+    sp->thread_cpu = -1;
+    if (test->num_thread_cpus > 0) {
+        struct iperf_stream *other;
+        int n = 0;
+
+        SLIST_FOREACH(other, &test->streams, streams)
+            n++;
+        sp->thread_cpu = test->thread_cpus[n % test->num_thread_cpus];
+    }
+
     iperf_add_stream(test, sp);
 
     return sp;
@@ -4847,83 +6523,170 @@ iperf_add_stream(struct iperf_test *test, struct iperf_stream *sp)
 static int
 diskfile_send(struct iperf_stream *sp)
 {
-    int r;
-    int buffer_left = sp->diskfile_left; // represents total data in buffer to be sent out
-    static int rtot;
-
-    /* if needed, read enough data from the disk to fill up the buffer */
-    if (sp->diskfile_left < sp->test->settings->blksize && !sp->test->done) {
-    	r = read(sp->diskfile_fd, sp->buffer, sp->test->settings->blksize -
-    		 sp->diskfile_left);
-        buffer_left += r;
-    	rtot += r;
-    	if (sp->test->debug) {
-    	    printf("read %d bytes from file, %d total\n", r, rtot);
-    	}
-
-        // If the buffer doesn't contain a full buffer at this point,
-        // adjust the size of the data to send.
-        if (buffer_left != sp->test->settings->blksize) {
-            if (sp->test->debug)
-                printf("possible eof\n");
-            // setting data size to be sent,
-            // which is less than full block/buffer size
-            // (to be used by iperf_tcp_send, etc.)
-            sp->pending_size = buffer_left;
+    int blksize = sp->test->settings->blksize;
+    struct iperf_time start;
+    ssize_t r;
+    int n;
+
+    /*
+     * Only read the next block once the last one is completely on the
+     * wire.  The block always ends at the end of the buffer, because
+     * iperf_tcp_send() sends the last pending_size bytes, so a partial
+     * write needs no shifting; the file offset says where we are.
+     */
+    if (sp->pending_size == 0) {
+        if (sp->test->done)
+            return 0;
+
+        iperf_time_now(&start);
+        for (n = 0; n < blksize; n += r) {
+            r = pread(sp->diskfile_fd, sp->buffer + n, blksize - n, sp->diskfile_offset + n);
+            if (r < 0) {
+                if (errno == EINTR)
+                    r = 0;
+                else {
+                    iperf_err(sp->test, "diskfile read failed: %s", strerror(errno));
+                    return NET_HARDERROR;
+                }
+            } else if (r == 0)
+                break;
         }
+        iperf_diskfile_account(sp, &start, n);
+        sp->diskfile_offset += n;
 
-        // If there's no work left, we're done.
-        if (buffer_left == 0) {
-    	    sp->test->done = 1;
-    	    if (sp->test->debug)
-    		  printf("done\n");
-    	}
+        if (n == 0) {
+            if (sp->test->debug)
+                printf("diskfile done, %jd bytes read\n", (intmax_t) sp->diskfile_offset);
+            sp->test->done = 1;
+            return 0;
+        }
+        if (n < blksize)
+            memmove(sp->buffer + (blksize - n), sp->buffer, n);
+        sp->pending_size = n;
     }
 
-    // If there's no data left in the file or in the buffer, we're done.
-    // No more data available to be sent.
-    // Return without sending data to the network
-    if( sp->test->done || buffer_left == 0 ){
+    return sp->snd2(sp);
+}
+
+/*
+ * -F -Z on a TCP sender: hand the file itself to sendfile(), so the
+ * data never passes through user space.  The time spent includes
+ * reading the file, which can't be told apart from the send here.
+ */
+static int
+diskfile_sendfile(struct iperf_stream *sp)
+{
+    struct iperf_time start;
+    int r;
+
+    if (sp->test->done)
+        return 0;
+
+    iperf_time_now(&start);
+    r = Nsendfile_offset(sp->diskfile_fd, sp->socket, &sp->diskfile_offset, sp->test->settings->blksize);
+    if (r < 0)
+        return r;
+    iperf_diskfile_account(sp, &start, r);
+
+    if (r == 0) {
         if (sp->test->debug)
-              printf("already done\n");
+            printf("diskfile done, %jd bytes sent\n", (intmax_t) sp->diskfile_offset);
         sp->test->done = 1;
         return 0;
     }
 
-    r = sp->snd2(sp);
-    if (r < 0) {
-	return r;
-    }
-    /*
-     * Compute how much data is in the buffer but didn't get sent.
-     * If there are bytes that got left behind, slide them to the
-     * front of the buffer so they can hopefully go out on the next
-     * pass.
-     */
-    sp->diskfile_left = buffer_left - r;
-    if (sp->diskfile_left && sp->diskfile_left < sp->test->settings->blksize) {
-	memcpy(sp->buffer,
-	       sp->buffer + (sp->test->settings->blksize - sp->diskfile_left),
-	       sp->diskfile_left);
-	if (sp->test->debug)
-	    printf("Shifting %d bytes by %d\n", sp->diskfile_left, (sp->test->settings->blksize - sp->diskfile_left));
-    }
+    sp->result->bytes_sent += r;
+    sp->result->bytes_sent_this_interval += r;
     return r;
 }
 
 static int
 diskfile_recv(struct iperf_stream *sp)
 {
-    int r;
+    struct iperf_time start;
+    ssize_t w;
+    char *buf;
+    int r, n;
+
+    if (sp->diskwriter != NULL) {
+        /*
+         * Take the queue slot first: if the disk is behind, stop reading.
+         * The block is received straight into it.
+         */
+        buf = sp->buffer;
+        sp->buffer = iperf_diskwriter_get(sp->diskwriter);
+        r = sp->rcv2(sp);
+        sp->buffer = buf;
+        if (r <= 0)
+            return r;
+        if (iperf_diskwriter_put(sp->diskwriter, r) < 0) {
+            iperf_err(sp->test, "diskfile write failed: %s", strerror(errno));
+            return NET_HARDERROR;
+        }
+        return r;
+    }
 
     r = sp->rcv2(sp);
-    if (r > 0) {
-	// NOTE: Currently ignoring the return value of writing to disk
-	(void) (write(sp->diskfile_fd, sp->buffer, r) + 1);
+    if (r <= 0)
+        return r;
+
+    iperf_time_now(&start);
+    for (n = 0; n < r; n += w) {
+        w = pwrite(sp->diskfile_fd, sp->buffer + n, r - n, sp->diskfile_offset + n);
+        if (w < 0) {
+            if (errno == EINTR)
+                w = 0;
+            else {
+                iperf_err(sp->test, "diskfile write failed: %s", strerror(errno));
+                return NET_HARDERROR;
+            }
+        }
     }
+    iperf_diskfile_account(sp, &start, r);
+    sp->diskfile_offset += r;
+
     return r;
 }
 
+/*
+ * -F -Z on a TCP receiver: move the data socket -> pipe -> file with
+ * splice(), without copying it into the stream buffer.  Like
+ * Nrecv_no_select(), try to fill a whole block before returning.
+ */
+static int
+diskfile_splice_recv(struct iperf_stream *sp)
+{
+    int blksize = sp->test->settings->blksize;
+    struct iperf_time start;
+    int r, w, n, left;
+
+    for (n = 0; n < blksize; n += r) {
+        r = Nsplice(sp->socket, sp->diskfile_pipe[1], NULL, blksize - n);
+        if (r < 0)
+            return r;
+        if (r == 0)
+            break;
+
+        iperf_time_now(&start);
+        for (left = r; left > 0; left -= w) {
+            w = Nsplice(sp->diskfile_pipe[0], sp->diskfile_fd, &sp->diskfile_offset, left);
+            if (w < 0) {
+                iperf_err(sp->test, "diskfile write failed: %s", strerror(errno));
+                return NET_HARDERROR;
+            }
+        }
+        iperf_diskfile_account(sp, &start, r);
+    }
+
+    /* Only count bytes received while we're in the correct state. */
+    if (sp->test->state == TEST_RUNNING) {
+        sp->result->bytes_received += n;
+        sp->result->bytes_received_this_interval += n;
+    }
+
+    return n;
+}
+
 
 void
 iperf_catch_sigend(void (*handler)(int))
@@ -4965,6 +6728,7 @@ iperf_got_sigend(struct iperf_test *test, int sig)
 	    test->on_test_finish(test);
 	test->reporter_callback(test);
     }
+    iperf_history_end(test, 0);
 
     if (test->ctrl_sck >= 0) {
 	iperf_set_test_state(test, (test->role == 'c') ? CLIENT_TERMINATE : SERVER_TERMINATE);
@@ -5095,6 +6859,8 @@ int
 iperf_json_finish(struct iperf_test *test)
 {
     if (test->json_top) {
+        if (iperf_json_end_phase(test, 1) < 0)
+            return -1;
         if (test->title) {
             cJSON_AddStringToObject(test->json_top, "title", test->title);
         }
@@ -5157,6 +6923,7 @@ iperf_json_finish(struct iperf_test *test)
     }
 
     test->json_top = test->json_start = test->json_connected = test->json_intervals = test->json_server_output = test->json_end = NULL;
+    test->json_phases = NULL;
     return 0;
 }
 
@@ -5248,8 +7015,141 @@ iperf_clearaffinity(struct iperf_test *test)
 #endif /* neither HAVE_SCHED_SETAFFINITY nor HAVE_CPUSET_SETAFFINITY nor HAVE_SETPROCESSAFFINITYMASK */
 }
 
-static char iperf_timestr[100];
-static char linebuffer[1024];
+/*
+ * --thread-affinity: one CPU per stream worker thread, rather than -A's
+ * one CPU for the whole process.  On big.LITTLE phones the scheduler
+ * will move a busy thread to a little core mid-test; "big" orders the
+ * CPUs we may run on by their cpu_capacity, biggest first, and streams
+ * take them in turn.
+ */
+
+/* The CPU's relative capacity (1024 for the biggest), or -1 if not known */
+int
+iperf_cpu_capacity(int cpu)
+{
+    char path[80];
+    FILE *f;
+    int capacity = -1;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpu_capacity", cpu);
+    if ((f = fopen(path, "r")) == NULL)
+        return -1;
+    if (fscanf(f, "%d", &capacity) != 1)
+        capacity = -1;
+    fclose(f);
+    return capacity;
+}
+
+#if defined(HAVE_SCHED_SETAFFINITY)
+static int
+compare_cpu_capacity(const void *a, const void *b)
+{
+    const int *x = (const int *) a, *y = (const int *) b;
+
+    /* x[1], y[1] are capacities: biggest first, then by CPU number */
+    if (x[1] != y[1])
+        return y[1] - x[1];
+    return x[0] - y[0];
+}
+#endif /* HAVE_SCHED_SETAFFINITY */
+
+/*
+ * Parse --thread-affinity: "big", or a list of CPUs and ranges such as
+ * "4-7,2".  Fills test->thread_cpus.
+ */
+int
+iperf_parse_thread_affinity(struct iperf_test *test, const char *arg)
+{
+#if defined(HAVE_SCHED_SETAFFINITY)
+    int n = 0;
+
+    if (strcmp(arg, "big") == 0) {
+        cpu_set_t allowed;
+        int cpus[CPU_SETSIZE][2];
+        int cpu;
+
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+            goto bad;
+        for (cpu = 0; cpu < CPU_SETSIZE && n < MAX_THREAD_CPUS; cpu++) {
+            if (!CPU_ISSET(cpu, &allowed))
+                continue;
+            cpus[n][0] = cpu;
+            cpus[n][1] = iperf_cpu_capacity(cpu);
+            n++;
+        }
+        qsort(cpus, n, sizeof(cpus[0]), compare_cpu_capacity);
+        for (cpu = 0; cpu < n; cpu++)
+            test->thread_cpus[cpu] = cpus[cpu][0];
+    } else {
+        const char *p = arg;
+        char *end;
+        long first, last;
+
+        while (*p != '\0') {
+            first = last = strtol(p, &end, 10);
+            if (end == p)
+                goto bad;
+            if (*end == '-') {
+                p = end + 1;
+                last = strtol(p, &end, 10);
+                if (end == p)
+                    goto bad;
+            }
+            if (first < 0 || last < first || last >= CPU_SETSIZE)
+                goto bad;
+            for (; first <= last; first++) {
+                if (n == MAX_THREAD_CPUS)
+                    goto bad;
+                test->thread_cpus[n++] = (int) first;
+            }
+            if (*end == ',')
+                end++;
+            else if (*end != '\0')
+                goto bad;
+            p = end;
+        }
+    }
+    if (n == 0)
+        goto bad;
+    test->num_thread_cpus = n;
+    return 0;
+
+bad:
+#endif /* HAVE_SCHED_SETAFFINITY */
+    (void) arg;
+    test->num_thread_cpus = 0;
+    i_errno = IETHREADAFFINITY;
+    return -1;
+}
+
+/*
+ * Called on the stream's worker thread: pin it to sp->thread_cpu.  A
+ * failure is remembered in sp->thread_cpu_error, for the report, rather
+ * than ending the test.
+ */
+void
+iperf_stream_setaffinity(struct iperf_stream *sp)
+{
+#if defined(HAVE_SCHED_SETAFFINITY)
+    cpu_set_t cpu_set;
+
+    if (sp->thread_cpu < 0)
+        return;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(sp->thread_cpu, &cpu_set);
+    /* On Linux, pid 0 is the calling thread, not the whole process */
+    if (sched_setaffinity(0, sizeof(cpu_set), &cpu_set) != 0)
+        sp->thread_cpu_error = errno;
+    if (sp->test->debug_level >= DEBUG_LEVEL_INFO)
+        iperf_printf(sp->test, "Thread FD %d on CPU %d%s\n", sp->socket, sp->thread_cpu,
+                     sp->thread_cpu_error ? " failed" : "");
+#else /* HAVE_SCHED_SETAFFINITY */
+    (void) sp;
+#endif /* HAVE_SCHED_SETAFFINITY */
+}
+
+static _Thread_local char iperf_timestr[100];
+static _Thread_local char linebuffer[1024];
 
 int
 iperf_printf(struct iperf_test *test, const char* format, ...)
@@ -5330,7 +7230,11 @@ iperf_printf(struct iperf_test *test, const char* format, ...)
             }
             r += r0;
         }
-	fprintf(test->outfile, "%s", linebuffer);
+	/* --max-clients: one fprintf, so the clients' lines don't interleave */
+	if (test->server_session != NULL && test->max_clients > 1)
+	    fprintf(test->outfile, "[#%d] %s", test->server_session->id, linebuffer);
+	else
+	    fprintf(test->outfile, "%s", linebuffer);
 
 	if (test->role == 's' && iperf_get_test_get_server_output(test)) {
 	    struct iperf_textline *l = (struct iperf_textline *) malloc(sizeof(struct iperf_textline));
@@ -52,6 +52,7 @@ struct iperf_stream_result;
 struct iperf_interval_results;
 struct iperf_stream;
 struct iperf_time;
+struct iperf_ui_frame;
 
 #if !defined(__IPERF_H)
 typedef uint_fast64_t iperf_size_t;
@@ -103,6 +104,21 @@ typedef atomic_uint_fast64_t atomic_iperf_size_t;
 #define OPT_USE_PKCS1_PADDING 30
 #define OPT_CNTL_KA 31
 #define OPT_SKIP_RX_COPY 32
+#define OPT_VERIFY_PAYLOAD 33
+#define OPT_DIRECT_IO 34
+#define OPT_PERF_COUNTERS 35
+#define OPT_PACING_BUCKET 36
+#define OPT_TXTIME 37
+#define OPT_RX_TIMESTAMPS 38
+#define OPT_UDP_HISTOGRAMS 39
+#define OPT_TCPINFO_SAMPLE 40
+#define OPT_THREAD_AFFINITY 41
+#define OPT_RATE_SEARCH 42
+#define OPT_PHASES 43
+#define OPT_PHASE_GAP 44
+#define OPT_MAX_CLIENTS 45
+#define OPT_ACCEPT_THREADS 46
+#define OPT_HISTORY 47
 
 /* states */
 #define TEST_START 1
@@ -121,6 +137,8 @@ typedef atomic_uint_fast64_t atomic_iperf_size_t;
 #define DISPLAY_RESULTS 14
 #define IPERF_START 15
 #define IPERF_DONE 16
+#define RATE_FEEDBACK 17    /* --rate-search: the receiver's last interval follows, not a state change */
+#define NEXT_PHASE 18       /* --phases: the client wants another measurement on this control connection */
 #define ACCESS_DENIED (-1)
 #define SERVER_ERROR (-2)
 
@@ -146,6 +164,7 @@ FILE *iperf_get_test_outfile(struct iperf_test *ipt);
 uint64_t iperf_get_test_rate(struct iperf_test *ipt);
 
 int iperf_get_test_pacing_timer(struct iperf_test *ipt);
+int iperf_get_test_pacing_bucket(struct iperf_test *ipt);
 
 uint64_t iperf_get_test_bytes(struct iperf_test *ipt);
 
@@ -161,7 +180,20 @@ double iperf_get_test_stats_interval(struct iperf_test *ipt);
 
 int iperf_get_test_num_streams(struct iperf_test *ipt);
 
+int iperf_get_test_phases(struct iperf_test *ipt);
+
+int iperf_get_test_phase(struct iperf_test *ipt);
+
+int iperf_get_test_max_clients(struct iperf_test *ipt);
+
+int iperf_get_test_accept_threads(struct iperf_test *ipt);
+
+char* iperf_get_test_history_dir(struct iperf_test *ipt);
+
+int iperf_get_test_ui_frame_hz(struct iperf_test *ipt);
+
 int iperf_get_test_repeating_payload(struct iperf_test *ipt);
+int iperf_get_test_verify_payload(struct iperf_test *ipt);
 
 int iperf_get_test_timestamps(struct iperf_test *ipt);
 
@@ -237,6 +269,7 @@ void iperf_set_test_logfile(struct iperf_test *ipt, const char *logfile);
 void iperf_set_test_rate(struct iperf_test *ipt, uint64_t rate);
 
 void iperf_set_test_pacing_timer(struct iperf_test *ipt, int pacing_timer);
+void iperf_set_test_pacing_bucket(struct iperf_test *ipt, int pacing_bucket);
 
 void iperf_set_test_bytes(struct iperf_test *ipt, uint64_t bytes);
 
@@ -252,7 +285,18 @@ void iperf_set_test_socket_bufsize(struct iperf_test *ipt, int socket_bufsize);
 
 void iperf_set_test_num_streams(struct iperf_test *ipt, int num_streams);
 
+void iperf_set_test_phases(struct iperf_test *ipt, int phases);
+
+void iperf_set_test_phase_gap(struct iperf_test *ipt, double phase_gap);
+
+void iperf_set_test_max_clients(struct iperf_test *ipt, int max_clients);
+
+void iperf_set_test_accept_threads(struct iperf_test *ipt, int accept_threads);
+
+void iperf_set_test_history_dir(struct iperf_test *ipt, const char *dir);
+
 void iperf_set_test_repeating_payload(struct iperf_test *ipt, int repeating_payload);
+void iperf_set_test_verify_payload(struct iperf_test *ipt, int verify_payload);
 
 void iperf_set_test_timestamps(struct iperf_test *ipt, int timestamps);
 
@@ -317,6 +361,16 @@ iperf_set_on_test_connect_callback(struct iperf_test *ipt, void (*callback)(stru
 void
 iperf_set_on_test_finish_callback(struct iperf_test *ipt, void (*callback)(struct iperf_test *));
 
+/*
+ * Coalesce interval reports into at most hz frames per second of test
+ * time, each passed to callback on the reporting thread; the last, partial
+ * one when the test ends.  hz of 0 turns frames off.  Printed and JSON
+ * output are unaffected.
+ */
+void
+iperf_set_test_ui_frames(struct iperf_test *ipt, int hz,
+                         void (*callback)(struct iperf_test *, const struct iperf_ui_frame *));
+
 #if defined(HAVE_SSL)
 void    iperf_set_test_client_username(struct iperf_test *ipt, const char *client_username);
 void    iperf_set_test_client_password(struct iperf_test *ipt, const char *client_password);
@@ -353,6 +407,20 @@ void connect_msg(struct iperf_stream *sp);
  */
 void iperf_stats_callback(struct iperf_test *test);
 
+/**
+ * iperf_stream_init_cpu_clock -- find the CPU-time clock of a stream's
+ * freshly started worker thread
+ *
+ */
+void iperf_stream_init_cpu_clock(struct iperf_stream *sp);
+
+/**
+ * iperf_stream_sample_cpu -- record the CPU time used so far by a
+ * stream's worker thread; do this before cancelling the thread
+ *
+ */
+void iperf_stream_sample_cpu(struct iperf_stream *sp);
+
 /**
  * iperf_reporter_callback -- handles the report printing
  *
@@ -369,6 +437,17 @@ struct iperf_test *iperf_new_test(void);
 
 int iperf_defaults(struct iperf_test *testp);
 
+/**
+ * iperf_clone_test -- return a new iperf_test with src's options, as
+ * iperf_parse_arguments and the iperf_set_test_* calls left them, but
+ * none of its run state: to run a prepared test again without parsing
+ * it again.  src must not be running.
+ *
+ * returns NULL on failure
+ *
+ */
+struct iperf_test *iperf_clone_test(struct iperf_test *src);
+
 /**
  * iperf_free_test -- free resources used by test, calls iperf_free_stream to
  * free streams
@@ -427,9 +506,11 @@ long get_rttvar(struct iperf_interval_results *irp);
 long get_pmtu(struct iperf_interval_results *irp);
 void print_tcpinfo(struct iperf_test *test);
 void build_tcpinfo_message(struct iperf_interval_results *r, char *message);
+void get_tcp_limits_diff(const struct iperf_tcp_limits *now, const struct iperf_tcp_limits *before, struct iperf_tcp_limits *diff);
+const char *get_tcp_limits_verdict(const struct iperf_tcp_limits *l, double secs);
+cJSON *build_tcp_limits_json(const struct iperf_tcp_limits *l, double secs, int verdict);
 
 int iperf_set_send_state(struct iperf_test *test, signed char state);
-void iperf_check_throttle(struct iperf_stream *sp, struct iperf_time *nowP);
 int iperf_send_mt(struct iperf_stream *) /* __attribute__((hot)) */;
 int iperf_recv_mt(struct iperf_stream *);
 void iperf_catch_sigend(void (*handler)(int));
@@ -441,10 +522,21 @@ void warning(const char *);
 int iperf_exchange_results(struct iperf_test *);
 int iperf_init_test(struct iperf_test *);
 int iperf_create_send_timers(struct iperf_test *);
+/* --rate-search: the receiving side's report after each stats interval, and the sender's reading of it */
+int iperf_rate_search_send_feedback(struct iperf_test *test);
+int iperf_rate_search_recv_feedback(struct iperf_test *test);
 int iperf_parse_arguments(struct iperf_test *, int, char **);
 int iperf_open_logfile(struct iperf_test *);
 void iperf_close_logfile(struct iperf_test *);
 void iperf_reset_test(struct iperf_test *);
+/*
+ * --phases: end one measurement and get ready for the next on the same
+ * control connection.  Stops the stream threads, frees the streams and
+ * clears the counters, timers and results, but keeps the settings.
+ */
+int iperf_reset_phase(struct iperf_test *);
+/* The server's listener for the data connections of a new test or phase */
+int iperf_listen_streams(struct iperf_test *);
 
 void iperf_reset_stats(struct iperf_test *test);
 
@@ -469,6 +561,8 @@ int iperf_client_end(struct iperf_test *);
 int iperf_run_server(struct iperf_test *);
 int iperf_server_listen(struct iperf_test *);
 int iperf_accept(struct iperf_test *);
+/* Take s on as the control connection of a client whose cookie is in test->cookie */
+int iperf_accept_control(struct iperf_test *, int s);
 int iperf_handle_message_server(struct iperf_test *);
 int iperf_create_pidfile(struct iperf_test *);
 int iperf_delete_pidfile(struct iperf_test *);
@@ -481,6 +575,9 @@ int iperf_json_finish(struct iperf_test *);
 /* CPU affinity routines */
 int iperf_setaffinity(struct iperf_test *, int affinity);
 int iperf_clearaffinity(struct iperf_test *);
+int iperf_cpu_capacity(int cpu);
+int iperf_parse_thread_affinity(struct iperf_test *, const char *arg);
+void iperf_stream_setaffinity(struct iperf_stream *sp);
 
 /* Custom printf routine. */
 int iperf_printf(struct iperf_test *test, const char *format,
@@ -500,7 +597,7 @@ void iperf_signormalexit(struct iperf_test *test, const char *format,
 void iperf_exit(struct iperf_test *test, int exit_code, const char *format,
                 va_list argp) __attribute__ ((noreturn));
 char *iperf_strerror(int);
-extern int i_errno;
+extern _Thread_local int i_errno;
 enum {
     IENONE = 0,             // No error
     /* Parameter errors */
@@ -540,6 +637,19 @@ enum {
     IEUDPFILETRANSFER = 34, // Cannot transfer file using UDP
     IESERVERAUTHUSERS = 35,  // Cannot access authorized users file
     IECNTLKA = 36,          // Control connection Keepalive period should be larger than the full retry period (interval * count)
+    IEVERIFYPAYLOAD = 37,   // Payload verification cannot be used with -F, -Z or --skip-rx-copy
+    IEDIRECTIO = 38,        // --direct-io requires -F
+    IEPACINGBUCKET = 39,    // Invalid --pacing-bucket depth
+    IETXTIME = 40,          // --txtime needs UDP and a -b bitrate
+    IERXTIMESTAMPS = 41,    // --rx-timestamps needs UDP
+    IEUDPHISTOGRAMS = 42,   // --udp-histograms needs UDP
+    IETCPINFOSAMPLE = 43,   // Bad --tcpinfo-sample period, or no Linux TCP_INFO
+    IETHREADAFFINITY = 44,  // Bad --thread-affinity CPU list, or no sched_setaffinity()
+    IERATESEARCH = 45,      // Bad --rate-search loss, or not UDP in one direction
+    IEPHASES = 46,          // Bad --phases count or --phase-gap
+    IEMAXCLIENTS = 47,      // Bad --max-clients count
+    IEACCEPTTHREADS = 48,   // Bad --accept-threads count, or no SO_REUSEPORT
+    IEHISTORY = 49,         // --history directory isn't writable (check perror)
     /* Test errors */
     IENEWTEST = 100,        // Unable to create a new test (check perror)
     IEINITTEST = 101,       // Test initialization failed (check perror)
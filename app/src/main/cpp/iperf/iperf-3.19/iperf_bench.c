@@ -0,0 +1,364 @@
+/*
+ * Loopback benchmark for the data path.
+ *
+ * Runs an iperf client and server in one process over 127.0.0.1 for
+ * each protocol, -l length and -P stream count asked for, and prints
+ * one JSON object per run: what got through, the CPU it took (for the
+ * whole process and for the sending and receiving stream threads), and
+ * how many send and receive calls the stream threads made.  Compare the
+ * lines from two builds to see what a change did to the data path.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_util.h"
+#include "units.h"
+
+#define BENCH_PORT 5301
+#define BENCH_DURATION 2
+#define BENCH_MAX_LIST 32
+/* How long to wait for the server thread to start listening */
+#define BENCH_LISTEN_TIMEOUT_MS 5000
+
+struct bench_list {
+    int n;
+    int v[BENCH_MAX_LIST];
+};
+
+struct bench_run {
+    int protocol;               /* Ptcp or Pudp */
+    int streams;
+    int length;
+    int duration;
+    int port;
+};
+
+static void
+bench_usage(FILE *f)
+{
+    fprintf(f, "Usage: iperf_bench [-T | -u] [-t secs] [-P list] [-l list] [-p port] [-o file]\n"
+               "  -T        TCP only\n"
+               "  -u        UDP only\n"
+               "  -t secs   seconds per run (default %d)\n"
+               "  -P list   parallel streams, e.g. 1,4,16 (default 1,2,4,8,16,32,64)\n"
+               "  -l list   message lengths, e.g. 1400,128K (default 1400,8K,32K,128K);\n"
+               "            UDP skips those over %d\n"
+               "  -p port   first server port; each run takes the next (default %d)\n"
+               "  -o file   write the JSON lines to file rather than stdout\n",
+            BENCH_DURATION, MAX_UDP_BLOCKSIZE, BENCH_PORT);
+}
+
+/* A comma-separated list of positive sizes up to max, with K/M suffixes */
+static int
+parse_list(struct bench_list *list, const char *arg, iperf_size_t max)
+{
+    char *copy, *tok, *save;
+    iperf_size_t v;
+
+    copy = strdup(arg);
+    if (copy == NULL)
+        return -1;
+    list->n = 0;
+    for (tok = strtok_r(copy, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+        v = unit_atoi(tok);
+        if (v == 0 || v > max || list->n == BENCH_MAX_LIST) {
+            free(copy);
+            return -1;
+        }
+        list->v[list->n++] = (int) v;
+    }
+    free(copy);
+    return list->n > 0 ? 0 : -1;
+}
+
+static double
+wall_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double
+timeval_secs(const struct timeval *tv)
+{
+    return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+static void *
+server_thread(void *arg)
+{
+    struct iperf_test *test = arg;
+
+    if (iperf_run_server(test) < 0)
+        fprintf(stderr, "iperf_bench: server: %s\n", iperf_strerror(i_errno));
+    return NULL;
+}
+
+/* Sum of the stream threads' CPU time, in seconds */
+static double
+streams_cpu_secs(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    uint64_t usecs = 0;
+
+    SLIST_FOREACH(sp, &test->streams, streams)
+        if (sp->thread_cpu_clock_valid)
+            usecs += sp->thread_cpu_usecs;
+    return usecs / 1e6;
+}
+
+/* How long the client measured for, or the -t duration if it didn't say */
+static double
+measured_secs(struct iperf_test *test, int duration)
+{
+    struct iperf_stream *sp = SLIST_FIRST(&test->streams);
+    struct iperf_time diff;
+    double secs;
+
+    if (sp == NULL || iperf_time_diff(&sp->result->end_time, &sp->result->start_time, &diff) != 0)
+        return duration;
+    secs = iperf_time_in_secs(&diff);
+    return secs > 0 ? secs : duration;
+}
+
+static struct iperf_test *
+bench_test(char role, const struct bench_run *run, FILE *devnull)
+{
+    struct iperf_test *test;
+
+    test = iperf_new_test();
+    if (test == NULL)
+        return NULL;
+    iperf_defaults(test);
+    iperf_set_test_role(test, role);
+    iperf_set_test_server_port(test, run->port);
+    test->outfile = devnull;
+    if (role == 's') {
+        iperf_set_test_one_off(test, 1);
+    } else {
+        iperf_set_test_server_hostname(test, "127.0.0.1");
+        set_protocol(test, run->protocol);
+        iperf_set_test_duration(test, run->duration);
+        iperf_set_test_num_streams(test, run->streams);
+        iperf_set_test_blksize(test, run->length);
+        iperf_set_test_rate(test, 0);       /* as fast as it goes, UDP too */
+    }
+    return test;
+}
+
+/*
+ * One client/server run.  Prints its JSON line to out and returns 0, or
+ * prints an error line and returns -1.
+ */
+static int
+bench_run(const struct bench_run *run, FILE *out, FILE *devnull)
+{
+    struct iperf_test *server, *client;
+    struct iperf_stream *sp;
+    struct rusage ru0, ru1;
+    pthread_t thr;
+    double t0, wall, secs, user, sys;
+    int64_t packets = 0, lost = 0;
+    int waited, rc = 0;
+    cJSON *j;
+    char *str;
+
+    server = bench_test('s', run, devnull);
+    client = bench_test('c', run, devnull);
+    if (server == NULL || client == NULL) {
+        fprintf(stderr, "iperf_bench: out of memory\n");
+        exit(1);
+    }
+
+    getrusage(RUSAGE_SELF, &ru0);
+    t0 = wall_secs();
+    if (pthread_create(&thr, NULL, server_thread, server) != 0) {
+        fprintf(stderr, "iperf_bench: can't start the server thread\n");
+        exit(1);
+    }
+    /* The server says IPERF_START once it is listening */
+    for (waited = 0; __atomic_load_n(&server->state, __ATOMIC_ACQUIRE) != IPERF_START; waited++) {
+        if (waited == BENCH_LISTEN_TIMEOUT_MS) {
+            fprintf(stderr, "iperf_bench: the server didn't start listening\n");
+            exit(1);
+        }
+        usleep(1000);
+    }
+    if (iperf_run_client(client) < 0) {
+        fprintf(stderr, "iperf_bench: client: %s\n", iperf_strerror(i_errno));
+        rc = -1;
+        /* A server still waiting for the client would wait forever */
+        pthread_cancel(thr);
+    }
+    pthread_join(thr, NULL);
+    wall = wall_secs() - t0;
+    getrusage(RUSAGE_SELF, &ru1);
+
+    j = iperf_json_printf("protocol: %s  streams: %d  length: %d  duration: %d",
+                          run->protocol == Pudp ? "UDP" : "TCP",
+                          (int64_t) run->streams, (int64_t) run->length, (int64_t) run->duration);
+    if (j == NULL) {
+        fprintf(stderr, "iperf_bench: out of memory\n");
+        exit(1);
+    }
+    if (rc < 0) {
+        cJSON_AddStringToObject(j, "error", iperf_strerror(i_errno));
+    } else {
+        secs = measured_secs(client, run->duration);
+        user = timeval_secs(&ru1.ru_utime) - timeval_secs(&ru0.ru_utime);
+        sys = timeval_secs(&ru1.ru_stime) - timeval_secs(&ru0.ru_stime);
+        cJSON_AddNumberToObject(j, "seconds", secs);
+        cJSON_AddNumberToObject(j, "bytes_sent", (double) client->bytes_sent);
+        cJSON_AddNumberToObject(j, "bytes_received", (double) server->bytes_received);
+        cJSON_AddNumberToObject(j, "bits_per_second", server->bytes_received * 8.0 / secs);
+        if (run->protocol == Pudp) {
+            SLIST_FOREACH(sp, &server->streams, streams) {
+                packets += sp->packet_count;
+                lost += sp->cnt_error;
+            }
+            cJSON_AddNumberToObject(j, "lost_percent", packets > 0 ? 100.0 * lost / packets : 0.0);
+        }
+        /* Both ends share the process, so this is the CPU of the whole run */
+        cJSON_AddItemToObject(j, "cpu", iperf_json_printf("user_secs: %f  system_secs: %f  percent: %f",
+                                                          user, sys, 100.0 * (user + sys) / wall));
+        cJSON_AddNumberToObject(j, "sender_threads_cpu_percent", 100.0 * streams_cpu_secs(client) / secs);
+        cJSON_AddNumberToObject(j, "receiver_threads_cpu_percent", 100.0 * streams_cpu_secs(server) / secs);
+        /* One send() or recv() (or one batch, for --txtime) per block */
+        cJSON_AddItemToObject(j, "calls", iperf_json_printf("send: %d  recv: %d  bytes_per_send: %f  bytes_per_recv: %f",
+                                                            (int64_t) client->blocks_sent, (int64_t) server->blocks_received,
+                                                            client->blocks_sent ? (double) client->bytes_sent / client->blocks_sent : 0.0,
+                                                            server->blocks_received ? (double) server->bytes_received / server->blocks_received : 0.0));
+        cJSON_AddItemToObject(j, "context_switches", iperf_json_printf("voluntary: %d  involuntary: %d",
+                                                                       (int64_t) (ru1.ru_nvcsw - ru0.ru_nvcsw),
+                                                                       (int64_t) (ru1.ru_nivcsw - ru0.ru_nivcsw)));
+    }
+    str = cJSON_PrintUnformatted(j);
+    if (str != NULL) {
+        fprintf(out, "%s\n", str);
+        fflush(out);
+        cJSON_free(str);
+    }
+    cJSON_Delete(j);
+
+    iperf_free_test(client);
+    iperf_free_test(server);
+    return rc;
+}
+
+int
+main(int argc, char **argv)
+{
+    static const int default_streams[] = { 1, 2, 4, 8, 16, 32, 64 };
+    static const int default_lengths[] = { 1400, 8 * 1024, 32 * 1024, 128 * 1024 };
+    struct bench_list streams, lengths;
+    struct bench_run run;
+    int protocols[2] = { Ptcp, Pudp }, nprotocols = 2;
+    int port = BENCH_PORT, duration = BENCH_DURATION;
+    int p, l, s, flag, failed = 0;
+    FILE *out = stdout, *devnull;
+
+    streams.n = sizeof(default_streams) / sizeof(default_streams[0]);
+    memcpy(streams.v, default_streams, sizeof(default_streams));
+    lengths.n = sizeof(default_lengths) / sizeof(default_lengths[0]);
+    memcpy(lengths.v, default_lengths, sizeof(default_lengths));
+
+    while ((flag = getopt(argc, argv, "Tut:P:l:p:o:h")) != -1) {
+        switch (flag) {
+            case 'T':
+                protocols[0] = Ptcp;
+                nprotocols = 1;
+                break;
+            case 'u':
+                protocols[0] = Pudp;
+                nprotocols = 1;
+                break;
+            case 't':
+                duration = atoi(optarg);
+                if (duration <= 0) {
+                    bench_usage(stderr);
+                    return 1;
+                }
+                break;
+            case 'P':
+                if (parse_list(&streams, optarg, MAX_STREAMS) < 0) {
+                    bench_usage(stderr);
+                    return 1;
+                }
+                break;
+            case 'l':
+                if (parse_list(&lengths, optarg, MAX_BLOCKSIZE) < 0) {
+                    bench_usage(stderr);
+                    return 1;
+                }
+                break;
+            case 'p':
+                port = atoi(optarg);
+                if (port <= 0 || port > 65535) {
+                    bench_usage(stderr);
+                    return 1;
+                }
+                break;
+            case 'o':
+                out = fopen(optarg, "w");
+                if (out == NULL) {
+                    perror(optarg);
+                    return 1;
+                }
+                break;
+            case 'h':
+                bench_usage(stdout);
+                return 0;
+            default:
+                bench_usage(stderr);
+                return 1;
+        }
+    }
+
+    devnull = fopen("/dev/null", "w");
+    if (devnull == NULL) {
+        perror("/dev/null");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    memset(&run, 0, sizeof(run));
+    run.duration = duration;
+    run.port = port;
+    for (p = 0; p < nprotocols; p++) {
+        for (l = 0; l < lengths.n; l++) {
+            if (protocols[p] == Pudp && lengths.v[l] > MAX_UDP_BLOCKSIZE)
+                continue;
+            for (s = 0; s < streams.n; s++) {
+                run.protocol = protocols[p];
+                run.length = lengths.v[l];
+                run.streams = streams.v[s];
+                if (bench_run(&run, out, devnull) < 0)
+                    failed++;
+                /* A fresh port each run, so nothing lingering gets in the way */
+                if (++run.port > 65535)
+                    run.port = port;
+            }
+        }
+    }
+
+    if (out != stdout)
+        fclose(out);
+    fclose(devnull);
+    return failed ? 1 : 0;
+}
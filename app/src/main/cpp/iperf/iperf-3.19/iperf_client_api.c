@@ -40,10 +40,13 @@
 
 #include "iperf.h"
 #include "iperf_api.h"
+#include "iperf_history.h"
 #include "iperf_util.h"
 #include "iperf_locale.h"
 #include "iperf_time.h"
 #include "net.h"
+#include "perf_counters.h"
+#include "iperf_tcpinfo_sampler.h"
 #include "timer.h"
 
 #if defined(HAVE_TCP_CONGESTION)
@@ -78,6 +81,11 @@ iperf_client_worker_run(void *s) {
     pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
     pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
 
+    /* Affinity and counters belong to the calling thread, so set them up here */
+    iperf_stream_setaffinity(sp);
+    if (test->perf_counters)
+        perf_counters_open(sp);
+
     while (!(test->done) && !(sp->done)) {
         if (sp->sender) {
             if (iperf_send_mt(sp) < 0) {
@@ -192,6 +200,9 @@ client_stats_timer_proc(TimerClientData client_data, struct iperf_time *nowP) {
         return;
     if (test->stats_callback)
         test->stats_callback(test);
+    /* A lost control connection shows up in the main loop */
+    if (test->rate_search_loss >= 0 && test->mode == RECEIVER)
+        (void) iperf_rate_search_send_feedback(test);
 }
 
 static void
@@ -293,10 +304,56 @@ create_client_omit_timer(struct iperf_test *test) {
     return 0;
 }
 
+/*
+ * --phases: show this phase's summary, wait out the gap, and ask the
+ * server for the next phase on the same control connection.  The
+ * settings stay as they are; only the data connections are made again.
+ */
+static int
+iperf_client_next_phase(struct iperf_test *test) {
+    struct iperf_stream *sp;
+    struct timeval tv;
+    fd_set read_set;
+    int rc;
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+        close(sp->socket);
+    }
+    test->reporter_callback(test);
+    iflush(test);
+    iperf_history_end(test, 1);
+
+    if (iperf_reset_phase(test) < 0)
+        return -1;
+
+    /*
+     * Nothing should come from the server during the gap.  If something
+     * does, or the socket is shut down to stop the test, leave it for
+     * the main loop to read.
+     */
+    if (test->phase_gap > 0) {
+        FD_ZERO(&read_set);
+        FD_SET(test->ctrl_sck, &read_set);
+        tv.tv_sec = (time_t) test->phase_gap;
+        tv.tv_usec = (suseconds_t) ((test->phase_gap - tv.tv_sec) * 1000000);
+        do {
+            rc = select(test->ctrl_sck + 1, &read_set, NULL, NULL, &tv);
+        } while (rc < 0 && errno == EINTR);
+        if (rc != 0)
+            return 0;
+    }
+
+    cpu_util(NULL);
+    if (iperf_set_send_state(test, NEXT_PHASE) != 0)
+        return -1;
+    return 0;
+}
+
 int
 iperf_handle_message_client(struct iperf_test *test) {
     int rval;
     int32_t err;
+    signed char state;
 
     if (NULL == test) {
         iperf_err(NULL, "No test\n");
@@ -310,7 +367,7 @@ iperf_handle_message_client(struct iperf_test *test) {
     }
 
     /*!!! Why is this read() and not Nread()? */
-    if ((rval = read(test->ctrl_sck, (char *) &test->state, sizeof(signed char))) <= 0) {
+    if ((rval = read(test->ctrl_sck, (char *) &state, sizeof(signed char))) <= 0) {
         if (rval == 0) {
             i_errno = IECTRLCLOSE;
             return -1;
@@ -319,6 +376,9 @@ iperf_handle_message_client(struct iperf_test *test) {
             return -1;
         }
     }
+    if (state == RATE_FEEDBACK)
+        return iperf_rate_search_recv_feedback(test);
+    test->state = state;
 
     if (test->debug_level >= DEBUG_LEVEL_INFO) {
         iperf_printf(test, "State change: client received and changed State to %d-%s\n",
@@ -361,7 +421,11 @@ iperf_handle_message_client(struct iperf_test *test) {
         case DISPLAY_RESULTS:
             if (test->on_test_finish)
                 test->on_test_finish(test);
-            iperf_client_end(test);
+            if (test->phase < test->phases) {
+                if (iperf_client_next_phase(test) < 0)
+                    return -1;
+            } else
+                iperf_client_end(test);
             break;
         case IPERF_DONE:
             break;
@@ -587,6 +651,9 @@ iperf_run_client(struct iperf_test *test) {
         if (iperf_json_start(test) < 0)
             return -1;
 
+    /* A client that never gets to run a test is in the history too */
+    iperf_history_begin(test);
+
     if (test->json_output) {
         cJSON_AddItemToObject(test->json_start, "version", cJSON_CreateString(version));
         cJSON_AddItemToObject(test->json_start, "system_info",
@@ -606,7 +673,7 @@ iperf_run_client(struct iperf_test *test) {
     cpu_util(NULL);
     if (test->mode != SENDER)
         rcv_timeout_us =
-                (test->settings->rcv_timeout.secs * SEC_TO_US) + test->settings->rcv_timeout.usecs;
+                (test->settings->rcv_timeout.secs * SEC_TO_US) + test->settings->rcv_timeout.nsecs / 1000;
     else
         rcv_timeout_us = 0;
 
@@ -634,7 +701,7 @@ iperf_run_client(struct iperf_test *test) {
             }
             if (timeout_us < 0 || timeout_us > rcv_timeout_us) {
                 used_timeout.tv_sec = test->settings->rcv_timeout.secs;
-                used_timeout.tv_usec = test->settings->rcv_timeout.usecs;
+                used_timeout.tv_usec = test->settings->rcv_timeout.nsecs / 1000;
             }
             timeout = &used_timeout;
         }
@@ -687,6 +754,13 @@ iperf_run_client(struct iperf_test *test) {
                     goto cleanup_and_fail;
                 }
                 FD_CLR(test->ctrl_sck, &read_set);
+
+                /* --phases: the next one starts its threads afresh */
+                if (test->state == NEXT_PHASE) {
+                    startup = 1;
+                    last_receive_blocks = 0;
+                    last_receive_time = now;
+                }
             }
         }
 
@@ -709,6 +783,7 @@ iperf_run_client(struct iperf_test *test) {
                         goto cleanup_and_fail;
                     }
                     sp->thread_created = 1;
+                    iperf_stream_init_cpu_clock(sp);
                     if (test->debug_level >= DEBUG_LEVEL_INFO) {
                         iperf_printf(test, "Thread FD %d created\n", sp->socket);
                     }
@@ -716,6 +791,8 @@ iperf_run_client(struct iperf_test *test) {
                 if (test->debug_level >= DEBUG_LEVEL_INFO) {
                     iperf_printf(test, "All threads created\n");
                 }
+                if (test->tcpinfo_sample_ms > 0 && iperf_tcpinfo_sampler_start(test) < 0)
+                    warning("--tcpinfo-sample: unable to start the sampling thread");
                 if (pthread_attr_destroy(&attr) != 0) {
                     i_errno = IEPTHREADATTRDESTROY;
                     goto cleanup_and_fail;
@@ -749,6 +826,8 @@ iperf_run_client(struct iperf_test *test) {
                         int rc;
                         sp->done = 1;
                         if (sp->thread_created == 1) {
+                            /* Last look at the thread's CPU time for the final stats */
+                            iperf_stream_sample_cpu(sp);
                             rc = pthread_cancel(sp->thr);
                             if (rc != 0 && rc != ESRCH) {
                                 i_errno = IEPTHREADCANCEL;
@@ -777,6 +856,7 @@ iperf_run_client(struct iperf_test *test) {
                 }
 
                 /* Yes, done!  Send TEST_END. */
+                iperf_tcpinfo_sampler_stop(test);
                 test->done = 1;
                 cpu_util(test->cpu_util);
                 test->stats_callback(test);
@@ -826,6 +906,7 @@ iperf_run_client(struct iperf_test *test) {
         iperf_printf(test, "\n");
         iperf_printf(test, "%s", report_done);
     }
+    iperf_history_end(test, 1);
 
     iflush(test);
 
@@ -834,6 +915,7 @@ iperf_run_client(struct iperf_test *test) {
     cleanup_and_fail:
     /* Cancel all outstanding threads */
     i_errno_save = i_errno;
+    iperf_tcpinfo_sampler_stop(test);
     SLIST_FOREACH(sp, &test->streams, streams) {
         if (sp->done) {
             continue;
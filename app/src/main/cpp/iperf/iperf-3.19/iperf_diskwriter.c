@@ -0,0 +1,252 @@
+/*
+ * Asynchronous file writer for -F on the receiving side.
+ *
+ * Writing the file on the stream's receive thread means a slow disk
+ * (budget phone flash, say) stops us reading the socket, the TCP window
+ * closes and the disk's speed gets reported as the network's.  Instead
+ * the receive thread only receives each block into a queue and a writer
+ * thread per stream puts it on disk.  How full the queue gets, and how
+ * long the receive thread had to wait for room in it, show which of the
+ * two was the bottleneck.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_diskwriter.h"
+
+void
+iperf_diskfile_account(struct iperf_stream *sp, struct iperf_time *start, int bytes)
+{
+    struct iperf_time now, temp_time;
+    uint64_t usecs;
+
+    iperf_time_now(&now);
+    iperf_time_diff(&now, start, &temp_time);
+    usecs = iperf_time_in_usecs(&temp_time);
+
+    /* Maybe on the writer thread, while the stats timer reads these */
+    __atomic_add_fetch(&sp->diskfile_usecs, usecs, __ATOMIC_RELAXED);
+    if (usecs > __atomic_load_n(&sp->diskfile_max_usecs, __ATOMIC_RELAXED))
+        __atomic_store_n(&sp->diskfile_max_usecs, usecs, __ATOMIC_RELAXED);
+    if (usecs >= DISKFILE_STALL_USECS) {
+        __atomic_add_fetch(&sp->diskfile_stalls, 1, __ATOMIC_RELAXED);
+        if (sp->test->debug_level >= DEBUG_LEVEL_INFO)
+            iperf_printf(sp->test, "diskfile stall: %.3f ms on stream %d\n",
+                         usecs / 1000.0, sp->socket);
+    }
+    if (bytes > 0)
+        __atomic_add_fetch(&sp->diskfile_bytes, bytes, __ATOMIC_RELAXED);
+}
+
+#if defined(O_DIRECT)
+/* Stop using O_DIRECT on this file; the rest goes through the page cache. */
+static void
+diskwriter_drop_direct(struct iperf_diskwriter *dw, const char *why)
+{
+    int flags;
+
+    dw->direct = 0;
+    if ((flags = fcntl(dw->fd, F_GETFL)) >= 0)
+        (void) fcntl(dw->fd, F_SETFL, flags & ~O_DIRECT);
+    if (dw->sp->test->debug_level >= DEBUG_LEVEL_INFO)
+        iperf_printf(dw->sp->test, "diskfile: direct I/O off for stream %d: %s\n",
+                     dw->sp->socket, why);
+}
+#endif /* O_DIRECT */
+
+static int
+diskwriter_write(struct iperf_diskwriter *dw, const char *buf, int len)
+{
+    ssize_t w;
+    int n;
+
+#if defined(O_DIRECT)
+    /* O_DIRECT wants aligned offsets and lengths; a short block ends that */
+    if (dw->direct && (len % DISKWRITER_ALIGN != 0 || dw->offset % DISKWRITER_ALIGN != 0))
+        diskwriter_drop_direct(dw, "unaligned block");
+#endif /* O_DIRECT */
+
+    for (n = 0; n < len; n += w) {
+        w = pwrite(dw->fd, buf + n, len - n, dw->offset + n);
+        if (w < 0) {
+            if (errno == EINTR) {
+                w = 0;
+                continue;
+            }
+#if defined(O_DIRECT)
+            if (errno == EINVAL && dw->direct) {
+                diskwriter_drop_direct(dw, strerror(errno));
+                w = 0;
+                continue;
+            }
+#endif /* O_DIRECT */
+            return -1;
+        }
+    }
+    dw->offset += len;
+    return 0;
+}
+
+static void *
+diskwriter_run(void *arg)
+{
+    struct iperf_diskwriter *dw = arg;
+    struct iperf_time start;
+    char *buf;
+    int len;
+
+    for (;;) {
+        while (sem_wait(&dw->used_slots) < 0 && errno == EINTR)
+            ;
+        /* A wake-up with nothing queued is iperf_diskwriter_free() */
+        if (__atomic_load_n(&dw->queued_blocks, __ATOMIC_ACQUIRE) == 0)
+            break;
+
+        buf = dw->buffers + (size_t) dw->tail * dw->blksize;
+        len = dw->lengths[dw->tail];
+
+        /* After a failure keep draining, so the receive thread can't hang */
+        if (!dw->error) {
+            iperf_time_now(&start);
+            if (diskwriter_write(dw, buf, len) < 0)
+                dw->error = errno;
+            else
+                iperf_diskfile_account(dw->sp, &start, len);
+        }
+
+        dw->tail = (dw->tail + 1) % dw->slots;
+        __atomic_sub_fetch(&dw->queued_bytes, len, __ATOMIC_RELAXED);
+        __atomic_sub_fetch(&dw->queued_blocks, 1, __ATOMIC_RELEASE);
+        sem_post(&dw->free_slots);
+
+        /*
+         * Also stop once drained after iperf_diskwriter_free(): if the
+         * receive thread was cancelled between queueing a block and
+         * posting it, the wake-up meant to stop us was spent on it.
+         */
+        if (__atomic_load_n(&dw->stopping, __ATOMIC_ACQUIRE) &&
+            __atomic_load_n(&dw->queued_blocks, __ATOMIC_ACQUIRE) == 0)
+            break;
+    }
+    return NULL;
+}
+
+struct iperf_diskwriter *
+iperf_diskwriter_new(struct iperf_stream *sp, int direct)
+{
+    struct iperf_diskwriter *dw;
+    void *buffers;
+
+    dw = (struct iperf_diskwriter *) calloc(1, sizeof(struct iperf_diskwriter));
+    if (dw == NULL)
+        return NULL;
+
+    dw->sp = sp;
+    dw->fd = sp->diskfile_fd;
+    dw->blksize = sp->settings->blksize;
+    dw->offset = sp->diskfile_offset;
+    dw->direct = direct;
+    dw->slots = DISKWRITER_QUEUE_BYTES / dw->blksize;
+    if (dw->slots < DISKWRITER_MIN_SLOTS)
+        dw->slots = DISKWRITER_MIN_SLOTS;
+
+    if (posix_memalign(&buffers, DISKWRITER_ALIGN, (size_t) dw->slots * dw->blksize) != 0) {
+        free(dw);
+        return NULL;
+    }
+    dw->buffers = buffers;
+    dw->lengths = (int *) calloc(dw->slots, sizeof(int));
+    if (dw->lengths == NULL)
+        goto fail_buffers;
+
+    if (sem_init(&dw->free_slots, 0, dw->slots) < 0)
+        goto fail_lengths;
+    if (sem_init(&dw->used_slots, 0, 0) < 0)
+        goto fail_free_sem;
+    if (pthread_create(&dw->thread, NULL, diskwriter_run, dw) != 0)
+        goto fail_used_sem;
+
+    return dw;
+
+fail_used_sem:
+    sem_destroy(&dw->used_slots);
+fail_free_sem:
+    sem_destroy(&dw->free_slots);
+fail_lengths:
+    free(dw->lengths);
+fail_buffers:
+    free(dw->buffers);
+    free(dw);
+    return NULL;
+}
+
+char *
+iperf_diskwriter_get(struct iperf_diskwriter *dw)
+{
+    struct iperf_time start, now, temp_time;
+
+    if (!dw->reserved) {
+        /* Only a full ring makes us wait, and that is the disk's fault */
+        if (sem_trywait(&dw->free_slots) < 0) {
+            iperf_time_now(&start);
+            while (sem_wait(&dw->free_slots) < 0 && errno == EINTR)
+                ;
+            iperf_time_now(&now);
+            iperf_time_diff(&now, &start, &temp_time);
+            __atomic_add_fetch(&dw->wait_usecs, iperf_time_in_usecs(&temp_time), __ATOMIC_RELAXED);
+        }
+        dw->reserved = 1;
+    }
+    return dw->buffers + (size_t) dw->head * dw->blksize;
+}
+
+int
+iperf_diskwriter_put(struct iperf_diskwriter *dw, int len)
+{
+    int queued;
+
+    if (dw->error) {
+        errno = dw->error;
+        return -1;
+    }
+
+    dw->lengths[dw->head] = len;
+    dw->head = (dw->head + 1) % dw->slots;
+    dw->reserved = 0;
+
+    __atomic_add_fetch(&dw->queued_bytes, len, __ATOMIC_RELAXED);
+    queued = __atomic_add_fetch(&dw->queued_blocks, 1, __ATOMIC_RELEASE);
+    if (queued > __atomic_load_n(&dw->max_queued_blocks, __ATOMIC_RELAXED))
+        __atomic_store_n(&dw->max_queued_blocks, queued, __ATOMIC_RELAXED);
+    if (queued > dw->peak_queued_blocks)
+        __atomic_store_n(&dw->peak_queued_blocks, queued, __ATOMIC_RELAXED);
+    sem_post(&dw->used_slots);
+    return 0;
+}
+
+void
+iperf_diskwriter_free(struct iperf_diskwriter *dw)
+{
+    /* The receive thread is gone; one extra post wakes the writer to exit */
+    __atomic_store_n(&dw->stopping, 1, __ATOMIC_RELEASE);
+    sem_post(&dw->used_slots);
+    pthread_join(dw->thread, NULL);
+
+    dw->sp->diskfile_offset = dw->offset;
+    sem_destroy(&dw->used_slots);
+    sem_destroy(&dw->free_slots);
+    free(dw->lengths);
+    free(dw->buffers);
+    free(dw);
+}
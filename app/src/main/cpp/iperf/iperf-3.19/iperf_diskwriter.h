@@ -0,0 +1,87 @@
+/*
+ * Asynchronous file writer for -F on the receiving side.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_DISKWRITER_H
+#define __IPERF_DISKWRITER_H
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "iperf.h"
+#include "iperf_time.h"
+
+/* Buffer alignment, and the size multiple O_DIRECT writes need */
+#define DISKWRITER_ALIGN 4096
+
+/* Memory queued per stream between the receive thread and the disk */
+#define DISKWRITER_QUEUE_BYTES (4 * 1024 * 1024)
+#define DISKWRITER_MIN_SLOTS 4
+
+/*
+ * The receive thread fills block buffers and the writer thread drains
+ * them, in order, through a single-producer/single-consumer ring.  Each
+ * index is only ever advanced by its own side, and the two semaphores
+ * both count the slots and order the hand-over, so neither side takes a
+ * lock; they only sleep when the ring is full or empty.
+ */
+struct iperf_diskwriter {
+    struct iperf_stream *sp;
+    int fd;
+    int blksize;
+    int slots;                  /* ring size, in blocks */
+    char *buffers;              /* slots * blksize, DISKWRITER_ALIGN aligned */
+    int *lengths;               /* bytes queued in each slot */
+    int head;                   /* next slot to fill, producer only */
+    int tail;                   /* next slot to write, writer only */
+    int reserved;               /* producer holds slot head */
+    off_t offset;               /* file offset, writer only */
+    int direct;                 /* writes are still going out with O_DIRECT */
+    volatile int error;         /* errno of the first failed write */
+    int stopping;               /* set by iperf_diskwriter_free() */
+
+    sem_t free_slots;
+    sem_t used_slots;
+    pthread_t thread;
+
+    /* Statistics; updated with __atomic builtins, read by the main thread */
+    int queued_blocks;          /* blocks waiting for the disk */
+    int queued_bytes;
+    int max_queued_blocks;      /* high-water mark since the last interval */
+    int peak_queued_blocks;     /* high-water mark for the whole test */
+    uint64_t wait_usecs;        /* receive thread blocked on a full ring */
+};
+
+/*
+ * Count one file read or write against the stream's disk statistics:
+ * bytes moved, time blocked and, if it took DISKFILE_STALL_USECS or
+ * longer, a stall.
+ */
+void iperf_diskfile_account(struct iperf_stream *sp, struct iperf_time *start, int bytes);
+
+/*
+ * Start a writer thread that appends to sp->diskfile_fd from the current
+ * offset.  With direct, the file is expected to be open with O_DIRECT;
+ * the writer falls back to buffered writes if a block can't be written
+ * that way.  Returns NULL on failure.
+ */
+struct iperf_diskwriter *iperf_diskwriter_new(struct iperf_stream *sp, int direct);
+
+/*
+ * Producer side, called from the stream's receive thread only.
+ * iperf_diskwriter_get() returns a free block buffer, waiting for the
+ * writer if the queue is full; calling it again without a put in between
+ * returns the same buffer.  iperf_diskwriter_put() queues len bytes of
+ * it and returns -1 (with errno set) once a write has failed.
+ */
+char *iperf_diskwriter_get(struct iperf_diskwriter *dw);
+int iperf_diskwriter_put(struct iperf_diskwriter *dw, int len);
+
+/* Write out everything still queued, stop the thread and free dw. */
+void iperf_diskwriter_free(struct iperf_diskwriter *dw);
+
+#endif /* __IPERF_DISKWRITER_H */
@@ -32,10 +32,11 @@
 #include <stdarg.h>
 #include "iperf.h"
 #include "iperf_api.h"
+#include "iperf_history.h"
 
-int gerror;
+_Thread_local int gerror;
 
-char iperf_timestrerr[100];
+_Thread_local char iperf_timestrerr[100];
 
 /* Do a printf to stderr. */
 void
@@ -147,16 +148,18 @@ iperf_exit(struct iperf_test *test, int exit_code, const char *format, va_list a
     }
 
     va_end(argp);
-    if (test)
+    if (test) {
+        iperf_history_end(test, 0);
         iperf_delete_pidfile(test);
+    }
     exit(exit_code);
 }
 
-int i_errno;
+_Thread_local int i_errno;
 
 char *
 iperf_strerror(int int_errno) {
-    static char errstr[256];
+    static _Thread_local char errstr[256];
     int len, perr, herr;
     perr = herr = 0;
 
@@ -399,6 +402,46 @@ iperf_strerror(int int_errno) {
         case IEUDPFILETRANSFER:
             snprintf(errstr, len, "cannot transfer file using UDP");
             break;
+        case IEVERIFYPAYLOAD:
+            snprintf(errstr, len, "payload verification cannot be used with a file transfer (-F), zerocopy (-Z) or --skip-rx-copy");
+            break;
+        case IEDIRECTIO:
+            snprintf(errstr, len, "--direct-io requires a file (-F)");
+            break;
+        case IEPACINGBUCKET:
+            snprintf(errstr, len, "--pacing-bucket must be a positive number of bytes");
+            break;
+        case IETXTIME:
+            snprintf(errstr, len, "--txtime requires UDP (-u) and a non-zero bitrate (-b)");
+            break;
+        case IERXTIMESTAMPS:
+            snprintf(errstr, len, "--rx-timestamps requires UDP (-u)");
+            break;
+        case IEUDPHISTOGRAMS:
+            snprintf(errstr, len, "--udp-histograms requires UDP (-u)");
+            break;
+        case IETHREADAFFINITY:
+            snprintf(errstr, len, "--thread-affinity takes \"big\" or a list of CPUs such as 4-7,2, and requires sched_setaffinity()");
+            break;
+        case IETCPINFOSAMPLE:
+            snprintf(errstr, len, "--tcpinfo-sample takes 1 to %d ms, and requires TCP and Linux TCP_INFO", TCPINFO_SAMPLE_MAX_MS);
+            break;
+        case IERATESEARCH:
+            snprintf(errstr, len, "--rate-search takes a loss percentage from 0 to 100, and requires UDP in one direction with an interval (-i) and without --txtime");
+            break;
+        case IEPHASES:
+            snprintf(errstr, len, "--phases takes 1 to %d, and --phase-gap 0 to %d seconds between two or more phases", MAX_PHASES, MAX_PHASE_GAP);
+            break;
+        case IEMAXCLIENTS:
+            snprintf(errstr, len, "--max-clients takes 1 to %d", MAX_SERVER_SESSIONS);
+            break;
+        case IEACCEPTTHREADS:
+            snprintf(errstr, len, "--accept-threads takes 1 to %d, and needs SO_REUSEPORT", MAX_ACCEPT_THREADS);
+            break;
+        case IEHISTORY:
+            snprintf(errstr, len, "unable to write to the --history directory");
+            perr = 1;
+            break;
         case IERVRSONLYRCVTIMEOUT:
             snprintf(errstr, len, "client receive timeout is valid only in receiving mode");
             perr = 1;
@@ -0,0 +1,237 @@
+/*
+ * Log-bucketed (HDR-style) histograms for --udp-histograms.
+ *
+ * The smoothed jitter (jitter += (|d| - jitter) / 16) says little about
+ * the tail, which is what decides whether a voice call survives.  Each
+ * UDP receiver can also count every transit-time change and inter-arrival
+ * gap in a histogram whose buckets grow with the value, so a few thousand
+ * of them cover nanoseconds to a minute at 1.6% resolution.  Counting is
+ * an index computation and a store; intervals and the -O period are done
+ * by subtracting copies, and histograms of several streams just add up.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "iperf.h"
+#include "iperf_util.h"
+#include "iperf_histogram.h"
+
+/* The middle of a bucket, in ns */
+static uint64_t
+histogram_value(int index)
+{
+    int shift, sub;
+
+    if (index < (1 << HISTOGRAM_SUB_BITS))
+        return index;
+    shift = (index - (1 << HISTOGRAM_SUB_BITS)) / (1 << (HISTOGRAM_SUB_BITS - 1)) + 1;
+    sub = (index - (1 << HISTOGRAM_SUB_BITS)) % (1 << (HISTOGRAM_SUB_BITS - 1)) + (1 << (HISTOGRAM_SUB_BITS - 1));
+    return ((uint64_t) sub << shift) + (1ULL << (shift - 1));
+}
+
+void
+iperf_histogram_copy(struct iperf_histogram *dst, const struct iperf_histogram *src)
+{
+    int i;
+
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+        dst->buckets[i] = __atomic_load_n(&src->buckets[i], __ATOMIC_RELAXED);
+}
+
+void
+iperf_histogram_merge(struct iperf_histogram *dst, const struct iperf_histogram *src)
+{
+    int i;
+
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+        dst->buckets[i] += src->buckets[i];
+}
+
+uint64_t
+iperf_histogram_count(const struct iperf_histogram *h)
+{
+    uint64_t n = 0;
+    int i;
+
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+        n += h->buckets[i];
+    return n;
+}
+
+uint64_t
+iperf_histogram_percentile(const struct iperf_histogram *h, double percentile)
+{
+    uint64_t n, rank, seen = 0;
+    int i;
+
+    n = iperf_histogram_count(h);
+    if (n == 0)
+        return 0;
+    /* The rank of the value wanted, from 1 to n */
+    rank = (uint64_t) (percentile / 100.0 * n + 0.5);
+    if (rank < 1)
+        rank = 1;
+    if (rank > n)
+        rank = n;
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank)
+            return histogram_value(i);
+    }
+    return histogram_value(HISTOGRAM_BUCKETS - 1);
+}
+
+cJSON *
+iperf_histogram_json(const struct iperf_histogram *h)
+{
+    uint64_t n = iperf_histogram_count(h);
+    cJSON *j;
+
+    j = iperf_json_printf("count: %d", (int64_t) n);
+    if (j != NULL && n > 0) {
+        cJSON_AddNumberToObject(j, "p50_us", iperf_histogram_percentile(h, 50.0) / 1000.0);
+        cJSON_AddNumberToObject(j, "p90_us", iperf_histogram_percentile(h, 90.0) / 1000.0);
+        cJSON_AddNumberToObject(j, "p99_us", iperf_histogram_percentile(h, 99.0) / 1000.0);
+        cJSON_AddNumberToObject(j, "p99_9_us", iperf_histogram_percentile(h, 99.9) / 1000.0);
+        cJSON_AddNumberToObject(j, "max_us", iperf_histogram_percentile(h, 100.0) / 1000.0);
+    }
+    return j;
+}
+
+struct iperf_udp_histograms *
+iperf_udp_histograms_new(void)
+{
+    return (struct iperf_udp_histograms *) calloc(1, sizeof(struct iperf_udp_histograms));
+}
+
+static void
+histogram_interval(struct iperf_histogram *interval, struct iperf_histogram *last, const struct iperf_histogram *total)
+{
+    uint64_t now;
+    int i;
+
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        now = __atomic_load_n(&total->buckets[i], __ATOMIC_RELAXED);
+        interval->buckets[i] = now - last->buckets[i];
+        last->buckets[i] = now;
+    }
+}
+
+void
+iperf_udp_histograms_interval(struct iperf_udp_histograms *hs)
+{
+    histogram_interval(&hs->interval.transit_delta, &hs->last.transit_delta, &hs->total.transit_delta);
+    histogram_interval(&hs->interval.interarrival, &hs->last.interarrival, &hs->total.interarrival);
+}
+
+void
+iperf_udp_histograms_omit(struct iperf_udp_histograms *hs)
+{
+    iperf_histogram_copy(&hs->omitted.transit_delta, &hs->total.transit_delta);
+    iperf_histogram_copy(&hs->omitted.interarrival, &hs->total.interarrival);
+}
+
+static void
+histogram_result(struct iperf_histogram *result, const struct iperf_histogram *total, const struct iperf_histogram *omitted)
+{
+    int i;
+
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+        result->buckets[i] = __atomic_load_n(&total->buckets[i], __ATOMIC_RELAXED) - omitted->buckets[i];
+}
+
+void
+iperf_udp_histograms_result(struct iperf_udp_histograms *hs, struct iperf_udp_histogram_set *result)
+{
+    histogram_result(&result->transit_delta, &hs->total.transit_delta, &hs->omitted.transit_delta);
+    histogram_result(&result->interarrival, &hs->total.interarrival, &hs->omitted.interarrival);
+}
+
+void
+iperf_udp_histogram_set_merge(struct iperf_udp_histogram_set *dst, const struct iperf_udp_histogram_set *src)
+{
+    iperf_histogram_merge(&dst->transit_delta, &src->transit_delta);
+    iperf_histogram_merge(&dst->interarrival, &src->interarrival);
+}
+
+cJSON *
+iperf_udp_histogram_set_json(const struct iperf_udp_histogram_set *set)
+{
+    cJSON *j;
+
+    j = cJSON_CreateObject();
+    if (j == NULL)
+        return NULL;
+    cJSON_AddItemToObject(j, "transit_delta", iperf_histogram_json(&set->transit_delta));
+    cJSON_AddItemToObject(j, "interarrival", iperf_histogram_json(&set->interarrival));
+    return j;
+}
+
+static cJSON *
+histogram_to_results(const struct iperf_histogram *h)
+{
+    cJSON *j, *pair;
+    int i;
+
+    j = cJSON_CreateArray();
+    if (j == NULL)
+        return NULL;
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        if (h->buckets[i] == 0)
+            continue;
+        pair = cJSON_CreateArray();
+        if (pair == NULL)
+            break;
+        cJSON_AddItemToArray(pair, cJSON_CreateNumber(i));
+        cJSON_AddItemToArray(pair, cJSON_CreateNumber((double) h->buckets[i]));
+        cJSON_AddItemToArray(j, pair);
+    }
+    return j;
+}
+
+static int
+histogram_from_results(struct iperf_histogram *h, cJSON *j)
+{
+    cJSON *pair, *index, *count;
+
+    if (j == NULL || !cJSON_IsArray(j))
+        return -1;
+    memset(h, 0, sizeof(*h));
+    cJSON_ArrayForEach(pair, j) {
+        index = cJSON_GetArrayItem(pair, 0);
+        count = cJSON_GetArrayItem(pair, 1);
+        if (index == NULL || count == NULL || !cJSON_IsNumber(index) || !cJSON_IsNumber(count) ||
+            index->valueint < 0 || index->valueint >= HISTOGRAM_BUCKETS)
+            return -1;
+        h->buckets[index->valueint] = (uint64_t) count->valuedouble;
+    }
+    return 0;
+}
+
+cJSON *
+iperf_udp_histogram_set_to_results(const struct iperf_udp_histogram_set *set)
+{
+    cJSON *j;
+
+    j = cJSON_CreateObject();
+    if (j == NULL)
+        return NULL;
+    cJSON_AddItemToObject(j, "transit_delta", histogram_to_results(&set->transit_delta));
+    cJSON_AddItemToObject(j, "interarrival", histogram_to_results(&set->interarrival));
+    return j;
+}
+
+int
+iperf_udp_histogram_set_from_results(struct iperf_udp_histogram_set *set, cJSON *j)
+{
+    if (histogram_from_results(&set->transit_delta, cJSON_GetObjectItem(j, "transit_delta")) < 0 ||
+        histogram_from_results(&set->interarrival, cJSON_GetObjectItem(j, "interarrival")) < 0)
+        return -1;
+    return 0;
+}
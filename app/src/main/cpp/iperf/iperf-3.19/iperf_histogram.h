@@ -0,0 +1,101 @@
+/*
+ * Log-bucketed (HDR-style) histograms for --udp-histograms.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_HISTOGRAM_H
+#define __IPERF_HISTOGRAM_H
+
+#include <stdint.h>
+
+#include "iperf_time.h"
+#include "cjson.h"
+
+/*
+ * Values below 2^HISTOGRAM_SUB_BITS ns get a bucket each; every power of
+ * two above that is split into 2^(HISTOGRAM_SUB_BITS - 1) buckets, so a
+ * value is known to within 1/64 (1.6%).  Values of 2^HISTOGRAM_MAX_BITS
+ * ns (about 69 s) or more are counted in the last bucket.
+ */
+#define HISTOGRAM_SUB_BITS 7
+#define HISTOGRAM_MAX_BITS 36
+#define HISTOGRAM_BUCKETS ((1 << HISTOGRAM_SUB_BITS) + \
+                           (HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS) * (1 << (HISTOGRAM_SUB_BITS - 1)))
+
+struct iperf_histogram {
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+};
+
+/* What one UDP receiver saw, or several merged */
+struct iperf_udp_histogram_set {
+    struct iperf_histogram transit_delta;   /* change in transit time, what the jitter smooths */
+    struct iperf_histogram interarrival;    /* time between packets arriving */
+};
+
+struct iperf_udp_histograms {
+    struct iperf_udp_histogram_set total;       /* receiving thread, or the peer's results */
+    struct iperf_udp_histogram_set last;        /* main thread: total at the last interval */
+    struct iperf_udp_histogram_set interval;    /* main thread: the last interval alone */
+    struct iperf_udp_histogram_set omitted;     /* main thread: total at the end of -O */
+    struct iperf_time prev_arrival;             /* receiving thread */
+};
+
+static inline int
+iperf_histogram_index(uint64_t value)
+{
+    int shift;
+
+    if (value < (1 << HISTOGRAM_SUB_BITS))
+        return (int) value;
+    if (value >= (1ULL << HISTOGRAM_MAX_BITS))
+        return HISTOGRAM_BUCKETS - 1;
+    /* Keep the top HISTOGRAM_SUB_BITS bits; the first of them is always 1 */
+    shift = 63 - __builtin_clzll(value) - (HISTOGRAM_SUB_BITS - 1);
+    return (1 << HISTOGRAM_SUB_BITS) + (shift - 1) * (1 << (HISTOGRAM_SUB_BITS - 1)) +
+           (int) ((value >> shift) - (1 << (HISTOGRAM_SUB_BITS - 1)));
+}
+
+/*
+ * Count one value, in ns: no allocation, no locks.  There must be only
+ * one thread recording; the atomic store keeps each bucket whole for
+ * readers on 32-bit ARM.
+ */
+static inline void
+iperf_histogram_record(struct iperf_histogram *h, uint64_t value)
+{
+    uint64_t *b = &h->buckets[iperf_histogram_index(value)];
+
+    __atomic_store_n(b, *b + 1, __ATOMIC_RELAXED);
+}
+
+/* Another thread's histogram, as it is now */
+void iperf_histogram_copy(struct iperf_histogram *dst, const struct iperf_histogram *src);
+/* dst += src */
+void iperf_histogram_merge(struct iperf_histogram *dst, const struct iperf_histogram *src);
+uint64_t iperf_histogram_count(const struct iperf_histogram *h);
+/* The value (ns) at or below which percentile percent of the counts fall */
+uint64_t iperf_histogram_percentile(const struct iperf_histogram *h, double percentile);
+
+/* Count, percentiles and maximum, in microseconds */
+cJSON *iperf_histogram_json(const struct iperf_histogram *h);
+
+struct iperf_udp_histograms *iperf_udp_histograms_new(void);
+/* Main thread, every interval: set ->interval and move ->last on */
+void iperf_udp_histograms_interval(struct iperf_udp_histograms *hs);
+/* Main thread, at the end of -O */
+void iperf_udp_histograms_omit(struct iperf_udp_histograms *hs);
+/* What was counted after -O */
+void iperf_udp_histograms_result(struct iperf_udp_histograms *hs, struct iperf_udp_histogram_set *result);
+void iperf_udp_histogram_set_merge(struct iperf_udp_histogram_set *dst, const struct iperf_udp_histogram_set *src);
+/* {"transit_delta": ..., "interarrival": ...} with iperf_histogram_json() */
+cJSON *iperf_udp_histogram_set_json(const struct iperf_udp_histogram_set *set);
+
+/*
+ * The results exchange: the non-empty buckets as [index, count] pairs,
+ * and back again; returns -1 if the JSON doesn't make sense.
+ */
+cJSON *iperf_udp_histogram_set_to_results(const struct iperf_udp_histogram_set *set);
+int iperf_udp_histogram_set_from_results(struct iperf_udp_histogram_set *set, cJSON *j);
+
+#endif /* __IPERF_HISTOGRAM_H */
@@ -0,0 +1,551 @@
+/*
+ * Binary test history for --history.
+ *
+ * A results screen that lists past tests shouldn't have to read each
+ * test's whole text log to find out where it went and how it ended.
+ * With --history every test appends one fixed-size summary to an index
+ * in the directory, which is all a list has to read, and writes its
+ * interval sums to a data file of its own, compact enough to map and
+ * chart without parsing.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_history.h"
+#include "iperf_time.h"
+
+#define DATA_MAGIC "IHD1"
+#define BLOCK_MAGIC "IHB1"
+#define INDEX_MAGIC "IHX1"
+#define HISTORY_VERSION 1
+#define DATA_HEADER_SIZE 16
+#define BLOCK_HEADER_SIZE (16 + 8 * HISTORY_NUM_COLUMNS)
+#define BLOCK_MAX_SIZE (BLOCK_HEADER_SIZE + 8 * HISTORY_NUM_COLUMNS * HISTORY_BLOCK_RECORDS)
+
+struct iperf_history_writer {
+    int fd;
+    int count;
+    int64_t columns[HISTORY_NUM_COLUMNS][HISTORY_BLOCK_RECORDS];
+    unsigned char buf[BLOCK_MAX_SIZE];
+};
+
+/* A test's open entry */
+struct iperf_history {
+    struct iperf_history_summary summary;
+    struct iperf_history_writer *writer;    /* from the first interval on */
+    struct iperf_time start;
+    int failed;                             /* reported, and no more data is written */
+};
+
+static void
+put16(unsigned char *p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void
+put32(unsigned char *p, uint32_t v)
+{
+    put16(p, v);
+    put16(p + 2, v >> 16);
+}
+
+static void
+put64(unsigned char *p, uint64_t v)
+{
+    put32(p, v);
+    put32(p + 4, v >> 32);
+}
+
+static uint16_t
+get16(const unsigned char *p)
+{
+    return p[0] | (uint16_t) p[1] << 8;
+}
+
+static uint32_t
+get32(const unsigned char *p)
+{
+    return get16(p) | (uint32_t) get16(p + 2) << 16;
+}
+
+static uint64_t
+get64(const unsigned char *p)
+{
+    return get32(p) | (uint64_t) get32(p + 4) << 32;
+}
+
+static uint64_t
+zigzag(int64_t d)
+{
+    return ((uint64_t) d << 1) ^ (uint64_t) -(int64_t) ((uint64_t) d >> 63);
+}
+
+static int64_t
+unzigzag(uint64_t z)
+{
+    return (int64_t) ((z >> 1) ^ -(z & 1));
+}
+
+/* The fewest bytes of 0, 1, 2, 4 and 8 that hold v */
+static int
+width_of(uint64_t v)
+{
+    if (v == 0)
+        return 0;
+    if (v <= 0xff)
+        return 1;
+    if (v <= 0xffff)
+        return 2;
+    if (v <= 0xffffffff)
+        return 4;
+    return 8;
+}
+
+static int
+write_all(int fd, const unsigned char *buf, size_t len)
+{
+    ssize_t r;
+
+    while (len > 0) {
+        r = write(fd, buf, len);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += r;
+        len -= r;
+    }
+    return 0;
+}
+
+struct iperf_history_writer *
+iperf_history_writer_open(const char *path)
+{
+    struct iperf_history_writer *w;
+    unsigned char header[DATA_HEADER_SIZE];
+
+    w = (struct iperf_history_writer *) calloc(1, sizeof(*w));
+    if (w == NULL)
+        return NULL;
+    w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (w->fd < 0) {
+        free(w);
+        return NULL;
+    }
+    memset(header, 0, sizeof(header));
+    memcpy(header, DATA_MAGIC, 4);
+    put16(header + 4, HISTORY_VERSION);
+    put16(header + 6, HISTORY_NUM_COLUMNS);
+    put32(header + 8, HISTORY_BLOCK_RECORDS);
+    if (write_all(w->fd, header, sizeof(header)) < 0) {
+        close(w->fd);
+        free(w);
+        return NULL;
+    }
+    return w;
+}
+
+/* Encode the buffered records as one block and write it */
+static int
+writer_flush(struct iperf_history_writer *w)
+{
+    unsigned char *p = w->buf;
+    int widths[HISTORY_NUM_COLUMNS];
+    uint64_t max, z;
+    size_t len;
+    int c, i, b;
+
+    if (w->count == 0)
+        return 0;
+    memset(p, 0, BLOCK_HEADER_SIZE);
+    memcpy(p, BLOCK_MAGIC, 4);
+    put16(p + 4, w->count);
+    for (c = 0; c < HISTORY_NUM_COLUMNS; c++) {
+        max = 0;
+        for (i = 1; i < w->count; i++) {
+            z = zigzag((int64_t) ((uint64_t) w->columns[c][i] - (uint64_t) w->columns[c][i - 1]));
+            if (z > max)
+                max = z;
+        }
+        widths[c] = width_of(max);
+        p[8 + c] = widths[c];
+        put64(p + 16 + 8 * c, w->columns[c][0]);
+    }
+    p += BLOCK_HEADER_SIZE;
+    for (c = 0; c < HISTORY_NUM_COLUMNS; c++) {
+        if (widths[c] == 0)
+            continue;
+        for (i = 1; i < w->count; i++) {
+            z = zigzag((int64_t) ((uint64_t) w->columns[c][i] - (uint64_t) w->columns[c][i - 1]));
+            for (b = 0; b < widths[c]; b++)
+                *p++ = z >> (8 * b);
+        }
+    }
+    /* Keep every block 8-byte aligned for whoever maps the file */
+    while ((p - w->buf) % 8 != 0)
+        *p++ = 0;
+    len = p - w->buf;
+    w->count = 0;
+    return write_all(w->fd, w->buf, len);
+}
+
+int
+iperf_history_writer_add(struct iperf_history_writer *w, const struct iperf_history_record *r)
+{
+    int c;
+
+    for (c = 0; c < HISTORY_NUM_COLUMNS; c++)
+        w->columns[c][w->count] = r->v[c];
+    if (++w->count == HISTORY_BLOCK_RECORDS)
+        return writer_flush(w);
+    return 0;
+}
+
+int
+iperf_history_writer_close(struct iperf_history_writer *w)
+{
+    int rc;
+
+    rc = writer_flush(w);
+    if (close(w->fd) < 0)
+        rc = -1;
+    free(w);
+    return rc;
+}
+
+int
+iperf_history_map(const char *path, struct iperf_history_map *map)
+{
+    struct stat st;
+    void *base;
+    int fd;
+
+    map->base = NULL;
+    map->size = 0;
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+    if (st.st_size > 0) {
+        base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (base == MAP_FAILED) {
+            close(fd);
+            return -1;
+        }
+        map->base = base;
+        map->size = st.st_size;
+    }
+    close(fd);
+    return 0;
+}
+
+void
+iperf_history_unmap(struct iperf_history_map *map)
+{
+    if (map->base != NULL)
+        munmap((void *) map->base, map->size);
+    map->base = NULL;
+    map->size = 0;
+}
+
+int
+iperf_history_read(const struct iperf_history_map *map, struct iperf_history_record *records, int max)
+{
+    const unsigned char *p, *block, *end;
+    int64_t value[HISTORY_NUM_COLUMNS];
+    int widths[HISTORY_NUM_COLUMNS];
+    uint32_t block_records;
+    uint64_t z;
+    size_t len;
+    int n = 0, count, c, i, b;
+
+    if (map->size < DATA_HEADER_SIZE || memcmp(map->base, DATA_MAGIC, 4) != 0 ||
+        get16(map->base + 4) != HISTORY_VERSION || get16(map->base + 6) != HISTORY_NUM_COLUMNS)
+        return -1;
+    block_records = get32(map->base + 8);
+    block = map->base + DATA_HEADER_SIZE;
+    end = map->base + map->size;
+
+    while (end - block >= BLOCK_HEADER_SIZE && memcmp(block, BLOCK_MAGIC, 4) == 0) {
+        count = get16(block + 4);
+        if (count < 1 || (uint32_t) count > block_records)
+            break;
+        len = BLOCK_HEADER_SIZE;
+        for (c = 0; c < HISTORY_NUM_COLUMNS; c++) {
+            widths[c] = block[8 + c];
+            if (widths[c] != 0 && widths[c] != 1 && widths[c] != 2 && widths[c] != 4 && widths[c] != 8)
+                return n;
+            len += (size_t) widths[c] * (count - 1);
+        }
+        len = (len + 7) & ~(size_t) 7;
+        if ((size_t) (end - block) < len)
+            break;              /* cut short */
+
+        if (records == NULL) {
+            n += count;
+            block += len;
+            continue;
+        }
+        /* Column by column, each record gets its value as the running sum */
+        p = block + BLOCK_HEADER_SIZE;
+        for (c = 0; c < HISTORY_NUM_COLUMNS; c++) {
+            value[c] = (int64_t) get64(block + 16 + 8 * c);
+            for (i = 0; i < count; i++) {
+                if (i > 0 && widths[c] > 0) {
+                    z = 0;
+                    for (b = 0; b < widths[c]; b++)
+                        z |= (uint64_t) *p++ << (8 * b);
+                    value[c] = (int64_t) ((uint64_t) value[c] + (uint64_t) unzigzag(z));
+                }
+                if (n + i < max)
+                    records[n + i].v[c] = value[c];
+            }
+        }
+        n += count;
+        if (n >= max)
+            return max;
+        block += len;
+    }
+    return n;
+}
+
+static void
+put_direction(unsigned char *p, const struct iperf_history_direction *d)
+{
+    put64(p, d->bytes_sent);
+    put64(p + 8, d->bytes_received);
+    put32(p + 16, d->sender_ms);
+    put32(p + 20, d->receiver_ms);
+    put32(p + 24, d->retransmits);
+    put32(p + 28, d->packets);
+    put32(p + 32, d->lost);
+    put32(p + 36, d->jitter_us);
+}
+
+static void
+get_direction(const unsigned char *p, struct iperf_history_direction *d)
+{
+    d->bytes_sent = get64(p);
+    d->bytes_received = get64(p + 8);
+    d->sender_ms = get32(p + 16);
+    d->receiver_ms = get32(p + 20);
+    d->retransmits = get32(p + 24);
+    d->packets = get32(p + 28);
+    d->lost = get32(p + 32);
+    d->jitter_us = get32(p + 36);
+}
+
+/*
+ * Offsets: 0 magic, 4 version, 6 record size, 8 start_ms, 16 duration_ms,
+ * 20 role, protocol, mode, complete, 24 num_streams, 26 phase,
+ * 28 num_intervals, 32 tx, 72 rx, 112 host, 160 tag, 208 data_file,
+ * 248 reserved.
+ */
+void
+iperf_history_summary_encode(const struct iperf_history_summary *s, unsigned char buf[HISTORY_SUMMARY_SIZE])
+{
+    memset(buf, 0, HISTORY_SUMMARY_SIZE);
+    memcpy(buf, INDEX_MAGIC, 4);
+    put16(buf + 4, HISTORY_VERSION);
+    put16(buf + 6, HISTORY_SUMMARY_SIZE);
+    put64(buf + 8, s->start_ms);
+    put32(buf + 16, s->duration_ms);
+    buf[20] = s->role;
+    buf[21] = s->protocol;
+    buf[22] = (unsigned char) s->mode;
+    buf[23] = s->complete;
+    put16(buf + 24, s->num_streams);
+    put16(buf + 26, s->phase);
+    put32(buf + 28, s->num_intervals);
+    put_direction(buf + 32, &s->tx);
+    put_direction(buf + 72, &s->rx);
+    strncpy((char *) buf + 112, s->host, sizeof(s->host) - 1);
+    strncpy((char *) buf + 160, s->tag, sizeof(s->tag) - 1);
+    strncpy((char *) buf + 208, s->data_file, sizeof(s->data_file) - 1);
+}
+
+int
+iperf_history_summary_decode(const unsigned char buf[HISTORY_SUMMARY_SIZE], struct iperf_history_summary *s)
+{
+    if (memcmp(buf, INDEX_MAGIC, 4) != 0 || get16(buf + 6) != HISTORY_SUMMARY_SIZE)
+        return -1;
+    memset(s, 0, sizeof(*s));
+    s->start_ms = (int64_t) get64(buf + 8);
+    s->duration_ms = get32(buf + 16);
+    s->role = buf[20];
+    s->protocol = buf[21];
+    s->mode = (int8_t) buf[22];
+    s->complete = buf[23];
+    s->num_streams = get16(buf + 24);
+    s->phase = get16(buf + 26);
+    s->num_intervals = get32(buf + 28);
+    get_direction(buf + 32, &s->tx);
+    get_direction(buf + 72, &s->rx);
+    memcpy(s->host, buf + 112, sizeof(s->host) - 1);
+    memcpy(s->tag, buf + 160, sizeof(s->tag) - 1);
+    memcpy(s->data_file, buf + 208, sizeof(s->data_file) - 1);
+    return 0;
+}
+
+int
+iperf_history_append_summary(const char *dir, const struct iperf_history_summary *s)
+{
+    unsigned char buf[HISTORY_SUMMARY_SIZE];
+    char path[PATH_MAX];
+    int fd, rc;
+
+    if (snprintf(path, sizeof(path), "%s/%s", dir, HISTORY_INDEX_NAME) >= (int) sizeof(path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    iperf_history_summary_encode(s, buf);
+    fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0)
+        return -1;
+    rc = write(fd, buf, sizeof(buf)) == sizeof(buf) ? 0 : -1;
+    if (close(fd) < 0)
+        rc = -1;
+    return rc;
+}
+
+/* Report the first thing that goes wrong; the test goes on without the rest */
+static void
+history_failed(struct iperf_test *test, const char *what)
+{
+    if (!test->history->failed)
+        iperf_err(test, "unable to write --history %s: %s", what, strerror(errno));
+    test->history->failed = 1;
+}
+
+/* The other side of the test, as an address or name */
+static void
+history_host(struct iperf_test *test, char *host, size_t len)
+{
+    struct sockaddr_storage sa;
+    socklen_t sa_len = sizeof(sa);
+    char ipr[INET6_ADDRSTRLEN];
+
+    if (test->role == 'c') {
+        if (test->server_hostname != NULL)
+            snprintf(host, len, "%s", test->server_hostname);
+        return;
+    }
+    if (test->ctrl_sck < 0 || getpeername(test->ctrl_sck, (struct sockaddr *) &sa, &sa_len) < 0)
+        return;
+    if (sa.ss_family == AF_INET)
+        inet_ntop(AF_INET, &((struct sockaddr_in *) &sa)->sin_addr, ipr, sizeof(ipr));
+    else if (sa.ss_family == AF_INET6)
+        inet_ntop(AF_INET6, &((struct sockaddr_in6 *) &sa)->sin6_addr, ipr, sizeof(ipr));
+    else
+        return;
+    snprintf(host, len, "%s", strncmp(ipr, "::ffff:", 7) == 0 ? ipr + 7 : ipr);
+}
+
+void
+iperf_history_begin(struct iperf_test *test)
+{
+    struct iperf_history *h;
+    struct timeval now;
+
+    if (test->history_dir == NULL || test->history != NULL)
+        return;
+    h = (struct iperf_history *) calloc(1, sizeof(*h));
+    if (h == NULL)
+        return;
+    gettimeofday(&now, NULL);
+    h->summary.start_ms = (int64_t) now.tv_sec * 1000 + now.tv_usec / 1000;
+    iperf_time_now(&h->start);
+    h->summary.role = test->role;
+    h->summary.phase = test->phase;
+    if (test->extra_data != NULL)
+        snprintf(h->summary.tag, sizeof(h->summary.tag), "%s", test->extra_data);
+    history_host(test, h->summary.host, sizeof(h->summary.host));
+    test->history = h;
+}
+
+void
+iperf_history_add(struct iperf_test *test, const struct iperf_history_record *r)
+{
+    struct iperf_history *h = test->history;
+    char path[PATH_MAX];
+
+    if (h == NULL || h->failed)
+        return;
+    if (h->writer == NULL) {
+        /* Tests from one client, and phases of one test, can start in the same millisecond */
+        snprintf(h->summary.data_file, sizeof(h->summary.data_file), "%lld-%.8s-%d%s",
+                 (long long) h->summary.start_ms, test->cookie, test->phase, HISTORY_DATA_SUFFIX);
+        snprintf(path, sizeof(path), "%s/%s", test->history_dir, h->summary.data_file);
+        h->writer = iperf_history_writer_open(path);
+        if (h->writer == NULL) {
+            h->summary.data_file[0] = '\0';
+            history_failed(test, "data");
+            return;
+        }
+    }
+    if (iperf_history_writer_add(h->writer, r) < 0) {
+        history_failed(test, "data");
+        return;
+    }
+    h->summary.num_intervals++;
+}
+
+void
+iperf_history_set_direction(struct iperf_test *test, int sender, const struct iperf_history_direction *d)
+{
+    if (test->history == NULL)
+        return;
+    if (sender)
+        test->history->summary.tx = *d;
+    else
+        test->history->summary.rx = *d;
+}
+
+void
+iperf_history_end(struct iperf_test *test, int complete)
+{
+    struct iperf_history *h = test->history;
+    struct iperf_time now, elapsed;
+
+    if (h == NULL)
+        return;
+    iperf_time_now(&now);
+    iperf_time_diff(&h->start, &now, &elapsed);
+    h->summary.duration_ms = iperf_time_in_usecs(&elapsed) / 1000;
+    h->summary.complete = complete;
+    /* Settings the client sent are known by now */
+    h->summary.protocol = test->protocol != NULL ? test->protocol->id : 0;
+    h->summary.mode = test->mode;
+    h->summary.num_streams = test->num_streams;
+    if (h->writer != NULL && iperf_history_writer_close(h->writer) < 0)
+        history_failed(test, "data");
+    h->writer = NULL;
+    if (iperf_history_append_summary(test->history_dir, &h->summary) < 0)
+        history_failed(test, "index");
+    free(h);
+    test->history = NULL;
+}
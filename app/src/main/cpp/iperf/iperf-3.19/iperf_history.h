@@ -0,0 +1,128 @@
+/*
+ * Binary test history for --history.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_HISTORY_H
+#define __IPERF_HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct iperf_test;
+
+/*
+ * A history directory holds one index file, to which every test adds a
+ * fixed-size summary record when it ends, and one data file per test
+ * with its interval sums.  Both are little-endian.
+ *
+ * A data file is a header and then blocks of up to HISTORY_BLOCK_RECORDS
+ * records stored column by column.  Each column of a block is its first
+ * value and then the differences from one record to the next, zigzag
+ * encoded in the fewest bytes (0, 1, 2, 4 or 8) that hold all of them,
+ * so a column that doesn't change takes no space at all.  Blocks are
+ * written whole and are self-contained, so a file cut short by a crash
+ * is readable up to its last complete block, and a mapped file can be
+ * decoded a block at a time.
+ */
+#define HISTORY_INDEX_NAME "history.ihx"
+#define HISTORY_DATA_SUFFIX ".ihd"
+#define HISTORY_BLOCK_RECORDS 64
+
+/* The columns of a data file, in the order they are stored */
+enum {
+    HISTORY_START_MS,           /* interval start, since the test started */
+    HISTORY_END_MS,
+    HISTORY_BYTES,
+    HISTORY_RETRANSMITS,
+    HISTORY_PACKETS,
+    HISTORY_LOST,
+    HISTORY_JITTER_US,
+    HISTORY_FLAGS,
+    HISTORY_NUM_COLUMNS
+};
+
+/* HISTORY_FLAGS */
+#define HISTORY_FLAG_SENDER 0x1     /* the sum of this side's sending streams */
+#define HISTORY_FLAG_OMITTED 0x2
+
+/* One interval sum, in one direction */
+struct iperf_history_record {
+    int64_t v[HISTORY_NUM_COLUMNS];
+};
+
+struct iperf_history_writer;
+
+/* Create (or truncate) a data file; NULL with errno set if it can't be */
+struct iperf_history_writer *iperf_history_writer_open(const char *path);
+/* Add a record; a full block is written out.  -1 if a write failed */
+int iperf_history_writer_add(struct iperf_history_writer *w, const struct iperf_history_record *r);
+/* Write out what is left and close; -1 if a write failed */
+int iperf_history_writer_close(struct iperf_history_writer *w);
+
+/* A data file mapped for reading */
+struct iperf_history_map {
+    const unsigned char *base;
+    size_t size;
+};
+
+int iperf_history_map(const char *path, struct iperf_history_map *map);
+void iperf_history_unmap(struct iperf_history_map *map);
+/*
+ * Decode up to max records, or just count them if records is NULL.
+ * Stops at the first incomplete or damaged block; -1 if the file
+ * isn't a history data file at all.
+ */
+int iperf_history_read(const struct iperf_history_map *map, struct iperf_history_record *records, int max);
+
+/* One direction of a test, as its end summary has it */
+struct iperf_history_direction {
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    uint32_t sender_ms;
+    uint32_t receiver_ms;
+    uint32_t retransmits;
+    uint32_t packets;
+    uint32_t lost;
+    uint32_t jitter_us;
+};
+
+#define HISTORY_SUMMARY_SIZE 256
+
+/* An index record: one test, or one of its --phases */
+struct iperf_history_summary {
+    int64_t start_ms;           /* wall clock, since the epoch */
+    uint32_t duration_ms;
+    char role;
+    uint8_t protocol;
+    int8_t mode;                /* SENDER, RECEIVER or BIDIRECTIONAL, as the side that wrote it */
+    uint8_t complete;           /* 0 if it failed or was stopped */
+    uint16_t num_streams;
+    uint16_t phase;
+    uint32_t num_intervals;
+    struct iperf_history_direction tx;      /* this side's sending streams */
+    struct iperf_history_direction rx;
+    char host[48];              /* the other side */
+    char tag[48];               /* --extra-data */
+    char data_file[40];         /* in the same directory; empty if it has no intervals */
+};
+
+void iperf_history_summary_encode(const struct iperf_history_summary *s, unsigned char buf[HISTORY_SUMMARY_SIZE]);
+/* -1 if buf doesn't hold a summary */
+int iperf_history_summary_decode(const unsigned char buf[HISTORY_SUMMARY_SIZE], struct iperf_history_summary *s);
+/* Append to dir's index with a single write, so tests ending together don't interleave */
+int iperf_history_append_summary(const char *dir, const struct iperf_history_summary *s);
+
+/*
+ * What a test with --history calls as it runs.  begin is a no-op if the
+ * test's entry is already open; end writes the index record and closes
+ * it, and is a no-op if there is none.  Failing to write history is
+ * reported once and never fails the test.
+ */
+void iperf_history_begin(struct iperf_test *test);
+void iperf_history_add(struct iperf_test *test, const struct iperf_history_record *r);
+void iperf_history_set_direction(struct iperf_test *test, int sender, const struct iperf_history_direction *d);
+void iperf_history_end(struct iperf_test *test, int complete);
+
+#endif /* __IPERF_HISTORY_H */
@@ -104,10 +104,22 @@ const char usage_longstr[] = "Usage: iperf3 [-s|-c host] [options]\n"
                              "  -i, --interval  #         seconds between periodic throughput reports\n"
                              "  -I, --pidfile file        write PID file\n"
                              "  -F, --file name           xmit/recv the specified file\n"
+                             "  --direct-io               write a received -F file with O_DIRECT\n"
+                             "  --perf-counters           count cycles, instructions, context switches and\n"
+                             "                            page faults of each stream thread (perf_event_open)\n"
+                             #if defined(linux)
+                             "  --tcpinfo-sample #        read TCP_INFO of each stream every # ms on a separate\n"
+                             "                            thread; the time series goes in the JSON output\n"
+                             #endif /* linux */
                              #if defined(HAVE_CPU_AFFINITY)
                              "  -A, --affinity n[,m]      set CPU affinity core number to n (the core the process will use)\n"
                              "                             (optional Client only m - the Server's core number for this test)\n"
                              #endif /* HAVE_CPU_AFFINITY */
+                             #if defined(HAVE_SCHED_SETAFFINITY)
+                             "  --thread-affinity big|n[-m][,...]\n"
+                             "                            pin each stream's thread to its own CPU: the biggest\n"
+                             "                            cores first (cpu_capacity), or the CPUs listed\n"
+                             #endif /* HAVE_SCHED_SETAFFINITY */
                              #if defined(HAVE_SO_BINDTODEVICE)
                              "  -B, --bind <host>[%%<dev>] bind to the interface associated with the address <host>\n"
                            "                            (optional <dev> equivalent to `--bind-dev <dev>`)\n"
@@ -119,6 +131,8 @@ const char usage_longstr[] = "Usage: iperf3 [-s|-c host] [options]\n"
                              "  -J, --json                output in JSON format\n"
                              "  --json-stream             output in line-delimited JSON format\n"
                              "  --logfile f               send output to a log file\n"
+                             "  --history dir             add each test's summary to an index in dir, and\n"
+                             "                            its interval sums to a binary file next to it\n"
                              "  --forceflush              force flushing output at every interval\n"
                              "  --timestamps<=format>     emit a timestamp at the start of each output line\n"
                              "                            (optional \"=\" and format string as per strftime(3))\n"
@@ -148,6 +162,9 @@ const char usage_longstr[] = "Usage: iperf3 [-s|-c host] [options]\n"
                              "                            total data rate.  Default is 5 seconds)\n"
                              "  --idle-timeout #          restart idle server after # seconds in case it\n"
                              "                            got stuck (default - no timeout)\n"
+                             "  --max-clients #           test up to # clients at once (default 1)\n"
+                             "  --accept-threads #        accept connections on # threads, each with its\n"
+                             "                            own SO_REUSEPORT listener (default 1)\n"
                              #if defined(HAVE_SSL)
                              "  --rsa-private-key-path    path to the RSA private key used to decrypt\n"
 			   "                            authentication credentials\n"
@@ -172,6 +189,20 @@ const char usage_longstr[] = "Usage: iperf3 [-s|-c host] [options]\n"
                              "                            (optional slash and packet count for burst mode)\n"
                              "  --pacing-timer #[KMG]     set the Server timing for pacing, in microseconds (default %d)\n"
                              "                            (deprecated - for servers using older versions ackward compatibility)\n"
+                             "  --pacing-bucket #[KMG]    token bucket depth for -b pacing, in bytes\n"
+                             "                            (default 1 ms at the target bitrate, at least one burst)\n"
+                             #if defined(HAVE_SO_TXTIME)
+                             "  --txtime                  UDP: have the kernel (fq qdisc) send each packet\n"
+                             "                            at its scheduled time, using SO_TXTIME\n"
+                             #endif /* HAVE_SO_TXTIME */
+                             #if defined(HAVE_SO_TIMESTAMPNS)
+                             "  --rx-timestamps           UDP: also measure jitter from the kernel's receive\n"
+                             "                            timestamps (SO_TIMESTAMPNS)\n"
+                             #endif /* HAVE_SO_TIMESTAMPNS */
+                             "  --udp-histograms          UDP: percentiles of transit-time changes and\n"
+                             "                            inter-arrival gaps at the receiver\n"
+                             "  --rate-search #           UDP: search for the highest bitrate losing at most\n"
+                             "                            # percent, adjusting -b every interval\n"
                              #if defined(HAVE_SO_MAX_PACING_RATE)
                              "  --fq-rate #[KMG]          enable fair-queuing based socket pacing in\n"
                              "                            bits/sec (Linux only)\n"
@@ -181,6 +212,8 @@ const char usage_longstr[] = "Usage: iperf3 [-s|-c host] [options]\n"
                              "                            (per direction) at least this number of bytes (instead of -t or -k)\n"
                              "  -k, --blockcount #[KMG]   transmit until the end of the interval when the client sent or received\n"
                              "                            (per direction) at least this number of blocks (instead of -t or -n)\n"
+                             "  --phases #                run the test # times over one control connection\n"
+                             "  --phase-gap #             seconds to wait between --phases (default 0)\n"
                              "  -l, --length    #[KMG]    length of buffer to read or write\n"
                              "                            (default %d KB for TCP, dynamic or %d for UDP)\n"
                              "  --cport         <port>    bind to a specific client port (TCP and UDP, default: ephemeral port)\n"
@@ -219,6 +252,8 @@ const char usage_longstr[] = "Usage: iperf3 [-s|-c host] [options]\n"
                              "  --udp-counters-64bit      use 64-bit counters in UDP test packets\n"
                              "  --repeating-payload       use repeating pattern in payload, instead of\n"
                              "                            randomized payload (like in iperf2)\n"
+                             "  --verify-payload          send a deterministic payload and have the receiver\n"
+                             "                            check every block (CRC32C), reporting corrupted blocks\n"
                              #if defined(HAVE_DONT_FRAGMENT)
                              "  --dont-fragment           set IPv4 Don't Fragment flag\n"
                              #endif /* HAVE_DONT_FRAGMENT */
@@ -318,6 +353,9 @@ const char test_start_blocks[] =
 const char report_time[] =
         "Time: %s\n";
 
+const char report_clock_source[] =
+        "Clock source: %s\n";
+
 const char report_connecting[] =
         "Connecting to host %s, port %d\n";
 
@@ -330,6 +368,9 @@ const char report_authentication_failed[] =
 const char report_reverse[] =
         "Reverse mode, remote host %s is sending\n";
 
+const char report_phase[] =
+        "Phase %d of %d\n";
+
 const char report_accepted[] =
         "Accepted connection from %s, port %d\n";
 
@@ -351,6 +392,27 @@ const char report_omit_done[] =
 const char report_diskfile[] =
         "        Sent %s / %s (%d%%) of %s\n";
 
+const char report_diskfile_io[] =
+        "        Disk %s in %.2f sec busy, %s/sec, %" PRId64 " stalls, longest %.1f ms%s\n";
+
+const char report_diskfile_zerocopy[] = " (zero-copy)";
+
+const char report_diskfile_interval[] =
+        "[%3d]%s %6.2f-%-6.2f sec  disk %s  %s/sec  busy %.1f%%  %" PRId64 " stalls\n";
+
+const char report_diskfile_queue_interval[] =
+        "[%3d]%s %6.2f-%-6.2f sec  disk %s  %s/sec  busy %.1f%%  %" PRId64 " stalls  queue %d/%d  backlog %s%s\n";
+
+const char report_diskfile_disk_bound[] = "  (disk-bound)";
+
+const char report_diskfile_queue[] =
+        "        Disk queue peaked at %d/%d blocks, receive waited %.2f sec for the writer%s\n";
+
+const char report_diskfile_direct[] = " (direct I/O)";
+
+const char report_diskfile_bound[] =
+        "        The disk, not the network, was the bottleneck: receive was blocked on it %.0f%% of the time\n";
+
 const char report_done[] =
         "iperf Done.\n";
 
@@ -434,6 +496,12 @@ const char report_outoforder[] =
 const char report_sum_outoforder[] =
         "[SUM]%s %4.1f-%4.1f sec  %"PRIu64" datagrams received out-of-order\n";
 
+const char report_corrupted[] =
+        "[%3d]%s %6.2f-%-6.2f sec  %" PRId64 "/%" PRId64 " blocks failed payload verification\n";
+
+const char report_sum_corrupted[] =
+        "[SUM]%s %6.2f-%-6.2f sec  %" PRId64 "/%" PRId64 " blocks failed payload verification\n";
+
 const char report_peer[] =
         "[%3d] local %s port %u connected with %s port %u\n";
 
@@ -458,6 +526,68 @@ const char reportCSV_peer[] =
 const char report_cpu[] =
         "CPU Utilization: %s/%s %.1f%% (%.1f%%u/%.1f%%s), %s/%s %.1f%% (%.1f%%u/%.1f%%s)\n";
 
+const char report_stream_cpu[] =
+        "[%3d]%s CPU %.2f sec, %.1f%% of one core\n";
+
+const char report_cpu_streams[] =
+        "Stream CPU: busiest thread %.1f%% of one core, all streams %.1f%%\n";
+
+const char report_pacing[] =
+        "[%3d]%s pacing: gap %.1f us (target %.1f, min %.1f, max %.1f), mean error %.1f us, %" PRId64 " sleeps, bucket %" PRId64 " bytes\n";
+
+const char report_thread_affinity[] =
+        "[%3d]%s worker thread on CPU %d\n";
+
+const char report_thread_affinity_capacity[] =
+        "[%3d]%s worker thread on CPU %d (capacity %d)\n";
+
+const char report_thread_affinity_failed[] =
+        "[%3d]%s worker thread could not be pinned to CPU %d: %s\n";
+
+const char report_tcp_limits[] =
+        "[%3d]%s sender %s: busy %.0f%% of the time, rwnd-limited %.0f%%, sndbuf-limited %.0f%%\n";
+
+const char report_rate_search_step[] =
+        "[SUM] %6.2f sec  rate search: %ss/sec per stream, %ss/sec received, %.3f%% lost (%s), next %s\n";
+
+const char report_rate_search[] =
+        "Rate search: %ss/sec per stream (%ss/sec in all) at %g%% loss or less, %s after %d steps\n";
+
+const char report_tcpinfo_series[] =
+        "[%3d]%s tcp_info: %d samples every %d ms, snd_cwnd %ss to %ss, rtt %.2f to %.2f ms, delivery rate up to %ss/sec\n";
+
+const char report_txtime[] =
+        "[%3d]%s txtime: sent %.1f us after schedule on average (%.1f us absolute, max %.1f us), %" PRId64 " of %" PRId64 " packets reported, %" PRId64 " dropped\n";
+
+const char report_rx_timestamps[] =
+        "[%3d]%s rx timestamps: jitter %.3f ms by kernel arrival, %.3f ms in user space (+%.3f ms), receive latency %.1f us mean, %.1f us max\n";
+
+const char report_sequence[] =
+        "[%3d]%s %" PRId64 " out of order (distance mean %.1f, max %" PRId64 "), %" PRId64 " duplicates, %" PRId64 " late\n";
+
+const char report_histograms[] =
+        "[%3d]%s transit delta ms: p50 %.3f  p90 %.3f  p99 %.3f  p99.9 %.3f  max %.3f; inter-arrival ms: p50 %.3f  p99 %.3f  max %.3f\n";
+
+const char report_sum_histograms[] =
+        "[SUM]%s transit delta ms: p50 %.3f  p90 %.3f  p99 %.3f  p99.9 %.3f  max %.3f; inter-arrival ms: p50 %.3f  p99 %.3f  max %.3f\n";
+
+const char report_txtime_ignored[] =
+        "[%3d]%s warning: packets left before their SO_TXTIME; the route's qdisc does not honour it (needs fq)\n";
+
+const char report_perf[] =
+        "[%3d]%s perf: %.2f cycles/byte, IPC %.2f, %" PRIu64 " context switches, %" PRIu64 " page faults%s\n";
+
+const char report_perf_sw[] =
+        "[%3d]%s perf: %" PRIu64 " context switches, %" PRIu64 " page faults (no hardware counters)\n";
+
+const char report_perf_user_only[] = " (user space only)";
+
+const char report_perf_unavailable[] =
+        "[%3d]%s perf: counters not available (see perf_event_paranoid)\n";
+
+const char report_cpu_bound[] =
+        "warning: a stream thread used %.0f%% of a CPU core; the test was likely CPU-bound rather than network-bound\n";
+
 const char report_local[] = "local";
 const char report_remote[] = "remote";
 const char report_sender[] = "sender";
@@ -50,8 +50,10 @@ extern const char test_start_bytes[];
 extern const char test_start_blocks[];
 
 extern const char report_time[];
+extern const char report_clock_source[];
 extern const char report_connecting[];
 extern const char report_reverse[];
+extern const char report_phase[];
 extern const char report_accepted[];
 extern const char report_cookie[];
 extern const char report_connected[];
@@ -61,6 +63,14 @@ extern const char report_window[];
 extern const char report_autotune[];
 extern const char report_omit_done[];
 extern const char report_diskfile[];
+extern const char report_diskfile_io[];
+extern const char report_diskfile_zerocopy[];
+extern const char report_diskfile_interval[];
+extern const char report_diskfile_queue_interval[];
+extern const char report_diskfile_disk_bound[];
+extern const char report_diskfile_queue[];
+extern const char report_diskfile_direct[];
+extern const char report_diskfile_bound[];
 extern const char report_done[];
 extern const char report_read_lengths[];
 extern const char report_read_length_times[];
@@ -89,6 +99,8 @@ extern const char report_omitted[];
 extern const char report_bw_separator[];
 extern const char report_outoforder[];
 extern const char report_sum_outoforder[];
+extern const char report_corrupted[];
+extern const char report_sum_corrupted[];
 extern const char report_peer[];
 extern const char report_mss_unsupported[];
 extern const char report_mss[];
@@ -98,6 +110,27 @@ extern const char server_reporting[];
 extern const char reportCSV_peer[];
 
 extern const char report_cpu[];
+extern const char report_stream_cpu[];
+extern const char report_cpu_streams[];
+extern const char report_cpu_bound[];
+extern const char report_pacing[];
+extern const char report_thread_affinity[];
+extern const char report_thread_affinity_capacity[];
+extern const char report_thread_affinity_failed[];
+extern const char report_tcp_limits[];
+extern const char report_rate_search_step[];
+extern const char report_rate_search[];
+extern const char report_tcpinfo_series[];
+extern const char report_txtime[];
+extern const char report_txtime_ignored[];
+extern const char report_rx_timestamps[];
+extern const char report_sequence[];
+extern const char report_histograms[];
+extern const char report_sum_histograms[];
+extern const char report_perf[];
+extern const char report_perf_sw[];
+extern const char report_perf_user_only[];
+extern const char report_perf_unavailable[];
 extern const char report_local[];
 extern const char report_remote[];
 extern const char report_sender[];
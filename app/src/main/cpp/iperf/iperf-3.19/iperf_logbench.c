@@ -0,0 +1,240 @@
+/*
+ * Benchmark for the session log writer's compression.
+ *
+ * Writes the same synthetic log (interval lines as -i 0.1 -P 4 prints
+ * them, or -J --json-stream events with -J) through iperf_logwriter at
+ * each compression level asked for, and prints one JSON object per level:
+ * how much went in and came out, and the CPU it took per MB written.  The
+ * difference from level 0 is what compression costs, to set against how
+ * much smaller it makes a soak test's log.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <getopt.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_util.h"
+#include "iperf_logwriter.h"
+
+#define LOGBENCH_MB 32
+#define LOGBENCH_PART_SIZE (5 * 1024 * 1024)   /* as the app's */
+#define LOGBENCH_MAX_LEVELS 10
+
+static void
+logbench_usage(FILE *f)
+{
+    fprintf(f, "Usage: iperf_logbench [-J] [-m MB] [-z levels] [-d dir] [-o file]\n"
+               "  -J         --json-stream events rather than text interval lines\n"
+               "  -m MB      log size per run (default %d)\n"
+               "  -z levels  zlib levels, 0 for none, e.g. 0,1,6 (default 0,1,3,6,9)\n"
+               "  -d dir     where to write the log (default .)\n"
+               "  -o file    write the JSON lines to file rather than stdout\n",
+            LOGBENCH_MB);
+}
+
+static double
+wall_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double
+cpu_secs(const struct rusage *ru)
+{
+    return ru->ru_utime.tv_sec + ru->ru_utime.tv_usec / 1e6 +
+           ru->ru_stime.tv_sec + ru->ru_stime.tv_usec / 1e6;
+}
+
+/* Line i of the log, with numbers that move about as a real test's do */
+static int
+logbench_line(char *buf, size_t size, long i, int json)
+{
+    unsigned r = (unsigned) i * 2654435761u;
+    double start = (i / 5) * 0.1;
+    int stream = i % 5 == 4 ? -1 : 5 + 2 * (int) (i % 5);
+    long bytes = 1048576 + (long) (r % 524288);
+
+    if (json)
+        return snprintf(buf, size,
+                        "{\"event\":\"interval\",\"data\":{\"streams\":[{\"socket\":%d,\"start\":%.6f,"
+                        "\"end\":%.6f,\"seconds\":0.100000,\"bytes\":%ld,\"bits_per_second\":%.1f,"
+                        "\"retransmits\":%u,\"snd_cwnd\":%u,\"rtt\":%u,\"rttvar\":%u,\"pmtu\":1500,"
+                        "\"omitted\":false,\"sender\":true}]}}\n",
+                        stream < 0 ? 11 : stream, start, start + 0.1, bytes, bytes * 80.0,
+                        r % 97 == 0 ? r % 5 : 0, 64000 + r % 4096 * 16, 20000 + r % 9000, 500 + r % 700);
+    if (stream < 0)
+        return snprintf(buf, size, "[SUM] %6.2f-%-6.2f sec  %5.2f MBytes  %5.1f Mbits/sec  %3u\n",
+                        start, start + 0.1, bytes * 4 / 1048576.0, bytes * 4 * 80 / 1e6,
+                        r % 97 == 0 ? r % 5 : 0);
+    return snprintf(buf, size, "[%3d] %6.2f-%-6.2f sec  %5.2f MBytes  %5.1f Mbits/sec  %3u   %4u KBytes\n",
+                    stream, start, start + 0.1, bytes / 1048576.0, bytes * 80 / 1e6,
+                    r % 97 == 0 ? r % 5 : 0, 64 + r % 4096 / 64);
+}
+
+/* Total size of the log's parts, which are then removed */
+static long long
+logbench_remove(const char *prefix, const char *suffix, int first, int last)
+{
+    char path[PATH_MAX];
+    struct stat st;
+    long long size = 0;
+    int part;
+
+    for (part = first; part <= last; part++) {
+        snprintf(path, sizeof(path), "%s%d%s", prefix, part, suffix);
+        if (stat(path, &st) == 0)
+            size += st.st_size;
+        unlink(path);
+    }
+    return size;
+}
+
+/* One run at one level; prints its JSON line, and returns the CPU per MB or -1 */
+static double
+logbench_run(const char *dir, int json, long long total, int level, double base, FILE *out)
+{
+    struct iperf_logwriter *lw;
+    struct rusage ru0, ru1;
+    char prefix[PATH_MAX], line[512];
+    const char *suffix = level > 0 ? ".txt.gz" : ".txt";
+    long long in = 0, size;
+    double t0, wall, cpu, mb;
+    int n, first, last;
+    long i;
+    cJSON *j;
+    char *str;
+
+    snprintf(prefix, sizeof(prefix), "%s/iperf_logbench_%d_", dir, (int) getpid());
+    getrusage(RUSAGE_SELF, &ru0);
+    t0 = wall_secs();
+    lw = iperf_logwriter_open(prefix, suffix, LOGBENCH_PART_SIZE, level);
+    if (lw == NULL) {
+        perror(prefix);
+        return -1;
+    }
+    for (i = 0; in < total; i++) {
+        n = logbench_line(line, sizeof(line), i, json);
+        if (iperf_logwriter_write(lw, line, n) < 0)
+            break;
+        in += n;
+    }
+    iperf_logwriter_parts(lw, &first, &last);
+    if (iperf_logwriter_close(lw) < 0) {
+        perror(prefix);
+        logbench_remove(prefix, suffix, first, last);
+        return -1;
+    }
+    wall = wall_secs() - t0;
+    getrusage(RUSAGE_SELF, &ru1);
+    size = logbench_remove(prefix, suffix, first, last);
+
+    mb = in / 1048576.0;
+    cpu = cpu_secs(&ru1) - cpu_secs(&ru0);
+    j = iperf_json_printf("format: %s  level: %d  bytes_in: %d  bytes_out: %d  parts: %d",
+                          json ? "json-stream" : "text", (int64_t) level, (int64_t) in,
+                          (int64_t) size, (int64_t) (last - first + 1));
+    if (j == NULL) {
+        fprintf(stderr, "iperf_logbench: out of memory\n");
+        exit(1);
+    }
+    cJSON_AddNumberToObject(j, "ratio", size > 0 ? (double) in / size : 0.0);
+    cJSON_AddNumberToObject(j, "seconds", wall);
+    cJSON_AddNumberToObject(j, "cpu_ms_per_mb", 1000.0 * cpu / mb);
+    if (base >= 0)
+        cJSON_AddNumberToObject(j, "compression_cpu_ms_per_mb", 1000.0 * cpu / mb - base);
+    str = cJSON_PrintUnformatted(j);
+    if (str != NULL) {
+        fprintf(out, "%s\n", str);
+        fflush(out);
+        cJSON_free(str);
+    }
+    cJSON_Delete(j);
+    return 1000.0 * cpu / mb;
+}
+
+int
+main(int argc, char **argv)
+{
+    int levels[LOGBENCH_MAX_LEVELS] = { 0, 1, 3, 6, 9 }, nlevels = 5;
+    int json = 0, mbs = LOGBENCH_MB, flag, l, failed = 0;
+    const char *dir = ".";
+    char *copy, *tok, *save;
+    double cost, base = -1;
+    FILE *out = stdout;
+
+    while ((flag = getopt(argc, argv, "Jm:z:d:o:h")) != -1) {
+        switch (flag) {
+            case 'J':
+                json = 1;
+                break;
+            case 'm':
+                mbs = atoi(optarg);
+                if (mbs <= 0) {
+                    logbench_usage(stderr);
+                    return 1;
+                }
+                break;
+            case 'z':
+                copy = strdup(optarg);
+                if (copy == NULL)
+                    return 1;
+                nlevels = 0;
+                for (tok = strtok_r(copy, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+                    if (nlevels == LOGBENCH_MAX_LEVELS || atoi(tok) < 0 || atoi(tok) > 9) {
+                        logbench_usage(stderr);
+                        return 1;
+                    }
+                    levels[nlevels++] = atoi(tok);
+                }
+                free(copy);
+                if (nlevels == 0) {
+                    logbench_usage(stderr);
+                    return 1;
+                }
+                break;
+            case 'd':
+                dir = optarg;
+                break;
+            case 'o':
+                out = fopen(optarg, "w");
+                if (out == NULL) {
+                    perror(optarg);
+                    return 1;
+                }
+                break;
+            case 'h':
+                logbench_usage(stdout);
+                return 0;
+            default:
+                logbench_usage(stderr);
+                return 1;
+        }
+    }
+
+    for (l = 0; l < nlevels; l++) {
+        cost = logbench_run(dir, json, (long long) mbs * 1048576, levels[l], base, out);
+        if (cost < 0)
+            failed++;
+        else if (levels[l] == 0)
+            base = cost;
+    }
+
+    if (out != stdout)
+        fclose(out);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,510 @@
+/*
+ * Batched, rotating text log writer.
+ *
+ * The app keeps a text log of every line a test prints, and with -i 0.1
+ * that is tens of lines a second.  Opening, appending to and closing the
+ * file for each one (and looking for the right part to append to) puts
+ * a handful of file system calls on the path of every line.  Instead,
+ * lines are only copied into a queue, and a writer thread hands the
+ * queue to the kernel in one write once it is big or old enough, syncs
+ * every few seconds rather than never, and moves on to the next part of
+ * the log when one is full.
+ *
+ * Soak tests with -J --json-stream write hundreds of MB of very
+ * repetitive text, so the writer can also deflate it on the way out.
+ * That costs CPU on the writer thread only; iperf_logbench measures how
+ * much per MB, against how much smaller the log gets.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#if defined(HAVE_ZLIB)
+#include <zlib.h>
+#endif /* HAVE_ZLIB */
+
+#include "iperf.h"
+#include "iperf_pacer.h"
+#include "iperf_logwriter.h"
+
+struct iperf_logwriter {
+    char *prefix;
+    char *suffix;
+    off_t max_size;
+    int fd;                     /* the part open, writer only */
+    off_t size;                 /* of that part, writer only */
+    int first_part;
+    int compress;               /* zlib level, or 0 */
+#if defined(HAVE_ZLIB)
+    z_stream zs;                /* writer only, like the rest of the deflate state */
+    int in_member;              /* text deflated since the member's header */
+    unsigned char *zbuf;
+#endif /* HAVE_ZLIB */
+
+    pthread_mutex_t lock;       /* everything below */
+    pthread_cond_t wake;        /* the writer waits on this */
+    pthread_cond_t written;     /* and flushes on this */
+    int part;
+    char *queue;                /* text not yet taken by the writer */
+    size_t queued;
+    size_t queue_size;
+    int64_t queued_ns;          /* when the oldest of it came */
+    size_t dropped;             /* bytes, since the writer last looked */
+    uint64_t flushes_asked;
+    uint64_t flushes_done;
+    int error;                  /* errno of the first failed write */
+    int stopping;
+    pthread_t thread;
+};
+
+static void
+logwriter_path(struct iperf_logwriter *lw, int part, char *path, size_t size)
+{
+    snprintf(path, size, "%s%d%s", lw->prefix, part, lw->suffix);
+}
+
+static int
+logwriter_open_part(struct iperf_logwriter *lw, int part)
+{
+    char path[PATH_MAX];
+    struct stat st;
+    int fd;
+
+    logwriter_path(lw, part, path, sizeof(path));
+    fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+    lw->fd = fd;
+    lw->size = st.st_size;
+    return 0;
+}
+
+/* Close the full part and start the next one */
+static int
+logwriter_next_part(struct iperf_logwriter *lw)
+{
+    int part;
+
+    (void) fdatasync(lw->fd);
+    close(lw->fd);
+    lw->fd = -1;
+
+    pthread_mutex_lock(&lw->lock);
+    part = ++lw->part;
+    pthread_mutex_unlock(&lw->lock);
+    return logwriter_open_part(lw, part);
+}
+
+static int
+logwriter_write_all(int fd, const char *text, size_t len)
+{
+    ssize_t w;
+
+    while (len > 0) {
+        w = write(fd, text, len);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        text += w;
+        len -= w;
+    }
+    return 0;
+}
+
+#if defined(HAVE_ZLIB)
+#define LOGWRITER_ZBUF_SIZE (64 * 1024)
+
+/* Deflate text (or, with no text, just flush) and write out what comes */
+static int
+logwriter_deflate(struct iperf_logwriter *lw, const char *text, size_t len, int flush)
+{
+    size_t n;
+
+    lw->zs.next_in = (Bytef *) text;
+    lw->zs.avail_in = len;
+    do {
+        lw->zs.next_out = lw->zbuf;
+        lw->zs.avail_out = LOGWRITER_ZBUF_SIZE;
+        if (deflate(&lw->zs, flush) == Z_STREAM_ERROR) {
+            errno = EIO;
+            return -1;
+        }
+        n = LOGWRITER_ZBUF_SIZE - lw->zs.avail_out;
+        if (n > 0 && logwriter_write_all(lw->fd, (char *) lw->zbuf, n) < 0)
+            return -1;
+        lw->size += n;
+    } while (lw->zs.avail_out == 0);
+    if (len > 0)
+        lw->in_member = 1;
+    return 0;
+}
+#endif /* HAVE_ZLIB */
+
+/*
+ * After a batch: with compression, flush it so that it can all be read
+ * back, and at a sync point, or once the part is full, end the member.
+ */
+static int
+logwriter_end_batch(struct iperf_logwriter *lw, int sync)
+{
+#if defined(HAVE_ZLIB)
+    int full = 0;
+
+    if (!lw->compress || !lw->in_member)
+        return 0;
+    if (!sync) {
+        if (logwriter_deflate(lw, NULL, 0, Z_SYNC_FLUSH) < 0)
+            return -1;
+        full = lw->size >= lw->max_size;
+        if (!full)
+            return 0;
+    }
+    if (logwriter_deflate(lw, NULL, 0, Z_FINISH) < 0)
+        return -1;
+    deflateReset(&lw->zs);
+    lw->in_member = 0;
+    if (full || lw->size >= lw->max_size)
+        return logwriter_next_part(lw);
+#else
+    (void) lw;
+    (void) sync;
+#endif /* HAVE_ZLIB */
+    return 0;
+}
+
+/* Write text out, starting new parts as they fill up, at line ends */
+static int
+logwriter_write_out(struct iperf_logwriter *lw, const char *text, size_t len)
+{
+    const char *nl;
+    size_t n, room;
+
+#if defined(HAVE_ZLIB)
+    /* Compressed parts are only ever full at the end of a batch */
+    if (lw->compress)
+        return logwriter_deflate(lw, text, len, Z_NO_FLUSH);
+#endif /* HAVE_ZLIB */
+
+    while (len > 0) {
+        n = len;
+        if (lw->size + (off_t) len > lw->max_size) {
+            /* As much as fits, up to the end of a line */
+            room = lw->size < lw->max_size ? (size_t) (lw->max_size - lw->size) : 0;
+            for (n = room < len ? room : len; n > 0 && text[n - 1] != '\n'; n--)
+                ;
+            if (n == 0 && lw->size == 0) {
+                /* A line longer than a whole part gets one to itself */
+                nl = memchr(text, '\n', len);
+                n = nl != NULL ? (size_t) (nl - text) + 1 : len;
+            }
+        }
+        if (n > 0) {
+            if (logwriter_write_all(lw->fd, text, n) < 0)
+                return -1;
+            lw->size += n;
+            text += n;
+            len -= n;
+        }
+        if (len > 0 && logwriter_next_part(lw) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+static void *
+logwriter_run(void *arg)
+{
+    struct iperf_logwriter *lw = arg;
+    struct timespec deadline;
+    char *batch = NULL, *swap;
+    size_t batch_size = 0, len, dropped;
+    int64_t now, synced_ns, due;
+    uint64_t flushes;
+    int dirty = 0, sync_now, stopping, rc;
+    char note[64];
+
+    synced_ns = iperf_pacer_now();
+    pthread_mutex_lock(&lw->lock);
+    for (;;) {
+        /* Sleep until a batch is due, a flush is asked for, or a sync */
+        for (;;) {
+            now = iperf_pacer_now();
+            if (lw->stopping || lw->flushes_asked != lw->flushes_done ||
+                lw->queued >= LOGWRITER_BATCH_BYTES)
+                break;
+            if (lw->queued > 0 && now - lw->queued_ns >= (int64_t) LOGWRITER_FLUSH_MS * mS_TO_NS)
+                break;
+            if (dirty && now - synced_ns >= (int64_t) LOGWRITER_SYNC_MS * mS_TO_NS)
+                break;
+            if (lw->queued == 0 && !dirty) {
+                pthread_cond_wait(&lw->wake, &lw->lock);
+                continue;
+            }
+            due = lw->queued > 0 ? lw->queued_ns + (int64_t) LOGWRITER_FLUSH_MS * mS_TO_NS : INT64_MAX;
+            if (dirty && synced_ns + (int64_t) LOGWRITER_SYNC_MS * mS_TO_NS < due)
+                due = synced_ns + (int64_t) LOGWRITER_SYNC_MS * mS_TO_NS;
+            deadline.tv_sec = due / SEC_TO_NS;
+            deadline.tv_nsec = due % SEC_TO_NS;
+            (void) pthread_cond_timedwait(&lw->wake, &lw->lock, &deadline);
+        }
+
+        /* Take the queue, and leave our emptied buffer for the next lines */
+        swap = lw->queue;
+        lw->queue = batch;
+        batch = swap;
+        len = lw->queue_size;
+        lw->queue_size = batch_size;
+        batch_size = len;
+        len = lw->queued;
+        lw->queued = 0;
+        dropped = lw->dropped;
+        lw->dropped = 0;
+        flushes = lw->flushes_asked;
+        sync_now = flushes != lw->flushes_done || lw->stopping;
+        stopping = lw->stopping;
+        pthread_mutex_unlock(&lw->lock);
+
+        /* After a failure keep taking the queue, so it can't grow forever */
+        rc = 0;
+        if (lw->fd >= 0 && (len > 0 || dropped > 0)) {
+            rc = logwriter_write_out(lw, batch, len);
+            if (rc == 0 && dropped > 0) {
+                snprintf(note, sizeof(note), "[log] %zu bytes dropped here\n", dropped);
+                rc = logwriter_write_out(lw, note, strlen(note));
+            }
+            dirty = 1;
+        }
+        now = iperf_pacer_now();
+        sync_now = dirty && (sync_now || now - synced_ns >= (int64_t) LOGWRITER_SYNC_MS * mS_TO_NS);
+        if (rc == 0 && lw->fd >= 0 && (len > 0 || dropped > 0 || sync_now))
+            rc = logwriter_end_batch(lw, sync_now);
+        if (rc == 0 && lw->fd >= 0 && sync_now) {
+            rc = fdatasync(lw->fd);
+            dirty = 0;
+            synced_ns = now;
+        }
+
+        pthread_mutex_lock(&lw->lock);
+        if (rc < 0 && !lw->error)
+            lw->error = errno;
+        lw->flushes_done = flushes;
+        pthread_cond_broadcast(&lw->written);
+        if (stopping && lw->queued == 0)
+            break;
+    }
+    pthread_mutex_unlock(&lw->lock);
+    free(batch);
+    return NULL;
+}
+
+struct iperf_logwriter *
+iperf_logwriter_open(const char *prefix, const char *suffix, off_t max_size, int compress)
+{
+    struct iperf_logwriter *lw;
+    pthread_condattr_t attr;
+    char path[PATH_MAX];
+    struct stat st;
+    off_t size = 0;
+    int saved_errno;
+
+    lw = (struct iperf_logwriter *) calloc(1, sizeof(*lw));
+    if (lw == NULL)
+        return NULL;
+    lw->fd = -1;
+    lw->max_size = max_size;
+    lw->compress = compress;
+    lw->prefix = strdup(prefix);
+    lw->suffix = strdup(suffix);
+    if (lw->prefix == NULL || lw->suffix == NULL)
+        goto fail;
+
+    if (compress) {
+#if defined(HAVE_ZLIB)
+        /* +16: gzip framing, so the parts are ordinary .gz files */
+        lw->zbuf = malloc(LOGWRITER_ZBUF_SIZE);
+        if (lw->zbuf == NULL)
+            goto fail;
+        if (deflateInit2(&lw->zs, compress, Z_DEFLATED, LOGWRITER_WINDOW_BITS + 16,
+                         LOGWRITER_MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK) {
+            free(lw->zbuf);
+            lw->zbuf = NULL;
+            errno = EINVAL;
+            goto fail;
+        }
+#else
+        errno = ENOTSUP;
+        goto fail;
+#endif /* HAVE_ZLIB */
+    }
+
+    /* A reopened log carries on in its last part, if that has room */
+    for (lw->part = 1; ; lw->part++) {
+        logwriter_path(lw, lw->part, path, sizeof(path));
+        if (stat(path, &st) < 0)
+            break;
+        size = st.st_size;
+    }
+    if (lw->part > 1 && size < max_size)
+        lw->part--;
+    lw->first_part = lw->part;
+    if (logwriter_open_part(lw, lw->part) < 0)
+        goto fail;
+
+    /* Deadlines are on the same clock as iperf_pacer_now() */
+    if (pthread_condattr_init(&attr) != 0)
+        goto fail;
+    if (pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) != 0 ||
+        pthread_cond_init(&lw->wake, &attr) != 0) {
+        pthread_condattr_destroy(&attr);
+        goto fail;
+    }
+    pthread_condattr_destroy(&attr);
+    if (pthread_cond_init(&lw->written, NULL) != 0)
+        goto fail_wake;
+    if (pthread_mutex_init(&lw->lock, NULL) != 0)
+        goto fail_written;
+    if (pthread_create(&lw->thread, NULL, logwriter_run, lw) != 0)
+        goto fail_mutex;
+    return lw;
+
+fail_mutex:
+    pthread_mutex_destroy(&lw->lock);
+fail_written:
+    pthread_cond_destroy(&lw->written);
+fail_wake:
+    pthread_cond_destroy(&lw->wake);
+fail:
+    saved_errno = errno;
+    if (lw->fd >= 0)
+        close(lw->fd);
+#if defined(HAVE_ZLIB)
+    if (lw->zbuf != NULL) {
+        deflateEnd(&lw->zs);
+        free(lw->zbuf);
+    }
+#endif /* HAVE_ZLIB */
+    free(lw->prefix);
+    free(lw->suffix);
+    free(lw);
+    errno = saved_errno;
+    return NULL;
+}
+
+int
+iperf_logwriter_write(struct iperf_logwriter *lw, const char *text, size_t len)
+{
+    size_t size;
+    char *queue;
+
+    pthread_mutex_lock(&lw->lock);
+    if (lw->error) {
+        errno = lw->error;
+        pthread_mutex_unlock(&lw->lock);
+        return -1;
+    }
+    if (lw->queued + len > lw->queue_size) {
+        size = lw->queue_size > 0 ? lw->queue_size : 2 * LOGWRITER_BATCH_BYTES;
+        while (size < lw->queued + len)
+            size *= 2;
+        queue = size <= LOGWRITER_MAX_PENDING ? realloc(lw->queue, size) : NULL;
+        if (queue == NULL) {
+            lw->dropped += len;
+            pthread_mutex_unlock(&lw->lock);
+            return 0;
+        }
+        lw->queue = queue;
+        lw->queue_size = size;
+    }
+    if (lw->queued == 0) {
+        /* The writer sleeps for good while there's nothing to do */
+        lw->queued_ns = iperf_pacer_now();
+        pthread_cond_signal(&lw->wake);
+    }
+    memcpy(lw->queue + lw->queued, text, len);
+    lw->queued += len;
+    if (lw->queued >= LOGWRITER_BATCH_BYTES && lw->queued - len < LOGWRITER_BATCH_BYTES)
+        pthread_cond_signal(&lw->wake);
+    pthread_mutex_unlock(&lw->lock);
+    return 0;
+}
+
+int
+iperf_logwriter_flush(struct iperf_logwriter *lw)
+{
+    uint64_t flush;
+    int error;
+
+    pthread_mutex_lock(&lw->lock);
+    flush = ++lw->flushes_asked;
+    pthread_cond_signal(&lw->wake);
+    while (lw->flushes_done < flush)
+        pthread_cond_wait(&lw->written, &lw->lock);
+    error = lw->error;
+    pthread_mutex_unlock(&lw->lock);
+    if (error) {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+void
+iperf_logwriter_parts(struct iperf_logwriter *lw, int *first, int *last)
+{
+    pthread_mutex_lock(&lw->lock);
+    *first = lw->first_part;
+    *last = lw->part;
+    pthread_mutex_unlock(&lw->lock);
+}
+
+int
+iperf_logwriter_close(struct iperf_logwriter *lw)
+{
+    int error;
+
+    pthread_mutex_lock(&lw->lock);
+    lw->stopping = 1;
+    pthread_cond_signal(&lw->wake);
+    pthread_mutex_unlock(&lw->lock);
+    pthread_join(lw->thread, NULL);
+
+    error = lw->error;
+    if (lw->fd >= 0)
+        close(lw->fd);
+    pthread_cond_destroy(&lw->written);
+    pthread_cond_destroy(&lw->wake);
+    pthread_mutex_destroy(&lw->lock);
+#if defined(HAVE_ZLIB)
+    if (lw->zbuf != NULL) {
+        deflateEnd(&lw->zs);
+        free(lw->zbuf);
+    }
+#endif /* HAVE_ZLIB */
+    free(lw->queue);
+    free(lw->prefix);
+    free(lw->suffix);
+    free(lw);
+    if (error) {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,63 @@
+/*
+ * Batched, rotating text log writer.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_LOGWRITER_H
+#define __IPERF_LOGWRITER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Queued text is written out once there is this much of it... */
+#define LOGWRITER_BATCH_BYTES (64 * 1024)
+/* ...or once the oldest of it has waited this long */
+#define LOGWRITER_FLUSH_MS 1000
+/* Written text is synced to storage at least this often */
+#define LOGWRITER_SYNC_MS 5000
+/* Text beyond this, queued while a write is stuck, is dropped and counted */
+#define LOGWRITER_MAX_PENDING (8 * 1024 * 1024)
+
+/*
+ * With compression each part is a gzip file made of members.  Every
+ * batch ends in a sync flush, so all that was written can be decoded, and
+ * every sync point ends the member, so a crash costs at most the last,
+ * unfinished one's checksum: zcat prints everything up to the cut and
+ * then complains.  A small window keeps the deflate state near 64 KB.
+ */
+#define LOGWRITER_WINDOW_BITS 13
+#define LOGWRITER_MEM_LEVEL 6
+
+struct iperf_logwriter;
+
+/*
+ * Start a writer thread appending to "<prefix><part><suffix>", parts
+ * counting from 1: to the last one there is if it is smaller than
+ * max_size, or else to a new one.  A part is closed before it would grow
+ * past max_size, at the end of a line, and the next one started.
+ * With compress, a zlib level from 1 to 9, parts are gzip files and are
+ * closed at the end of the first batch that takes them to max_size.
+ * Returns NULL with errno set if the first part can't be opened, or if
+ * compression is asked for and this build has no zlib (ENOTSUP).
+ */
+struct iperf_logwriter *iperf_logwriter_open(const char *prefix, const char *suffix, off_t max_size,
+                                             int compress);
+
+/*
+ * Queue len bytes of text.  Never blocks on the file: this only copies
+ * under a lock, so it can be called from any thread, for every line.
+ * Returns -1 (with errno set) once a write has failed.
+ */
+int iperf_logwriter_write(struct iperf_logwriter *lw, const char *text, size_t len);
+
+/* Wait until everything queued so far has been written and synced */
+int iperf_logwriter_flush(struct iperf_logwriter *lw);
+
+/* The parts written to so far: first and last, inclusive */
+void iperf_logwriter_parts(struct iperf_logwriter *lw, int *first, int *last);
+
+/* Write out and sync what is queued, stop the thread and free lw; -1 if a write failed */
+int iperf_logwriter_close(struct iperf_logwriter *lw);
+
+#endif /* __IPERF_LOGWRITER_H */
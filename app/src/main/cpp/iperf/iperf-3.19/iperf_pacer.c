@@ -0,0 +1,234 @@
+/*
+ * Token-bucket pacing for -b.
+ *
+ * The old throttle worked out the average rate since the start of the
+ * test on every message.  Where it couldn't sleep it spun on the clock,
+ * and after any stall it sent back-to-back until the average caught up,
+ * so low-rate UDP went out in bursts.  Here each stream has a bucket
+ * that fills at the target rate up to a small depth.  A message is sent
+ * as long as the bucket holds a block's worth; only when it runs dry do
+ * we read the clock, and if that isn't enough we sleep until the
+ * absolute CLOCK_MONOTONIC time at which it will be.
+ *
+ * Since the clock is only read when the bucket runs dry, the achieved
+ * inter-message gap is sampled there too, averaged over the messages
+ * sent since the previous sample.  At low rates that is every message.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_util.h"
+#include "iperf_pacer.h"
+
+int64_t
+iperf_pacer_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * SEC_TO_NS + ts.tv_nsec;
+}
+
+void
+iperf_pacer_sleep_until(int64_t deadline, int64_t now)
+{
+#if defined(HAVE_CLOCK_NANOSLEEP)
+    struct timespec ts;
+
+    (void) now;
+    ts.tv_sec = deadline / SEC_TO_NS;
+    ts.tv_nsec = deadline % SEC_TO_NS;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+#elif defined(HAVE_NANOSLEEP)
+    /* Relative, but to an absolute deadline, so oversleeping doesn't add up */
+    struct timespec ts;
+
+    ts.tv_sec = (deadline - now) / SEC_TO_NS;
+    ts.tv_nsec = (deadline - now) % SEC_TO_NS;
+    (void) nanosleep(&ts, NULL);
+#else /* !HAVE_CLOCK_NANOSLEEP && !HAVE_NANOSLEEP */
+    /* Nothing to sleep with; the caller spins on the clock */
+    (void) deadline;
+    (void) now;
+#endif /* HAVE_CLOCK_NANOSLEEP, HAVE_NANOSLEEP */
+}
+
+static void
+pacer_refill(struct iperf_pacer *p, int64_t now)
+{
+    p->tokens += (double) (now - p->refill_ns) * p->rate / SEC_TO_NS;
+    if (p->tokens > p->depth)
+        p->tokens = p->depth;
+    p->refill_ns = now;
+}
+
+/*
+ * The sending thread is the only one adding to the statistics, so a
+ * plain read and an atomic store will do; the store just keeps the main
+ * thread from seeing half of a 64-bit value on 32-bit ARM.
+ */
+#define PACER_ADD(field, n) __atomic_store_n(&(field), (field) + (n), __ATOMIC_RELAXED)
+
+static void
+pacer_sample(struct iperf_pacer *p, int64_t now)
+{
+    struct iperf_pacer_stats *t = &p->total;
+    uint64_t gap, error;
+
+    if (p->sample_ns != 0 && p->sent > 0) {
+        gap = (uint64_t) (now - p->sample_ns) / p->sent;
+        error = gap > (uint64_t) p->target_gap_ns ? gap - p->target_gap_ns : p->target_gap_ns - gap;
+
+        PACER_ADD(t->messages, p->sent);
+        PACER_ADD(t->gap_ns, (uint64_t) (now - p->sample_ns));
+        PACER_ADD(t->error_ns, error * p->sent);
+        if (gap < __atomic_load_n(&t->min_gap_ns, __ATOMIC_RELAXED))
+            __atomic_store_n(&t->min_gap_ns, gap, __ATOMIC_RELAXED);
+        if (gap > __atomic_load_n(&t->max_gap_ns, __ATOMIC_RELAXED))
+            __atomic_store_n(&t->max_gap_ns, gap, __ATOMIC_RELAXED);
+        if (gap < __atomic_load_n(&p->interval_min_gap_ns, __ATOMIC_RELAXED))
+            __atomic_store_n(&p->interval_min_gap_ns, gap, __ATOMIC_RELAXED);
+        if (gap > __atomic_load_n(&p->interval_max_gap_ns, __ATOMIC_RELAXED))
+            __atomic_store_n(&p->interval_max_gap_ns, gap, __ATOMIC_RELAXED);
+    }
+    p->sample_ns = now;
+    p->sent = 0;
+}
+
+/* Rate (bits/s) and depth from the settings, keeping the tokens there are */
+static void
+pacer_set_rate(struct iperf_pacer *p, uint64_t rate)
+{
+    struct iperf_settings *settings = p->settings;
+    double min_depth;
+
+    p->rate = rate / 8.0;
+    p->target_gap_ns = (int64_t) (settings->blksize * SEC_TO_NS / p->rate);
+
+    /*
+     * A burst (-b rate/n) must fit in the bucket to go out back-to-back,
+     * with a block to spare: a bucket only just big enough refills to
+     * exactly that after each sleep, and whatever the sleep overshot by
+     * would be clipped off, so large blocks would fall short of the rate
+     */
+    min_depth = (double) ((settings->burst > 0 ? settings->burst : 1) + 1) * settings->blksize;
+    if (settings->pacing_bucket > 0)
+        p->depth = settings->pacing_bucket;
+    else
+        p->depth = p->rate * PACER_DEFAULT_DEPTH_USECS / SEC_TO_US;
+    if (p->depth < min_depth)
+        p->depth = min_depth;
+    if (p->tokens > p->depth)
+        p->tokens = p->depth;
+}
+
+void
+iperf_pacer_init(struct iperf_stream *sp)
+{
+    struct iperf_pacer *p = &sp->pacer;
+
+    memset(p, 0, sizeof(*p));
+    memset(&sp->omitted_pacer, 0, sizeof(sp->omitted_pacer));
+    p->total.min_gap_ns = p->interval_min_gap_ns = UINT64_MAX;
+    p->settings = sp->settings;
+    if (sp->settings->rate == 0)
+        return;
+    pacer_set_rate(p, sp->settings->rate);
+}
+
+void
+iperf_pacer_set_rate(struct iperf_pacer *p, uint64_t rate)
+{
+    __atomic_store_n(&p->new_rate, rate, __ATOMIC_RELAXED);
+}
+
+void
+iperf_pacer_wait(struct iperf_pacer *p, int len)
+{
+    int64_t now, deadline;
+
+    if (p->tokens >= len)
+        return;
+
+    /* A new rate is picked up here, where the clock gets read anyway */
+    if (__atomic_load_n(&p->new_rate, __ATOMIC_RELAXED) != 0)
+        pacer_set_rate(p, __atomic_exchange_n(&p->new_rate, 0, __ATOMIC_RELAXED));
+
+    now = iperf_pacer_now();
+    if (p->refill_ns == 0) {
+        /* First message: start with just enough for it, not a full bucket */
+        p->refill_ns = p->sample_ns = now;
+        p->tokens = len;
+        return;
+    }
+    pacer_refill(p, now);
+    while (p->tokens < len) {
+        /* When the bucket will hold len, rounded up so one sleep does it */
+        deadline = p->refill_ns + (int64_t) ((len - p->tokens) * SEC_TO_NS / p->rate) + 1;
+        iperf_pacer_sleep_until(deadline, now);
+        PACER_ADD(p->total.sleeps, 1);
+        now = iperf_pacer_now();
+        pacer_refill(p, now);
+    }
+    pacer_sample(p, now);
+}
+
+void
+iperf_pacer_read(struct iperf_pacer *p, struct iperf_pacer_stats *total, struct iperf_pacer_stats *interval)
+{
+    total->messages = __atomic_load_n(&p->total.messages, __ATOMIC_RELAXED);
+    total->gap_ns = __atomic_load_n(&p->total.gap_ns, __ATOMIC_RELAXED);
+    total->error_ns = __atomic_load_n(&p->total.error_ns, __ATOMIC_RELAXED);
+    total->min_gap_ns = __atomic_load_n(&p->total.min_gap_ns, __ATOMIC_RELAXED);
+    total->max_gap_ns = __atomic_load_n(&p->total.max_gap_ns, __ATOMIC_RELAXED);
+    total->sleeps = __atomic_load_n(&p->total.sleeps, __ATOMIC_RELAXED);
+    if (interval != NULL) {
+        interval->min_gap_ns = __atomic_exchange_n(&p->interval_min_gap_ns, UINT64_MAX, __ATOMIC_RELAXED);
+        interval->max_gap_ns = __atomic_exchange_n(&p->interval_max_gap_ns, 0, __ATOMIC_RELAXED);
+    }
+}
+
+void
+iperf_pacer_diff(const struct iperf_pacer_stats *now, const struct iperf_pacer_stats *before, struct iperf_pacer_stats *diff)
+{
+    diff->messages = now->messages - (before == NULL ? 0 : before->messages);
+    diff->gap_ns = now->gap_ns - (before == NULL ? 0 : before->gap_ns);
+    diff->error_ns = now->error_ns - (before == NULL ? 0 : before->error_ns);
+    diff->sleeps = now->sleeps - (before == NULL ? 0 : before->sleeps);
+}
+
+void
+iperf_pacer_omit(struct iperf_pacer *p, struct iperf_pacer_stats *omitted)
+{
+    iperf_pacer_read(p, omitted, NULL);
+    __atomic_store_n(&p->total.min_gap_ns, UINT64_MAX, __ATOMIC_RELAXED);
+    __atomic_store_n(&p->total.max_gap_ns, 0, __ATOMIC_RELAXED);
+}
+
+cJSON *
+iperf_pacer_json(struct iperf_pacer *p, const struct iperf_pacer_stats *stats)
+{
+    cJSON *j;
+
+    j = iperf_json_printf("target_gap_us: %f  bucket_bytes: %d  sleeps: %d",
+                          p->target_gap_ns / 1000.0, (int64_t) p->depth, (int64_t) stats->sleeps);
+    if (j != NULL && stats->messages > 0) {
+        cJSON_AddNumberToObject(j, "gap_us", (double) stats->gap_ns / stats->messages / 1000.0);
+        cJSON_AddNumberToObject(j, "gap_error_us", (double) stats->error_ns / stats->messages / 1000.0);
+        if (stats->min_gap_ns != UINT64_MAX)
+            cJSON_AddNumberToObject(j, "gap_min_us", stats->min_gap_ns / 1000.0);
+        cJSON_AddNumberToObject(j, "gap_max_us", stats->max_gap_ns / 1000.0);
+    }
+    return j;
+}
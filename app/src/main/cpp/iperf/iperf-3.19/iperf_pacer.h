@@ -0,0 +1,63 @@
+/*
+ * Token-bucket pacing for -b.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_PACER_H
+#define __IPERF_PACER_H
+
+#include "iperf.h"
+
+/*
+ * Set up sp->pacer from the test's -b rate, --pacing-bucket and burst
+ * settings.  Nothing is paced if the rate is 0.
+ */
+void iperf_pacer_init(struct iperf_stream *sp);
+
+/*
+ * Main thread: have the sending thread switch to rate (bits/s) the next
+ * time the bucket runs dry.  Only for a stream that is being paced.
+ */
+void iperf_pacer_set_rate(struct iperf_pacer *p, uint64_t rate);
+
+/* CLOCK_MONOTONIC, in nanoseconds */
+int64_t iperf_pacer_now(void);
+
+/*
+ * Sleep until the CLOCK_MONOTONIC time deadline; now is a recent reading
+ * of that clock, for platforms that can only sleep for a duration.  May
+ * return early if interrupted.
+ */
+void iperf_pacer_sleep_until(int64_t deadline, int64_t now);
+
+/*
+ * Sending thread only: wait until the bucket holds len bytes, sleeping
+ * to an absolute deadline if it has run dry, then charge the bytes
+ * actually sent with iperf_pacer_spend().
+ */
+void iperf_pacer_wait(struct iperf_pacer *p, int len);
+
+static inline void
+iperf_pacer_spend(struct iperf_pacer *p, int bytes)
+{
+    p->tokens -= bytes;
+    p->sent++;
+}
+
+/*
+ * Main thread: current totals, and the gap range since the last call
+ * (min_gap_ns/max_gap_ns of *interval, which is otherwise left alone).
+ */
+void iperf_pacer_read(struct iperf_pacer *p, struct iperf_pacer_stats *total, struct iperf_pacer_stats *interval);
+
+/* Counters of now less those of before (may be NULL); min/max are left alone */
+void iperf_pacer_diff(const struct iperf_pacer_stats *now, const struct iperf_pacer_stats *before, struct iperf_pacer_stats *diff);
+
+/* Main thread, at the end of -O: snapshot into *omitted and restart min/max */
+void iperf_pacer_omit(struct iperf_pacer *p, struct iperf_pacer_stats *omitted);
+
+/* stats as a JSON object, in microseconds */
+cJSON *iperf_pacer_json(struct iperf_pacer *p, const struct iperf_pacer_stats *stats);
+
+#endif /* __IPERF_PACER_H */
@@ -0,0 +1,143 @@
+/*
+ * Closed-loop bandwidth search for --rate-search.
+ *
+ * Finding the highest rate a path takes without losing more than a
+ * given share of UDP packets used to mean running whole tests one after
+ * another with a higher -b each time.  Here the search runs inside one
+ * test: at every stats interval the receiving side reports what arrived
+ * and what was lost over the control connection, and the sending side
+ * moves every stream's pacer to the next rate to try.
+ *
+ * A rate that lost too much leaves queues behind it, so the interval
+ * after one is not counted against the next rate.  A rate the senders
+ * couldn't reach is treated as too high, but what they did reach
+ * without loss counts as good.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "iperf.h"
+#include "iperf_util.h"
+#include "iperf_rate_search.h"
+
+struct iperf_rate_search *
+iperf_rate_search_new(double loss_threshold, uint64_t start_rate)
+{
+    struct iperf_rate_search *rs;
+
+    rs = (struct iperf_rate_search *) calloc(1, sizeof(*rs));
+    if (rs == NULL)
+        return NULL;
+    rs->loss_threshold = loss_threshold;
+    rs->rate = start_rate < RATE_SEARCH_MIN_RATE ? RATE_SEARCH_MIN_RATE : start_rate;
+    return rs;
+}
+
+void
+iperf_rate_search_free(struct iperf_rate_search *rs)
+{
+    if (rs == NULL)
+        return;
+    free(rs->steps);
+    free(rs);
+}
+
+static void
+rate_search_record(struct iperf_rate_search *rs, const struct iperf_rate_search_step *step)
+{
+    struct iperf_rate_search_step *steps;
+    int max_steps;
+
+    if (rs->num_steps == rs->max_steps) {
+        max_steps = rs->max_steps ? rs->max_steps * 2 : 32;
+        steps = realloc(rs->steps, max_steps * sizeof(*steps));
+        if (steps == NULL)
+            return;             /* the search goes on, the trajectory just has a gap */
+        rs->steps = steps;
+        rs->max_steps = max_steps;
+    }
+    rs->steps[rs->num_steps++] = *step;
+}
+
+uint64_t
+iperf_rate_search_step(struct iperf_rate_search *rs, double time, int streams,
+                       double sent_bps, double received_bps, double lost_percent)
+{
+    struct iperf_rate_search_step step;
+    uint64_t achieved;
+
+    if (rs->done)
+        return rs->rate;
+    if (rs->skip > 0) {
+        rs->skip--;
+        return rs->rate;
+    }
+
+    memset(&step, 0, sizeof(step));
+    step.time = time;
+    step.rate = rs->rate;
+    step.sent_bps = sent_bps;
+    step.received_bps = received_bps;
+    step.lost_percent = lost_percent;
+    step.sender_limited = streams > 0 && sent_bps < RATE_SEARCH_SHORTFALL * rs->rate * streams;
+    step.good = lost_percent <= rs->loss_threshold && !step.sender_limited;
+    rate_search_record(rs, &step);
+
+    if (step.good) {
+        rs->lo = rs->rate;
+    } else {
+        rs->hi = rs->rate;
+        if (lost_percent <= rs->loss_threshold) {
+            achieved = (uint64_t) (sent_bps / streams);
+            if (achieved > rs->lo)
+                rs->lo = achieved;
+        } else
+            rs->skip = 1;
+    }
+
+    if (rs->hi == 0)
+        rs->rate *= 2;                  /* nothing has failed yet */
+    else if (rs->lo == 0)
+        rs->rate = rs->hi / 2;          /* nothing has passed yet */
+    else if (rs->hi - rs->lo <= RATE_SEARCH_TOLERANCE * rs->hi) {
+        rs->rate = rs->lo;
+        rs->done = rs->converged = 1;
+    } else
+        rs->rate = rs->lo + (rs->hi - rs->lo) / 2;
+
+    if (rs->rate < RATE_SEARCH_MIN_RATE) {
+        rs->rate = RATE_SEARCH_MIN_RATE;
+        rs->done = 1;
+    }
+    return rs->rate;
+}
+
+cJSON *
+iperf_rate_search_json(const struct iperf_rate_search *rs, int streams)
+{
+    const struct iperf_rate_search_step *st;
+    cJSON *j, *j_steps;
+    int i;
+
+    j = iperf_json_printf("loss_threshold: %f  converged: %b  rate: %d  total_rate: %d",
+                          rs->loss_threshold, rs->converged, (int64_t) rs->lo, (int64_t) rs->lo * streams);
+    if (j == NULL)
+        return NULL;
+    j_steps = cJSON_CreateArray();
+    if (j_steps == NULL)
+        return j;
+    for (i = 0; i < rs->num_steps; i++) {
+        st = &rs->steps[i];
+        cJSON_AddItemToArray(j_steps, iperf_json_printf("time: %f  rate: %d  sent_bps: %f  received_bps: %f  lost_percent: %f  good: %b  sender_limited: %b",
+                                                        st->time, (int64_t) st->rate, st->sent_bps, st->received_bps,
+                                                        st->lost_percent, st->good, st->sender_limited));
+    }
+    cJSON_AddItemToObject(j, "steps", j_steps);
+    return j;
+}
@@ -0,0 +1,61 @@
+/*
+ * Closed-loop bandwidth search for --rate-search.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_RATE_SEARCH_H
+#define __IPERF_RATE_SEARCH_H
+
+#include <stdint.h>
+
+#include "cjson.h"
+
+/* Stop bisecting once the highest good rate is within this share of the lowest bad one */
+#define RATE_SEARCH_TOLERANCE 0.02
+/* Senders below this share of the target rate couldn't keep up */
+#define RATE_SEARCH_SHORTFALL 0.9
+/* Per stream, bits/s; the search gives up below this */
+#define RATE_SEARCH_MIN_RATE (10 * 1000)
+
+/* One measured interval, and what the search made of it */
+struct iperf_rate_search_step {
+    double time;                /* seconds since the search started */
+    uint64_t rate;              /* per stream target, bits/s */
+    double sent_bps;            /* all sending streams */
+    double received_bps;
+    double lost_percent;
+    int good;                   /* loss within the threshold and the senders kept up */
+    int sender_limited;
+};
+
+struct iperf_rate_search {
+    double loss_threshold;      /* percent */
+    uint64_t rate;              /* per stream target now, bits/s */
+    uint64_t lo;                /* highest rate found good, 0 if none yet */
+    uint64_t hi;                /* lowest rate found bad, 0 if none yet */
+    int skip;                   /* feedback to ignore while a lossy rate's queues drain */
+    int done;
+    int converged;
+    struct iperf_rate_search_step *steps;
+    int num_steps, max_steps;
+};
+
+struct iperf_rate_search *iperf_rate_search_new(double loss_threshold, uint64_t start_rate);
+void iperf_rate_search_free(struct iperf_rate_search *rs);
+
+/*
+ * Feed in one interval as seen by the receivers (received_bps and
+ * lost_percent) and the senders (sent_bps, over streams streams), and
+ * get back the per stream rate to send at next.  Doubles the rate until
+ * one fails (or halves it until one passes), then bisects between the
+ * best good and the worst bad rate until they are RATE_SEARCH_TOLERANCE
+ * apart, and then holds the good one.
+ */
+uint64_t iperf_rate_search_step(struct iperf_rate_search *rs, double time, int streams,
+                                double sent_bps, double received_bps, double lost_percent);
+
+/* The outcome and every step, for the end of the test and the results exchange */
+cJSON *iperf_rate_search_json(const struct iperf_rate_search *rs, int streams);
+
+#endif /* __IPERF_RATE_SEARCH_H */
@@ -49,15 +49,19 @@
 
 #include "iperf.h"
 #include "iperf_api.h"
+#include "iperf_history.h"
 #include "iperf_udp.h"
 #include "iperf_tcp.h"
 #include "iperf_util.h"
 #include "timer.h"
 #include "iperf_time.h"
 #include "net.h"
+#include "perf_counters.h"
+#include "iperf_tcpinfo_sampler.h"
 #include "units.h"
 #include "iperf_util.h"
 #include "iperf_locale.h"
+#include "iperf_server_pool.h"
 
 #if defined(HAVE_TCP_CONGESTION)
 #if !defined(TCP_CA_NAME_MAX)
@@ -91,6 +95,11 @@ iperf_server_worker_run(void *s) {
     pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
     pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
 
+    /* Affinity and counters belong to the calling thread, so set them up here */
+    iperf_stream_setaffinity(sp);
+    if (test->perf_counters)
+        perf_counters_open(sp);
+
     while (!(test->done) && !(sp->done)) {
         if (sp->sender) {
             if (iperf_send_mt(sp) < 0) {
@@ -111,8 +120,14 @@ iperf_server_worker_run(void *s) {
 int
 iperf_server_listen(struct iperf_test *test) {
     retry:
-    if ((test->listener = netannounce(test->settings->domain, Ptcp, test->bind_address,
-                                      test->bind_dev, test->server_port)) < 0) {
+    /* --accept-threads: the pool adds the other listeners next to this one */
+    if (test->accept_threads > 1)
+        test->listener = netannounce_reuseport(test->settings->domain, Ptcp, test->bind_address,
+                                               test->bind_dev, test->server_port);
+    else
+        test->listener = netannounce(test->settings->domain, Ptcp, test->bind_address,
+                                     test->bind_dev, test->server_port);
+    if (test->listener < 0) {
         if (errno == EAFNOSUPPORT &&
             (test->settings->domain == AF_INET6 || test->settings->domain == AF_UNSPEC)) {
             /* If we get "Address family not supported by protocol", that
@@ -166,52 +181,17 @@ iperf_accept(struct iperf_test *test) {
 
     if (test->ctrl_sck == -1) {
         /* Server free, accept new client */
-        test->ctrl_sck = s;
-        // set TCP_NODELAY for lower latency on control messages
-        int flag = 1;
-        if (setsockopt(test->ctrl_sck, IPPROTO_TCP, TCP_NODELAY, (char *) &flag, sizeof(int))) {
-            i_errno = IESETNODELAY;
-            goto error_handling;
-        }
-
-#if defined(HAVE_TCP_USER_TIMEOUT)
-        int opt;
-        if ((opt = test->settings->snd_timeout)) {
-            if (setsockopt(s, IPPROTO_TCP, TCP_USER_TIMEOUT, &opt, sizeof(opt)) < 0) {
-                i_errno = IESETUSERTIMEOUT;
-                goto error_handling;
-            }
-        }
-#endif /* HAVE_TCP_USER_TIMEOUT */
-
-#if defined (HAVE_TCP_KEEPALIVE)
-        // Set Control Connection TCP Keepalive (especially useful for long UDP test sessions)
-        if (iperf_set_control_keepalive(test) < 0)
-            return -1;
-#endif //HAVE_TCP_KEEPALIVE
-
-        if (Nread(test->ctrl_sck, test->cookie, COOKIE_SIZE, Ptcp) != COOKIE_SIZE) {
+        if (Nread(s, test->cookie, COOKIE_SIZE, Ptcp) != COOKIE_SIZE) {
             /*
              * Note this error covers both the case of a system error
              * or the inability to read the correct amount of data
              * (i.e. timed out).
              */
             i_errno = IERECVCOOKIE;
-            goto error_handling;
+            close(s);
+            return ret;
         }
-        FD_SET(test->ctrl_sck, &test->read_set);
-        if (test->ctrl_sck > test->max_fd) test->max_fd = test->ctrl_sck;
-
-        if (iperf_set_send_state(test, PARAM_EXCHANGE) != 0)
-            goto error_handling;
-        if (iperf_exchange_parameters(test) < 0)
-            goto error_handling;
-        if (test->server_affinity != -1) {
-            if (iperf_setaffinity(test, test->server_affinity) != 0)
-                goto error_handling;
-        }
-        if (test->on_connect)
-            test->on_connect(test);
+        return iperf_accept_control(test, s);
     } else {
         /*
          * Don't try to read from the socket.  It could block an ongoing test.
@@ -229,9 +209,54 @@ iperf_accept(struct iperf_test *test) {
         close(s);
     }
     return 0;
+}
+
+int
+iperf_accept_control(struct iperf_test *test, int s) {
+    test->ctrl_sck = s;
+    // set TCP_NODELAY for lower latency on control messages
+    int flag = 1;
+    if (setsockopt(test->ctrl_sck, IPPROTO_TCP, TCP_NODELAY, (char *) &flag, sizeof(int))) {
+        i_errno = IESETNODELAY;
+        goto error_handling;
+    }
+
+#if defined(HAVE_TCP_USER_TIMEOUT)
+    int opt;
+    if ((opt = test->settings->snd_timeout)) {
+        if (setsockopt(s, IPPROTO_TCP, TCP_USER_TIMEOUT, &opt, sizeof(opt)) < 0) {
+            i_errno = IESETUSERTIMEOUT;
+            goto error_handling;
+        }
+    }
+#endif /* HAVE_TCP_USER_TIMEOUT */
+
+#if defined (HAVE_TCP_KEEPALIVE)
+    // Set Control Connection TCP Keepalive (especially useful for long UDP test sessions)
+    if (iperf_set_control_keepalive(test) < 0)
+        return -1;
+#endif //HAVE_TCP_KEEPALIVE
+
+    FD_SET(test->ctrl_sck, &test->read_set);
+    if (test->ctrl_sck > test->max_fd) test->max_fd = test->ctrl_sck;
+
+    if (iperf_set_send_state(test, PARAM_EXCHANGE) != 0)
+        goto error_handling;
+    if (iperf_exchange_parameters(test) < 0)
+        goto error_handling;
+    if (test->server_affinity != -1) {
+        if (iperf_setaffinity(test, test->server_affinity) != 0)
+            goto error_handling;
+    }
+    if (test->on_connect)
+        test->on_connect(test);
+    return 0;
+
     error_handling:
+    FD_CLR(s, &test->read_set);
     close(s);
-    return ret;
+    test->ctrl_sck = -1;
+    return -1;
 }
 
 
@@ -240,6 +265,7 @@ int
 iperf_handle_message_server(struct iperf_test *test) {
     int rval;
     struct iperf_stream *sp;
+    signed char state;
 
     if (test->debug_level >= DEBUG_LEVEL_INFO) {
         iperf_printf(test, "Reading new State from the Client - current state is %d-%s\n",
@@ -247,7 +273,7 @@ iperf_handle_message_server(struct iperf_test *test) {
     }
 
     // XXX: Need to rethink how this behaves to fit API
-    if ((rval = Nread(test->ctrl_sck, (char *) &test->state, sizeof(signed char), Ptcp)) <= 0) {
+    if ((rval = Nread(test->ctrl_sck, (char *) &state, sizeof(signed char), Ptcp)) <= 0) {
         if (rval == 0) {
             iperf_err(test, "the client has unexpectedly closed the connection");
             i_errno = IECTRLCLOSE;
@@ -258,6 +284,9 @@ iperf_handle_message_server(struct iperf_test *test) {
             return -1;
         }
     }
+    if (state == RATE_FEEDBACK)
+        return iperf_rate_search_recv_feedback(test);
+    test->state = state;
 
     if (test->debug_level >= DEBUG_LEVEL_INFO) {
         iperf_printf(test, "State change: server received and changed State to %d-%s\n",
@@ -268,6 +297,7 @@ iperf_handle_message_server(struct iperf_test *test) {
         case TEST_START:
             break;
         case TEST_END:
+            iperf_tcpinfo_sampler_stop(test);
             test->done = 1;
             cpu_util(test->cpu_util);
             test->stats_callback(test);
@@ -285,15 +315,28 @@ iperf_handle_message_server(struct iperf_test *test) {
                 return -1;
             if (test->on_test_finish)
                 test->on_test_finish(test);
+            iperf_history_end(test, 1);
             break;
         case IPERF_DONE:
             break;
+        case NEXT_PHASE:
+            /* Same settings and control connection, new data connections */
+            if (test->phase >= test->phases) {
+                i_errno = IEMESSAGE;
+                return -1;
+            }
+            if (iperf_reset_phase(test) < 0)
+                return -1;
+            if (iperf_listen_streams(test) < 0)
+                return -1;
+            break;
         case CLIENT_TERMINATE:
             i_errno = IECLIENTTERM;
 
             // Temporarily be in DISPLAY_RESULTS phase so we can get
             // ending summary statistics.
             signed char oldstate = test->state;
+            iperf_tcpinfo_sampler_stop(test);
             cpu_util(test->cpu_util);
             test->state = DISPLAY_RESULTS;
             test->reporter_callback(test);
@@ -344,6 +387,9 @@ server_stats_timer_proc(TimerClientData client_data, struct iperf_time *nowP) {
         return;
     if (test->stats_callback)
         test->stats_callback(test);
+    /* A lost control connection shows up in the main loop */
+    if (test->rate_search_loss >= 0 && test->mode == RECEIVER)
+        (void) iperf_rate_search_send_feedback(test);
 }
 
 static void
@@ -442,12 +488,28 @@ create_server_omit_timer(struct iperf_test *test) {
     return 0;
 }
 
+/* How many data connections to take, in each direction, for the client's test */
+static void
+server_streams_expected(struct iperf_test *test, int *streams_to_send, int *streams_to_rec) {
+    if (test->mode == BIDIRECTIONAL) {
+        *streams_to_send = test->num_streams;
+        *streams_to_rec = test->num_streams;
+    } else if (test->mode == RECEIVER) {
+        *streams_to_rec = test->num_streams;
+        *streams_to_send = 0;
+    } else {
+        *streams_to_send = test->num_streams;
+        *streams_to_rec = 0;
+    }
+}
+
 static void
 cleanup_server(struct iperf_test *test) {
     struct iperf_stream *sp;
 
     /* Cancel outstanding threads */
     int i_errno_save = i_errno;
+    iperf_tcpinfo_sampler_stop(test);
     SLIST_FOREACH(sp, &test->streams, streams) {
         int rc;
         sp->done = 1;
@@ -499,6 +561,8 @@ cleanup_server(struct iperf_test *test) {
         close(test->prot_listener);
         test->prot_listener = -1;
     }
+    if (test->server_session != NULL)
+        iperf_server_session_release_udp(test->server_session);
 
     /* Cancel any remaining timers. */
     if (test->stats_timer != NULL) {
@@ -575,8 +639,11 @@ iperf_run_server(struct iperf_test *test) {
         iflush(test);
     }
 
-    // Open socket and listen
-    if (iperf_server_listen(test) < 0) {
+    // Open socket and listen, unless --max-clients' pool already took the client on
+    if (test->server_session != NULL) {
+        FD_ZERO(&test->read_set);
+        FD_ZERO(&test->write_set);
+    } else if (iperf_server_listen(test) < 0) {
         cleanup_server(test);
         return -2;
     }
@@ -588,7 +655,15 @@ iperf_run_server(struct iperf_test *test) {
     send_streams_accepted = 0;
     rec_streams_accepted = 0;
     rcv_timeout_us =
-            (test->settings->rcv_timeout.secs * SEC_TO_US) + test->settings->rcv_timeout.usecs;
+            (test->settings->rcv_timeout.secs * SEC_TO_US) + test->settings->rcv_timeout.nsecs / 1000;
+
+    if (test->server_session != NULL) {
+        if (iperf_accept_control(test, test->server_session->ctrl_sck) < 0) {
+            cleanup_server(test);
+            return -1;
+        }
+        server_streams_expected(test, &streams_to_send, &streams_to_rec);
+    }
 
     while (test->state != IPERF_DONE) {
 
@@ -626,7 +701,7 @@ iperf_run_server(struct iperf_test *test) {
             }
             if (timeout_us < 0 || timeout_us > rcv_timeout_us) {
                 used_timeout.tv_sec = test->settings->rcv_timeout.secs;
-                used_timeout.tv_usec = test->settings->rcv_timeout.usecs;
+                used_timeout.tv_usec = test->settings->rcv_timeout.nsecs / 1000;
             }
             timeout = &used_timeout;
         }
@@ -671,9 +746,11 @@ iperf_run_server(struct iperf_test *test) {
 
                     /*
                      * Running a test. If we're receiving, be sure we're making
-                     * progress (sender hasn't died/crashed).
+                     * progress (sender hasn't died/crashed).  Nothing is sent
+                     * while the client waits out a --phase-gap, though.
                      */
-                else if (test->mode != SENDER && t_usecs > rcv_timeout_us) {
+                else if (test->mode != SENDER && t_usecs > rcv_timeout_us &&
+                         !(test->state == DISPLAY_RESULTS && test->phase < test->phases)) {
                     /* Idle timeout if no new blocks received */
                     if (test->blocks_received == last_receive_blocks) {
                         test->server_forced_no_msg_restarts_count += 1;
@@ -696,7 +773,7 @@ iperf_run_server(struct iperf_test *test) {
         }
 
         if (result > 0) {
-            if (FD_ISSET(test->listener, &read_set)) {
+            if (test->listener >= 0 && FD_ISSET(test->listener, &read_set)) {
                 if (test->state != CREATE_STREAMS) {
                     if (iperf_accept(test) < 0) {
                         cleanup_server(test);
@@ -705,16 +782,7 @@ iperf_run_server(struct iperf_test *test) {
                     FD_CLR(test->listener, &read_set);
 
                     // Set streams number
-                    if (test->mode == BIDIRECTIONAL) {
-                        streams_to_send = test->num_streams;
-                        streams_to_rec = test->num_streams;
-                    } else if (test->mode == RECEIVER) {
-                        streams_to_rec = test->num_streams;
-                        streams_to_send = 0;
-                    } else {
-                        streams_to_send = test->num_streams;
-                        streams_to_rec = 0;
-                    }
+                    server_streams_expected(test, &streams_to_send, &streams_to_rec);
                 }
             }
             if (FD_ISSET(test->ctrl_sck, &read_set)) {
@@ -723,6 +791,14 @@ iperf_run_server(struct iperf_test *test) {
                     return -1;
                 }
                 FD_CLR(test->ctrl_sck, &read_set);
+
+                /* --phases: the client has asked for the next one */
+                if (test->state == CREATE_STREAMS) {
+                    send_streams_accepted = 0;
+                    rec_streams_accepted = 0;
+                    last_receive_blocks = 0;
+                    last_receive_time = now;
+                }
             }
 
             if (test->state == CREATE_STREAMS) {
@@ -846,10 +922,13 @@ iperf_run_server(struct iperf_test *test) {
 
                 if (rec_streams_accepted == streams_to_rec &&
                     send_streams_accepted == streams_to_send) {
-                    if (test->protocol->id != Ptcp) {
+                    /* A --max-clients session's TCP "listener" is only its own queue from the pool */
+                    if (test->protocol->id != Ptcp || test->server_session != NULL) {
                         FD_CLR(test->prot_listener, &test->read_set);
                         close(test->prot_listener);
                         test->prot_listener = -1;
+                        if (test->server_session != NULL)
+                            iperf_server_session_release_udp(test->server_session);
                     } else {
                         if (test->no_delay || test->settings->mss ||
                             test->settings->socket_bufsize) {
@@ -926,6 +1005,7 @@ iperf_run_server(struct iperf_test *test) {
                             return -1;
                         }
                         sp->thread_created = 1;
+                        iperf_stream_init_cpu_clock(sp);
                         if (test->debug_level >= DEBUG_LEVEL_INFO) {
                             iperf_printf(test, "Thread FD %d created\n", sp->socket);
                         }
@@ -933,6 +1013,8 @@ iperf_run_server(struct iperf_test *test) {
                     if (test->debug_level >= DEBUG_LEVEL_INFO) {
                         iperf_printf(test, "All threads created\n");
                     }
+                    if (test->tcpinfo_sample_ms > 0 && iperf_tcpinfo_sampler_start(test) < 0)
+                        warning("--tcpinfo-sample: unable to start the sampling thread");
                     if (pthread_attr_destroy(&attr) != 0) {
                         i_errno = IEPTHREADATTRDESTROY;
                         cleanup_server(test);
@@ -0,0 +1,706 @@
+/*
+ * Concurrent server for --max-clients.
+ *
+ * The one-client server refuses anybody who connects while a test is
+ * running.  Here one thread owns the listening socket instead and reads
+ * the cookie every connection starts with, without waiting on any one
+ * connection for it.  A cookie it hasn't seen is a
+ * new client: it gets a test of its own, run by the ordinary
+ * iperf_run_server() on a thread of its own.  A cookie it has seen is
+ * one of that client's data connections, and is queued for its test to
+ * pick up as if it had accepted it itself.
+ *
+ * Each client's test is a copy of the listening one, with all of the
+ * server's options.  Timers and error numbers are per thread, so the
+ * tests don't see each other's; they share the output (or --logfile),
+ * each line tagged with the client.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_server_pool.h"
+#include "net.h"
+#include "timer.h"
+
+/* A test for one client, with the server's own options */
+static struct iperf_test *
+pool_new_test(struct iperf_test *server)
+{
+    struct iperf_test *test;
+
+    test = iperf_clone_test(server);
+    if (test == NULL)
+        return NULL;
+    /* Ending a one-off server, and its pidfile, are the pool's business */
+    test->one_off = 0;
+    free(test->pidfile);
+    test->pidfile = NULL;
+
+    return test;
+}
+
+/* Have the pool's thread look at the sessions; a wakeup already pending does as well */
+static void
+pool_wake(struct iperf_server_pool *pool)
+{
+    char c = 0;
+
+    (void) !write(pool->wake[1], &c, 1);
+}
+
+static void
+pool_free_session(struct iperf_server_session *session)
+{
+    size_t i;
+
+    for (i = 0; i < session->num_queued; i++)
+        close(session->queued[i]);
+    close(session->handoff[0]);
+    close(session->handoff[1]);
+    close(session->ctrl_dup);
+    free(session);
+}
+
+static void *
+pool_session_run(void *arg)
+{
+    struct iperf_server_session *session = (struct iperf_server_session *) arg;
+    struct iperf_server_pool *pool = session->pool;
+    struct iperf_test *test = session->test;
+    sigset_t set;
+    int rc;
+
+    /* Signals go to the pool's thread, as they do to the one-client server's */
+    sigemptyset(&set);
+#ifdef SIGTERM
+    sigaddset(&set, SIGTERM);
+#endif
+#ifdef SIGHUP
+    sigaddset(&set, SIGHUP);
+#endif
+#ifdef SIGINT
+    sigaddset(&set, SIGINT);
+#endif
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    rc = iperf_run_server(test);
+    if (rc < 0) {
+        iperf_err(test, "error - %s", iperf_strerror(i_errno));
+        if (test->json_output)
+            iperf_json_finish(test);
+        iflush(test);
+    }
+    session->auth_failed = rc < 0 && i_errno == IEAUTHTEST;
+    iperf_free_test(test);
+    tmr_destroy();
+
+    pthread_mutex_lock(&pool->lock);
+    session->test = NULL;
+    session->finished = 1;
+    pthread_mutex_unlock(&pool->lock);
+    pool_wake(pool);
+    return NULL;
+}
+
+/* Start a test for a new client on control connection s, in a place pool_route kept for it */
+static int
+pool_new_session(struct iperf_server_pool *pool, int s, const char *cookie)
+{
+    struct iperf_server_session *session;
+
+    session = (struct iperf_server_session *) calloc(1, sizeof(*session));
+    if (session == NULL)
+        return -1;
+    session->pool = pool;
+    session->handoff[0] = session->handoff[1] = -1;
+    /* The test closes s when it's done; the pool keeps its own to end it early */
+    session->ctrl_sck = s;
+    session->ctrl_dup = dup(s);
+    if (session->ctrl_dup < 0 || pipe(session->handoff) < 0) {
+        pool_free_session(session);
+        return -1;
+    }
+    memcpy(session->cookie, cookie, COOKIE_SIZE);
+    session->test = pool_new_test(pool->test);
+    if (session->test == NULL) {
+        pool_free_session(session);
+        return -1;
+    }
+    memcpy(session->test->cookie, cookie, COOKIE_SIZE);
+    session->test->server_session = session;
+
+    /* Listed before the thread can take the lock to look for itself */
+    pthread_mutex_lock(&pool->lock);
+    session->id = ++pool->next_id;
+    if (pthread_create(&session->thread, NULL, pool_session_run, session) != 0) {
+        pthread_mutex_unlock(&pool->lock);
+        session->test->server_session = NULL;
+        iperf_free_test(session->test);
+        pool_free_session(session);
+        return -1;
+    }
+    session->next = pool->sessions;
+    pool->sessions = session;
+    pthread_mutex_unlock(&pool->lock);
+    /* So an --idle-timeout the pool is waiting out starts again */
+    pool_wake(pool);
+    return 0;
+}
+
+/* A connection that has sent its cookie: a new client, or a data connection for one we have */
+static void
+pool_route(struct iperf_server_pool *pool, int s, const char *cookie)
+{
+    struct iperf_test *test = pool->test;
+    struct iperf_server_session *session;
+    signed char rbuf = ACCESS_DENIED;
+    char c = 0;
+
+    /* The tests expect their sockets blocking, as accept() gives them */
+    setnonblocking(s, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    for (session = pool->sessions; session != NULL; session = session->next) {
+        if (!session->finished && memcmp(session->cookie, cookie, COOKIE_SIZE) == 0)
+            break;
+    }
+    if (session != NULL) {
+        if (session->num_queued < sizeof(session->queued) / sizeof(session->queued[0]) &&
+            write(session->handoff[1], &c, 1) == 1)
+            session->queued[session->num_queued++] = s;
+        else
+            close(s);
+        pthread_mutex_unlock(&pool->lock);
+        return;
+    }
+    /* A one-off server only lets the clients it has finish once one is done */
+    if (pool->active >= test->max_clients || (test->one_off && pool->served > 0)) {
+        pthread_mutex_unlock(&pool->lock);
+        /* As the one-client server does while it is busy */
+        if (Nwrite(s, (char *) &rbuf, sizeof(rbuf), Ptcp) < 0 && test->debug)
+            printf("failed to send ACCESS_DENIED to a client over --max-clients\n");
+        close(s);
+        return;
+    }
+    pool->active++;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (pool_new_session(pool, s, cookie) < 0) {
+        iperf_err(test, "unable to start a test for a new client: %s", strerror(errno));
+        close(s);
+        pthread_mutex_lock(&pool->lock);
+        pool->active--;
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+/* Take pending connection i out of the intake, keeping the rest in the order they came */
+static void
+pool_intake_remove(struct iperf_server_intake *intake, int i)
+{
+    intake->num_pending--;
+    memmove(&intake->pending[i], &intake->pending[i + 1], (intake->num_pending - i) * sizeof(intake->pending[0]));
+}
+
+static void
+pool_intake_drop(struct iperf_server_intake *intake, int i)
+{
+    close(intake->pending[i].s);
+    pool_intake_remove(intake, i);
+}
+
+/* Pending connection i has sent its cookie */
+static void
+pool_intake_route(struct iperf_server_pool *pool, struct iperf_server_intake *intake, int i)
+{
+    char cookie[COOKIE_SIZE];
+    int s = intake->pending[i].s;
+
+    memcpy(cookie, intake->pending[i].cookie, COOKIE_SIZE);
+    pool_intake_remove(intake, i);
+    pool_route(pool, s, cookie);
+}
+
+/* Read what has come of a pending connection's cookie; 1 if it is all there */
+static int
+pool_intake_read(struct iperf_server_pool *pool, struct iperf_server_pending *p)
+{
+    ssize_t r;
+
+    for (;;) {
+        r = read(p->s, p->cookie + p->got, COOKIE_SIZE - p->got);
+        if (r > 0) {
+            p->got += r;
+            if (p->got == COOKIE_SIZE)
+                return 1;
+        } else if (r < 0 && errno == EINTR)
+            continue;
+        else if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 0;
+        else {
+            /* Only this connection's problem */
+            if (pool->test->debug)
+                printf("no cookie from a new connection, closing it\n");
+            return -1;
+        }
+    }
+}
+
+/* The intake's sockets, for select() */
+static void
+pool_intake_fds(struct iperf_server_intake *intake, fd_set *set, int *max_fd)
+{
+    int i;
+
+    FD_SET(intake->listener, set);
+    if (intake->listener > *max_fd)
+        *max_fd = intake->listener;
+    for (i = 0; i < intake->num_pending; i++) {
+        FD_SET(intake->pending[i].s, set);
+        if (intake->pending[i].s > *max_fd)
+            *max_fd = intake->pending[i].s;
+    }
+}
+
+/* How long select() may wait before a pending cookie is overdue; NULL if none is pending */
+static struct timeval *
+pool_intake_timeout(struct iperf_server_intake *intake, struct timeval *tv)
+{
+    struct iperf_time now, diff;
+    int64_t usecs;
+
+    if (intake->num_pending == 0)
+        return NULL;
+    /* They are kept in the order they came, so the first is due first */
+    iperf_time_now(&now);
+    usecs = iperf_time_diff(&intake->pending[0].deadline, &now, &diff) ? 0 : iperf_time_in_usecs(&diff);
+    tv->tv_sec = usecs / SEC_TO_US;
+    tv->tv_usec = usecs % SEC_TO_US;
+    return tv;
+}
+
+/*
+ * Take a connection off the listener if set says there is one, read
+ * whatever cookies have come in, route the connections that have sent all
+ * of theirs, and drop those that are too slow about it.  -1 if accept()
+ * fails, which means the listener has.
+ */
+static int
+pool_intake(struct iperf_server_pool *pool, struct iperf_server_intake *intake, fd_set *set)
+{
+    struct iperf_server_pending *p;
+    struct sockaddr_storage addr;
+    struct iperf_time now;
+    socklen_t len;
+    int i, s, r;
+
+    for (i = 0; i < intake->num_pending;) {
+        p = &intake->pending[i];
+        r = FD_ISSET(p->s, set) ? pool_intake_read(pool, p) : 0;
+        if (r > 0)
+            pool_intake_route(pool, intake, i);
+        else if (r < 0)
+            pool_intake_drop(intake, i);
+        else
+            i++;
+    }
+
+    iperf_time_now(&now);
+    for (i = 0; i < intake->num_pending;) {
+        if (iperf_time_compare(&intake->pending[i].deadline, &now) <= 0) {
+            if (pool->test->debug)
+                printf("no cookie from a new connection in %d sec, closing it\n", POOL_COOKIE_TIMEOUT);
+            pool_intake_drop(intake, i);
+        } else
+            i++;
+    }
+
+    if (!FD_ISSET(intake->listener, set))
+        return 0;
+    len = sizeof(addr);
+    if ((s = accept(intake->listener, (struct sockaddr *) &addr, &len)) < 0) {
+        i_errno = IEACCEPT;
+        return -1;
+    }
+    if (setnonblocking(s, 1) < 0) {
+        close(s);
+        return 0;
+    }
+    /* Full up: the one that has been waiting longest gives way */
+    if (intake->num_pending == POOL_MAX_PENDING)
+        pool_intake_drop(intake, 0);
+    p = &intake->pending[intake->num_pending++];
+    p->s = s;
+    p->got = 0;
+    p->deadline = now;
+    iperf_time_add_usecs(&p->deadline, POOL_COOKIE_TIMEOUT * SEC_TO_US);
+    /* It has often sent its cookie already */
+    r = pool_intake_read(pool, p);
+    if (r > 0)
+        pool_intake_route(pool, intake, intake->num_pending - 1);
+    else if (r < 0)
+        pool_intake_drop(intake, intake->num_pending - 1);
+    return 0;
+}
+
+/* Close the connections still sending their cookie */
+static void
+pool_intake_close(struct iperf_server_intake *intake)
+{
+    while (intake->num_pending > 0)
+        pool_intake_drop(intake, intake->num_pending - 1);
+}
+
+/* --accept-threads: take connections off one of the listeners until it is shut down */
+static void *
+pool_acceptor_run(void *arg)
+{
+    struct iperf_server_acceptor *acceptor = (struct iperf_server_acceptor *) arg;
+    struct iperf_server_pool *pool = acceptor->pool;
+    struct timeval tv;
+    fd_set read_set;
+    sigset_t set;
+    int max_fd, result;
+
+    /* Signals go to the pool's thread */
+    sigemptyset(&set);
+#ifdef SIGTERM
+    sigaddset(&set, SIGTERM);
+#endif
+#ifdef SIGHUP
+    sigaddset(&set, SIGHUP);
+#endif
+#ifdef SIGINT
+    sigaddset(&set, SIGINT);
+#endif
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    for (;;) {
+        FD_ZERO(&read_set);
+        max_fd = -1;
+        pool_intake_fds(&acceptor->intake, &read_set, &max_fd);
+        result = select(max_fd + 1, &read_set, NULL, NULL, pool_intake_timeout(&acceptor->intake, &tv));
+        if (result < 0 && errno != EINTR) {
+            i_errno = IESELECT;
+            break;
+        }
+        if (result < 0)
+            continue;
+        /* Shutting the listener down wakes us, and accept() then fails */
+        if (pool_intake(pool, &acceptor->intake, &read_set) < 0)
+            break;
+    }
+    pool_intake_close(&acceptor->intake);
+
+    /* Unless the pool is stopping anyway, it has to, like the one-listener server */
+    pthread_mutex_lock(&pool->lock);
+    if (!pool->stopping && pool->acceptor_errno == 0)
+        pool->acceptor_errno = i_errno;
+    pthread_mutex_unlock(&pool->lock);
+    pool_wake(pool);
+    return NULL;
+}
+
+/* Open the other --accept-threads listeners next to test->listener, and start their threads */
+static int
+pool_start_acceptors(struct iperf_server_pool *pool)
+{
+    struct iperf_test *test = pool->test;
+    struct iperf_server_acceptor *acceptor;
+    int i;
+
+    for (i = 0; i < test->accept_threads; i++) {
+        acceptor = &pool->acceptors[i];
+        acceptor->pool = pool;
+        acceptor->intake.num_pending = 0;
+        if (i == 0)
+            acceptor->intake.listener = test->listener;
+        else if ((acceptor->intake.listener = netannounce_reuseport(test->settings->domain, Ptcp, test->bind_address,
+                                                             test->bind_dev, test->server_port)) < 0) {
+            i_errno = IELISTEN;
+            return -1;
+        }
+        if (pthread_create(&acceptor->thread, NULL, pool_acceptor_run, acceptor) != 0) {
+            if (i > 0)
+                close(acceptor->intake.listener);
+            i_errno = IEPTHREADCREATE;
+            return -1;
+        }
+        pool->num_acceptors++;
+    }
+    return 0;
+}
+
+/* Wake the accept threads out of accept(), wait for them, and close their listeners */
+static void
+pool_stop_acceptors(struct iperf_server_pool *pool)
+{
+    int i;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_mutex_unlock(&pool->lock);
+    for (i = 0; i < pool->num_acceptors; i++)
+        shutdown(pool->acceptors[i].intake.listener, SHUT_RDWR);
+    for (i = 0; i < pool->num_acceptors; i++) {
+        pthread_join(pool->acceptors[i].thread, NULL);
+        if (i > 0)
+            close(pool->acceptors[i].intake.listener);
+    }
+    pool->num_acceptors = 0;
+}
+
+/*
+ * Join and free the sessions that are done, adding those that count
+ * towards a one-off server's client to pool->served.
+ */
+static void
+pool_reap(struct iperf_server_pool *pool)
+{
+    struct iperf_server_session *session, **sp, *done = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    for (sp = &pool->sessions; *sp != NULL;) {
+        session = *sp;
+        if (session->finished) {
+            *sp = session->next;
+            session->next = done;
+            done = session;
+            pool->active--;
+            /* Authentication failure doesn't count for 1-off test */
+            if (!session->auth_failed)
+                pool->served++;
+        } else
+            sp = &session->next;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    while (done != NULL) {
+        session = done;
+        done = session->next;
+        pthread_join(session->thread, NULL);
+        pool_free_session(session);
+    }
+}
+
+/* End every client's test, and wait for them */
+static void
+pool_stop(struct iperf_server_pool *pool)
+{
+    struct iperf_server_session *session;
+
+    pthread_mutex_lock(&pool->lock);
+    for (session = pool->sessions; session != NULL; session = session->next) {
+        if (!session->finished)
+            shutdown(session->ctrl_dup, SHUT_RDWR);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    while (pool->sessions != NULL) {
+        session = pool->sessions;
+        pool->sessions = session->next;
+        pthread_join(session->thread, NULL);
+        pool_free_session(session);
+    }
+    pool->active = 0;
+}
+
+int
+iperf_server_pool_wanted(struct iperf_test *test)
+{
+    return test->max_clients > 1 || test->accept_threads > 1;
+}
+
+int
+iperf_run_server_pool(struct iperf_test *test)
+{
+    struct iperf_server_pool pool;
+    struct timeval idle, cookie_tv, *timeout;
+    fd_set read_set;
+    char buf[64];
+    int rc = 0, result, max_fd, active, served, cookie_due;
+
+    memset(&pool, 0, sizeof(pool));
+    pool.test = test;
+    pool.intake.listener = -1;
+
+    if (test->logfile) {
+        if (iperf_open_logfile(test) < 0)
+            return -2;
+    }
+    if (pipe(pool.wake) < 0) {
+        i_errno = IEINITTEST;
+        return -2;
+    }
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_mutex_init(&pool.udp_lock, NULL);
+
+    if (iperf_server_listen(test) < 0) {
+        rc = -2;
+        goto done;
+    }
+    pool.intake.listener = test->listener;
+    /* With --accept-threads this thread only starts and ends things */
+    if (test->accept_threads > 1 && pool_start_acceptors(&pool) < 0) {
+        rc = -2;
+        goto done;
+    }
+    /* Listening, as iperf_run_server() says it is */
+    iperf_set_test_state(test, IPERF_START);
+
+    for (;;) {
+        pthread_mutex_lock(&pool.lock);
+        active = pool.active;
+        served = pool.served;
+        pthread_mutex_unlock(&pool.lock);
+        /* Data connections may still come for clients that are running */
+        if (test->one_off && served > 0 && active == 0)
+            break;
+
+        FD_ZERO(&read_set);
+        FD_SET(pool.wake[0], &read_set);
+        max_fd = pool.wake[0];
+        if (pool.num_acceptors == 0)
+            pool_intake_fds(&pool.intake, &read_set, &max_fd);
+
+        /* As the one-client server, restart when nobody has come for --idle-timeout */
+        timeout = NULL;
+        if (active == 0 && test->settings->idle_timeout > 0) {
+            idle.tv_sec = test->settings->idle_timeout;
+            idle.tv_usec = 0;
+            timeout = &idle;
+        }
+        /* A cookie falling due first isn't the idle timeout */
+        cookie_due = pool.num_acceptors == 0 && pool_intake_timeout(&pool.intake, &cookie_tv) != NULL &&
+            (timeout == NULL || timercmp(&cookie_tv, timeout, <));
+        if (cookie_due)
+            timeout = &cookie_tv;
+
+        result = select(max_fd + 1, &read_set, NULL, NULL, timeout);
+        if (result < 0 && errno != EINTR) {
+            i_errno = IESELECT;
+            rc = -1;
+            break;
+        }
+        if (result == 0 && cookie_due) {
+            FD_ZERO(&read_set);
+            pool_intake(&pool, &pool.intake, &read_set);
+            continue;
+        }
+        if (result == 0) {
+            test->server_forced_idle_restarts_count += 1;
+            rc = test->one_off ? 0 : 2;
+            break;
+        }
+        if (result < 0)
+            continue;
+
+        if (FD_ISSET(pool.wake[0], &read_set)) {
+            /* Whatever woke us, pool_reap looks at them all */
+            (void) !read(pool.wake[0], buf, sizeof(buf));
+            pool_reap(&pool);
+            if (pool.acceptor_errno != 0) {
+                i_errno = pool.acceptor_errno;
+                rc = -1;
+                break;
+            }
+        }
+        if (pool.num_acceptors == 0 && pool_intake(&pool, &pool.intake, &read_set) < 0) {
+            rc = -1;
+            break;
+        }
+    }
+
+  done:
+    pool_intake_close(&pool.intake);
+    pool_stop_acceptors(&pool);
+    pool_stop(&pool);
+    if (test->listener >= 0) {
+        close(test->listener);
+        test->listener = -1;
+    }
+    close(pool.wake[0]);
+    close(pool.wake[1]);
+    pthread_mutex_destroy(&pool.lock);
+    pthread_mutex_destroy(&pool.udp_lock);
+    return rc;
+}
+
+int
+iperf_server_session_take_stream(struct iperf_server_session *session)
+{
+    struct iperf_server_pool *pool = session->pool;
+    char c;
+    int s = -1;
+
+    if (read(session->handoff[0], &c, 1) != 1)
+        return -1;
+    pthread_mutex_lock(&pool->lock);
+    if (session->num_queued > 0) {
+        s = session->queued[0];
+        session->num_queued--;
+        memmove(&session->queued[0], &session->queued[1], session->num_queued * sizeof(session->queued[0]));
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return s;
+}
+
+int
+iperf_server_session_listen(struct iperf_server_session *session)
+{
+    /* The test closes its "listener" once it has its streams, so it gets a copy */
+    return dup(session->handoff[0]);
+}
+
+void
+iperf_server_session_hold_udp(struct iperf_server_session *session)
+{
+    if (session->udp_held)
+        return;
+    pthread_mutex_lock(&session->pool->udp_lock);
+    session->udp_held = 1;
+}
+
+void
+iperf_server_session_release_udp(struct iperf_server_session *session)
+{
+    if (!session->udp_held)
+        return;
+    session->udp_held = 0;
+    pthread_mutex_unlock(&session->pool->udp_lock);
+}
+
+uint64_t
+iperf_server_session_rate(struct iperf_server_session *session, uint64_t rate, int *sessions)
+{
+    struct iperf_server_pool *pool = session->pool;
+    struct iperf_server_session *s;
+    uint64_t total = 0;
+    int n = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    session->rate = rate;
+    for (s = pool->sessions; s != NULL; s = s->next) {
+        if (!s->finished) {
+            total += s->rate;
+            n++;
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    *sessions = n;
+    return total;
+}
@@ -0,0 +1,119 @@
+/*
+ * Concurrent server for --max-clients.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_SERVER_POOL_H
+#define __IPERF_SERVER_POOL_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "iperf.h"
+
+struct iperf_server_pool;
+
+/*
+ * One client's control session, run as an ordinary iperf_run_server()
+ * test of its own on a thread of its own.  The pool hands it the control
+ * connection, then any data connection that comes with its cookie.
+ */
+struct iperf_server_session {
+    struct iperf_server_pool *pool;
+    struct iperf_test *test;
+    int id;                         /* from 1, in the order clients came */
+    int ctrl_sck;                   /* the control connection, for the test to take over */
+    int ctrl_dup;                   /* the pool's own copy, to end the test early */
+    char cookie[COOKIE_SIZE];
+    int handoff[2];                 /* a pipe; a byte for each queued data connection */
+    int queued[MAX_STREAMS * 2];    /* data connections not yet taken */
+    size_t num_queued;
+    uint64_t rate;                  /* last averaged bits/s, for --server-bitrate-limit */
+    int udp_held;                   /* this session has the UDP port to itself */
+    int finished;
+    int auth_failed;                /* doesn't count as a one-off server's client */
+    pthread_t thread;
+    struct iperf_server_session *next;
+};
+
+/* Connections waiting for their cookie at most, and how long they may take over it */
+#define POOL_MAX_PENDING 64
+#define POOL_COOKIE_TIMEOUT 10      /* seconds, as Nread() waits */
+
+/* A connection whose cookie hasn't all arrived yet */
+struct iperf_server_pending {
+    int s;
+    int got;
+    char cookie[COOKIE_SIZE];
+    struct iperf_time deadline;
+};
+
+/*
+ * A listener and the connections taken off it that are still sending
+ * their cookie, read as it arrives so that no one of them holds up the
+ * others
+ */
+struct iperf_server_intake {
+    int listener;
+    struct iperf_server_pending pending[POOL_MAX_PENDING];
+    int num_pending;
+};
+
+/* With --accept-threads, one of the SO_REUSEPORT listeners and the thread draining it */
+struct iperf_server_acceptor {
+    struct iperf_server_pool *pool;
+    struct iperf_server_intake intake;
+    pthread_t thread;
+};
+
+struct iperf_server_pool {
+    struct iperf_test *test;        /* the listening one, with the server's options */
+    int active;                     /* counting slots an acceptor has taken */
+    int served;                     /* clients done that count for a one-off server */
+    int next_id;
+    int wake[2];                    /* a pipe sessions write to when they finish */
+    pthread_mutex_t lock;           /* sessions, their queues and rates */
+    pthread_mutex_t udp_lock;       /* UDP streams are set up on the port one session at a time */
+    struct iperf_server_session *sessions;
+    struct iperf_server_intake intake;  /* test->listener's, when the main loop accepts on it */
+    struct iperf_server_acceptor acceptors[MAX_ACCEPT_THREADS];
+    int num_acceptors;              /* 0 when the main loop accepts on test->listener itself */
+    int stopping;
+    int acceptor_errno;             /* why an acceptor gave up, for the main loop to return */
+};
+
+/* Whether test's server options need the pool rather than iperf_run_server() */
+int iperf_server_pool_wanted(struct iperf_test *test);
+
+/*
+ * Accept clients on test's port and run up to test->max_clients of them
+ * at once, each on its own thread.  Returns on an error, after an idle
+ * --idle-timeout, or for a one-off server, which takes no new client once
+ * one is done, when the clients it has are done; with what
+ * iperf_run_server() would have returned.  Every client's test has ended
+ * by then.
+ */
+int iperf_run_server_pool(struct iperf_test *test);
+
+/* The next data connection the pool has queued for this session */
+int iperf_server_session_take_stream(struct iperf_server_session *session);
+
+/* What a session's test listens on for its TCP data connections */
+int iperf_server_session_listen(struct iperf_server_session *session);
+
+/*
+ * UDP data connections carry no cookie, so only one session at a time
+ * may listen for them on the port.  Holding blocks until the port is
+ * free; releasing is a no-op if this session doesn't hold it.
+ */
+void iperf_server_session_hold_udp(struct iperf_server_session *session);
+void iperf_server_session_release_udp(struct iperf_server_session *session);
+
+/*
+ * Record this session's averaged bitrate and return the sum over all
+ * running sessions, and how many there are, for the aggregate limit.
+ */
+uint64_t iperf_server_session_rate(struct iperf_server_session *session, uint64_t rate, int *sessions);
+
+#endif /* __IPERF_SERVER_POOL_H */
@@ -0,0 +1,195 @@
+/*
+ * Benchmark for test setup: how long it takes to get a test ready to run,
+ * parsed from its command line each time or cloned from a prepared one.
+ *
+ * Sets up the tests of a rate sweep -- the same command line with -b
+ * stepping through the rates -- over and over, both ways, and prints one
+ * JSON object per way with the microseconds per test.  "parse" is what
+ * the app's argument path does for every run: iperf_new_test,
+ * iperf_defaults and iperf_parse_arguments.  "clone" is a prepared config
+ * (IperfConfig): parsed once, then iperf_clone_test and the rate set for
+ * each run.  Nothing is run, so this is setup alone.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_util.h"
+
+#define SETUPBENCH_TESTS 100000
+#define SETUPBENCH_RATES 20
+#define SETUPBENCH_MAX_ARGS 64
+
+static void
+setupbench_usage(FILE *f)
+{
+    fprintf(f, "Usage: iperf_setupbench [-n tests] [-o file] [-- iperf3 options]\n"
+               "  -n tests   tests to set up each way (default %d)\n"
+               "  -o file    write the JSON lines to file rather than stdout\n"
+               "  options    the sweep's command line, less -b (default -c 127.0.0.1 -u -t 1 -i 0.1 -J)\n",
+            SETUPBENCH_TESTS);
+}
+
+static double
+wall_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Rate of test i of the sweep, in bits/sec */
+static uint64_t
+setupbench_rate(int i)
+{
+    return 5000000ULL * (1 + i % SETUPBENCH_RATES);
+}
+
+/* argv for test i of the sweep; rate holds its -b, as parsing can write into it */
+static int
+setupbench_argv(int i, int nopts, char **opts, char **argv, char *rate, size_t size)
+{
+    int k, argc = 0;
+
+    argv[argc++] = "iperf3";
+    for (k = 0; k < nopts; k++)
+        argv[argc++] = opts[k];
+    argv[argc++] = "-b";
+    snprintf(rate, size, "%" PRIu64, setupbench_rate(i));
+    argv[argc++] = rate;
+    argv[argc] = NULL;
+    return argc;
+}
+
+/* A new test parsed from argv, or NULL */
+static struct iperf_test *
+setupbench_parse(int argc, char **argv)
+{
+    struct iperf_test *test;
+
+    test = iperf_new_test();
+    if (test == NULL)
+        return NULL;
+    if (iperf_defaults(test) < 0 || iperf_parse_arguments(test, argc, argv) < 0) {
+        iperf_free_test(test);
+        return NULL;
+    }
+    return test;
+}
+
+/*
+ * Sets up n tests, cloned from prepared if it isn't NULL and parsed
+ * otherwise; prints its JSON line, and returns the microseconds per test
+ * or -1
+ */
+static double
+setupbench_run(struct iperf_test *prepared, int n, int nopts, char **opts, FILE *out)
+{
+    struct iperf_test *test;
+    char *argv[SETUPBENCH_MAX_ARGS], rate[32];
+    double t0, us;
+    int i, argc;
+    cJSON *j;
+    char *str;
+
+    t0 = wall_secs();
+    for (i = 0; i < n; i++) {
+        if (prepared != NULL) {
+            test = iperf_clone_test(prepared);
+            if (test != NULL)
+                iperf_set_test_rate(test, setupbench_rate(i));
+        } else {
+            argc = setupbench_argv(i, nopts, opts, argv, rate, sizeof(rate));
+            test = setupbench_parse(argc, argv);
+        }
+        if (test == NULL) {
+            fprintf(stderr, "iperf_setupbench: %s\n", iperf_strerror(i_errno));
+            return -1;
+        }
+        iperf_free_test(test);
+    }
+    us = 1e6 * (wall_secs() - t0) / n;
+
+    j = iperf_json_printf("setup: %s  tests: %d  rates: %d", prepared != NULL ? "clone" : "parse",
+                          (int64_t) n, (int64_t) SETUPBENCH_RATES);
+    if (j == NULL) {
+        fprintf(stderr, "iperf_setupbench: out of memory\n");
+        exit(1);
+    }
+    cJSON_AddNumberToObject(j, "us_per_test", us);
+    str = cJSON_PrintUnformatted(j);
+    if (str != NULL) {
+        fprintf(out, "%s\n", str);
+        fflush(out);
+        cJSON_free(str);
+    }
+    cJSON_Delete(j);
+    return us;
+}
+
+int
+main(int argc, char **argv)
+{
+    char *defaults[] = { "-c", "127.0.0.1", "-u", "-t", "1", "-i", "0.1", "-J" };
+    char **opts = defaults, *test_argv[SETUPBENCH_MAX_ARGS], rate[32];
+    int n = SETUPBENCH_TESTS, nopts = sizeof(defaults) / sizeof(defaults[0]), flag, failed = 0;
+    struct iperf_test *prepared;
+    FILE *out = stdout;
+
+    while ((flag = getopt(argc, argv, "+n:o:h")) != -1) {
+        switch (flag) {
+            case 'n':
+                n = atoi(optarg);
+                if (n <= 0) {
+                    setupbench_usage(stderr);
+                    return 1;
+                }
+                break;
+            case 'o':
+                out = fopen(optarg, "w");
+                if (out == NULL) {
+                    perror(optarg);
+                    return 1;
+                }
+                break;
+            case 'h':
+                setupbench_usage(stdout);
+                return 0;
+            default:
+                setupbench_usage(stderr);
+                return 1;
+        }
+    }
+    if (optind < argc) {
+        opts = argv + optind;
+        nopts = argc - optind;
+    }
+    if (nopts > SETUPBENCH_MAX_ARGS - 4) {
+        setupbench_usage(stderr);
+        return 1;
+    }
+    /* iperf_parse_arguments starts from there */
+    optind = 0;
+
+    if (setupbench_run(NULL, n, nopts, opts, out) < 0)
+        failed++;
+    prepared = setupbench_parse(setupbench_argv(0, nopts, opts, test_argv, rate, sizeof(rate)), test_argv);
+    if (prepared == NULL || setupbench_run(prepared, n, nopts, opts, out) < 0)
+        failed++;
+    if (prepared != NULL)
+        iperf_free_test(prepared);
+
+    if (out != stdout)
+        fclose(out);
+    return failed ? 1 : 0;
+}
@@ -42,13 +42,51 @@
 #include "iperf_api.h"
 #include "iperf_tcp.h"
 #include "iperf_util.h"
+#include "iperf_server_pool.h"
 #include "net.h"
 #include "cjson.h"
+#include "crc32c.h"
 
 #if defined(HAVE_FLOWLABEL)
 #include "flowlabel.h"
 #endif /* HAVE_FLOWLABEL */
 
+/* iperf_tcp_verify
+ *
+ * Feed received bytes through the running CRC32C for --verify-payload.
+ * The sender writes blksize-long copies of its buffer back to back, so
+ * block boundaries are known regardless of how recv() splits the data.
+ */
+static void
+iperf_tcp_verify(struct iperf_stream *sp, const char *buf, int len)
+{
+    int blksize = sp->settings->blksize;
+    int n;
+
+    while (len > 0) {
+        n = blksize - sp->verify_offset;
+        if (n > len)
+            n = len;
+        sp->verify_partial_crc = crc32c(sp->verify_partial_crc, buf, n);
+        sp->verify_offset += n;
+        buf += n;
+        len -= n;
+
+        if (sp->verify_offset == blksize) {
+            if (sp->verify_partial_crc != sp->verify_crc) {
+                sp->corrupted_blocks++;
+                if (sp->test->debug_level >= DEBUG_LEVEL_INFO)
+                    fprintf(stderr, "CORRUPTED block %" PRId64 " on stream %d\n",
+                            sp->verified_blocks, sp->socket);
+            }
+            sp->verified_blocks++;
+            sp->verify_partial_crc = 0;
+            sp->verify_offset = 0;
+        }
+    }
+}
+
+
 /* iperf_tcp_recv
  *
  * receives the data for TCP
@@ -70,6 +108,10 @@ iperf_tcp_recv(struct iperf_stream *sp) {
     if (r < 0)
         return r;
 
+    /* Verify even late data, or we'd lose track of the block boundaries. */
+    if (sp->test->verify_payload)
+        iperf_tcp_verify(sp, sp->buffer, r);
+
     /* Only count bytes received while we're in the correct state. */
     if (sp->test->state == TEST_RUNNING) {
         sp->result->bytes_received += r;
@@ -98,7 +140,9 @@ iperf_tcp_send(struct iperf_stream *sp) {
     if (sp->test->zerocopy)
         r = Nsendfile(sp->buffer_fd, sp->socket, sp->buffer, sp->pending_size);
     else
-        r = Nwrite(sp->socket, sp->buffer, sp->pending_size, Ptcp);
+        /* Pick a partial write up where it stopped, so that the byte
+         * stream stays a plain repetition of the buffer. */
+        r = Nwrite(sp->socket, sp->buffer + sp->settings->blksize - sp->pending_size, sp->pending_size, Ptcp);
 
     if (r < 0)
         return r;
@@ -115,6 +159,46 @@ iperf_tcp_send(struct iperf_stream *sp) {
 }
 
 
+/*
+ * iperf_tcp_accept for a --max-clients session: the pool has accepted the
+ * connection and checked its cookie already.  The options the listener
+ * would have been made with are set on the connection instead; that is
+ * too late for the MSS, and for the window scale a buffer size implies.
+ */
+static int
+iperf_tcp_accept_session(struct iperf_test *test) {
+    int s, opt;
+
+    if ((s = iperf_server_session_take_stream(test->server_session)) < 0) {
+        i_errno = IESTREAMCONNECT;
+        return -1;
+    }
+    if (test->no_delay) {
+        opt = 1;
+        if (setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt)) < 0) {
+            close(s);
+            i_errno = IESETNODELAY;
+            return -1;
+        }
+    }
+    if ((opt = test->settings->socket_bufsize)) {
+        if (setsockopt(s, SOL_SOCKET, SO_RCVBUF, &opt, sizeof(opt)) < 0 ||
+            setsockopt(s, SOL_SOCKET, SO_SNDBUF, &opt, sizeof(opt)) < 0) {
+            close(s);
+            i_errno = IESETBUF;
+            return -1;
+        }
+    }
+#if defined(HAVE_SO_MAX_PACING_RATE)
+    if (test->settings->fqrate) {
+        uint64_t fqrate = test->settings->fqrate / 8;
+        if (fqrate > 0 && setsockopt(s, SOL_SOCKET, SO_MAX_PACING_RATE, &fqrate, sizeof(fqrate)) < 0)
+            warning("Unable to set socket pacing");
+    }
+#endif /* HAVE_SO_MAX_PACING_RATE */
+    return s;
+}
+
 /* iperf_tcp_accept
  *
  * accept a new TCP stream connection
@@ -127,6 +211,9 @@ iperf_tcp_accept(struct iperf_test *test) {
     socklen_t len;
     struct sockaddr_storage addr;
 
+    if (test->server_session != NULL)
+        return iperf_tcp_accept_session(test);
+
     len = sizeof(addr);
     if ((s = accept(test->listener, (struct sockaddr *) &addr, &len)) < 0) {
         i_errno = IESTREAMCONNECT;
@@ -179,6 +266,13 @@ iperf_tcp_listen(struct iperf_test *test) {
     int saved_errno;
     int rcvbuf_actual, sndbuf_actual;
 
+    if (test->server_session != NULL) {
+        /* The pool has the listener; what it accepts for us comes through a pipe */
+        if ((s = iperf_server_session_listen(test->server_session)) < 0)
+            i_errno = IESTREAMLISTEN;
+        return s;
+    }
+
     s = test->listener;
 
     /*
@@ -0,0 +1,329 @@
+/*
+ * High-rate TCP_INFO time series for --tcpinfo-sample.
+ *
+ * save_tcpinfo() reads TCP_INFO once per reporting interval, which at
+ * the default second says nothing about slow start, a handover or a
+ * cwnd collapse and recovery.  With --tcpinfo-sample one extra thread,
+ * at a lower priority than the stream threads, reads TCP_INFO of every
+ * TCP stream each period and stores the fields that matter in a ring
+ * allocated with the stream.  The stream threads never see it.  At the
+ * end the series goes into the JSON output column by column, each value
+ * as the change from the one before, which keeps it small.
+ *
+ * The C libraries differ in how much of struct tcp_info they declare,
+ * so this reads the kernel's layout (struct iperf_tcp_info_linux); what
+ * getsockopt() returns says how much of it this kernel filled in.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_util.h"
+#include "iperf_pacer.h"
+#include "iperf_tcpinfo_sampler.h"
+
+#if defined(__linux__) && defined(TCP_INFO)
+#define TCPINFO_SAMPLER_SUPPORTED 1
+#endif /* __linux__ && TCP_INFO */
+
+int
+iperf_tcpinfo_sampler_supported(void)
+{
+#if defined(TCPINFO_SAMPLER_SUPPORTED)
+    return 1;
+#else
+    return 0;
+#endif /* TCPINFO_SAMPLER_SUPPORTED */
+}
+
+struct iperf_tcpinfo_ring *
+iperf_tcpinfo_ring_new(struct iperf_test *test)
+{
+    struct iperf_tcpinfo_ring *ring;
+    int64_t capacity = TCPINFO_RING_MAX;
+
+    /* The whole test and a little more, if we know how long it is */
+    if (test->duration > 0)
+        capacity = ((int64_t) test->omit + test->duration + 2) * 1000 / test->tcpinfo_sample_ms;
+    if (capacity > TCPINFO_RING_MAX)
+        capacity = TCPINFO_RING_MAX;
+    if (capacity < TCPINFO_RING_MIN)
+        capacity = TCPINFO_RING_MIN;
+
+    ring = (struct iperf_tcpinfo_ring *) calloc(1, sizeof(*ring) + capacity * sizeof(struct iperf_tcpinfo_sample));
+    if (ring == NULL)
+        return NULL;
+    ring->capacity = (int) capacity;
+    return ring;
+}
+
+#if defined(TCPINFO_SAMPLER_SUPPORTED)
+static void
+tcpinfo_sample(struct iperf_tcpinfo_ring *ring, int fd, uint64_t t_us)
+{
+    struct iperf_tcpinfo_sample *s;
+    struct iperf_tcp_info_linux info;
+    socklen_t len = sizeof(info);
+
+    memset(&info, 0, sizeof(info));
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) < 0) {
+        ring->failed++;
+        return;
+    }
+    ring->info_len = len;
+
+    s = &ring->samples[ring->written % ring->capacity];
+    s->t_us = t_us;
+    s->snd_cwnd = info.snd_cwnd * info.snd_mss;
+    s->snd_ssthresh = info.snd_ssthresh;
+    s->rtt_us = info.rtt;
+    s->rttvar_us = info.rttvar;
+    s->unacked = info.unacked;
+    s->total_retrans = info.total_retrans;
+    s->ca_state = info.ca_state;
+    /* Fields the kernel didn't fill in were zeroed above */
+    s->pacing_rate = info.pacing_rate;
+    s->bytes_acked = info.bytes_acked;
+    s->notsent_bytes = info.notsent_bytes;
+    s->min_rtt_us = info.min_rtt;
+    s->delivery_rate = info.delivery_rate;
+    s->app_limited = info.delivery_rate_app_limited;
+    s->busy_us = info.busy_time;
+    s->rwnd_limited_us = info.rwnd_limited;
+    s->sndbuf_limited_us = info.sndbuf_limited;
+    ring->written++;
+}
+
+static void *
+tcpinfo_sampler_run(void *arg)
+{
+    struct iperf_tcpinfo_sampler *ts = (struct iperf_tcpinfo_sampler *) arg;
+    struct iperf_stream *sp;
+    struct timespec deadline;
+    int64_t next, now, late;
+
+#if defined(SYS_gettid)
+    /* On Linux this lowers just this thread, not the whole process */
+    (void) setpriority(PRIO_PROCESS, (id_t) syscall(SYS_gettid), TCPINFO_SAMPLER_NICE);
+#endif /* SYS_gettid */
+
+    next = ts->start_ns;
+    pthread_mutex_lock(&ts->lock);
+    while (!ts->stopping) {
+        pthread_mutex_unlock(&ts->lock);
+
+        now = iperf_pacer_now();
+        SLIST_FOREACH(sp, &ts->test->streams, streams)
+            if (sp->tcpinfo != NULL && sp->socket >= 0)
+                tcpinfo_sample(sp->tcpinfo, sp->socket, (uint64_t) (now - ts->start_ns) / 1000);
+
+        next += ts->period_ns;
+        now = iperf_pacer_now();
+        if (next <= now) {
+            /* Running late: skip the periods we missed, don't bunch up */
+            late = (now - next) / ts->period_ns + 1;
+            ts->overruns += late;
+            next += late * ts->period_ns;
+        }
+        deadline.tv_sec = next / SEC_TO_NS;
+        deadline.tv_nsec = next % SEC_TO_NS;
+
+        pthread_mutex_lock(&ts->lock);
+        while (!ts->stopping && pthread_cond_timedwait(&ts->wake, &ts->lock, &deadline) != ETIMEDOUT)
+            ;
+    }
+    pthread_mutex_unlock(&ts->lock);
+    return NULL;
+}
+#endif /* TCPINFO_SAMPLER_SUPPORTED */
+
+int
+iperf_tcpinfo_sampler_start(struct iperf_test *test)
+{
+#if defined(TCPINFO_SAMPLER_SUPPORTED)
+    struct iperf_tcpinfo_sampler *ts;
+    pthread_condattr_t attr;
+
+    ts = (struct iperf_tcpinfo_sampler *) calloc(1, sizeof(*ts));
+    if (ts == NULL)
+        return -1;
+    ts->test = test;
+    ts->period_ns = (int64_t) test->tcpinfo_sample_ms * mS_TO_NS;
+    ts->start_ns = iperf_pacer_now();
+
+    /* Deadlines are on the same clock as iperf_pacer_now() */
+    if (pthread_condattr_init(&attr) != 0)
+        goto fail;
+    if (pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) != 0 ||
+        pthread_cond_init(&ts->wake, &attr) != 0) {
+        pthread_condattr_destroy(&attr);
+        goto fail;
+    }
+    pthread_condattr_destroy(&attr);
+    if (pthread_mutex_init(&ts->lock, NULL) != 0)
+        goto fail_cond;
+    if (pthread_create(&ts->thread, NULL, tcpinfo_sampler_run, ts) != 0)
+        goto fail_mutex;
+
+    test->tcpinfo_sampler = ts;
+    return 0;
+
+fail_mutex:
+    pthread_mutex_destroy(&ts->lock);
+fail_cond:
+    pthread_cond_destroy(&ts->wake);
+fail:
+    free(ts);
+    return -1;
+#else
+    (void) test;
+    return -1;
+#endif /* TCPINFO_SAMPLER_SUPPORTED */
+}
+
+void
+iperf_tcpinfo_sampler_stop(struct iperf_test *test)
+{
+    struct iperf_tcpinfo_sampler *ts = test->tcpinfo_sampler;
+
+    if (ts == NULL)
+        return;
+    pthread_mutex_lock(&ts->lock);
+    ts->stopping = 1;
+    pthread_cond_signal(&ts->wake);
+    pthread_mutex_unlock(&ts->lock);
+    pthread_join(ts->thread, NULL);
+
+    test->tcpinfo_overruns = ts->overruns;
+    pthread_cond_destroy(&ts->wake);
+    pthread_mutex_destroy(&ts->lock);
+    free(ts);
+    test->tcpinfo_sampler = NULL;
+}
+
+/* The i'th sample still in the ring, oldest first */
+static const struct iperf_tcpinfo_sample *
+ring_sample(const struct iperf_tcpinfo_ring *ring, uint64_t i)
+{
+    uint64_t first = ring->written > (uint64_t) ring->capacity ? ring->written - ring->capacity : 0;
+
+    return &ring->samples[(first + i) % ring->capacity];
+}
+
+static int
+ring_count(const struct iperf_tcpinfo_ring *ring)
+{
+    return ring->written < (uint64_t) ring->capacity ? (int) ring->written : ring->capacity;
+}
+
+int
+iperf_tcpinfo_ring_range(const struct iperf_tcpinfo_ring *ring, struct iperf_tcpinfo_sample *min, struct iperf_tcpinfo_sample *max)
+{
+    const struct iperf_tcpinfo_sample *s;
+    int i, n = ring_count(ring);
+
+    memset(min, 0, sizeof(*min));
+    memset(max, 0, sizeof(*max));
+    for (i = 0; i < n; i++) {
+        s = ring_sample(ring, i);
+        if (i == 0 || s->snd_cwnd < min->snd_cwnd)
+            min->snd_cwnd = s->snd_cwnd;
+        if (s->snd_cwnd > max->snd_cwnd)
+            max->snd_cwnd = s->snd_cwnd;
+        if (i == 0 || s->rtt_us < min->rtt_us)
+            min->rtt_us = s->rtt_us;
+        if (s->rtt_us > max->rtt_us)
+            max->rtt_us = s->rtt_us;
+        if (s->delivery_rate > max->delivery_rate)
+            max->delivery_rate = s->delivery_rate;
+    }
+    return n;
+}
+
+/* Add name: [first, delta, delta, ...] of the field at offset, of the given size */
+static void
+ring_column(cJSON *j, const struct iperf_tcpinfo_ring *ring, const char *name, size_t offset, size_t size)
+{
+    const struct iperf_tcpinfo_sample *s;
+    cJSON *column;
+    int64_t value, prev = 0;
+    int i, n = ring_count(ring);
+
+    column = cJSON_CreateArray();
+    if (column == NULL)
+        return;
+    for (i = 0; i < n; i++) {
+        s = ring_sample(ring, i);
+        if (size == sizeof(uint64_t))
+            value = (int64_t) *(const uint64_t *) ((const char *) s + offset);
+        else if (size == sizeof(uint32_t))
+            value = *(const uint32_t *) ((const char *) s + offset);
+        else
+            value = *(const uint8_t *) ((const char *) s + offset);
+        cJSON_AddItemToArray(column, cJSON_CreateNumber((double) (value - prev)));
+        prev = value;
+    }
+    cJSON_AddItemToObject(j, name, column);
+}
+
+#define RING_COLUMN(j, ring, name, field) \
+    ring_column(j, ring, name, offsetof(struct iperf_tcpinfo_sample, field), sizeof(((struct iperf_tcpinfo_sample *) 0)->field))
+
+cJSON *
+iperf_tcpinfo_ring_json(const struct iperf_tcpinfo_ring *ring, int period_ms, uint64_t overruns)
+{
+    cJSON *j;
+
+    j = iperf_json_printf("period_ms: %d  samples: %d  dropped: %d  failed: %d  overruns: %d  encoding: %s",
+                          (int64_t) period_ms, (int64_t) ring_count(ring),
+                          (int64_t) (ring->written - ring_count(ring)), (int64_t) ring->failed,
+                          (int64_t) overruns, "delta");
+    if (j == NULL)
+        return NULL;
+
+    RING_COLUMN(j, ring, "t_us", t_us);
+#if defined(TCPINFO_SAMPLER_SUPPORTED)
+    RING_COLUMN(j, ring, "snd_cwnd", snd_cwnd);
+    RING_COLUMN(j, ring, "snd_ssthresh", snd_ssthresh);
+    RING_COLUMN(j, ring, "rtt_us", rtt_us);
+    RING_COLUMN(j, ring, "rttvar_us", rttvar_us);
+    RING_COLUMN(j, ring, "unacked", unacked);
+    RING_COLUMN(j, ring, "total_retrans", total_retrans);
+    RING_COLUMN(j, ring, "ca_state", ca_state);
+    /* Older kernels stop short; leave out what they didn't fill in */
+    if (TCPINFO_HAS(ring->info_len, bytes_acked)) {
+        RING_COLUMN(j, ring, "pacing_rate", pacing_rate);
+        RING_COLUMN(j, ring, "bytes_acked", bytes_acked);
+    }
+    if (TCPINFO_HAS(ring->info_len, min_rtt)) {
+        RING_COLUMN(j, ring, "notsent_bytes", notsent_bytes);
+        RING_COLUMN(j, ring, "min_rtt_us", min_rtt_us);
+    }
+    if (TCPINFO_HAS(ring->info_len, delivery_rate)) {
+        RING_COLUMN(j, ring, "delivery_rate", delivery_rate);
+        RING_COLUMN(j, ring, "app_limited", app_limited);
+    }
+    if (TCPINFO_HAS(ring->info_len, sndbuf_limited)) {
+        RING_COLUMN(j, ring, "busy_us", busy_us);
+        RING_COLUMN(j, ring, "rwnd_limited_us", rwnd_limited_us);
+        RING_COLUMN(j, ring, "sndbuf_limited_us", sndbuf_limited_us);
+    }
+#endif /* TCPINFO_SAMPLER_SUPPORTED */
+    return j;
+}
@@ -0,0 +1,90 @@
+/*
+ * High-rate TCP_INFO time series for --tcpinfo-sample.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_TCPINFO_SAMPLER_H
+#define __IPERF_TCPINFO_SAMPLER_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "iperf.h"
+#include "cjson.h"
+
+/* Samples kept per stream; a longer test keeps the most recent ones */
+#define TCPINFO_RING_MAX (1 << 15)
+#define TCPINFO_RING_MIN 16
+/* The sampler thread's nice value, so it yields to the stream threads */
+#define TCPINFO_SAMPLER_NICE 10
+
+/* One reading of TCP_INFO, with the fields worth plotting */
+struct iperf_tcpinfo_sample {
+    uint64_t t_us;                  /* since the sampler started */
+    uint64_t pacing_rate;           /* bytes/s */
+    uint64_t delivery_rate;         /* bytes/s */
+    uint64_t bytes_acked;
+    uint64_t busy_us;               /* time busy sending data */
+    uint64_t rwnd_limited_us;       /* ... limited by the receive window */
+    uint64_t sndbuf_limited_us;     /* ... limited by the send buffer */
+    uint32_t snd_cwnd;              /* bytes */
+    uint32_t snd_ssthresh;          /* segments */
+    uint32_t rtt_us;
+    uint32_t rttvar_us;
+    uint32_t min_rtt_us;
+    uint32_t unacked;
+    uint32_t total_retrans;
+    uint32_t notsent_bytes;
+    uint8_t ca_state;
+    uint8_t app_limited;
+};
+
+/*
+ * Written by the sampler thread only, and read by the main thread only
+ * once the sampler has stopped, so it needs no locking.
+ */
+struct iperf_tcpinfo_ring {
+    int capacity;
+    int info_len;                   /* bytes of struct tcp_info the kernel filled in */
+    uint64_t written;               /* samples taken; the ring holds the last capacity */
+    uint64_t failed;                /* getsockopt() errors */
+    struct iperf_tcpinfo_sample samples[];
+};
+
+struct iperf_tcpinfo_sampler {
+    struct iperf_test *test;
+    int64_t period_ns;
+    int64_t start_ns;               /* CLOCK_MONOTONIC */
+    uint64_t overruns;              /* periods skipped because a pass ran late */
+    int stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_t thread;
+};
+
+/* Nonzero if this platform's TCP_INFO can be sampled */
+int iperf_tcpinfo_sampler_supported(void);
+
+/* A ring sized for the test's duration and --tcpinfo-sample period */
+struct iperf_tcpinfo_ring *iperf_tcpinfo_ring_new(struct iperf_test *test);
+
+/*
+ * Start the test's sampler thread, which reads TCP_INFO of every stream
+ * with a ring each period.  Returns -1 if the thread can't be started.
+ */
+int iperf_tcpinfo_sampler_start(struct iperf_test *test);
+
+/* Stop and free the sampler, if there is one; the rings stay with the streams */
+void iperf_tcpinfo_sampler_stop(struct iperf_test *test);
+
+/* Smallest and largest snd_cwnd and rtt in the ring; returns the number of samples */
+int iperf_tcpinfo_ring_range(const struct iperf_tcpinfo_ring *ring, struct iperf_tcpinfo_sample *min, struct iperf_tcpinfo_sample *max);
+
+/*
+ * The series as a JSON object with one array per field: the first value,
+ * then each change from the one before.
+ */
+cJSON *iperf_tcpinfo_ring_json(const struct iperf_tcpinfo_ring *ring, int period_ms, uint64_t overruns);
+
+#endif /* __IPERF_TCPINFO_SAMPLER_H */
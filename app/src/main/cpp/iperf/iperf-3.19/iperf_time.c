@@ -31,22 +31,179 @@
 #include "iperf_config.h"
 #include "iperf_time.h"
 
+#define NSECS_PER_SEC 1000000000ULL
+
 #ifdef HAVE_CLOCK_GETTIME
 
+#include <pthread.h>
 #include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+/*
+ * iperf_time_now() runs for every UDP packet sent and received, so it
+ * reads the CPU's counter directly where that is safe: CNTVCT_EL0 on
+ * arm64, whose frequency the kernel publishes in CNTFRQ_EL0, or an
+ * invariant TSC on x86.  Even a vDSO clock_gettime() spends most of
+ * its time on its seqlock and conversions.  iperf_time_calibrate()
+ * measures the counter against CLOCK_MONOTONIC once per process, when a
+ * test is set up; until then, or if the counter looks wrong, we simply
+ * stay with clock_gettime().
+ *
+ * Like CLOCK_BOOTTIME, such counters may keep running in suspend, so
+ * don't compare these times with other clocks; only with each other.
+ */
+static const char *fast_clock_name = "clock_gettime";
+static int fast_clock;          /* set, with release, once the rest is */
+static uint64_t fast_base_ticks;
+static uint64_t fast_base_ns;
+static double fast_ns_per_tick;
+static pthread_once_t fast_clock_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Calibration: FAST_CLOCK_WINDOWS back-to-back windows of
+ * FAST_CLOCK_WINDOW_NS each, every one of which must agree with the
+ * rate over all of them (and on arm64 with the published rate) to
+ * within FAST_CLOCK_TOLERANCE
+ */
+#define FAST_CLOCK_WINDOWS 4
+#define FAST_CLOCK_WINDOW_NS 5000000
+#define FAST_CLOCK_TOLERANCE 0.0002
+
+static inline uint64_t
+fast_clock_ticks(void)
+{
+#if defined(__aarch64__)
+    uint64_t v;
+
+    __asm__ __volatile__("isb; mrs %0, cntvct_el0" : "=r" (v) : : "memory");
+    return v;
+#elif defined(__x86_64__) || defined(__i386__)
+    uint32_t lo, hi;
+
+    __asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t) hi << 32) | lo;
+#else
+    return 0;
+#endif
+}
+
+static uint64_t
+monotonic_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * NSECS_PER_SEC + ts.tv_nsec;
+}
+
+/* CLOCK_MONOTONIC and the counter at (nearly) the same instant */
+static void
+fast_clock_sample(uint64_t *ns, uint64_t *ticks)
+{
+    uint64_t before = monotonic_ns();
+
+    *ticks = fast_clock_ticks();
+    *ns = before + (monotonic_ns() - before) / 2;
+}
+
+static int
+fast_clock_agrees(double measured, double expected)
+{
+    return measured >= expected * (1 - FAST_CLOCK_TOLERANCE) && measured <= expected * (1 + FAST_CLOCK_TOLERANCE);
+}
+
+static void
+fast_clock_init(void)
+{
+    struct timespec pause;
+    uint64_t ns[FAST_CLOCK_WINDOWS + 1], t[FAST_CLOCK_WINDOWS + 1];
+    double measured, nominal = 0.0;
+    const char *name;
+    int i;
+
+#if defined(__aarch64__)
+    uint64_t freq;
+
+    __asm__ __volatile__("mrs %0, cntfrq_el0" : "=r" (freq));
+    if (freq == 0)
+        return;
+    nominal = (double) NSECS_PER_SEC / freq;
+    name = "cntvct";
+#elif defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+
+    /* Only an invariant TSC ticks at one rate through P- and C-states */
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1 << 8)))
+        return;
+    name = "tsc";
+#else
+    return;
+#endif
+
+    fast_clock_sample(&ns[0], &t[0]);
+    for (i = 1; i <= FAST_CLOCK_WINDOWS; i++) {
+        pause.tv_sec = 0;
+        pause.tv_nsec = FAST_CLOCK_WINDOW_NS;
+        while (nanosleep(&pause, &pause) < 0)
+            ;
+        fast_clock_sample(&ns[i], &t[i]);
+        if (t[i] <= t[i - 1] || ns[i] <= ns[i - 1])
+            return;
+    }
+
+    /* One rate for the whole run, so every window has to show it */
+    measured = (double) (ns[FAST_CLOCK_WINDOWS] - ns[0]) / (t[FAST_CLOCK_WINDOWS] - t[0]);
+    for (i = 1; i <= FAST_CLOCK_WINDOWS; i++)
+        if (!fast_clock_agrees((double) (ns[i] - ns[i - 1]) / (t[i] - t[i - 1]), measured))
+            return;
+    if (nominal > 0.0) {
+        if (!fast_clock_agrees(measured, nominal))
+            return;
+        measured = nominal;
+    }
+
+    fast_base_ticks = t[FAST_CLOCK_WINDOWS];
+    fast_base_ns = ns[FAST_CLOCK_WINDOWS];
+    fast_ns_per_tick = measured;
+    fast_clock_name = name;
+    __atomic_store_n(&fast_clock, 1, __ATOMIC_RELEASE);
+}
+
+void
+iperf_time_calibrate(void)
+{
+    pthread_once(&fast_clock_once, fast_clock_init);
+}
 
 int
 iperf_time_now(struct iperf_time *time1) {
     struct timespec ts;
+    uint64_t ns;
     int result;
+
+    if (__atomic_load_n(&fast_clock, __ATOMIC_ACQUIRE)) {
+        ns = fast_base_ns + (uint64_t) ((double) (fast_clock_ticks() - fast_base_ticks) * fast_ns_per_tick);
+        time1->secs = (uint32_t) (ns / NSECS_PER_SEC);
+        time1->nsecs = (uint32_t) (ns % NSECS_PER_SEC);
+        return 0;
+    }
+
     result = clock_gettime(CLOCK_MONOTONIC, &ts);
     if (result == 0) {
         time1->secs = (uint32_t) ts.tv_sec;
-        time1->usecs = (uint32_t) ts.tv_nsec / 1000;
+        time1->nsecs = (uint32_t) ts.tv_nsec;
     }
     return result;
 }
 
+const char *
+iperf_time_source(void)
+{
+    return __atomic_load_n(&fast_clock, __ATOMIC_ACQUIRE) ? fast_clock_name : "clock_gettime";
+}
+
 #else
 
 #include <sys/time.h>
@@ -58,10 +215,21 @@ iperf_time_now(struct iperf_time *time1)
     int result;
     result = gettimeofday(&tv, NULL);
     time1->secs = tv.tv_sec;
-    time1->usecs = tv.tv_usec;
+    time1->nsecs = tv.tv_usec * 1000;
     return result;
 }
 
+void
+iperf_time_calibrate(void)
+{
+}
+
+const char *
+iperf_time_source(void)
+{
+    return "gettimeofday";
+}
+
 #endif
 
 /* iperf_time_add_usecs
@@ -70,21 +238,35 @@ iperf_time_now(struct iperf_time *time1)
  */
 void
 iperf_time_add_usecs(struct iperf_time *time1, uint64_t usecs) {
-    uint64_t total_usecs;
+    iperf_time_add_nsecs(time1, usecs * 1000);
+}
+
+/* iperf_time_add_nsecs
+ *
+ * Add a number of nanoseconds to a iperf_time.
+ */
+void
+iperf_time_add_nsecs(struct iperf_time *time1, uint64_t nsecs) {
+    uint64_t total_nsecs;
 
-    total_usecs = time1->usecs + usecs;
-    time1->secs += total_usecs / 1000000L;
-    time1->usecs = total_usecs % 1000000L;
+    total_nsecs = time1->nsecs + nsecs;
+    time1->secs += total_nsecs / NSECS_PER_SEC;
+    time1->nsecs = total_nsecs % NSECS_PER_SEC;
 }
 
 uint64_t
 iperf_time_in_usecs(struct iperf_time *time) {
-    return time->secs * 1000000LL + time->usecs;
+    return time->secs * 1000000LL + time->nsecs / 1000;
+}
+
+uint64_t
+iperf_time_in_nsecs(struct iperf_time *time) {
+    return time->secs * NSECS_PER_SEC + time->nsecs;
 }
 
 double
 iperf_time_in_secs(struct iperf_time *time) {
-    return time->secs + time->usecs / 1000000.0;
+    return time->secs + time->nsecs / 1000000000.0;
 }
 
 /* iperf_time_compare
@@ -100,9 +282,9 @@ iperf_time_compare(struct iperf_time *time1, struct iperf_time *time2) {
         return -1;
     if (time1->secs > time2->secs)
         return 1;
-    if (time1->usecs < time2->usecs)
+    if (time1->nsecs < time2->nsecs)
         return -1;
-    if (time1->usecs > time2->usecs)
+    if (time1->nsecs > time2->nsecs)
         return 1;
     return 0;
 }
@@ -123,24 +305,24 @@ iperf_time_diff(struct iperf_time *time1, struct iperf_time *time2, struct iperf
     cmp = iperf_time_compare(time1, time2);
     if (cmp == 0) {
         diff->secs = 0;
-        diff->usecs = 0;
+        diff->nsecs = 0;
         past = 1;
     } else if (cmp == 1) {
         diff->secs = time1->secs - time2->secs;
-        diff->usecs = time1->usecs;
-        if (diff->usecs < time2->usecs) {
+        diff->nsecs = time1->nsecs;
+        if (diff->nsecs < time2->nsecs) {
             diff->secs -= 1;
-            diff->usecs += 1000000;
+            diff->nsecs += NSECS_PER_SEC;
         }
-        diff->usecs = diff->usecs - time2->usecs;
+        diff->nsecs = diff->nsecs - time2->nsecs;
     } else {
         diff->secs = time2->secs - time1->secs;
-        diff->usecs = time2->usecs;
-        if (diff->usecs < time1->usecs) {
+        diff->nsecs = time2->nsecs;
+        if (diff->nsecs < time1->nsecs) {
             diff->secs -= 1;
-            diff->usecs += 1000000;
+            diff->nsecs += NSECS_PER_SEC;
         }
-        diff->usecs = diff->usecs - time1->usecs;
+        diff->nsecs = diff->nsecs - time1->nsecs;
         past = 1;
     }
 
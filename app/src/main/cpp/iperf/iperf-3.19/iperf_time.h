@@ -31,19 +31,33 @@
 
 struct iperf_time {
     uint32_t secs;
-    uint32_t usecs;
+    uint32_t nsecs;
 };
 
 int iperf_time_now(struct iperf_time *time1);
 
+/*
+ * Choose the clock iperf_time_now() reads, once per process; it takes some
+ * 20 ms, so it's done when setting up a test rather than on first use.
+ * Times taken before and after it compare as well as any others.
+ */
+void iperf_time_calibrate(void);
+
+/* The clock iperf_time_now() reads: "cntvct", "tsc" or "clock_gettime" */
+const char *iperf_time_source(void);
+
 void iperf_time_add_usecs(struct iperf_time *time1, uint64_t usecs);
 
+void iperf_time_add_nsecs(struct iperf_time *time1, uint64_t nsecs);
+
 int iperf_time_compare(struct iperf_time *time1, struct iperf_time *time2);
 
 int iperf_time_diff(struct iperf_time *time1, struct iperf_time *time2, struct iperf_time *diff);
 
 uint64_t iperf_time_in_usecs(struct iperf_time *time);
 
+uint64_t iperf_time_in_nsecs(struct iperf_time *time);
+
 double iperf_time_in_secs(struct iperf_time *time);
 
 #endif
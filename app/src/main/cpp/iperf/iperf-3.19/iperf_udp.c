@@ -24,6 +24,11 @@
  * This code is distributed under a BSD style license, see the LICENSE
  * file for complete information.
  */
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE    /* sendmmsg() */
+#endif
+#include "iperf_config.h"
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -38,14 +43,219 @@
 #include <inttypes.h>
 #include <sys/time.h>
 #include <sys/select.h>
+#include <time.h>
+#if defined(HAVE_SO_TXTIME)
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#endif /* HAVE_SO_TXTIME */
 
 #include "iperf.h"
 #include "iperf_api.h"
 #include "iperf_util.h"
 #include "iperf_udp.h"
+#include "iperf_server_pool.h"
 #include "timer.h"
 #include "net.h"
 #include "cjson.h"
+#include "crc32c.h"
+#include "iperf_pacer.h"
+#include "iperf_histogram.h"
+
+#if defined(HAVE_SO_TIMESTAMPNS)
+/*
+ * --rx-timestamps: read the datagram with recvmsg() to get the time the
+ * kernel received it (CLOCK_REALTIME) as well.  *kernel_ts is left zero
+ * if the kernel didn't timestamp this one.
+ */
+static int
+iperf_udp_recv_timestamped(struct iperf_stream *sp, int size, int flags, struct timespec *kernel_ts)
+{
+    union {
+        char buf[CMSG_SPACE(sizeof(struct timespec))];
+        struct cmsghdr align;
+    } control;
+    struct cmsghdr *cm;
+    struct msghdr msg;
+    struct iovec iov;
+    ssize_t r;
+
+    iov.iov_base = sp->buffer;
+    iov.iov_len = size;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    kernel_ts->tv_sec = 0;
+    kernel_ts->tv_nsec = 0;
+
+    r = recvmsg(sp->socket, &msg, flags);
+    if (r < 0) {
+        /* As Nrecv_no_select() */
+        if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+            return 0;
+        return NET_HARDERROR;
+    }
+    for (cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm))
+        if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPNS)
+            memcpy(kernel_ts, CMSG_DATA(cm), sizeof(*kernel_ts));
+    return (int) r;
+}
+
+/*
+ * The receiving thread is the only writer, as with the pacer's
+ * statistics; the atomic store keeps 64-bit values whole on 32-bit ARM.
+ */
+#define RXTS_ADD(field, n) __atomic_store_n(&(field), (field) + (n), __ATOMIC_RELAXED)
+
+/*
+ * RFC 1889 jitter again, but of the kernel's arrival times, and how long
+ * after those iperf_udp_recv() took its own.  The kernel's clock is
+ * CLOCK_REALTIME, but only differences between transit times are used,
+ * so it needn't agree with the sender's.
+ */
+static void
+iperf_udp_rxts_account(struct iperf_stream *sp, const struct timespec *kernel_ts, struct iperf_time *sent_time)
+{
+    struct iperf_rxts_stats *t = &sp->rxts;
+    struct timespec now;
+    int64_t arrival_ns, transit_ns, d;
+    uint64_t latency;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    arrival_ns = (int64_t) kernel_ts->tv_sec * SEC_TO_NS + kernel_ts->tv_nsec;
+    d = (int64_t) now.tv_sec * SEC_TO_NS + now.tv_nsec - arrival_ns;
+    latency = d > 0 ? (uint64_t) d : 0;
+
+    /* In integer nanoseconds: as a double, a wall-clock time has no ns left */
+    transit_ns = arrival_ns - (int64_t) iperf_time_in_nsecs(sent_time);
+    if (t->packets == 0)
+        sp->prev_kernel_transit_ns = transit_ns;
+    d = transit_ns - sp->prev_kernel_transit_ns;
+    if (d < 0)
+        d = -d;
+    sp->prev_kernel_transit_ns = transit_ns;
+    sp->kernel_jitter += ((double) d / SEC_TO_NS - sp->kernel_jitter) / 16.0;
+
+    RXTS_ADD(t->packets, 1);
+    RXTS_ADD(t->latency_ns, latency);
+    if (latency > t->max_latency_ns)
+        __atomic_store_n(&t->max_latency_ns, latency, __ATOMIC_RELAXED);
+    if (latency > __atomic_load_n(&sp->interval_max_rx_latency_ns, __ATOMIC_RELAXED))
+        __atomic_store_n(&sp->interval_max_rx_latency_ns, latency, __ATOMIC_RELAXED);
+}
+#endif /* HAVE_SO_TIMESTAMPNS */
+
+/*
+ * Clear the window's bits for sequence numbers from..to, fewer than
+ * SEQ_WINDOW of them, a word at a time.
+ */
+static void
+seq_window_clear_bits(uint64_t *window, unsigned first, unsigned last)
+{
+    unsigned first_word = first / 64, last_word = last / 64, i;
+    uint64_t first_mask = ~0ULL << (first % 64), last_mask = ~0ULL >> (63 - last % 64);
+
+    if (first_word == last_word) {
+        window[first_word] &= ~(first_mask & last_mask);
+        return;
+    }
+    window[first_word] &= ~first_mask;
+    for (i = first_word + 1; i < last_word; i++)
+        window[i] = 0;
+    window[last_word] &= ~last_mask;
+}
+
+static void
+seq_window_clear(uint64_t *window, uint64_t from, uint64_t to)
+{
+    unsigned first = from % SEQ_WINDOW, last = to % SEQ_WINDOW;
+
+    if (first <= last)
+        seq_window_clear_bits(window, first, last);
+    else {
+        seq_window_clear_bits(window, first, SEQ_WINDOW - 1);
+        seq_window_clear_bits(window, 0, last);
+    }
+}
+
+/*
+ * Loss, reordering and duplicates.  sp->packet_count is the highest
+ * sequence number seen so far, and sp->seq_window has a bit for each of
+ * the SEQ_WINDOW numbers up to it, set if that packet has arrived.
+ * Jumping forward counts the numbers skipped as lost; one of those
+ * turning up later is out of order and no longer lost.  A number that
+ * was already seen is a duplicate, which the old code took for a
+ * reordered packet, taking away a loss that was real.  Anything older
+ * than the window is late: it may be either, so it is counted on its
+ * own and the loss stays.  Every case is a few word operations.
+ */
+static void
+iperf_udp_sequence(struct iperf_stream *sp, uint64_t pcount)
+{
+    struct iperf_test *test = sp->test;
+    uint64_t *word, bit, distance;
+    int bucket;
+
+    if (pcount > (uint64_t) sp->packet_count) {
+        if (pcount - sp->packet_count >= SEQ_WINDOW)
+            memset(sp->seq_window, 0, sizeof(sp->seq_window));
+        else if (pcount > (uint64_t) sp->packet_count + 1)
+            seq_window_clear(sp->seq_window, sp->packet_count + 1, pcount - 1);
+
+        /* Forward, but is there a gap in sequence numbers? */
+        if (pcount > (uint64_t) sp->packet_count + 1) {
+            /* There's a gap so count that as a loss. */
+            sp->cnt_error += (pcount - 1) - sp->packet_count;
+            if (test->debug_level >= DEBUG_LEVEL_INFO)
+                fprintf(stderr,
+                        "LOST %" PRIu64 " PACKETS - received packet %" PRIu64 " but expected sequence %" PRIu64 " on stream %d\n",
+                        (pcount - sp->packet_count + 1), pcount, sp->packet_count + 1,
+                        sp->socket);
+        }
+        sp->seq_window[(pcount % SEQ_WINDOW) / 64] |= 1ULL << (pcount % 64);
+        /* Update the highest sequence number seen so far. */
+        sp->packet_count = pcount;
+        return;
+    }
+
+    distance = sp->packet_count - pcount;
+    if (distance >= SEQ_WINDOW) {
+        sp->seq.late++;
+        if (test->debug_level >= DEBUG_LEVEL_INFO)
+            fprintf(stderr,
+                    "LATE - received packet %" PRIu64 ", %" PRIu64 " behind sequence %" PRIu64 " on stream %d\n",
+                    pcount, distance, sp->packet_count, sp->socket);
+        return;
+    }
+
+    word = &sp->seq_window[(pcount % SEQ_WINDOW) / 64];
+    bit = 1ULL << (pcount % 64);
+    if (*word & bit) {
+        sp->seq.duplicates++;
+        if (test->debug_level >= DEBUG_LEVEL_INFO)
+            fprintf(stderr, "DUPLICATE - received packet %" PRIu64 " again on stream %d\n",
+                    pcount, sp->socket);
+        return;
+    }
+    *word |= bit;
+
+    /* A gap filled in: it was counted lost when the gap opened */
+    sp->outoforder_packets++;
+    if (sp->cnt_error > 0)
+        sp->cnt_error--;
+    bucket = 63 - __builtin_clzll(distance);
+    sp->seq.reorder_distance[bucket]++;
+    sp->seq.reorder_distance_sum += distance;
+    if ((int64_t) distance > sp->seq.reorder_distance_max)
+        sp->seq.reorder_distance_max = distance;
+
+    /* Log the out-of-order packet */
+    if (test->debug_level >= DEBUG_LEVEL_INFO)
+        fprintf(stderr,
+                "OUT OF ORDER - received packet %" PRIu64 " but expected sequence %" PRIu64 " on stream %d\n",
+                pcount, sp->packet_count + 1, sp->socket);
+}
 
 /* iperf_udp_recv
  *
@@ -62,6 +272,9 @@ iperf_udp_recv(struct iperf_stream *sp) {
     struct iperf_time sent_time, arrival_time, temp_time;
     struct iperf_test *test = sp->test;	
     int sock_opt = 0;
+#if defined(HAVE_SO_TIMESTAMPNS)
+    struct timespec kernel_ts;
+#endif /* HAVE_SO_TIMESTAMPNS */
 
 #if defined(HAVE_MSG_TRUNC)
     // UDP recv() with MSG_TRUNC reads only the size bytes, but return the length of the full packet
@@ -71,6 +284,11 @@ iperf_udp_recv(struct iperf_stream *sp) {
     }
 #endif /* HAVE_MSG_TRUNC */
 
+#if defined(HAVE_SO_TIMESTAMPNS)
+    if (sp->rx_timestamps)
+        r = iperf_udp_recv_timestamped(sp, size, sock_opt, &kernel_ts);
+    else
+#endif /* HAVE_SO_TIMESTAMPNS */
     r = Nrecv_no_select(sp->socket, sp->buffer, size, Pudp, sock_opt);
 
     /*
@@ -104,7 +322,7 @@ iperf_udp_recv(struct iperf_stream *sp) {
             usec = ntohl(usec);
             pcount = be64toh(pcount);
             sent_time.secs = sec;
-            sent_time.usecs = usec;
+            sent_time.nsecs = usec * uS_TO_NS;
         } else {
             uint32_t pc;
             memcpy(&sec, sp->buffer, sizeof(sec));
@@ -114,7 +332,7 @@ iperf_udp_recv(struct iperf_stream *sp) {
             usec = ntohl(usec);
             pcount = ntohl(pc);
             sent_time.secs = sec;
-            sent_time.usecs = usec;
+            sent_time.nsecs = usec * uS_TO_NS;
         }
 
         if (test->debug_level >= DEBUG_LEVEL_DEBUG)
@@ -122,56 +340,25 @@ iperf_udp_recv(struct iperf_stream *sp) {
                     sp->packet_count);
 
         /*
-         * Try to handle out of order packets.  The way we do this
-         * uses a constant amount of storage but might not be
-         * correct in all cases.  In particular we seem to have the
-         * assumption that packets can't be duplicated in the network,
-         * because duplicate packets will possibly cause some problems here.
-         *
-         * First figure out if the sequence numbers are going forward.
-         * Note that pcount is the sequence number read from the packet,
-         * and sp->packet_count is the highest sequence number seen so
-         * far (so we're expecting to see the packet with sequence number
-         * sp->packet_count + 1 arrive next).
+         * Payload verification.  Everything past the header is the
+         * sender's untouched buffer, and a datagram of the wrong size
+         * has been tampered with just as much as one with bad contents.
          */
-        if (pcount >= sp->packet_count + 1) {
+        if (test->verify_payload) {
+            int hdrlen = sizeof(sec) + sizeof(usec) + (test->udp_counters_64bit ? sizeof(uint64_t) : sizeof(uint32_t));
 
-            /* Forward, but is there a gap in sequence numbers? */
-            if (pcount > sp->packet_count + 1) {
-                /* There's a gap so count that as a loss. */
-                sp->cnt_error += (pcount - 1) - sp->packet_count;
+            if (r != sp->settings->blksize ||
+                crc32c(0, sp->buffer + hdrlen, r - hdrlen) != sp->verify_udp_crc) {
+                sp->corrupted_blocks++;
                 if (test->debug_level >= DEBUG_LEVEL_INFO)
-                    fprintf(stderr,
-                            "LOST %" PRIu64 " PACKETS - received packet %" PRIu64 " but expected sequence %" PRIu64 " on stream %d\n",
-                            (pcount - sp->packet_count + 1), pcount, sp->packet_count + 1,
-                            sp->socket);
+                    fprintf(stderr, "CORRUPTED datagram %" PRIu64 " on stream %d\n",
+                            pcount, sp->socket);
             }
-            /* Update the highest sequence number seen so far. */
-            sp->packet_count = pcount;
-        } else {
-
-            /*
-             * Sequence number went backward (or was stationary?!?).
-             * This counts as an out-of-order packet.
-             */
-            sp->outoforder_packets++;
-
-            /*
-             * If we have lost packets, then the fact that we are now
-             * seeing an out-of-order packet offsets a prior sequence
-             * number gap that was counted as a loss.  So we can take
-             * away a loss.
-             */
-            if (sp->cnt_error > 0)
-                sp->cnt_error--;
-
-            /* Log the out-of-order packet */
-            if (test->debug_level >= DEBUG_LEVEL_INFO)
-                fprintf(stderr,
-                        "OUT OF ORDER - received packet %" PRIu64 " but expected sequence %" PRIu64 " on stream %d\n",
-                        pcount, sp->packet_count + 1, sp->socket);
+            sp->verified_blocks++;
         }
 
+        iperf_udp_sequence(sp, pcount);
+
         /*
          * jitter measurement
          *
@@ -197,6 +384,21 @@ iperf_udp_recv(struct iperf_stream *sp) {
             d = -d;
         sp->prev_transit = transit;
         sp->jitter += (d - sp->jitter) / 16.0;
+
+        /* --udp-histograms: the whole distribution of what jitter smooths */
+        if (sp->histograms != NULL) {
+            if (!first_packet) {
+                iperf_histogram_record(&sp->histograms->total.transit_delta, (uint64_t) (d * SEC_TO_NS + 0.5));
+                iperf_time_diff(&arrival_time, &sp->histograms->prev_arrival, &temp_time);
+                iperf_histogram_record(&sp->histograms->total.interarrival, iperf_time_in_nsecs(&temp_time));
+            }
+            sp->histograms->prev_arrival = arrival_time;
+        }
+
+#if defined(HAVE_SO_TIMESTAMPNS)
+        if (sp->rx_timestamps && (kernel_ts.tv_sec != 0 || kernel_ts.tv_nsec != 0))
+            iperf_udp_rxts_account(sp, &kernel_ts, &sent_time);
+#endif /* HAVE_SO_TIMESTAMPNS */
     } else {
         if (test->debug_level >= DEBUG_LEVEL_INFO)
             printf("Late receive, state = %d\n", test->state);
@@ -206,6 +408,437 @@ iperf_udp_recv(struct iperf_stream *sp) {
 }
 
 
+#if defined(HAVE_SO_TXTIME)
+/*
+ * --txtime: kernel-paced UDP.
+ *
+ * Sleeping between packets leaves the spacing at the mercy of the
+ * scheduler, which on a phone CPU that has clocked down can be late by
+ * milliseconds.  Instead every packet carries its transmit time in an
+ * SO_TXTIME control message and the fq qdisc holds it until then, so
+ * the sender only has to keep TXTIME_LEAD_USECS worth queued: it hands
+ * the kernel a batch with one sendmmsg() and sleeps.  The payload
+ * timestamp is the scheduled time, so the receiver's jitter is measured
+ * against the schedule.
+ *
+ * SO_TIMESTAMPING reports when each packet actually left; comparing that
+ * to the schedule shows whether the qdisc honoured it.  Without fq on
+ * the route it doesn't, and the packets leave up to TXTIME_LEAD_USECS
+ * early.
+ */
+struct iperf_txtime {
+    double next_ns;             /* transmit time of the next packet */
+    double gap_ns;              /* one packet at the target rate */
+    int64_t realtime_offset_ns; /* CLOCK_REALTIME - CLOCK_MONOTONIC */
+    uint32_t next_id;           /* SOF_TIMESTAMPING_OPT_ID of the next packet */
+    int hdr_len;
+    int64_t scheduled[TXTIME_RING];    /* by OPT_ID, for matching reports */
+    char headers[TXTIME_MAX_BATCH][16];
+    struct iovec iov[TXTIME_MAX_BATCH][2];
+    union {
+        char buf[CMSG_SPACE(sizeof(uint64_t))];
+        struct cmsghdr align;
+    } control[TXTIME_MAX_BATCH];
+    struct mmsghdr msgs[TXTIME_MAX_BATCH];
+
+    /* Written by the sending thread with __atomic builtins */
+    struct iperf_txtime_stats stats;
+    uint64_t interval_max_error_ns;
+};
+
+/* Only the sending thread adds to the statistics; see PACER_ADD */
+#define TXTIME_ADD(field, n) __atomic_store_n(&(field), (field) + (n), __ATOMIC_RELAXED)
+
+/* Match the kernel's send timestamps with the transmit times we asked for */
+static void
+iperf_udp_txtime_reap(struct iperf_stream *sp)
+{
+    struct iperf_txtime *tx = sp->txtime;
+    union {
+        char buf[512];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    struct cmsghdr *cm;
+    struct sock_extended_err *serr;
+    struct timespec *ts;
+    int64_t actual, error;
+    uint64_t abs_error;
+
+    for (;;) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        if (recvmsg(sp->socket, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+            break;
+
+        serr = NULL;
+        ts = NULL;
+        for (cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPING)
+                ts = (struct timespec *) CMSG_DATA(cm);    /* struct scm_timestamping */
+            else if ((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                     (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))
+                serr = (struct sock_extended_err *) CMSG_DATA(cm);
+        }
+        if (serr == NULL)
+            continue;
+        if (serr->ee_origin == SO_EE_ORIGIN_TXTIME) {
+            TXTIME_ADD(tx->stats.dropped, 1);
+            continue;
+        }
+        /* Skip reports so late that the slot has been reused */
+        if (serr->ee_origin != SO_EE_ORIGIN_TIMESTAMPING || ts == NULL ||
+            (uint32_t) (tx->next_id - serr->ee_data) > TXTIME_RING)
+            continue;
+
+        actual = (int64_t) ts[0].tv_sec * SEC_TO_NS + ts[0].tv_nsec - tx->realtime_offset_ns;
+        error = actual - tx->scheduled[serr->ee_data % TXTIME_RING];
+        abs_error = error < 0 ? -error : error;
+        TXTIME_ADD(tx->stats.reported, 1);
+        TXTIME_ADD(tx->stats.error_ns, error);
+        TXTIME_ADD(tx->stats.abs_error_ns, abs_error);
+        if (error < -TXTIME_EARLY_USECS * 1000LL)
+            TXTIME_ADD(tx->stats.early, 1);
+        if (abs_error > tx->stats.max_error_ns)
+            __atomic_store_n(&tx->stats.max_error_ns, abs_error, __ATOMIC_RELAXED);
+        if (abs_error > __atomic_load_n(&tx->interval_max_error_ns, __ATOMIC_RELAXED))
+            __atomic_store_n(&tx->interval_max_error_ns, abs_error, __ATOMIC_RELAXED);
+    }
+}
+
+static int
+iperf_udp_send_txtime(struct iperf_stream *sp)
+{
+    struct iperf_txtime *tx = sp->txtime;
+    int size = sp->settings->blksize;
+    int64_t lead = TXTIME_LEAD_USECS * 1000LL;
+    int64_t now, t;
+    int i, n, r, soft;
+    char *h;
+
+    /* A late sender starts afresh rather than bursting to catch up */
+    now = iperf_pacer_now();
+    if (tx->next_ns < now)
+        tx->next_ns = now;
+    if (tx->next_ns > now + lead) {
+        iperf_pacer_sleep_until((int64_t) tx->next_ns - lead, now);
+        now = iperf_pacer_now();
+    }
+
+    /* Everything due within the lead goes to the kernel in one call */
+    n = (int) ((now + lead - tx->next_ns) / tx->gap_ns) + 1;
+    if (n < 1)
+        n = 1;
+    if (n > TXTIME_MAX_BATCH)
+        n = TXTIME_MAX_BATCH;
+
+    for (i = 0; i < n; i++) {
+        t = (int64_t) tx->next_ns;
+        ++sp->packet_count;
+        h = tx->headers[i];
+        if (sp->test->udp_counters_64bit) {
+            uint32_t sec = htonl(t / SEC_TO_NS), usec = htonl((t % SEC_TO_NS) / 1000);
+            uint64_t pcount = htobe64(sp->packet_count);
+
+            memcpy(h, &sec, sizeof(sec));
+            memcpy(h + 4, &usec, sizeof(usec));
+            memcpy(h + 8, &pcount, sizeof(pcount));
+        } else {
+            uint32_t sec = htonl(t / SEC_TO_NS), usec = htonl((t % SEC_TO_NS) / 1000);
+            uint32_t pcount = htonl(sp->packet_count);
+
+            memcpy(h, &sec, sizeof(sec));
+            memcpy(h + 4, &usec, sizeof(usec));
+            memcpy(h + 8, &pcount, sizeof(pcount));
+        }
+        memcpy(CMSG_DATA(CMSG_FIRSTHDR(&tx->msgs[i].msg_hdr)), &t, sizeof(uint64_t));
+        tx->scheduled[(tx->next_id + i) % TXTIME_RING] = t;
+        tx->next_ns += tx->gap_ns;
+    }
+
+    r = sendmmsg(sp->socket, tx->msgs, n, 0);
+    soft = 0;
+    if (r < 0) {
+        soft = (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS);
+        r = 0;
+    }
+    if (r < n) {
+        /* Take back the numbers and transmit times of what didn't go */
+        sp->packet_count -= n - r;
+        tx->next_ns -= (n - r) * tx->gap_ns;
+    }
+    if (r == 0) {
+        if (soft && sp->test->debug_level >= DEBUG_LEVEL_INFO)
+            printf("UDP send failed on NET_SOFTERROR. errno=%s\n", strerror(errno));
+        return soft ? NET_SOFTERROR : NET_HARDERROR;
+    }
+    tx->next_id += r;
+    TXTIME_ADD(tx->stats.packets, r);
+
+    sp->result->bytes_sent += (iperf_size_t) r * size;
+    sp->result->bytes_sent_this_interval += (iperf_size_t) r * size;
+
+    iperf_udp_txtime_reap(sp);
+    return r * size;
+}
+#endif /* HAVE_SO_TXTIME */
+
+int
+iperf_udp_txtime_init(struct iperf_stream *sp)
+{
+#if defined(HAVE_SO_TXTIME)
+    struct iperf_txtime *tx;
+    struct sock_txtime cfg;
+    struct timespec rt, mono;
+    struct cmsghdr *cm;
+    int size = sp->settings->blksize;
+    int flags, i;
+
+    if (sp->settings->rate == 0)
+        return -1;
+
+    cfg.clockid = CLOCK_MONOTONIC;
+    cfg.flags = SOF_TXTIME_REPORT_ERRORS;
+    if (setsockopt(sp->socket, SOL_SOCKET, SO_TXTIME, &cfg, sizeof(cfg)) < 0) {
+        warning("Unable to set SO_TXTIME; pacing --txtime in user space");
+        return -1;
+    }
+    tx = (struct iperf_txtime *) calloc(1, sizeof(struct iperf_txtime));
+    if (tx == NULL)
+        return -1;
+
+    /* Only for the statistics, so carry on without it */
+    flags = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE |
+            SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+    if (setsockopt(sp->socket, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0 && sp->test->debug)
+        printf("SO_TIMESTAMPING not available on socket %d: %s\n", sp->socket, strerror(errno));
+
+    /* The kernel timestamps with CLOCK_REALTIME; SO_TXTIME wants CLOCK_MONOTONIC */
+    clock_gettime(CLOCK_REALTIME, &rt);
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    tx->realtime_offset_ns = ((int64_t) rt.tv_sec - mono.tv_sec) * SEC_TO_NS + (rt.tv_nsec - mono.tv_nsec);
+
+    tx->gap_ns = (double) size * 8 * SEC_TO_NS / sp->settings->rate;
+    tx->hdr_len = sp->test->udp_counters_64bit ? 16 : 12;
+    for (i = 0; i < TXTIME_MAX_BATCH; i++) {
+        /* The header differs per packet; the payload is the stream's buffer */
+        tx->iov[i][0].iov_base = tx->headers[i];
+        tx->iov[i][0].iov_len = tx->hdr_len;
+        tx->iov[i][1].iov_base = sp->buffer + tx->hdr_len;
+        tx->iov[i][1].iov_len = size - tx->hdr_len;
+        tx->msgs[i].msg_hdr.msg_iov = tx->iov[i];
+        tx->msgs[i].msg_hdr.msg_iovlen = 2;
+        tx->msgs[i].msg_hdr.msg_control = tx->control[i].buf;
+        tx->msgs[i].msg_hdr.msg_controllen = sizeof(tx->control[i].buf);
+        cm = CMSG_FIRSTHDR(&tx->msgs[i].msg_hdr);
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type = SCM_TXTIME;
+        cm->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+    }
+
+    sp->txtime = tx;
+    return 0;
+#else /* HAVE_SO_TXTIME */
+    (void) sp;
+    warning("--txtime is not supported on this platform; pacing in user space");
+    return -1;
+#endif /* HAVE_SO_TXTIME */
+}
+
+void
+iperf_udp_txtime_free(struct iperf_stream *sp)
+{
+    free(sp->txtime);
+    sp->txtime = NULL;
+}
+
+void
+iperf_udp_txtime_read(struct iperf_stream *sp, struct iperf_txtime_stats *total, struct iperf_txtime_stats *interval)
+{
+#if defined(HAVE_SO_TXTIME)
+    struct iperf_txtime *tx = sp->txtime;
+
+    total->packets = __atomic_load_n(&tx->stats.packets, __ATOMIC_RELAXED);
+    total->reported = __atomic_load_n(&tx->stats.reported, __ATOMIC_RELAXED);
+    total->error_ns = __atomic_load_n(&tx->stats.error_ns, __ATOMIC_RELAXED);
+    total->abs_error_ns = __atomic_load_n(&tx->stats.abs_error_ns, __ATOMIC_RELAXED);
+    total->max_error_ns = __atomic_load_n(&tx->stats.max_error_ns, __ATOMIC_RELAXED);
+    total->early = __atomic_load_n(&tx->stats.early, __ATOMIC_RELAXED);
+    total->dropped = __atomic_load_n(&tx->stats.dropped, __ATOMIC_RELAXED);
+    if (interval != NULL)
+        interval->max_error_ns = __atomic_exchange_n(&tx->interval_max_error_ns, 0, __ATOMIC_RELAXED);
+#else /* HAVE_SO_TXTIME */
+    (void) sp;
+    memset(total, 0, sizeof(*total));
+    if (interval != NULL)
+        interval->max_error_ns = 0;
+#endif /* HAVE_SO_TXTIME */
+}
+
+void
+iperf_udp_txtime_diff(const struct iperf_txtime_stats *now, const struct iperf_txtime_stats *before, struct iperf_txtime_stats *diff)
+{
+    diff->packets = now->packets - (before == NULL ? 0 : before->packets);
+    diff->reported = now->reported - (before == NULL ? 0 : before->reported);
+    diff->error_ns = now->error_ns - (before == NULL ? 0 : before->error_ns);
+    diff->abs_error_ns = now->abs_error_ns - (before == NULL ? 0 : before->abs_error_ns);
+    diff->early = now->early - (before == NULL ? 0 : before->early);
+    diff->dropped = now->dropped - (before == NULL ? 0 : before->dropped);
+}
+
+void
+iperf_udp_txtime_omit(struct iperf_stream *sp, struct iperf_txtime_stats *omitted)
+{
+    iperf_udp_txtime_read(sp, omitted, NULL);
+#if defined(HAVE_SO_TXTIME)
+    __atomic_store_n(&sp->txtime->stats.max_error_ns, 0, __ATOMIC_RELAXED);
+#endif /* HAVE_SO_TXTIME */
+}
+
+/* Most of the reported packets left well before their transmit time */
+int
+iperf_udp_txtime_ignored(const struct iperf_txtime_stats *stats)
+{
+    return stats->reported > 0 && stats->early * 2 > stats->reported;
+}
+
+cJSON *
+iperf_udp_txtime_json(const struct iperf_txtime_stats *stats)
+{
+    cJSON *j;
+
+    j = iperf_json_printf("packets: %d  reported: %d  early: %d  dropped: %d",
+                          (int64_t) stats->packets, (int64_t) stats->reported,
+                          (int64_t) stats->early, (int64_t) stats->dropped);
+    if (j != NULL && stats->reported > 0) {
+        cJSON_AddNumberToObject(j, "error_mean_us", (double) stats->error_ns / stats->reported / 1000.0);
+        cJSON_AddNumberToObject(j, "error_abs_mean_us", (double) stats->abs_error_ns / stats->reported / 1000.0);
+        cJSON_AddNumberToObject(j, "error_max_us", stats->max_error_ns / 1000.0);
+        cJSON_AddBoolToObject(j, "honoured", !iperf_udp_txtime_ignored(stats));
+    }
+    return j;
+}
+
+int
+iperf_udp_rxts_init(struct iperf_stream *sp)
+{
+#if defined(HAVE_SO_TIMESTAMPNS)
+    int on = 1;
+
+    if (setsockopt(sp->socket, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0) {
+        warning("--rx-timestamps: the kernel won't timestamp received packets; jitter is from user space only");
+        return -1;
+    }
+    sp->rx_timestamps = 1;
+    return 0;
+#else /* HAVE_SO_TIMESTAMPNS */
+    (void) sp;
+    warning("--rx-timestamps is not supported on this platform; jitter is from user space only");
+    return -1;
+#endif /* HAVE_SO_TIMESTAMPNS */
+}
+
+void
+iperf_udp_rxts_read(struct iperf_stream *sp, struct iperf_rxts_stats *total, struct iperf_rxts_stats *interval)
+{
+    total->packets = __atomic_load_n(&sp->rxts.packets, __ATOMIC_RELAXED);
+    total->latency_ns = __atomic_load_n(&sp->rxts.latency_ns, __ATOMIC_RELAXED);
+    total->max_latency_ns = __atomic_load_n(&sp->rxts.max_latency_ns, __ATOMIC_RELAXED);
+    if (interval != NULL)
+        interval->max_latency_ns = __atomic_exchange_n(&sp->interval_max_rx_latency_ns, 0, __ATOMIC_RELAXED);
+}
+
+void
+iperf_udp_rxts_diff(const struct iperf_rxts_stats *now, const struct iperf_rxts_stats *before, struct iperf_rxts_stats *diff)
+{
+    diff->packets = now->packets - (before == NULL ? 0 : before->packets);
+    diff->latency_ns = now->latency_ns - (before == NULL ? 0 : before->latency_ns);
+}
+
+void
+iperf_udp_rxts_omit(struct iperf_stream *sp, struct iperf_rxts_stats *omitted)
+{
+    iperf_udp_rxts_read(sp, omitted, NULL);
+    __atomic_store_n(&sp->rxts.max_latency_ns, 0, __ATOMIC_RELAXED);
+}
+
+cJSON *
+iperf_udp_rxts_json(const struct iperf_rxts_stats *stats, double kernel_jitter, double jitter)
+{
+    cJSON *j;
+
+    j = iperf_json_printf("packets: %d  kernel_jitter_ms: %f  user_jitter_ms: %f  inflation_ms: %f",
+                          (int64_t) stats->packets, kernel_jitter * 1000.0, jitter * 1000.0,
+                          (jitter - kernel_jitter) * 1000.0);
+    if (j != NULL && stats->packets > 0) {
+        cJSON_AddNumberToObject(j, "latency_mean_us", (double) stats->latency_ns / stats->packets / 1000.0);
+        cJSON_AddNumberToObject(j, "latency_max_us", stats->max_latency_ns / 1000.0);
+    }
+    return j;
+}
+
+void
+iperf_udp_seq_diff(const struct iperf_seq_stats *now, const struct iperf_seq_stats *before, struct iperf_seq_stats *diff)
+{
+    int i;
+
+    diff->duplicates = now->duplicates - before->duplicates;
+    diff->late = now->late - before->late;
+    diff->reorder_distance_sum = now->reorder_distance_sum - before->reorder_distance_sum;
+    diff->reorder_distance_max = now->reorder_distance_max;
+    for (i = 0; i < SEQ_REORDER_BUCKETS; i++)
+        diff->reorder_distance[i] = now->reorder_distance[i] - before->reorder_distance[i];
+}
+
+cJSON *
+iperf_udp_seq_json(const struct iperf_seq_stats *stats, int64_t outoforder)
+{
+    cJSON *j, *histogram;
+    int i;
+
+    j = iperf_json_printf("out_of_order: %d  duplicates: %d  late: %d  reorder_distance_max: %d",
+                          outoforder, stats->duplicates, stats->late, stats->reorder_distance_max);
+    if (j == NULL)
+        return NULL;
+    if (outoforder > 0)
+        cJSON_AddNumberToObject(j, "reorder_distance_mean", (double) stats->reorder_distance_sum / outoforder);
+    /* Counts for distances 1, 2-3, 4-7, ... */
+    histogram = cJSON_CreateArray();
+    if (histogram != NULL) {
+        for (i = 0; i < SEQ_REORDER_BUCKETS; i++)
+            cJSON_AddItemToArray(histogram, cJSON_CreateNumber(stats->reorder_distance[i]));
+        cJSON_AddItemToObject(j, "reorder_distance", histogram);
+    }
+    return j;
+}
+
+int
+iperf_udp_seq_from_json(struct iperf_seq_stats *stats, cJSON *j)
+{
+    cJSON *j_duplicates, *j_late, *j_max, *j_mean, *j_outoforder, *j_histogram, *j_bucket;
+    int i = 0;
+
+    j_outoforder = cJSON_GetObjectItem(j, "out_of_order");
+    j_mean = cJSON_GetObjectItem(j, "reorder_distance_mean");
+    j_duplicates = cJSON_GetObjectItem(j, "duplicates");
+    j_late = cJSON_GetObjectItem(j, "late");
+    j_max = cJSON_GetObjectItem(j, "reorder_distance_max");
+    j_histogram = cJSON_GetObjectItem(j, "reorder_distance");
+    if (!cJSON_IsNumber(j_outoforder) || !cJSON_IsNumber(j_duplicates) || !cJSON_IsNumber(j_late) || !cJSON_IsNumber(j_max) ||
+        !cJSON_IsArray(j_histogram) || cJSON_GetArraySize(j_histogram) != SEQ_REORDER_BUCKETS)
+        return -1;
+    memset(stats, 0, sizeof(*stats));
+    stats->duplicates = (int64_t) j_duplicates->valuedouble;
+    stats->late = (int64_t) j_late->valuedouble;
+    stats->reorder_distance_max = (int64_t) j_max->valuedouble;
+    if (cJSON_IsNumber(j_mean))
+        stats->reorder_distance_sum = (int64_t) (j_mean->valuedouble * j_outoforder->valuedouble + 0.5);
+    cJSON_ArrayForEach(j_bucket, j_histogram)
+        stats->reorder_distance[i++] = (int64_t) j_bucket->valuedouble;
+    return 0;
+}
+
 /* iperf_udp_send
  *
  * sends the data for UDP
@@ -216,6 +849,11 @@ iperf_udp_send(struct iperf_stream *sp) {
     int size = sp->settings->blksize;
     struct iperf_time before;
 
+#if defined(HAVE_SO_TXTIME)
+    if (sp->txtime != NULL)
+        return iperf_udp_send_txtime(sp);
+#endif /* HAVE_SO_TXTIME */
+
     iperf_time_now(&before);
 
     ++sp->packet_count;
@@ -226,7 +864,7 @@ iperf_udp_send(struct iperf_stream *sp) {
         uint64_t pcount;
 
         sec = htonl(before.secs);
-        usec = htonl(before.usecs);
+        usec = htonl(before.nsecs / uS_TO_NS);
         pcount = htobe64(sp->packet_count);
 
         memcpy(sp->buffer, &sec, sizeof(sec));
@@ -238,7 +876,7 @@ iperf_udp_send(struct iperf_stream *sp) {
         uint32_t sec, usec, pcount;
 
         sec = htonl(before.secs);
-        usec = htonl(before.usecs);
+        usec = htonl(before.nsecs / uS_TO_NS);
         pcount = htonl(sp->packet_count);
 
         memcpy(sp->buffer, &sec, sizeof(sec));
@@ -493,8 +1131,18 @@ int
 iperf_udp_listen(struct iperf_test *test) {
     int s;
 
+    /*
+     * Until its streams are connected, a --max-clients session can't
+     * tell its clients' datagrams from another session's; wait for the
+     * port.  The server lets go once all the streams are set up.
+     */
+    if (test->server_session != NULL)
+        iperf_server_session_hold_udp(test->server_session);
+
     if ((s = netannounce(test->settings->domain, Pudp, test->bind_address, test->bind_dev,
                          test->server_port)) < 0) {
+        if (test->server_session != NULL)
+            iperf_server_session_release_udp(test->server_session);
         i_errno = IESTREAMLISTEN;
         return -1;
     }
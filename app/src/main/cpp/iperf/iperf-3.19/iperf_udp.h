@@ -60,5 +60,50 @@ int iperf_udp_connect(struct iperf_test *);
 
 int iperf_udp_init(struct iperf_test *);
 
+/* --txtime: how far ahead of the clock packets are queued, and in what batches */
+#define TXTIME_LEAD_USECS 2000
+#define TXTIME_MAX_BATCH 32
+/* Transmit times kept for matching the kernel's send reports */
+#define TXTIME_RING 4096
+/* A packet that left this much before its transmit time wasn't held */
+#define TXTIME_EARLY_USECS 50
+
+/**
+ * iperf_udp_txtime_init -- switch a sending stream to SO_TXTIME pacing
+ *
+ * returns 0, or -1 (with a warning) to leave pacing to iperf_send_mt()
+ *
+ */
+int iperf_udp_txtime_init(struct iperf_stream *);
+
+void iperf_udp_txtime_free(struct iperf_stream *);
+
+/* Statistics for the main thread, along the lines of iperf_pacer_read() */
+void iperf_udp_txtime_read(struct iperf_stream *, struct iperf_txtime_stats *total, struct iperf_txtime_stats *interval);
+void iperf_udp_txtime_diff(const struct iperf_txtime_stats *now, const struct iperf_txtime_stats *before, struct iperf_txtime_stats *diff);
+void iperf_udp_txtime_omit(struct iperf_stream *, struct iperf_txtime_stats *omitted);
+int iperf_udp_txtime_ignored(const struct iperf_txtime_stats *);
+cJSON *iperf_udp_txtime_json(const struct iperf_txtime_stats *);
+
+/* Sequence window statistics (struct iperf_seq_stats) */
+void iperf_udp_seq_diff(const struct iperf_seq_stats *now, const struct iperf_seq_stats *before, struct iperf_seq_stats *diff);
+/* As a JSON object, with out_of_order from the stream; and back, for the results exchange */
+cJSON *iperf_udp_seq_json(const struct iperf_seq_stats *, int64_t outoforder);
+int iperf_udp_seq_from_json(struct iperf_seq_stats *, cJSON *);
+
+/**
+ * iperf_udp_rxts_init -- have the kernel timestamp a receiving stream's packets
+ *
+ * returns 0, or -1 (with a warning) if only user-space jitter can be had
+ *
+ */
+int iperf_udp_rxts_init(struct iperf_stream *);
+
+/* --rx-timestamps statistics, as for --txtime */
+void iperf_udp_rxts_read(struct iperf_stream *, struct iperf_rxts_stats *total, struct iperf_rxts_stats *interval);
+void iperf_udp_rxts_diff(const struct iperf_rxts_stats *now, const struct iperf_rxts_stats *before, struct iperf_rxts_stats *diff);
+void iperf_udp_rxts_omit(struct iperf_stream *, struct iperf_rxts_stats *omitted);
+cJSON *iperf_udp_rxts_json(const struct iperf_rxts_stats *, double kernel_jitter, double jitter);
+
 
 #endif
@@ -98,6 +98,34 @@ void fill_with_repeating_pattern(void *out, size_t outsize) {
 }
 
 
+/*
+ * Fills buffer with a pseudo-random pattern derived only from seed, so
+ * that both ends of a --verify-payload test can generate the same
+ * payload independently (xorshift64* keyed by an FNV-1a hash of seed).
+ */
+void fill_with_seeded_pattern(void *out, size_t outsize, const char *seed) {
+    uint64_t x = 0xcbf29ce484222325ULL;
+    unsigned char *buf = (unsigned char *) out;
+    size_t i;
+
+    for (; *seed; seed++) {
+        x ^= (unsigned char) *seed;
+        x *= 0x100000001b3ULL;
+    }
+    if (x == 0)
+        x = 1;
+
+    for (i = 0; i < outsize; i++) {
+        if ((i & 7) == 0) {
+            x ^= x >> 12;
+            x ^= x << 25;
+            x ^= x >> 27;
+        }
+        buf[i] = (unsigned char) ((x * 0x2545f4914f6cdd1dULL) >> ((i & 7) * 8));
+    }
+}
+
+
 /* make_cookie
  *
  * Generate and return a cookie string
@@ -181,9 +209,9 @@ timeval_diff(struct timeval *tv0, struct timeval *tv1) {
 
 void
 cpu_util(double pcpu[3]) {
-    static struct iperf_time last;
-    static clock_t clast;
-    static struct rusage rlast;
+    static _Thread_local struct iperf_time last;
+    static _Thread_local clock_t clast;
+    static _Thread_local struct rusage rlast;
     struct iperf_time now, temp_time;
     clock_t ctemp;
     struct rusage rtemp;
@@ -297,6 +325,16 @@ get_optional_features(void) {
     numfeatures++;
 #endif /* HAVE_SO_MAX_PACING_RATE */
 
+#if defined(HAVE_LINUX_PERF_EVENT_H)
+    if (numfeatures > 0) {
+        strncat(features, ", ",
+                sizeof(features) - strlen(features) - 1);
+    }
+    strncat(features, "perf counters",
+            sizeof(features) - strlen(features) - 1);
+    numfeatures++;
+#endif /* HAVE_LINUX_PERF_EVENT_H */
+
 #if defined(HAVE_SSL)
     if (numfeatures > 0) {
 	strncat(features, ", ",
@@ -448,6 +486,12 @@ cJSON *iperf_cJSON_GetObjectItemType(cJSON *j, char *item_string, int expected_t
                 else
                     iperf_err(NULL, "iperf_cJSON_GetObjectItemType mismatch %s", item_string);
                 break;
+            case cJSON_Object:
+                if (cJSON_IsObject(j_p))
+                    return j_p;
+                else
+                    iperf_err(NULL, "iperf_cJSON_GetObjectItemType mismatch %s", item_string);
+                break;
             default:
                 iperf_err(NULL, "unsupported type");
         }
@@ -662,6 +706,12 @@ state_to_text(signed char state) {
         case IPERF_DONE:
             txt = "IPERF_DONE";
             break;
+        case RATE_FEEDBACK:
+            txt = "RATE_FEEDBACK - receiver's interval for --rate-search";
+            break;
+        case NEXT_PHASE:
+            txt = "NEXT_PHASE - another --phases measurement";
+            break;
         case ACCESS_DENIED:
             txt = "ACCESS_DENIED - Server is busy";
             break;
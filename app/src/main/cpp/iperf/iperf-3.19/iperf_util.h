@@ -36,6 +36,8 @@ int readentropy(void *out, size_t outsize);
 
 void fill_with_repeating_pattern(void *out, size_t outsize);
 
+void fill_with_seeded_pattern(void *out, size_t outsize, const char *seed);
+
 void make_cookie(char *);
 
 int is_closed(int);
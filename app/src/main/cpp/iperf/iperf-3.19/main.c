@@ -46,6 +46,7 @@
 #include "iperf_locale.h"
 #include "net.h"
 #include "units.h"
+#include "iperf_server_pool.h"
 
 
 static int run(struct iperf_test *test);
@@ -165,7 +166,7 @@ run(struct iperf_test *test) {
             }
             for (;;) {
                 int rc;
-                rc = iperf_run_server(test);
+                rc = iperf_server_pool_wanted(test) ? iperf_run_server_pool(test) : iperf_run_server(test);
                 test->server_last_run_rc = rc;
                 if (rc < 0) {
                     iperf_err(test, "error - %s", iperf_strerror(i_errno));
@@ -24,6 +24,10 @@
  * This code is distributed under a BSD style license, see the LICENSE
  * file for complete information.
  */
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE	/* splice() */
+#endif
+
 #include "iperf_config.h"
 
 #include <stdio.h>
@@ -73,7 +77,7 @@ static int nread_overall_timeout = 30;
  * by including "iperf.h", but net.c lives "below" this layer.  Clearly the
  * presence of this declaration is a sign we need to revisit this layering.
  */
-extern int gerror;
+extern _Thread_local int gerror;
 
 /*
  * timeout_connect adapted from netcat, via OpenBSD and FreeBSD
@@ -257,8 +261,8 @@ netdial(int domain, int proto, const char *local, const char *bind_dev, int loca
 
 /***************************************************************/
 
-int
-netannounce(int domain, int proto, const char *local, const char *bind_dev, int port) {
+static int
+announce(int domain, int proto, const char *local, const char *bind_dev, int port, int reuseport) {
     struct addrinfo hints, *res;
     char portstr[6];
     int s, opt, saved_errno;
@@ -316,6 +320,24 @@ netannounce(int domain, int proto, const char *local, const char *bind_dev, int
         errno = saved_errno;
         return -1;
     }
+    /* The kernel spreads new connections over all the sockets listening with this */
+    if (reuseport) {
+#if defined(SO_REUSEPORT)
+        if (setsockopt(s, SOL_SOCKET, SO_REUSEPORT,
+                       (char *) &opt, sizeof(opt)) < 0) {
+            saved_errno = errno;
+            close(s);
+            freeaddrinfo(res);
+            errno = saved_errno;
+            return -1;
+        }
+#else /* SO_REUSEPORT */
+        close(s);
+        freeaddrinfo(res);
+        errno = ENOPROTOOPT;
+        return -1;
+#endif /* SO_REUSEPORT */
+    }
     /*
      * If we got an IPv6 socket, figure out if it should accept IPv4
      * connections as well.  We do that if and only if no address
@@ -363,6 +385,16 @@ netannounce(int domain, int proto, const char *local, const char *bind_dev, int
     return s;
 }
 
+int
+netannounce(int domain, int proto, const char *local, const char *bind_dev, int port) {
+    return announce(domain, proto, local, bind_dev, port, 0);
+}
+
+int
+netannounce_reuseport(int domain, int proto, const char *local, const char *bind_dev, int port) {
+    return announce(domain, proto, local, bind_dev, port, 1);
+}
+
 /*******************************************************************/
 /* Nread - reads 'count' bytes from a socket  */
 /********************************************************************/
@@ -616,6 +648,81 @@ Nsendfile(int fromfd, int tofd, const char *buf, size_t count) {
 #endif /* HAVE_SENDFILE */
 }
 
+
+/*
+ *                      N S E N D F I L E _ O F F S E T
+ *
+ * One sendfile() of up to 'count' bytes of a regular file, starting at
+ * and advancing *offset, so that -F can send a file without copying it.
+ * Returns the number of bytes sent, 0 at end of file.
+ */
+
+int
+Nsendfile_offset(int fromfd, int tofd, off_t *offset, size_t count) {
+#if defined(HAVE_SENDFILE) && defined(linux)
+    register ssize_t r;
+
+    r = sendfile(tofd, fromfd, offset, count);
+    if (r < 0) {
+	switch (errno) {
+	    case EINTR:
+	    case EAGAIN:
+#if (EAGAIN != EWOULDBLOCK)
+	    case EWOULDBLOCK:
+#endif
+	    case ENOBUFS:
+	    case ENOMEM:
+		return NET_SOFTERROR;
+
+	    default:
+		return NET_HARDERROR;
+	}
+    }
+    return r;
+#else /* HAVE_SENDFILE && linux */
+    errno = ENOSYS;
+    return NET_HARDERROR;
+#endif /* HAVE_SENDFILE && linux */
+}
+
+
+int
+has_splice(void) {
+#if defined(HAVE_SPLICE)
+    return 1;
+#else /* HAVE_SPLICE */
+    return 0;
+#endif /* HAVE_SPLICE */
+}
+
+
+/*
+ *                      N S P L I C E
+ *
+ * One splice() of up to 'count' bytes; one side must be a pipe.  A
+ * non-NULL offset is used and advanced for tofd (a file).
+ * Like Nrecv_no_select(), returns 0 if interrupted before any data
+ * moved.
+ */
+
+int
+Nsplice(int fromfd, int tofd, off_t *offset, size_t count) {
+#if defined(HAVE_SPLICE)
+    register ssize_t r;
+
+    r = splice(fromfd, NULL, tofd, offset, count, SPLICE_F_MOVE);
+    if (r < 0) {
+	if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+	    return 0;
+	return NET_HARDERROR;
+    }
+    return r;
+#else /* HAVE_SPLICE */
+    errno = ENOSYS;
+    return NET_HARDERROR;
+#endif /* HAVE_SPLICE */
+}
+
 /*************************************************************************/
 
 int
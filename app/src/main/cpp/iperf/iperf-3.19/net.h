@@ -35,6 +35,8 @@ int create_socket(int domain, int type, int proto, const char *local, const char
 int netdial(int domain, int proto, const char *local, const char *bind_dev, int local_port,
             const char *server, int port, int timeout);
 int netannounce(int domain, int proto, const char *local, const char *bind_dev, int port);
+/* netannounce with SO_REUSEPORT, so that several sockets can listen on the port */
+int netannounce_reuseport(int domain, int proto, const char *local, const char *bind_dev, int port);
 int Nread(int fd, char *buf, size_t count, int prot);
 int Nrecv(int fd, char *buf, size_t count, int prot, int sock_opt);
 int Nread_no_select(int fd, char *buf, size_t count, int prot);
@@ -42,6 +44,9 @@ int Nrecv_no_select(int fd, char *buf, size_t count, int prot, int sock_opt);
 int Nwrite(int fd, const char *buf, size_t count, int prot) /* __attribute__((hot)) */;
 int has_sendfile(void);
 int Nsendfile(int fromfd, int tofd, const char *buf, size_t count) /* __attribute__((hot)) */;
+int Nsendfile_offset(int fromfd, int tofd, off_t *offset, size_t count);
+int has_splice(void);
+int Nsplice(int fromfd, int tofd, off_t *offset, size_t count);
 int setnonblocking(int fd, int nonblocking);
 int getsockdomain(int sock);
 int parse_qos(const char *tos);
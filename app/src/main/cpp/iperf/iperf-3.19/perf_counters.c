@@ -0,0 +1,166 @@
+/*
+ * Per-thread hardware and software counters for --perf-counters.
+ *
+ * When a handset underperforms, the interesting question is usually
+ * where the cycles go: syscalls, cache misses, the CPU clocking down.
+ * Each stream's worker thread opens a few perf_event_open(2) counters
+ * on itself, so they cover exactly iperf_send_mt()/iperf_recv_mt() and
+ * nothing else, and the stats timer reads them from the main thread.
+ *
+ * Android normally sets perf_event_paranoid so that unprivileged apps
+ * get nothing, or user space only; whatever can't be opened is simply
+ * not reported.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#if defined(HAVE_LINUX_PERF_EVENT_H)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif /* HAVE_LINUX_PERF_EVENT_H */
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "perf_counters.h"
+
+#if defined(HAVE_LINUX_PERF_EVENT_H) && defined(__NR_perf_event_open)
+#define PERF_COUNTERS_SUPPORTED 1
+
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} perf_events[PERF_NUM_COUNTERS] = {
+    [PERF_CYCLES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    [PERF_INSTRUCTIONS] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    [PERF_CONTEXT_SWITCHES] = { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+    [PERF_PAGE_FAULTS] = { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+};
+
+static int
+perf_event_open_self(int i, int exclude_kernel)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = perf_events[i].type;
+    attr.config = perf_events[i].config;
+    attr.exclude_kernel = exclude_kernel;
+    attr.exclude_hv = 1;
+    /* The PMU may be shared; enabled/running times let us scale */
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    /* pid 0, cpu -1: this thread, wherever it runs */
+    return (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif /* HAVE_LINUX_PERF_EVENT_H && __NR_perf_event_open */
+
+static const char *perf_counter_names[PERF_NUM_COUNTERS] = {
+    [PERF_CYCLES] = "cycles",
+    [PERF_INSTRUCTIONS] = "instructions",
+    [PERF_CONTEXT_SWITCHES] = "context_switches",
+    [PERF_PAGE_FAULTS] = "page_faults",
+};
+
+int
+perf_counters_open(struct iperf_stream *sp)
+{
+    int opened = 0;
+#if defined(PERF_COUNTERS_SUPPORTED)
+    int i, fd;
+
+    for (i = 0; i < PERF_NUM_COUNTERS; i++) {
+        /* Data path time is mostly in the kernel, so try to include it */
+        fd = -1;
+        if (!sp->perf_user_only) {
+            fd = perf_event_open_self(i, 0);
+            if (fd < 0 && (errno == EACCES || errno == EPERM))
+                sp->perf_user_only = 1;
+        }
+        if (fd < 0 && sp->perf_user_only)
+            fd = perf_event_open_self(i, 1);
+        if (fd < 0) {
+            if (sp->test->debug)
+                printf("perf counter %s not available on stream %d: %s\n",
+                       perf_counter_names[i], sp->socket, strerror(errno));
+            continue;
+        }
+        sp->perf_fd[i] = fd;
+        opened++;
+    }
+#endif /* PERF_COUNTERS_SUPPORTED */
+    return opened;
+}
+
+void
+perf_counters_read(struct iperf_stream *sp)
+{
+    uint64_t v[3];    /* value, time enabled, time running */
+    int i;
+
+    for (i = 0; i < PERF_NUM_COUNTERS; i++) {
+        if (sp->perf_fd[i] < 0)
+            continue;
+        if (read(sp->perf_fd[i], v, sizeof(v)) != sizeof(v))
+            continue;
+        if (v[2] > 0 && v[2] < v[1])
+            v[0] = (uint64_t) ((double) v[0] * v[1] / v[2]);
+        sp->perf_count[i] = v[0];
+    }
+}
+
+int
+perf_counters_available(struct iperf_stream *sp)
+{
+    int i;
+
+    for (i = 0; i < PERF_NUM_COUNTERS; i++)
+        if (sp->perf_fd[i] >= 0)
+            return 1;
+    return 0;
+}
+
+void
+perf_counters_close(struct iperf_stream *sp)
+{
+    int i;
+
+    for (i = 0; i < PERF_NUM_COUNTERS; i++) {
+        if (sp->perf_fd[i] >= 0)
+            close(sp->perf_fd[i]);
+        sp->perf_fd[i] = -1;
+    }
+}
+
+/*
+ * JSON object with the counters that are open, as counted over bytes of
+ * payload, plus the two ratios that usually tell the story: cycles per
+ * byte and instructions per cycle.
+ */
+cJSON *
+perf_counters_json(struct iperf_stream *sp, const uint64_t count[], iperf_size_t bytes)
+{
+    cJSON *j;
+    int i;
+
+    j = cJSON_CreateObject();
+    if (j == NULL)
+        return NULL;
+    for (i = 0; i < PERF_NUM_COUNTERS; i++)
+        if (sp->perf_fd[i] >= 0)
+            cJSON_AddNumberToObject(j, perf_counter_names[i], count[i]);
+    if (sp->perf_fd[PERF_CYCLES] >= 0 && bytes > 0)
+        cJSON_AddNumberToObject(j, "cycles_per_byte", (double) count[PERF_CYCLES] / bytes);
+    if (sp->perf_fd[PERF_CYCLES] >= 0 && sp->perf_fd[PERF_INSTRUCTIONS] >= 0 && count[PERF_CYCLES] > 0)
+        cJSON_AddNumberToObject(j, "ipc", (double) count[PERF_INSTRUCTIONS] / count[PERF_CYCLES]);
+    cJSON_AddBoolToObject(j, "user_only", sp->perf_user_only);
+    return j;
+}
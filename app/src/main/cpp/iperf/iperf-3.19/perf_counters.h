@@ -0,0 +1,31 @@
+/*
+ * Per-thread hardware and software counters for --perf-counters.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __PERF_COUNTERS_H
+#define __PERF_COUNTERS_H
+
+#include "iperf.h"
+
+/*
+ * Open the counters for the calling thread, which must be the stream's
+ * worker.  Counters the kernel won't give us (perf_event_paranoid,
+ * missing PMU, seccomp) are simply left closed; returns how many were
+ * opened.
+ */
+int perf_counters_open(struct iperf_stream *sp);
+
+/* Update sp->perf_count[] from the open counters; any thread may call it. */
+void perf_counters_read(struct iperf_stream *sp);
+
+/* Nonzero if at least one counter is open. */
+int perf_counters_available(struct iperf_stream *sp);
+
+void perf_counters_close(struct iperf_stream *sp);
+
+/* Counts (over bytes of payload) as a JSON object, with cycles/byte and IPC */
+cJSON *perf_counters_json(struct iperf_stream *sp, const uint64_t count[], iperf_size_t bytes);
+
+#endif /* __PERF_COUNTERS_H */
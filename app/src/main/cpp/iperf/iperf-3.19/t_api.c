@@ -55,6 +55,92 @@ int test_iperf_set_mss(struct iperf_test *test) {
     return 0;
 }
 
+int test_iperf_set_phases(struct iperf_test *test) {
+    int phases;
+    phases = iperf_get_test_phases(test);
+    assert(phases == 1);
+    assert(iperf_get_test_phase(test) == 1);
+    iperf_set_test_phases(test, 5);
+    phases = iperf_get_test_phases(test);
+    assert(phases == 5);
+    return 0;
+}
+
+int test_iperf_set_max_clients(struct iperf_test *test) {
+    int max_clients;
+    max_clients = iperf_get_test_max_clients(test);
+    assert(max_clients == 1);
+    iperf_set_test_max_clients(test, 8);
+    max_clients = iperf_get_test_max_clients(test);
+    assert(max_clients == 8);
+    return 0;
+}
+
+int test_iperf_set_accept_threads(struct iperf_test *test) {
+    int accept_threads;
+    accept_threads = iperf_get_test_accept_threads(test);
+    assert(accept_threads == 1);
+    iperf_set_test_accept_threads(test, 4);
+    accept_threads = iperf_get_test_accept_threads(test);
+    assert(accept_threads == 4);
+    return 0;
+}
+
+static void
+ui_frame_stub(struct iperf_test *test, const struct iperf_ui_frame *f) {
+    (void) test;
+    (void) f;
+}
+
+int test_iperf_set_ui_frames(struct iperf_test *test) {
+    assert(iperf_get_test_ui_frame_hz(test) == 0);
+    iperf_set_test_ui_frames(test, 4, ui_frame_stub);
+    assert(iperf_get_test_ui_frame_hz(test) == 4);
+    /* No callback, no frames */
+    iperf_set_test_ui_frames(test, 4, NULL);
+    assert(iperf_get_test_ui_frame_hz(test) == 0);
+    return 0;
+}
+
+int test_iperf_clone_test(void) {
+    char *argv[] = { "iperf3", "-c", "192.0.2.1", "-p", "5999", "-b", "10M", "-l", "1000",
+                     "-P", "4", "-t", "3", "-O", "1", "-R", "-F", "file.bin", "--extra-data", "tag", NULL };
+    struct iperf_test *test, *copy;
+    int rc;
+
+    test = iperf_new_test();
+    assert(test != NULL);
+    iperf_defaults(test);
+    rc = iperf_parse_arguments(test, 20, argv);
+    assert(rc == 0);
+
+    copy = iperf_clone_test(test);
+    assert(copy != NULL);
+    assert(iperf_get_test_role(copy) == 'c');
+    assert(strcmp(iperf_get_test_server_hostname(copy), "192.0.2.1") == 0);
+    assert(iperf_get_test_server_port(copy) == 5999);
+    assert(iperf_get_test_protocol_id(copy) == Ptcp);
+    assert(iperf_get_test_rate(copy) == 10000000);
+    assert(iperf_get_test_blksize(copy) == 1000);
+    assert(iperf_get_test_num_streams(copy) == 4);
+    assert(iperf_get_test_duration(copy) == 3);
+    assert(iperf_get_test_omit(copy) == 1);
+    assert(iperf_get_test_reverse(copy) == 1);
+    assert(copy->mode == RECEIVER);
+    assert(strcmp(copy->diskfile_name, "file.bin") == 0);
+    assert(strcmp(copy->extra_data, "tag") == 0);
+
+    /* The copy's strings are its own */
+    iperf_set_test_server_hostname(copy, "192.0.2.2");
+    iperf_set_test_rate(copy, 20000000);
+    assert(strcmp(iperf_get_test_server_hostname(test), "192.0.2.1") == 0);
+    assert(iperf_get_test_rate(test) == 10000000);
+    iperf_free_test(test);
+    assert(strcmp(iperf_get_test_server_hostname(copy), "192.0.2.2") == 0);
+    iperf_free_test(copy);
+    return 0;
+}
+
 int
 main(int argc, char **argv) {
     const char *ver;
@@ -79,6 +165,15 @@ main(int argc, char **argv) {
 
     ret += test_iperf_set_mss(test);
 
+    ret += test_iperf_set_phases(test);
+
+    ret += test_iperf_set_max_clients(test);
+    ret += test_iperf_set_accept_threads(test);
+
+    ret += test_iperf_set_ui_frames(test);
+
+    ret += test_iperf_clone_test();
+
     if (ret < 0) {
         return -1;
     }
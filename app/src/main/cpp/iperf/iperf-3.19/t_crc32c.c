@@ -0,0 +1,65 @@
+/*
+ * iperf, Copyright (c) 2014, 2017, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "crc32c.h"
+
+int
+main(int argc, char **argv) {
+    unsigned char buf[4096];
+    uint32_t whole, split;
+    size_t i, n;
+
+    /* Check value from RFC 3720 / the Castagnoli paper */
+    assert(crc32c(0, "123456789", 9) == 0xe3069283);
+    assert(crc32c(0, "", 0) == 0);
+
+    /* RFC 3720 B.4: 32 bytes of zeros, 32 bytes of 0xff */
+    memset(buf, 0, 32);
+    assert(crc32c(0, buf, 32) == 0x8a9136aa);
+    memset(buf, 0xff, 32);
+    assert(crc32c(0, buf, 32) == 0x62a8ab43);
+
+    /* Chained calls over arbitrary splits must match one pass */
+    for (i = 0; i < sizeof(buf); i++)
+	buf[i] = (unsigned char) (i * 31 + 7);
+    whole = crc32c(0, buf, sizeof(buf));
+    for (n = 0; n < sizeof(buf); n += 61) {
+	split = crc32c(crc32c(0, buf, n), buf + n, sizeof(buf) - n);
+	assert(split == whole);
+    }
+
+    /* Unaligned starts and odd lengths */
+    for (i = 1; i < 8; i++)
+	assert(crc32c(crc32c(0, buf, i), buf + i, 13) == crc32c(0, buf, i + 13));
+
+    printf("crc32c (%s) ok\n", crc32c_impl());
+    return 0;
+}
@@ -0,0 +1,101 @@
+/*
+ * iperf, Copyright (c) 2014, 2017, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "iperf_histogram.h"
+
+/* Within the histogram's resolution of 1/64 */
+static int
+close_to(uint64_t got, uint64_t want)
+{
+    return got >= want - want / 64 && got <= want + want / 64;
+}
+
+int
+main(int argc, char **argv) {
+    struct iperf_udp_histogram_set *a, *b;
+    struct iperf_histogram *h;
+    uint64_t v;
+    int i, last, rc;
+
+    a = calloc(1, sizeof(*a));
+    b = calloc(1, sizeof(*b));
+    assert(a != NULL && b != NULL);
+    h = &a->transit_delta;
+
+    /* Small values are exact, and indexes grow with the value */
+    for (v = 0; v < 128; v++)
+	assert(iperf_histogram_index(v) == (int) v);
+    last = 0;
+    for (v = 1; v < (1ULL << 40); v += v / 7 + 1) {
+	i = iperf_histogram_index(v);
+	assert(i >= last && i < HISTOGRAM_BUCKETS);
+	last = i;
+    }
+    assert(iperf_histogram_index(UINT64_MAX) == HISTOGRAM_BUCKETS - 1);
+
+    /* 1..1000 us: the percentiles are the obvious ones */
+    assert(iperf_histogram_percentile(h, 50.0) == 0);
+    for (v = 1; v <= 1000; v++)
+	iperf_histogram_record(h, v * 1000);
+    assert(iperf_histogram_count(h) == 1000);
+    assert(close_to(iperf_histogram_percentile(h, 50.0), 500000));
+    assert(close_to(iperf_histogram_percentile(h, 99.0), 990000));
+    assert(close_to(iperf_histogram_percentile(h, 100.0), 1000000));
+    assert(close_to(iperf_histogram_percentile(h, 0.0), 1000));
+
+    /* Merging a copy doubles the counts and leaves the percentiles */
+    iperf_histogram_copy(&b->transit_delta, h);
+    iperf_udp_histogram_set_merge(a, b);
+    assert(iperf_histogram_count(h) == 2000);
+    assert(close_to(iperf_histogram_percentile(h, 50.0), 500000));
+
+    /* A tail of 1% shows at p99.9 but not at p90 */
+    for (v = 0; v < 20; v++)
+	iperf_histogram_record(h, 50000000);
+    assert(close_to(iperf_histogram_percentile(h, 90.0), 900000));
+    assert(close_to(iperf_histogram_percentile(h, 99.9), 50000000));
+
+    /* Through the results exchange and back */
+    {
+	cJSON *j = iperf_udp_histogram_set_to_results(a);
+	assert(j != NULL);
+	rc = iperf_udp_histogram_set_from_results(b, j);
+	assert(rc == 0);
+	for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+	    assert(b->transit_delta.buckets[i] == a->transit_delta.buckets[i]);
+	cJSON_Delete(j);
+    }
+
+    printf("histogram: %d buckets, %zu bytes\n", HISTOGRAM_BUCKETS, sizeof(struct iperf_histogram));
+    free(a);
+    free(b);
+    return 0;
+}
@@ -0,0 +1,181 @@
+/*
+ * iperf, Copyright (c) 2014, 2017, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "iperf_history.h"
+
+#define NUM_RECORDS (2 * HISTORY_BLOCK_RECORDS + 22)
+
+/* A 10 s TCP test at 0.1 s intervals, or near enough */
+static void
+make_record(int i, struct iperf_history_record *r)
+{
+    r->v[HISTORY_START_MS] = i * 100;
+    r->v[HISTORY_END_MS] = i * 100 + 100;
+    r->v[HISTORY_BYTES] = 12500000 + (i % 7) * 131072 - (i % 3) * 400000;
+    r->v[HISTORY_RETRANSMITS] = i % 11 == 0 ? 40 : 0;
+    r->v[HISTORY_PACKETS] = 0;
+    r->v[HISTORY_LOST] = 0;
+    r->v[HISTORY_JITTER_US] = -5 + i % 10;
+    r->v[HISTORY_FLAGS] = HISTORY_FLAG_SENDER | (i < 3 ? HISTORY_FLAG_OMITTED : 0);
+}
+
+int
+main(int argc, char **argv)
+{
+    struct iperf_history_writer *w;
+    struct iperf_history_record r, *records;
+    struct iperf_history_map map;
+    struct iperf_history_summary s, t;
+    unsigned char buf[HISTORY_SUMMARY_SIZE];
+    char dir[] = "/tmp/t_historyXXXXXX";
+    char path[256];
+    struct stat st;
+    FILE *f;
+    int i, n, rc;
+
+    if (mkdtemp(dir) == NULL) {
+        perror(dir);
+        return 1;
+    }
+    snprintf(path, sizeof(path), "%s/test%s", dir, HISTORY_DATA_SUFFIX);
+
+    /* Two full blocks and a short one round-trip */
+    w = iperf_history_writer_open(path);
+    assert(w != NULL);
+    for (i = 0; i < NUM_RECORDS; i++) {
+        make_record(i, &r);
+        rc = iperf_history_writer_add(w, &r);
+        assert(rc == 0);
+    }
+    rc = iperf_history_writer_close(w);
+    assert(rc == 0);
+
+    records = calloc(NUM_RECORDS, sizeof(*records));
+    assert(records != NULL);
+    rc = iperf_history_map(path, &map);
+    assert(rc == 0);
+    rc = iperf_history_read(&map, NULL, 0);
+    assert(rc == NUM_RECORDS);
+    rc = iperf_history_read(&map, records, NUM_RECORDS);
+    assert(rc == NUM_RECORDS);
+    for (i = 0; i < NUM_RECORDS; i++) {
+        make_record(i, &r);
+        assert(memcmp(&r, &records[i], sizeof(r)) == 0);
+    }
+    /* A quarter of the 64 bytes a record takes as it is, or less */
+    assert(map.size < (size_t) NUM_RECORDS * 16);
+    rc = iperf_history_read(&map, records, 10);
+    assert(rc == 10);
+    iperf_history_unmap(&map);
+
+    /* Cut short as if by a crash: the complete blocks are still there */
+    rc = stat(path, &st);
+    assert(rc == 0);
+    rc = truncate(path, st.st_size - 8);
+    assert(rc == 0);
+    rc = iperf_history_map(path, &map);
+    assert(rc == 0);
+    rc = iperf_history_read(&map, records, NUM_RECORDS);
+    assert(rc == 2 * HISTORY_BLOCK_RECORDS);
+    iperf_history_unmap(&map);
+
+    /* Not a data file */
+    f = fopen(path, "w");
+    assert(f != NULL);
+    fputs("iperf Done.\n", f);
+    fclose(f);
+    rc = iperf_history_map(path, &map);
+    assert(rc == 0);
+    rc = iperf_history_read(&map, records, NUM_RECORDS);
+    assert(rc == -1);
+    iperf_history_unmap(&map);
+    unlink(path);
+    free(records);
+
+    /* Summaries round-trip, and are appended whole */
+    memset(&s, 0, sizeof(s));
+    s.start_ms = 1760000000123LL;
+    s.duration_ms = 10250;
+    s.role = 'c';
+    s.protocol = 1;
+    s.mode = -1;
+    s.complete = 1;
+    s.num_streams = 4;
+    s.phase = 2;
+    s.num_intervals = 100;
+    s.tx.bytes_sent = 5000000000ULL;
+    s.tx.bytes_received = 4999000000ULL;
+    s.tx.sender_ms = 10000;
+    s.tx.receiver_ms = 10040;
+    s.tx.retransmits = 12;
+    s.rx.packets = 90000;
+    s.rx.lost = 17;
+    s.rx.jitter_us = 230;
+    strcpy(s.host, "192.0.2.7");
+    strcpy(s.tag, "20261019_101500");
+    strcpy(s.data_file, "1760000000123-abcdefgh-2.ihd");
+    iperf_history_summary_encode(&s, buf);
+    rc = iperf_history_summary_decode(buf, &t);
+    assert(rc == 0);
+    assert(memcmp(&s, &t, sizeof(s)) == 0);
+    buf[0] = 'X';
+    rc = iperf_history_summary_decode(buf, &t);
+    assert(rc == -1);
+
+    rc = iperf_history_append_summary(dir, &s);
+
+    assert(rc == 0);
+    s.phase = 3;
+    rc = iperf_history_append_summary(dir, &s);
+    assert(rc == 0);
+    snprintf(path, sizeof(path), "%s/%s", dir, HISTORY_INDEX_NAME);
+    rc = stat(path, &st);
+    assert(rc == 0);
+    assert(st.st_size == 2 * HISTORY_SUMMARY_SIZE);
+    f = fopen(path, "r");
+    assert(f != NULL);
+    n = 0;
+    while (fread(buf, 1, sizeof(buf), f) == sizeof(buf)) {
+        rc = iperf_history_summary_decode(buf, &t);
+        assert(rc == 0);
+        assert(t.phase == 2 + n);
+        n++;
+    }
+    fclose(f);
+    assert(n == 2);
+    unlink(path);
+    rmdir(dir);
+
+    return 0;
+}
@@ -0,0 +1,245 @@
+/*
+ * iperf, Copyright (c) 2014, 2017, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#if defined(HAVE_ZLIB)
+#include <zlib.h>
+#endif /* HAVE_ZLIB */
+
+#include "iperf_logwriter.h"
+
+#define PART_SIZE 4096
+#define NUM_LINES 500
+
+/* What every part holds, in order, into out; how many parts there were */
+static int
+read_parts(const char *prefix, int first, int last, char *out, size_t size)
+{
+    char path[PATH_MAX];
+    struct stat st;
+    size_t len = 0, n;
+    FILE *f;
+    int part, rc;
+
+    for (part = first; part <= last; part++) {
+        snprintf(path, sizeof(path), "%s%d.txt", prefix, part);
+        rc = stat(path, &st);
+        assert(rc == 0);
+        assert(st.st_size > 0);
+        f = fopen(path, "r");
+        assert(f != NULL);
+        n = fread(out + len, 1, size - len, f);
+        fclose(f);
+        assert(n == (size_t) st.st_size);
+        /* Parts end at a line end, and only a line too long for one is over */
+        assert(out[len + n - 1] == '\n');
+        assert(n <= PART_SIZE || memchr(out + len, '\n', n) == out + len + n - 1);
+        len += n;
+    }
+    out[len] = '\0';
+    return last - first + 1;
+}
+
+#if defined(HAVE_ZLIB)
+/* The same for gzip parts: what gzread() gets out of them, up to any cut */
+static size_t
+read_gz_parts(const char *prefix, int first, int last, char *out, size_t size)
+{
+    char path[PATH_MAX];
+    size_t len = 0;
+    gzFile gz;
+    int part, n;
+
+    for (part = first; part <= last; part++) {
+        snprintf(path, sizeof(path), "%s%d.txt.gz", prefix, part);
+        gz = gzopen(path, "rb");
+        assert(gz != NULL);
+        while ((n = gzread(gz, out + len, size - len - 1)) > 0)
+            len += n;
+        gzclose(gz);
+    }
+    out[len] = '\0';
+    return len;
+}
+#endif /* HAVE_ZLIB */
+
+int
+main(int argc, char **argv)
+{
+    struct iperf_logwriter *lw;
+    char dir[] = "/tmp/t_logwriterXXXXXX";
+    char prefix[256], path[PATH_MAX], line[64];
+    char *expected, *got, *longline;
+    struct stat st;
+    size_t len;
+    int i, first, last, part, rc;
+
+    if (mkdtemp(dir) == NULL) {
+        perror(dir);
+        return 1;
+    }
+    snprintf(prefix, sizeof(prefix), "%s/log_", dir);
+    expected = calloc(1, 64 * 1024);
+    got = calloc(1, 64 * 1024);
+    assert(expected != NULL && got != NULL);
+
+    /* A line is only queued; a flush puts it on disk */
+    lw = iperf_logwriter_open(prefix, ".txt", PART_SIZE, 0);
+    assert(lw != NULL);
+    rc = iperf_logwriter_write(lw, "first\n", 6);
+    assert(rc == 0);
+    strcat(expected, "first\n");
+    snprintf(path, sizeof(path), "%s1.txt", prefix);
+    rc = stat(path, &st);
+    assert(rc == 0);
+    assert(st.st_size == 0);
+    rc = iperf_logwriter_flush(lw);
+    assert(rc == 0);
+    rc = stat(path, &st);
+    assert(rc == 0);
+    assert(st.st_size == 6);
+
+    /* Lines split into parts at line ends, nothing lost or reordered */
+    for (i = 0; i < NUM_LINES; i++) {
+        snprintf(line, sizeof(line), "[  5] %4d.00-%4d.10 sec  1.25 MBytes\n", i, i);
+        rc = iperf_logwriter_write(lw, line, strlen(line));
+        assert(rc == 0);
+        strcat(expected, line);
+    }
+    rc = iperf_logwriter_flush(lw);
+    assert(rc == 0);
+    iperf_logwriter_parts(lw, &first, &last);
+    assert(first == 1);
+    assert(last >= (int) (strlen(expected) / PART_SIZE) + 1);
+
+    /* A line bigger than a part gets one to itself */
+    longline = malloc(PART_SIZE + 100);
+    assert(longline != NULL);
+    memset(longline, 'x', PART_SIZE + 99);
+    longline[PART_SIZE + 99] = '\n';
+    rc = iperf_logwriter_write(lw, longline, PART_SIZE + 100);
+    assert(rc == 0);
+    memcpy(expected + strlen(expected), longline, PART_SIZE + 100);
+    rc = iperf_logwriter_write(lw, "last\n", 5);
+    assert(rc == 0);
+    strcat(expected, "last\n");
+    rc = iperf_logwriter_close(lw);
+    assert(rc == 0);
+
+    /* Reopened, it carries on in the last part, which has room */
+    lw = iperf_logwriter_open(prefix, ".txt", PART_SIZE, 0);
+    assert(lw != NULL);
+    iperf_logwriter_parts(lw, &first, &part);
+    rc = iperf_logwriter_write(lw, "again\n", 6);
+    assert(rc == 0);
+    strcat(expected, "again\n");
+    rc = iperf_logwriter_close(lw);
+    assert(rc == 0);
+    assert(first == part);
+    assert(part > last + 1);
+    read_parts(prefix, 1, part, got, 64 * 1024);
+    assert(strcmp(expected, got) == 0);
+
+    for (i = 1; i <= part; i++) {
+        snprintf(path, sizeof(path), "%s%d.txt", prefix, i);
+        unlink(path);
+    }
+
+#if defined(HAVE_ZLIB)
+    /* Compressed, the parts are gzip and far smaller */
+    snprintf(prefix, sizeof(prefix), "%s/gz_", dir);
+    lw = iperf_logwriter_open(prefix, ".txt.gz", PART_SIZE, 6);
+    assert(lw != NULL);
+    expected[0] = '\0';
+    for (i = 0; i < NUM_LINES; i++) {
+        snprintf(line, sizeof(line), "[  5] %4d.00-%4d.10 sec  1.25 MBytes\n", i, i);
+        rc = iperf_logwriter_write(lw, line, strlen(line));
+        assert(rc == 0);
+        strcat(expected, line);
+    }
+    rc = iperf_logwriter_flush(lw);
+    assert(rc == 0);
+    iperf_logwriter_parts(lw, &first, &last);
+    assert(first == 1 && last == 1);
+    snprintf(path, sizeof(path), "%s1.txt.gz", prefix);
+    rc = stat(path, &st);
+    assert(rc == 0);
+    assert(st.st_size < (off_t) strlen(expected) / 4);
+
+    /*
+     * A batch written between sync points is in a member that isn't
+     * finished yet, as after a crash, and still reads back
+     */
+    rc = iperf_logwriter_write(lw, "tail\n", 5);
+    assert(rc == 0);
+    strcat(expected, "tail\n");
+    sleep(LOGWRITER_FLUSH_MS / 1000 + 1);
+    len = read_gz_parts(prefix, 1, 1, got, 64 * 1024);
+    assert(len == strlen(expected));
+    assert(strcmp(expected, got) == 0);
+
+    /* Past max_size, at the end of a batch, the next part starts */
+    for (i = 0; i < 2000; i++) {
+        snprintf(line, sizeof(line), "%08x%08x\n", (unsigned) i * 2654435761u, (unsigned) i);
+        rc = iperf_logwriter_write(lw, line, strlen(line));
+        assert(rc == 0);
+        strcat(expected, line);
+    }
+    rc = iperf_logwriter_flush(lw);
+    assert(rc == 0);
+    rc = iperf_logwriter_write(lw, "next\n", 5);
+    assert(rc == 0);
+    strcat(expected, "next\n");
+    iperf_logwriter_parts(lw, &first, &last);
+    rc = iperf_logwriter_close(lw);
+    assert(rc == 0);
+    assert(last > 1);
+    snprintf(path, sizeof(path), "%s1.txt.gz", prefix);
+    rc = stat(path, &st);
+    assert(rc == 0);
+    assert(st.st_size >= PART_SIZE);
+    read_gz_parts(prefix, 1, last, got, 64 * 1024);
+    assert(strcmp(expected, got) == 0);
+    for (i = 1; i <= last; i++) {
+        snprintf(path, sizeof(path), "%s%d.txt.gz", prefix, i);
+        unlink(path);
+    }
+#endif /* HAVE_ZLIB */
+    rmdir(dir);
+    free(longline);
+    free(got);
+    free(expected);
+
+    return 0;
+}
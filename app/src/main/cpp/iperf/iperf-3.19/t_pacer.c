@@ -0,0 +1,101 @@
+/*
+ * iperf, Copyright (c) 2014, 2017, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include <assert.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "iperf.h"
+#include "iperf_pacer.h"
+
+#define RUN_NS 400000000LL
+
+/*
+ * Paces blocks of len at rate (bits/s) for RUN_NS, as a sending thread
+ * does, and returns the rate achieved from the first block's send on
+ */
+static double
+achieved(uint64_t rate, int len)
+{
+    struct iperf_settings settings;
+    struct iperf_stream sp;
+    int64_t t0, t1;
+    uint64_t bytes = 0;
+
+    memset(&settings, 0, sizeof(settings));
+    memset(&sp, 0, sizeof(sp));
+    settings.rate = rate;
+    settings.blksize = len;
+    sp.settings = &settings;
+    iperf_pacer_init(&sp);
+
+    iperf_pacer_wait(&sp.pacer, len);
+    iperf_pacer_spend(&sp.pacer, len);
+    t0 = t1 = iperf_pacer_now();
+    while (t1 - t0 < RUN_NS) {
+        iperf_pacer_wait(&sp.pacer, len);
+        iperf_pacer_spend(&sp.pacer, len);
+        bytes += len;
+        t1 = iperf_pacer_now();
+    }
+    return bytes * 8.0 * SEC_TO_NS / (t1 - t0);
+}
+
+/*
+ * Within 2% of -b, what the sleeps overshoot by notwithstanding.  A
+ * shortfall that is the pacer's own shows up every time, so a run the
+ * scheduler got in the way of is tried again.
+ */
+static int
+on_target(uint64_t rate, int len)
+{
+    double got;
+    int tries;
+
+    for (tries = 0; tries < 3; tries++) {
+        got = achieved(rate, len);
+        printf("pacer: -b %" PRIu64 " -l %d: %.0f bits/s\n", rate, len, got);
+        fflush(stdout);
+        if (got > rate * 0.98 && got < rate * 1.02)
+            return 1;
+    }
+    return 0;
+}
+
+int
+main(int argc, char **argv) {
+    int ok;
+
+    /* A block bigger than the default 1 ms of rate, TCP's default and a large UDP one */
+    ok = on_target(1000000000, 128 * 1024);
+    assert(ok);
+    ok = on_target(100000000, 32 * 1024);
+    assert(ok);
+
+    return 0;
+}
@@ -0,0 +1,106 @@
+/*
+ * iperf, Copyright (c) 2014, 2017, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "iperf_rate_search.h"
+
+/*
+ * A path that takes capacity bits/s per stream and drops the rest, from
+ * senders that can't go over sender_max bits/s per stream.  Returns the
+ * number of steps taken to finish.
+ */
+static int
+simulate(struct iperf_rate_search *rs, int streams, double capacity, double sender_max)
+{
+    double sent, received, lost;
+    int i;
+
+    for (i = 0; i < 200 && !rs->done; i++) {
+	sent = rs->rate < sender_max ? rs->rate : sender_max;
+	received = sent < capacity ? sent : capacity;
+	lost = 100.0 * (sent - received) / sent;
+	iperf_rate_search_step(rs, i, streams, sent * streams, received * streams, lost);
+    }
+    return i;
+}
+
+int
+main(int argc, char **argv) {
+    struct iperf_rate_search *rs;
+    cJSON *j;
+    uint64_t rate;
+    int steps;
+
+    /* Up from 1 Mbit/s to a 300 Mbit/s path, in a few dozen steps */
+    rs = iperf_rate_search_new(0.5, 1000000);
+    assert(rs != NULL);
+    steps = simulate(rs, 4, 300e6, 10e9);
+    assert(rs->done && rs->converged);
+    assert(rs->rate == rs->lo);
+    assert(rs->lo <= 300e6 && rs->lo >= 300e6 * (1 - 2 * RATE_SEARCH_TOLERANCE));
+    assert(steps < 40);
+    /* A lossy step is followed by one that isn't counted */
+    assert(rs->num_steps < steps);
+
+    /* Held there once converged */
+    rate = iperf_rate_search_step(rs, 99, 4, 1e9, 1e9, 50.0);
+    assert(rate == rs->lo);
+
+    j = iperf_rate_search_json(rs, 4);
+    assert(j != NULL);
+    assert(cJSON_IsTrue(cJSON_GetObjectItem(j, "converged")));
+    assert(cJSON_GetObjectItem(j, "total_rate")->valuedouble == 4.0 * rs->lo);
+    assert(cJSON_GetArraySize(cJSON_GetObjectItem(j, "steps")) == rs->num_steps);
+    cJSON_Delete(j);
+    iperf_rate_search_free(rs);
+
+    /* Starting too high halves until a rate passes */
+    rs = iperf_rate_search_new(1.0, 1000000000);
+    simulate(rs, 1, 20e6, 10e9);
+    assert(rs->converged);
+    assert(rs->lo <= 20e6 * 1.01 / 0.99 && rs->lo >= 20e6 * (1 - 2 * RATE_SEARCH_TOLERANCE));
+    assert(!rs->steps[0].good);
+    iperf_rate_search_free(rs);
+
+    /* Senders that top out first: a rate they come close enough to */
+    rs = iperf_rate_search_new(0.0, 1000000);
+    simulate(rs, 2, 10e9, 50e6);
+    assert(rs->converged);
+    assert(rs->lo <= 50e6 / RATE_SEARCH_SHORTFALL && rs->lo >= 50e6 * (1 - 2 * RATE_SEARCH_TOLERANCE));
+    iperf_rate_search_free(rs);
+
+    /* A path that loses everything: give up at the floor */
+    rs = iperf_rate_search_new(0.0, 1000000);
+    simulate(rs, 1, 0.0, 10e9);
+    assert(rs->done && !rs->converged);
+    assert(rs->rate == RATE_SEARCH_MIN_RATE && rs->lo == 0);
+    iperf_rate_search_free(rs);
+
+    return 0;
+}
@@ -0,0 +1,218 @@
+/*
+ * iperf, Copyright (c) 2014, 2017, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_server_pool.h"
+#include "timer.h"
+
+#define POOL_PORT 5331
+/* How long to wait for the pool to start listening */
+#define LISTEN_TIMEOUT_MS 5000
+
+/* A test run on a thread of its own, and what it returned */
+struct run {
+    struct iperf_test *test;
+    pthread_t thread;
+    int rc;
+    /* A client's, checked on its thread before it frees the test */
+    int streams;
+    int ok;
+    struct iperf_time start_time, end_time;
+};
+
+static FILE *devnull;
+
+/* Whether the client ran every stream it asked for, with the server's results for each */
+static int
+client_ok(struct run *client)
+{
+    struct iperf_stream *sp;
+    int n = 0;
+
+    if (client->rc != 0)
+        return 0;
+    SLIST_FOREACH(sp, &client->test->streams, streams) {
+        if (sp->result->bytes_sent == 0 || sp->result->bytes_received == 0)
+            return 0;
+        n++;
+    }
+    return n == client->streams;
+}
+
+static void *
+server_thread(void *arg)
+{
+    struct run *r = arg;
+
+    r->rc = iperf_run_server_pool(r->test);
+    return NULL;
+}
+
+static void *
+client_thread(void *arg)
+{
+    struct run *r = arg;
+
+    struct iperf_stream *sp;
+
+    r->rc = iperf_run_client(r->test);
+    r->ok = client_ok(r);
+    sp = SLIST_FIRST(&r->test->streams);
+    if (sp != NULL) {
+        r->start_time = sp->result->start_time;
+        r->end_time = sp->result->end_time;
+    }
+    /* The test's timers are this thread's, as a pool session's are */
+    iperf_free_test(r->test);
+    r->test = NULL;
+    tmr_destroy();
+    return NULL;
+}
+
+static struct iperf_test *
+new_test(char role, int port)
+{
+    struct iperf_test *test;
+
+    test = iperf_new_test();
+    assert(test != NULL);
+    iperf_defaults(test);
+    iperf_set_test_role(test, role);
+    iperf_set_test_server_port(test, port);
+    test->outfile = devnull;
+    return test;
+}
+
+/* A one-off pool with these options, on its own thread and listening */
+static void
+start_server(struct run *server, int port, int max_clients, int accept_threads)
+{
+    int waited, rc;
+
+    memset(server, 0, sizeof(*server));
+    server->test = new_test('s', port);
+    iperf_set_test_one_off(server->test, 1);
+    iperf_set_test_max_clients(server->test, max_clients);
+    iperf_set_test_accept_threads(server->test, accept_threads);
+    rc = pthread_create(&server->thread, NULL, server_thread, server);
+    assert(rc == 0);
+    for (waited = 0; __atomic_load_n(&server->test->state, __ATOMIC_ACQUIRE) != IPERF_START; waited++) {
+        assert(waited < LISTEN_TIMEOUT_MS);
+        usleep(1000);
+    }
+}
+
+static void
+start_client(struct run *client, int port, int streams, int duration)
+{
+    int rc;
+
+    memset(client, 0, sizeof(*client));
+    client->streams = streams;
+    client->test = new_test('c', port);
+    iperf_set_test_server_hostname(client->test, "127.0.0.1");
+    iperf_set_test_duration(client->test, duration);
+    iperf_set_test_num_streams(client->test, streams);
+    rc = pthread_create(&client->thread, NULL, client_thread, client);
+    assert(rc == 0);
+}
+
+/*
+ * --max-clients 2: two clients at once, each with its own test and
+ * results; the one-off server lets the longer one finish
+ */
+static void
+test_max_clients(void)
+{
+    static const int streams[2] = { 1, 3 }, duration[2] = { 2, 1 };
+    struct run server, clients[2];
+    int i;
+
+    start_server(&server, POOL_PORT, 2, 1);
+    for (i = 0; i < 2; i++)
+        start_client(&clients[i], POOL_PORT, streams[i], duration[i]);
+    for (i = 0; i < 2; i++)
+        pthread_join(clients[i].thread, NULL);
+    /* One-off, it is done once both are */
+    pthread_join(server.thread, NULL);
+    assert(server.rc == 0);
+
+    for (i = 0; i < 2; i++)
+        assert(clients[i].ok);
+    /* They overlapped, so neither waited for the other */
+    assert(iperf_time_compare(&clients[0].start_time, &clients[1].end_time) < 0);
+    assert(iperf_time_compare(&clients[1].start_time, &clients[0].end_time) < 0);
+
+    iperf_free_test(server.test);
+}
+
+#if defined(SO_REUSEPORT)
+/*
+ * --accept-threads 2: a client's 8 streams come in over both listeners,
+ * and each is handed to its test whichever thread took it
+ */
+static void
+test_accept_threads(void)
+{
+    struct run server, client;
+
+    start_server(&server, POOL_PORT + 1, 1, 2);
+    start_client(&client, POOL_PORT + 1, 8, 1);
+    pthread_join(client.thread, NULL);
+    pthread_join(server.thread, NULL);
+    assert(server.rc == 0);
+    assert(client.ok);
+
+    iperf_free_test(server.test);
+}
+#endif /* SO_REUSEPORT */
+
+int
+main(int argc, char **argv)
+{
+    devnull = fopen("/dev/null", "w");
+    assert(devnull != NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    test_max_clients();
+#if defined(SO_REUSEPORT)
+    test_accept_threads();
+#endif /* SO_REUSEPORT */
+
+    fclose(devnull);
+    return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ * iperf, Copyright (c) 2014, 2017, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "iperf_time.h"
+
+#define BENCH_CALLS 1000000
+
+static uint64_t
+monotonic_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int
+main(int argc, char **argv) {
+    struct iperf_time a, b, d;
+    struct timespec pause = { 0, 50000000 };
+    uint64_t start, ns_now, ns_gettime, mono0, mono1, fast0, fast1;
+    double drift;
+    int i, past;
+
+    /* Arithmetic carries nanoseconds into seconds */
+    a.secs = 1;
+    a.nsecs = 999999500;
+    iperf_time_add_nsecs(&a, 600);
+    assert(a.secs == 2 && a.nsecs == 100);
+    iperf_time_add_usecs(&a, 1500000);
+    assert(a.secs == 3 && a.nsecs == 500000100);
+    assert(iperf_time_in_nsecs(&a) == 3500000100ULL);
+    assert(iperf_time_in_usecs(&a) == 3500000);
+
+    b.secs = 2;
+    b.nsecs = 999999999;
+    assert(iperf_time_compare(&a, &b) == 1);
+    assert(iperf_time_compare(&b, &a) == -1);
+    past = iperf_time_diff(&a, &b, &d);
+    assert(past == 0);
+    assert(d.secs == 0 && d.nsecs == 500000101);
+    past = iperf_time_diff(&b, &a, &d);
+    assert(past == 1);
+    assert(d.secs == 0 && d.nsecs == 500000101);
+    past = iperf_time_diff(&a, &a, &d);
+    assert(past == 1);
+    assert(d.secs == 0 && d.nsecs == 0);
+
+    /* Whatever the source, it never goes backwards, even across choosing it */
+    iperf_time_now(&a);
+    iperf_time_calibrate();
+    iperf_time_now(&b);
+    assert(iperf_time_compare(&b, &a) >= 0);
+    a = b;
+    for (i = 0; i < BENCH_CALLS; i++) {
+	iperf_time_now(&b);
+	assert(iperf_time_compare(&b, &a) >= 0);
+	assert(b.nsecs < 1000000000);
+	a = b;
+    }
+
+    /* ...and keeps time with CLOCK_MONOTONIC to within 0.1% */
+    iperf_time_now(&a);
+    mono0 = monotonic_ns();
+    nanosleep(&pause, NULL);
+    iperf_time_now(&b);
+    mono1 = monotonic_ns();
+    fast0 = iperf_time_in_nsecs(&a);
+    fast1 = iperf_time_in_nsecs(&b);
+    drift = ((double) (fast1 - fast0) - (double) (mono1 - mono0)) / (mono1 - mono0);
+    assert(drift > -0.001 && drift < 0.001);
+
+    /* What a clock read costs on the data path */
+    start = monotonic_ns();
+    for (i = 0; i < BENCH_CALLS; i++)
+	iperf_time_now(&a);
+    ns_now = monotonic_ns() - start;
+    start = monotonic_ns();
+    for (i = 0; i < BENCH_CALLS; i++)
+	(void) monotonic_ns();
+    ns_gettime = monotonic_ns() - start;
+
+    printf("iperf_time %s: %.1f ns/call, clock_gettime: %.1f ns/call\n", iperf_time_source(),
+	   (double) ns_now / BENCH_CALLS, (double) ns_gettime / BENCH_CALLS);
+    return 0;
+}
@@ -43,6 +43,7 @@
  * I think MS Windows does support TCP_INFO, but iperf3 does not currently support Windows.
  */
 
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/param.h>
@@ -55,6 +56,7 @@
 #include "iperf.h"
 #include "iperf_api.h"
 #include "iperf_locale.h"
+#include "iperf_util.h"
 
 /*************************************************************/
 int
@@ -91,13 +93,35 @@ has_tcpinfo_retransmits(void) {
 /*************************************************************/
 void
 save_tcpinfo(struct iperf_stream *sp, struct iperf_interval_results *irp) {
-#if (defined(linux) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)) && \
-    defined(TCP_INFO)
+#if defined(linux) && defined(TCP_INFO)
+    /* The C library's struct tcp_info may stop short of the fields we want */
+    union {
+        struct tcp_info info;
+        struct iperf_tcp_info_linux ext;
+    } u;
+    socklen_t tcp_info_length = sizeof(u);
+
+    memset(&u, 0, sizeof(u));
+    if (getsockopt(sp->socket, IPPROTO_TCP, TCP_INFO, (void *) &u, &tcp_info_length) < 0)
+        iperf_err(sp->test, "getsockopt - %s", strerror(errno));
+    memcpy(&irp->tcpInfo, &u.info, sizeof(irp->tcpInfo));
+
+    irp->tcp_limits_valid = TCPINFO_HAS(tcp_info_length, sndbuf_limited);
+    if (irp->tcp_limits_valid) {
+        irp->tcp_limits.busy_us = u.ext.busy_time;
+        irp->tcp_limits.rwnd_limited_us = u.ext.rwnd_limited;
+        irp->tcp_limits.sndbuf_limited_us = u.ext.sndbuf_limited;
+        irp->tcp_limits.bytes_acked = u.ext.bytes_acked;
+        irp->delivery_rate = u.ext.delivery_rate;
+    }
+#elif (defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)) && defined(TCP_INFO)
     socklen_t tcp_info_length = sizeof(struct tcp_info);
 
     if (getsockopt(sp->socket, IPPROTO_TCP, TCP_INFO, (void *) &irp->tcpInfo, &tcp_info_length) < 0)
         iperf_err(sp->test, "getsockopt - %s", strerror(errno));
-
+#endif
+#if (defined(linux) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)) && \
+    defined(TCP_INFO)
     if (sp->test->debug) {
         printf("tcpi_snd_cwnd %u tcpi_snd_mss %u tcpi_rtt %u\n",
                irp->tcpInfo.tcpi_snd_cwnd, irp->tcpInfo.tcpi_snd_mss,
@@ -222,3 +246,74 @@ build_tcpinfo_message(struct iperf_interval_results *r, char *message) {
 	    r->tcpInfo.tcpi_rcv_space, r->tcpInfo.tcpi_snd_ssthresh, r->tcpInfo.tcpi_rtt);
 #endif
 }
+
+/*************************************************************/
+void
+get_tcp_limits_diff(const struct iperf_tcp_limits *now, const struct iperf_tcp_limits *before, struct iperf_tcp_limits *diff) {
+    diff->busy_us = now->busy_us - before->busy_us;
+    diff->rwnd_limited_us = now->rwnd_limited_us - before->rwnd_limited_us;
+    diff->sndbuf_limited_us = now->sndbuf_limited_us - before->sndbuf_limited_us;
+    diff->bytes_acked = now->bytes_acked - before->bytes_acked;
+}
+
+/*************************************************************/
+/*
+ * What held the sender back for most of secs: the application not
+ * writing (time not busy), the receive window, the send buffer, or
+ * else the network, i.e. the congestion window (busy, but neither of
+ * the other two).
+ */
+const char *
+get_tcp_limits_verdict(const struct iperf_tcp_limits *l, double secs) {
+    double wall = secs * 1000000.0;
+    double app, cwnd, most;
+    const char *verdict;
+
+    if (wall <= 0)
+        return "unknown";
+    app = wall > l->busy_us ? wall - l->busy_us : 0;
+    cwnd = (double) l->busy_us - l->rwnd_limited_us - l->sndbuf_limited_us;
+    if (cwnd < 0)
+        cwnd = 0;
+
+    verdict = "cwnd-limited";
+    most = cwnd;
+    if (l->rwnd_limited_us > most) {
+        verdict = "rwnd-limited";
+        most = l->rwnd_limited_us;
+    }
+    if (l->sndbuf_limited_us > most) {
+        verdict = "sndbuf-limited";
+        most = l->sndbuf_limited_us;
+    }
+    if (app > most)
+        verdict = "app-limited";
+    return verdict;
+}
+
+/*************************************************************/
+/*
+ * Percentages of secs of wall time; with verdict, also the cwnd- and
+ * app-limited shares and get_tcp_limits_verdict().
+ */
+cJSON *
+build_tcp_limits_json(const struct iperf_tcp_limits *l, double secs, int verdict) {
+    double wall = secs * 1000000.0;
+    double busy, rwnd, sndbuf, cwnd;
+    cJSON *j;
+
+    if (wall <= 0)
+        wall = 1;
+    busy = l->busy_us * 100.0 / wall;
+    rwnd = l->rwnd_limited_us * 100.0 / wall;
+    sndbuf = l->sndbuf_limited_us * 100.0 / wall;
+    j = iperf_json_printf("busy_percent: %f  rwnd_limited_percent: %f  sndbuf_limited_percent: %f  bytes_acked: %d",
+                          busy, rwnd, sndbuf, (int64_t) l->bytes_acked);
+    if (j != NULL && verdict) {
+        cwnd = busy - rwnd - sndbuf;
+        cJSON_AddNumberToObject(j, "cwnd_limited_percent", cwnd > 0 ? cwnd : 0);
+        cJSON_AddNumberToObject(j, "app_limited_percent", busy < 100 ? 100 - busy : 0);
+        cJSON_AddStringToObject(j, "verdict", get_tcp_limits_verdict(l, secs));
+    }
+    return j;
+}
@@ -33,8 +33,8 @@
 #include "timer.h"
 #include "iperf_time.h"
 
-static Timer *timers = NULL;
-static Timer *free_timers = NULL;
+static _Thread_local Timer *timers = NULL;
+static _Thread_local Timer *free_timers = NULL;
 
 TimerClientData JunkClientData;
 
@@ -150,7 +150,7 @@ tmr_timeout(struct iperf_time *nowP) {
     struct iperf_time now, diff;
     int64_t usecs;
     int past;
-    static struct timeval timeout;
+    static _Thread_local struct timeval timeout;
 
     getnow(nowP, &now);
     /* Since the list is sorted, we only need to look at the first timer. */
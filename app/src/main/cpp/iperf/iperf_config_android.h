@@ -3,7 +3,7 @@
 
 // System/Time features
 #define HAVE_CLOCK_GETTIME 1              // Used for precise timekeeping
-#undef HAVE_CLOCK_NANOSLEEP              // Not available in Android NDK
+#define HAVE_CLOCK_NANOSLEEP 1           // Bionic has it (API 21+); -b pacer sleeps to absolute deadlines
 #undef HAVE_CPUSET_SETAFFINITY           // Not used; Linux-specific
 #define HAVE_CPU_AFFINITY 1              // Enables CPU affinity support (via sched)
 
@@ -20,6 +20,7 @@
 #undef HAVE_IP_DONTFRAGMENT              // Linux socket option
 #undef HAVE_IP_MTU_DISCOVER              // Linux-specific feature
 #undef HAVE_LINUX_TCP_H                  // Linux-only TCP options
+#define HAVE_LINUX_PERF_EVENT_H 1        // perf_event_open() for --perf-counters
 #undef HAVE_MSG_TRUNC                    // Message truncation support (recv)
 #define HAVE_NANOSLEEP 1                 // For sub-second sleep
 
@@ -28,12 +29,15 @@
 #define HAVE_POLL_H 1                   // Polling support for I/O
 #define HAVE_PTHREAD 1                  // Android supports POSIX threads
 #undef HAVE_PTHREAD_PRIO_INHERIT        // Not always present in Android NDK
-#undef HAVE_SCHED_SETAFFINITY           // Optional; for setting thread affinity
+#define HAVE_SCHED_SETAFFINITY 1         // -A and --thread-affinity
 #undef HAVE_SCTP_H                      // No SCTP protocol on Android
-#undef HAVE_SENDFILE                    // `sendfile()` not supported in NDK
+#define HAVE_SENDFILE 1                 // <sys/sendfile.h> is in bionic (-Z, -F)
+#define HAVE_SPLICE 1                   // splice(), bionic API 21+ (-F -Z receive)
 #undef HAVE_SETPROCESSAFFINITYMASK      // Windows-only
 #undef HAVE_SO_BINDTODEVICE             // Not supported in Android user space
 #define HAVE_SO_MAX_PACING_RATE 1       // Controls pacing rate (useful on Android ≥ Q)
+#define HAVE_SO_TXTIME 1                // Per-packet transmit times for --txtime (kernel 4.19+)
+#define HAVE_SO_TIMESTAMPNS 1           // Kernel receive timestamps for --rx-timestamps
 #undef HAVE_SSL                         // Requires OpenSSL — disabled by default
 #undef HAVE_STDATOMIC_H                // Android NDK might lack full support
 #define HAVE_STDINT_H 1                 // Standard integer types
@@ -60,6 +64,9 @@
 // UNIX header
 #define HAVE_UNISTD_H 1                // Standard POSIX APIs (close, read, etc.)
 
+// Compression
+#define HAVE_ZLIB 1                    // The NDK's libz; compressed session logs
+
 // Required for libtool-style builds
 #define LT_OBJDIR ".libs/"
 
@@ -0,0 +1,92 @@
+/* Custom iperf_config.h for the host build (glibc Linux) */
+/* What configure finds on a current glibc system; SSL and SCTP stay off */
+
+// System/Time features
+#define HAVE_CLOCK_GETTIME 1              // Used for precise timekeeping
+#define HAVE_CLOCK_NANOSLEEP 1           // -b pacer sleeps to absolute deadlines
+#undef HAVE_CPUSET_SETAFFINITY           // Not used; Linux-specific
+#define HAVE_CPU_AFFINITY 1              // Enables CPU affinity support (via sched)
+
+// POSIX / System Functions
+#define HAVE_DAEMON 1                    // -D
+#define HAVE_DONT_FRAGMENT 1             // --dont-fragment, via IP_MTU_DISCOVER
+#define HAVE_DLFCN_H 1                   // Required for dynamic linking (e.g., dlsym)
+#define HAVE_ENDIAN_H 1                  // Provides byte-order functions
+#define HAVE_FLOWLABEL 1                 // -L, IPv6 flow labels
+#define HAVE_GETLINE 1                   // Used to read lines from config/stdin
+#define HAVE_INTTYPES_H 1                // Required for int64_t, uint32_t, etc.
+#define HAVE_IPPROTO_MPTCP 1             // --mptcp (glibc 2.32+)
+#undef HAVE_IP_DONTFRAG                  // Linux socket option
+#undef HAVE_IP_DONTFRAGMENT              // Linux socket option
+#define HAVE_IP_MTU_DISCOVER 1           // Linux socket option
+#undef HAVE_LINUX_TCP_H                  // Linux-only TCP options
+#define HAVE_LINUX_PERF_EVENT_H 1        // perf_event_open() for --perf-counters
+#define HAVE_MSG_TRUNC 1                 // Message truncation support (recv)
+#define HAVE_NANOSLEEP 1                 // For sub-second sleep
+
+// Networking Protocol Support
+#undef HAVE_NETINET_SCTP_H              // Needs lksctp; not used
+#define HAVE_POLL_H 1                   // Polling support for I/O
+#define HAVE_PTHREAD 1                  // POSIX threads
+#define HAVE_PTHREAD_PRIO_INHERIT 1     // Priority-inheriting mutexes
+#define HAVE_SCHED_SETAFFINITY 1         // -A and --thread-affinity
+#undef HAVE_SCTP_H                      // Needs lksctp; not used
+#define HAVE_SENDFILE 1                 // <sys/sendfile.h> (-Z, -F)
+#define HAVE_SPLICE 1                   // splice() (-F -Z receive)
+#undef HAVE_SETPROCESSAFFINITYMASK      // Windows-only
+#define HAVE_SO_BINDTODEVICE 1          // --bind-dev, host%dev
+#define HAVE_SO_MAX_PACING_RATE 1       // --fq-rate
+#define HAVE_SO_TXTIME 1                // Per-packet transmit times for --txtime (kernel 4.19+)
+#define HAVE_SO_TIMESTAMPNS 1           // Kernel receive timestamps for --rx-timestamps
+#undef HAVE_SSL                         // Not linked in the host build either
+#define HAVE_STDATOMIC_H 1              // C11 atomics for the stream counters
+#define HAVE_STDINT_H 1                 // Standard integer types
+#define HAVE_STDIO_H 1                  // Standard C I/O
+#define HAVE_STDLIB_H 1                 // Memory, process, conversions
+#define HAVE_STRINGS_H 1                // `bzero`, `strcasecmp`, etc.
+#define HAVE_STRING_H 1                 // String functions like `strcmp`
+
+// SCTP-specific types
+#undef HAVE_STRUCT_SCTP_ASSOC_VALUE    // Needs lksctp; not used
+
+// More system headers
+#undef HAVE_SYS_ENDIAN_H               // BSD-specific
+#define HAVE_SYS_SOCKET_H 1            // Basic networking
+#define HAVE_SYS_STAT_H 1              // File stats
+#define HAVE_SYS_TYPES_H 1             // System data types
+
+// TCP options
+#define HAVE_TCP_CONGESTION 1          // -C
+#undef HAVE_TCP_INFO_SND_WND          // Rare kernel struct field
+#define HAVE_TCP_KEEPALIVE 1           // --cntl-ka
+#define HAVE_TCP_USER_TIMEOUT 1        // --snd-timeout
+
+// UNIX header
+#define HAVE_UNISTD_H 1                // Standard POSIX APIs (close, read, etc.)
+
+// Compression
+#define HAVE_ZLIB 1                    // System zlib; compressed session logs
+
+// Required for libtool-style builds
+#define LT_OBJDIR ".libs/"
+
+// Package metadata (update version as needed)
+#define PACKAGE "iperf"
+#define PACKAGE_BUGREPORT "https://github.com/esnet/iperf"
+#define PACKAGE_NAME "iperf"
+#define PACKAGE_STRING "iperf 3.19"
+#define PACKAGE_TARNAME "iperf"
+#define PACKAGE_URL "https://software.es.net/iperf/"
+#define PACKAGE_VERSION "3.19"
+#define VERSION "3.19"
+// ──────────────────────────────
+// 🔁 SECTION TO UPDATE ON IPERF VERSION UPGRADE
+// (Update version strings when pulling new iperf source)
+// ──────────────────────────────
+#define PACKAGE_STRING "iperf @PACKAGE_VERSION@"     // ⬅️ Auto Update
+#define PACKAGE_VERSION "@PACKAGE_VERSION@"          // ⬅️ Auto Update
+#define VERSION "@PACKAGE_VERSION@"                  // ⬅️ Auto Update
+
+#define STDC_HEADERS 1                // Define if ANSI C headers are available
+
+/* #undef const */                    // Do not touch — reserved for legacy platforms
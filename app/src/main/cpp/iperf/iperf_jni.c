@@ -1,13 +1,20 @@
 #include <jni.h>
+#include <errno.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 #include <pthread.h>
 #include <android/log.h>
 
 #include "iperf.h"
 #include "iperf_api.h"
+#include "iperf_history.h"
+#include "iperf_logwriter.h"
+#include "iperf_server_pool.h"
+#include "units.h"
 
 // ─────────────────────────────────────────────────────────────────────────────
 // Logging macros
@@ -23,6 +30,16 @@ static struct iperf_test *global_test = NULL;
 static pthread_t reader_thread;
 static volatile bool stop_requested = false;
 
+// The session's text log, open from openLog() to closeLog()
+static struct iperf_logwriter *session_log = NULL;
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Interval reports go to the UI at most this often; the log gets them all
+#define UI_REPORT_GAP_MS 200
+
+// setUiFrameRate(): with a rate, the UI gets frames instead of interval reports
+static int ui_frame_hz = 0;
+
 // ─────────────────────────────────────────────────────────────────────────────
 // Structs
 // ─────────────────────────────────────────────────────────────────────────────
@@ -33,13 +50,176 @@ struct CallbackArgs {
     JavaVM *jvm;
     jobject callback_global;
     int pipe_fd;
+    bool frames;            // interval reports come as UI frames
+};
+
+/**
+ * UiThrottle - Which interval report the UI was last sent, and when.
+ */
+struct UiThrottle {
+    char interval[32];
+    bool shown;
+    long long shown_ms;
+    int held;               // lines only the log got
+    bool frames;            // hold every interval report
 };
 
+/**
+ * UiFrameTarget - Where onUiFrame sends the running test's frames: iperf
+ * reports on the thread that runs the test, whose env this is.
+ */
+struct UiFrameTarget {
+    JNIEnv *env;
+    jobject callback;
+    jmethodID onOutput;
+};
+
+static struct UiFrameTarget frame_target;
+
+// ─────────────────────────────────────────────────────────────────────────────
+// Session log
+// ─────────────────────────────────────────────────────────────────────────────
+/**
+ * Queues one line (prefix, then text, then a newline if text has none)
+ * for the session log, if there is one.  This only copies; the log
+ * writer's thread does the file I/O.
+ */
+static void logLine(const char *prefix, const char *text) {
+    char line[1280];
+    size_t len = strlen(text);
+    int n;
+
+    n = snprintf(line, sizeof(line), "%s%s%s", prefix, text,
+                 len > 0 && text[len - 1] == '\n' ? "" : "\n");
+    if (n >= (int) sizeof(line)) {
+        n = sizeof(line) - 1;
+        line[n - 1] = '\n';
+    }
+    pthread_mutex_lock(&log_lock);
+    if (session_log)
+        iperf_logwriter_write(session_log, line, n);
+    pthread_mutex_unlock(&log_lock);
+}
+
+/**
+ * Logs a status message, then passes it to onOutput: every line the
+ * callback gets is in the log already.
+ */
+static void notifyOutput(JNIEnv *env, jobject callback, jmethodID onOutput, const char *prefix,
+                         const char *msg) {
+    logLine(prefix, msg);
+    jstring line = (*env)->NewStringUTF(env, msg);
+    (*env)->CallVoidMethod(env, callback, onOutput, line);
+    (*env)->DeleteLocalRef(env, line);
+}
+
+/**
+ * The callback's prefix for its lines in the log, into prefix.
+ */
+static void getLogPrefix(JNIEnv *env, jobject callback, char *prefix, size_t size) {
+    jclass callbackClass = (*env)->GetObjectClass(env, callback);
+    jmethodID getter = (*env)->GetMethodID(env, callbackClass, "getLogPrefix",
+                                           "()Ljava/lang/String;");
+    jstring value = (jstring) (*env)->CallObjectMethod(env, callback, getter);
+    const char *chars = (*env)->GetStringUTFChars(env, value, NULL);
+
+    snprintf(prefix, size, "%s", chars);
+    (*env)->ReleaseStringUTFChars(env, value, chars);
+    (*env)->DeleteLocalRef(env, value);
+}
+
+/**
+ * Whether an output line goes to the UI as well as the log.  Interval
+ * reports do at most every UI_REPORT_GAP_MS, each with all its lines
+ * (one per stream and the SUM), or never if frames stand in for them;
+ * headers, --rate-search steps, end summaries and everything else
+ * always do.
+ */
+static bool showLine(struct UiThrottle *t, const char *line) {
+    char interval[sizeof(t->interval)];
+    struct timespec ts;
+    long long now_ms;
+
+    if (t->frames && strncmp(line, "{\"event\":\"interval\"", 19) == 0) {
+        t->held++;
+        return false;
+    }
+    if (sscanf(line, "[%*[^]]] %31s", interval) != 1 || !strstr(line, " sec ") ||
+        strstr(line, "sender") || strstr(line, "receiver") || strstr(line, " rate search: "))
+        return true;
+    if (t->frames) {
+        t->held++;
+        return false;
+    }
+
+    if (strcmp(interval, t->interval) != 0) {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        now_ms = ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+        strcpy(t->interval, interval);
+        t->shown = t->shown_ms == 0 || now_ms - t->shown_ms >= UI_REPORT_GAP_MS;
+        if (t->shown)
+            t->shown_ms = now_ms;
+    }
+    if (!t->shown)
+        t->held++;
+    return t->shown;
+}
+
+// ─────────────────────────────────────────────────────────────────────────────
+// UI frames
+// ─────────────────────────────────────────────────────────────────────────────
+/**
+ * Appends one direction of a frame to line, as an interval sum reads:
+ * bytes and rate, then retransmits (TCP sender) or jitter and loss (UDP
+ * receiver), so the app's throughput and loss parsing works on frames too.
+ */
+static void formatFrameDirection(struct iperf_test *test, char *line, size_t size,
+                                 const char *name, const struct iperf_ui_frame_direction *d,
+                                 double secs, bool sender) {
+    char ubuf[UNIT_LEN], nbuf[UNIT_LEN];
+    size_t len = strlen(line);
+
+    unit_snprintf(ubuf, UNIT_LEN, (double) d->bytes, 'A');
+    unit_snprintf(nbuf, UNIT_LEN, secs > 0 ? d->bytes / secs : 0,
+                  iperf_get_test_unit_format(test));
+    len += snprintf(line + len, size - len, "  %s %s  %s/sec", name, ubuf, nbuf);
+    if (len >= size)
+        return;
+    if (d->packets > 0)
+        snprintf(line + len, size - len, "  %.3f ms  %lld/%lld (%.2g%%)", d->jitter_ms,
+                 (long long) d->lost, (long long) d->packets, 100.0 * d->lost / d->packets);
+    else if (sender && test->sender_has_retransmits == 1)
+        snprintf(line + len, size - len, "  %lld retr", (long long) d->retransmits);
+}
+
+/**
+ * iperf's on_ui_frame: one line for the UI covering the intervals since
+ * the last frame.  It isn't logged: the log has every interval in full.
+ */
+static void onUiFrame(struct iperf_test *test, const struct iperf_ui_frame *frame) {
+    JNIEnv *env = frame_target.env;
+    double secs = frame->end - frame->start;
+    char line[256];
+
+    snprintf(line, sizeof(line), "[FRAME] %6.2f-%-6.2f sec", frame->start, frame->end);
+    if (frame->tx.active)
+        formatFrameDirection(test, line, sizeof(line), "TX", &frame->tx, secs, true);
+    if (frame->rx.active)
+        formatFrameDirection(test, line, sizeof(line), "RX", &frame->rx, secs, false);
+    if (frame->omitted && strlen(line) + 11 < sizeof(line))
+        strcat(line, "  (omitted)");
+
+    jstring text = (*env)->NewStringUTF(env, line);
+    (*env)->CallVoidMethod(env, frame_target.callback, frame_target.onOutput, text);
+    (*env)->DeleteLocalRef(env, text);
+}
+
 // ─────────────────────────────────────────────────────────────────────────────
 // Output reader thread
 // ─────────────────────────────────────────────────────────────────────────────
 /**
- * Reads output from iperf pipe and forwards each line to the Java callback.
+ * Reads output from iperf pipe, logs each line, and forwards those the
+ * UI should show to the Java callback.
  */
 void *readerThreadFunc(void *args_ptr) {
     struct CallbackArgs *args = (struct CallbackArgs *) args_ptr;
@@ -51,14 +231,29 @@ void *readerThreadFunc(void *args_ptr) {
                                              "(Ljava/lang/String;)V");
 
     char buffer[1024];
+    char prefix[32];
+    char note[128];
+    struct UiThrottle throttle = {0};
     FILE *fp = fdopen(args->pipe_fd, "r");
 
+    throttle.frames = args->frames;
+
+    getLogPrefix(env, args->callback_global, prefix, sizeof(prefix));
     while (fgets(buffer, sizeof(buffer), fp)) {
+        logLine(prefix, buffer);
+        if (!showLine(&throttle, buffer))
+            continue;
         jstring line = (*env)->NewStringUTF(env, buffer);
         (*env)->CallVoidMethod(env, args->callback_global, onOutput, line);
         (*env)->DeleteLocalRef(env, line);
     }
 
+    if (throttle.held > 0) {
+        snprintf(note, sizeof(note), "[iPerf JNI] %d interval lines are in the log only.",
+                 throttle.held);
+        notifyOutput(env, args->callback_global, onOutput, prefix, note);
+    }
+
     fclose(fp);
     (*env)->DeleteGlobalRef(env, args->callback_global);
     (*args->jvm)->DetachCurrentThread(args->jvm);
@@ -80,57 +275,128 @@ Java_com_abhishek_cellularlab_tests_iperf_IperfRunner_forceStopIperfTest(JNIEnv
     jclass callbackClass = (*env)->GetObjectClass(env, callback);
     jmethodID onOutput = (*env)->GetMethodID(env, callbackClass, "onOutput",
                                              "(Ljava/lang/String;)V");
+    char prefix[32];
 
-    jstring statusMsg = (*env)->NewStringUTF(env,
-                                             "[iPerf JNI] Requested graceful stop of iPerf test.");
-    (*env)->CallVoidMethod(env, callback, onOutput, statusMsg);
-    (*env)->DeleteLocalRef(env, statusMsg);
+    getLogPrefix(env, callback, prefix, sizeof(prefix));
+    notifyOutput(env, callback, onOutput, prefix,
+                 "[iPerf JNI] Requested graceful stop of iPerf test.");
 
     if (global_test && !global_test->done) {
         global_test->done = 1;
         iperf_set_send_state(global_test, IPERF_DONE);
         shutdown(global_test->ctrl_sck, SHUT_RDWR);  // Unblocks select()
+        // A server (or --max-clients pool) waiting for clients sits on the listener
+        if (iperf_get_test_role(global_test) == 's' && global_test->listener >= 0)
+            shutdown(global_test->listener, SHUT_RDWR);
     }
 }
 
 // ─────────────────────────────────────────────────────────────────────────────
-// Main iperf run method (JNI call from Java)
+// Server loop
 // ─────────────────────────────────────────────────────────────────────────────
 /**
- * Starts and runs an iperf3 client session using given arguments.
+ * Serves clients as iperf3 -s does, one at a time or, with --max-clients,
+ * several at once, until stopped (or after one client with -1).
+ * Returns -1 only if the server couldn't start.
+ */
+static int runIperfServer(struct iperf_test *test) {
+    int rc;
+
+    for (;;) {
+        if (iperf_server_pool_wanted(test))
+            rc = iperf_run_server_pool(test);
+        else
+            rc = iperf_run_server(test);
+        if (rc < 0 && !stop_requested) {
+            iperf_err(test, "error - %s", iperf_strerror(i_errno));
+            if (test->json_output)
+                iperf_json_finish(test);
+            iflush(test);
+        }
+        iperf_reset_test(test);
+        if (rc < -1)
+            return -1;
+        if (stop_requested || (iperf_get_test_one_off(test) && rc != 2))
+            return 0;
+    }
+}
+
+// ─────────────────────────────────────────────────────────────────────────────
+// Argument parsing
+// ─────────────────────────────────────────────────────────────────────────────
+/**
+ * Parses a Java String[] of iperf3 arguments into test, however many
+ * there are.  The strings are only borrowed from the JVM for the call:
+ * iperf keeps copies of what it needs.  Returns -1 with i_errno set.
+ */
+static int parseArguments(JNIEnv *env, struct iperf_test *test, jobjectArray arguments) {
+    int argc = (*env)->GetArrayLength(env, arguments);
+    jstring *strings = calloc(argc + 1, sizeof(*strings));
+    const char **chars = calloc(argc + 1, sizeof(*chars));
+    char **argv = calloc(argc + 1, sizeof(*argv));    // getopt reorders this one
+    int rc = -1;
+    int i;
+
+    if (!strings || !chars || !argv) {
+        i_errno = IENEWTEST;
+        goto done;
+    }
+    for (i = 0; i < argc; i++) {
+        strings[i] = (jstring) (*env)->GetObjectArrayElement(env, arguments, i);
+        chars[i] = (*env)->GetStringUTFChars(env, strings[i], NULL);
+        if (!chars[i]) {
+            i_errno = IENEWTEST;
+            goto done;
+        }
+        argv[i] = (char *) chars[i];
+    }
+    rc = iperf_parse_arguments(test, argc, argv);
+
+done:
+    for (i = 0; strings && chars && i < argc && strings[i]; i++) {
+        if (chars[i])
+            (*env)->ReleaseStringUTFChars(env, strings[i], chars[i]);
+        (*env)->DeleteLocalRef(env, strings[i]);
+    }
+    free(strings);
+    free(chars);
+    free(argv);
+    return rc;
+}
+
+// ─────────────────────────────────────────────────────────────────────────────
+// Shared client run
+// ─────────────────────────────────────────────────────────────────────────────
+/**
+ * Runs one iperf3 client with the given arguments, or as a copy of a
+ * prepared config (arguments is then unused): phases back-to-back
+ * measurements over a single control connection (1 for a plain test),
+ * phase_gap seconds apart.  Arguments with -s run a server instead.
  * Sends output and status updates via the provided callback.
  */
-JNIEXPORT void JNICALL
-Java_com_abhishek_cellularlab_tests_iperf_IperfRunner_runIperfLive(JNIEnv *env, jobject thiz,
-                                                                   jobjectArray arguments,
-                                                                   jobject callback) {
+static void runIperfClient(JNIEnv *env, jobjectArray arguments, struct iperf_test *config,
+                           jobject callback, int phases, double phase_gap) {
     jclass callbackClass = (*env)->GetObjectClass(env, callback);
     jmethodID onOutput = (*env)->GetMethodID(env, callbackClass, "onOutput",
                                              "(Ljava/lang/String;)V");
     jmethodID onError = (*env)->GetMethodID(env, callbackClass, "onError", "(Ljava/lang/String;)V");
     jmethodID onComplete = (*env)->GetMethodID(env, callbackClass, "onComplete", "()V");
 
-    // ───── Convert Java String[] to native char* argv[] ─────
-    int argc = (*env)->GetArrayLength(env, arguments);
-    if (argc > 64) argc = 64;
-
-    char *argv[64];
-    for (int i = 0; i < argc; i++) {
-        jstring arg = (jstring) (*env)->GetObjectArrayElement(env, arguments, i);
-        const char *arg_str = (*env)->GetStringUTFChars(env, arg, 0);
-        argv[i] = strdup(arg_str);
-        (*env)->ReleaseStringUTFChars(env, arg, arg_str);
-    }
-
     // ───── Create and initialize iperf test ─────
-    global_test = iperf_new_test();
+    global_test = config ? iperf_clone_test(config) : iperf_new_test();
     if (!global_test) {
         jstring errMsg = (*env)->NewStringUTF(env, "Failed to create iperf test");
         (*env)->CallVoidMethod(env, callback, onError, errMsg);
         (*env)->DeleteLocalRef(env, errMsg);
         return;
     }
-    iperf_defaults(global_test);
+    if (!config)
+        iperf_defaults(global_test);
+
+    if (phases > 1) {
+        iperf_set_test_phases(global_test, phases);
+        iperf_set_test_phase_gap(global_test, phase_gap);
+    }
 
     // ───── Setup pipe to capture iperf output ─────
     int pipefd[2];
@@ -146,8 +412,8 @@ Java_com_abhishek_cellularlab_tests_iperf_IperfRunner_runIperfLive(JNIEnv *env,
     setvbuf(fp, NULL, _IOLBF, 0);
     global_test->outfile = fp;
 
-    // ───── Parse iperf arguments ─────
-    if (iperf_parse_arguments(global_test, argc, argv) < 0) {
+    // ───── Parse iperf arguments (a config's have been) ─────
+    if (!config && parseArguments(env, global_test, arguments) < 0) {
         fflush(fp);
         fclose(fp);
 
@@ -158,20 +424,38 @@ Java_com_abhishek_cellularlab_tests_iperf_IperfRunner_runIperfLive(JNIEnv *env,
         return;
     }
 
+    // ───── UI frames, on this thread (not for --max-clients' session threads) ─────
+    bool frames = ui_frame_hz > 0 &&
+                  !(iperf_get_test_role(global_test) == 's' && iperf_server_pool_wanted(global_test));
+    if (frames) {
+        frame_target.env = env;
+        frame_target.callback = callback;
+        frame_target.onOutput = onOutput;
+        iperf_set_test_ui_frames(global_test, ui_frame_hz, onUiFrame);
+    }
+
     // ───── Start reader thread ─────
     struct CallbackArgs *cb_args = malloc(sizeof(struct CallbackArgs));
     (*env)->GetJavaVM(env, &cb_args->jvm);
     cb_args->callback_global = (*env)->NewGlobalRef(env, callback);
     cb_args->pipe_fd = pipefd[0];
+    cb_args->frames = frames;
     pthread_create(&reader_thread, NULL, readerThreadFunc, cb_args);
 
     // ───── Notify start ─────
-    jstring initMsg = (*env)->NewStringUTF(env, "🚀 Initiating iPerf3 client request...\n");
-    (*env)->CallVoidMethod(env, callback, onOutput, initMsg);
-    (*env)->DeleteLocalRef(env, initMsg);
+    char prefix[32];
+    getLogPrefix(env, callback, prefix, sizeof(prefix));
+    notifyOutput(env, callback, onOutput, prefix,
+                 iperf_get_test_role(global_test) == 's' ?
+                 "🚀 Starting iPerf3 server...\n" :
+                 "🚀 Initiating iPerf3 client request...\n");
 
     // ───── Run the test ─────
-    int result = iperf_run_client(global_test);
+    int result;
+    if (iperf_get_test_role(global_test) == 's')
+        result = runIperfServer(global_test);
+    else
+        result = iperf_run_client(global_test);
     if (result < 0 && global_test) {
         jstring errMsg = (*env)->NewStringUTF(env, iperf_strerror(i_errno));
         (*env)->CallVoidMethod(env, callback, onError, errMsg);
@@ -189,20 +473,14 @@ Java_com_abhishek_cellularlab_tests_iperf_IperfRunner_runIperfLive(JNIEnv *env,
 
     pthread_join(reader_thread, NULL);
 
-    for (int i = 0; i < argc; i++) {
-        free(argv[i]);
-    }
-
-    jstring finalMsg;
     if (stop_requested) {
-        finalMsg = (*env)->NewStringUTF(env, "[iPerf JNI] Test was stopped by user.");
+        notifyOutput(env, callback, onOutput, prefix, "[iPerf JNI] Test was stopped by user.");
     } else if (result < 0) {
-        finalMsg = (*env)->NewStringUTF(env, "[iPerf JNI] Test failed to complete successfully.");
+        notifyOutput(env, callback, onOutput, prefix,
+                     "[iPerf JNI] Test failed to complete successfully.");
     } else {
-        finalMsg = (*env)->NewStringUTF(env, "[iPerf JNI] Test completed successfully.");
+        notifyOutput(env, callback, onOutput, prefix, "[iPerf JNI] Test completed successfully.");
     }
-    (*env)->CallVoidMethod(env, callback, onOutput, finalMsg);
-    (*env)->DeleteLocalRef(env, finalMsg);
 
     // ───── Final cleanup ─────
     stop_requested = false;
@@ -211,3 +489,430 @@ Java_com_abhishek_cellularlab_tests_iperf_IperfRunner_runIperfLive(JNIEnv *env,
     // ───── Notify completion to Java ─────
     (*env)->CallVoidMethod(env, callback, onComplete);
 }
+
+// ─────────────────────────────────────────────────────────────────────────────
+// Main iperf run method (JNI call from Java)
+// ─────────────────────────────────────────────────────────────────────────────
+/**
+ * Starts and runs an iperf3 client session using given arguments
+ * (or a server, for "-s" and e.g. "--max-clients 4").
+ */
+JNIEXPORT void JNICALL
+Java_com_abhishek_cellularlab_tests_iperf_IperfRunner_runIperfLive(JNIEnv *env, jobject thiz,
+                                                                   jobjectArray arguments,
+                                                                   jobject callback) {
+    runIperfClient(env, arguments, NULL, callback, 1, 0);
+}
+
+// ─────────────────────────────────────────────────────────────────────────────
+// Repeated iperf run over one control connection (JNI call from Java)
+// ─────────────────────────────────────────────────────────────────────────────
+/**
+ * Runs the same test phases times on one control connection, keeping the
+ * parsed settings, and only making the data connections again for each
+ * phase (iperf3 --phases).  Each phase prints "Phase n of N" and its own
+ * summary; onComplete comes once, after the last one.
+ */
+JNIEXPORT void JNICALL
+Java_com_abhishek_cellularlab_tests_iperf_IperfRunner_runIperfSession(JNIEnv *env, jobject thiz,
+                                                                      jobjectArray arguments,
+                                                                      jint phases,
+                                                                      jdouble phaseGapSeconds,
+                                                                      jobject callback) {
+    runIperfClient(env, arguments, NULL, callback, phases, phaseGapSeconds);
+}
+
+// ─────────────────────────────────────────────────────────────────────────────
+// Prepared test configurations (JNI calls from Java)
+// ─────────────────────────────────────────────────────────────────────────────
+// What setConfigValue and setConfigString set; IperfConfig has the same numbers
+enum ConfigKey {
+    CONFIG_PORT = 1,            // -p
+    CONFIG_DURATION = 2,        // -t, seconds
+    CONFIG_OMIT = 3,            // -O, seconds
+    CONFIG_INTERVAL_MS = 4,     // -i, 0 for none
+    CONFIG_STREAMS = 5,         // -P
+    CONFIG_RATE = 6,            // -b, bits/sec
+    CONFIG_BLKSIZE = 7,         // -l, bytes
+    CONFIG_WINDOW = 8,          // -w, bytes
+    CONFIG_MSS = 9,             // -M
+    CONFIG_TOS = 10,            // -S
+    CONFIG_REVERSE = 11,        // -R, 0 or 1
+    CONFIG_BIDIRECTIONAL = 12,  // --bidir, 0 or 1
+    CONFIG_HOST = 101,          // -c
+    CONFIG_BIND_ADDRESS = 102,  // -B
+    CONFIG_CONGESTION = 103,    // -C
+    CONFIG_EXTRA_DATA = 104,    // --extra-data
+};
+
+/**
+ * Throws IllegalArgumentException with iperf's message for i_errno.
+ */
+static void throwIperfError(JNIEnv *env) {
+    jclass exceptionClass = (*env)->FindClass(env, "java/lang/IllegalArgumentException");
+    (*env)->ThrowNew(env, exceptionClass, iperf_strerror(i_errno));
+}
+
+/**
+ * One numeric option of a config, checked as iperf_parse_arguments
+ * checks it: on its own, and against the rest of the test as the checks
+ * after its option loop do (-t against -n/-k, -b 0 against --txtime,
+ * -i 0 and --bidir against --rate-search).  Only checks involving the
+ * option set need rerunning, as the others held when the config was
+ * parsed.  Returns -1 with i_errno set if the value is rejected.
+ */
+static int setConfigOption(struct iperf_test *test, int key, int64_t value) {
+    int udp = iperf_get_test_protocol_id(test) == Pudp;
+
+    switch (key) {
+        case CONFIG_PORT:
+            if (value < 1 || value > 65535) {
+                i_errno = IEBADPORT;
+                return -1;
+            }
+            iperf_set_test_server_port(test, value);
+            return 0;
+        case CONFIG_DURATION:
+            if (value < 0 || value > MAX_TIME) {
+                i_errno = IEDURATION;
+                return -1;
+            }
+            if (value > 0 && (test->settings->bytes != 0 || test->settings->blocks != 0)) {
+                i_errno = IEENDCONDITIONS;
+                return -1;
+            }
+            iperf_set_test_duration(test, value);
+            return 0;
+        case CONFIG_OMIT:
+            if (value < 0 || value > MAX_OMIT_TIME) {
+                i_errno = IEOMIT;
+                return -1;
+            }
+            iperf_set_test_omit(test, value);
+            return 0;
+        case CONFIG_INTERVAL_MS:
+            if (value != 0 && (value < MIN_INTERVAL * 1000 || value > MAX_INTERVAL * 1000)) {
+                i_errno = IEINTERVAL;
+                return -1;
+            }
+            if (value == 0 && test->rate_search_loss >= 0) {
+                i_errno = IERATESEARCH;
+                return -1;
+            }
+            iperf_set_test_stats_interval(test, value / 1000.0);
+            iperf_set_test_reporter_interval(test, value / 1000.0);
+            return 0;
+        case CONFIG_STREAMS:
+            if (value < 1 || value > MAX_STREAMS) {
+                i_errno = IENUMSTREAMS;
+                return -1;
+            }
+            iperf_set_test_num_streams(test, value);
+            return 0;
+        case CONFIG_RATE:
+            if (value < 0) {
+                i_errno = IEUNIMP;
+                return -1;
+            }
+            if (value == 0 && test->txtime) {
+                i_errno = IETXTIME;
+                return -1;
+            }
+            if (value == 0 && test->rate_search_loss >= 0)
+                value = UDP_RATE;       /* as parsed: the search starts from -b */
+            iperf_set_test_rate(test, value);
+            return 0;
+        case CONFIG_BLKSIZE:
+            if (udp && value != 0 && (value < MIN_UDP_BLOCKSIZE || value > MAX_UDP_BLOCKSIZE)) {
+                i_errno = IEUDPBLOCKSIZE;
+                return -1;
+            }
+            if (!udp && (value <= 0 || value > MAX_BLOCKSIZE)) {
+                i_errno = IEBLOCKSIZE;
+                return -1;
+            }
+            iperf_set_test_blksize(test, value);
+            return 0;
+        case CONFIG_WINDOW:
+            if (value < 0 || value > MAX_TCP_BUFFER) {
+                i_errno = IEBUFSIZE;
+                return -1;
+            }
+            iperf_set_test_socket_bufsize(test, value);
+            return 0;
+        case CONFIG_MSS:
+            if (value < 0 || value > MAX_MSS) {
+                i_errno = IEMSS;
+                return -1;
+            }
+            iperf_set_test_mss(test, value);
+            return 0;
+        case CONFIG_TOS:
+            if (value < 0 || value > 255) {
+                i_errno = IEBADTOS;
+                return -1;
+            }
+            iperf_set_test_tos(test, value);
+            return 0;
+        case CONFIG_REVERSE:
+            if (value && iperf_get_test_bidirectional(test)) {
+                i_errno = IEREVERSEBIDIR;
+                return -1;
+            }
+            iperf_set_test_reverse(test, value != 0);
+            return 0;
+        case CONFIG_BIDIRECTIONAL:
+            if (value && iperf_get_test_reverse(test)) {
+                i_errno = IEREVERSEBIDIR;
+                return -1;
+            }
+            if (value && test->rate_search_loss >= 0) {
+                i_errno = IERATESEARCH;
+                return -1;
+            }
+            iperf_set_test_bidirectional(test, value != 0);
+            return 0;
+        default:
+            i_errno = IEUNIMP;
+            return -1;
+    }
+}
+
+/**
+ * Parses iperf3 arguments once into a prepared test, which is returned
+ * as a handle for the calls below; throws IllegalArgumentException if
+ * they don't parse.
+ */
+JNIEXPORT jlong JNICALL
+Java_com_abhishek_cellularlab_tests_iperf_IperfRunner_newConfig(JNIEnv *env, jobject thiz,
+                                                                jobjectArray arguments) {
+    struct iperf_test *config = iperf_new_test();
+
+    if (!config) {
+        throwIperfError(env);
+        return 0;
+    }
+    iperf_defaults(config);
+    if (parseArguments(env, config, arguments) < 0) {
+        throwIperfError(env);
+        iperf_free_test(config);
+        return 0;
+    }
+    return (jlong) (intptr_t) config;
+}
+
+/**
+ * Sets one numeric option of a config (see ConfigKey); throws
+ * IllegalArgumentException if it is out of range.
+ */
+JNIEXPORT void JNICALL
+Java_com_abhishek_cellularlab_tests_iperf_IperfRunner_setConfigValue(JNIEnv *env, jobject thiz,
+                                                                     jlong handle, jint key,
+                                                                     jlong value) {
+    if (setConfigOption((struct iperf_test *) (intptr_t) handle, key, value) < 0)
+        throwIperfError(env);
+}
+
+/**
+ * Sets one text option of a config (see ConfigKey).
+ */
+JNIEXPORT void JNICALL
+Java_com_abhishek_cellularlab_tests_iperf_IperfRunner_setConfigString(JNIEnv *env, jobject thiz,
+                                                                      jlong handle, jint key,
+                                                                      jstring value) {
+    struct iperf_test *config = (struct iperf_test *) (intptr_t) handle;
+    const char *chars = (*env)->GetStringUTFChars(env, value, NULL);
+
+    if (!chars)
+        return;
+    switch (key) {
+        case CONFIG_HOST:
+            iperf_set_test_server_hostname(config, chars);
+            break;
+        case CONFIG_BIND_ADDRESS:
+            iperf_set_test_bind_address(config, chars);
+            break;
+        case CONFIG_CONGESTION:
+            iperf_set_test_congestion_control(config, (char *) chars);
+            break;
+        case CONFIG_EXTRA_DATA:
+            iperf_set_test_extra_data(config, chars);
+            break;
+        default:
+            i_errno = IEUNIMP;
+            throwIperfError(env);
+            break;
+    }
+    (*env)->ReleaseStringUTFChars(env, value, chars);
+}
+
+/**
+ * A copy of a config, to change without touching the original.
+ */
+JNIEXPORT jlong JNICALL
+Java_com_abhishek_cellularlab_tests_iperf_IperfRunner_cloneConfig(JNIEnv *env, jobject thiz,
+                                                                  jlong handle) {
+    struct iperf_test *copy = iperf_clone_test((struct iperf_test *) (intptr_t) handle);
+
+    if (!copy)
+        throwIperfError(env);
+    return (jlong) (intptr_t) copy;
+}
+
+JNIEXPORT void JNICALL
+Java_com_abhishek_cellularlab_tests_iperf_IperfRunner_freeConfig(JNIEnv *env, jobject thiz,
+                                                                 jlong handle) {
+    if (handle)
+        iperf_free_test((struct iperf_test *) (intptr_t) handle);
+}
+
+/**
+ * Runs a copy of a config as runIperfLive runs its arguments; the config
+ * itself is left as it was, to change and run again.
+ */
+JNIEXPORT void JNICALL
+Java_com_abhishek_cellularlab_tests_iperf_IperfRunner_runIperfConfig(JNIEnv *env, jobject thiz,
+                                                                     jlong handle,
+                                                                     jobject callback) {
+    runIperfClient(env, NULL, (struct iperf_test *) (intptr_t) handle, callback, 1, 0);
+}
+
+// ─────────────────────────────────────────────────────────────────────────────
+// UI frame rate (JNI call from Java)
+// ─────────────────────────────────────────────────────────────────────────────
+/**
+ * From the next test on, interval reports reach the UI as at most hz
+ * "[FRAME]" lines a second of test time, each summing every stream over
+ * the intervals since the last, however short -i and however many -P.
+ * The log still gets every line.  0 goes back to throttled report lines.
+ */
+JNIEXPORT void JNICALL
+Java_com_abhishek_cellularlab_tests_iperf_IperfRunner_setUiFrameRate(JNIEnv *env, jobject thiz,
+                                                                     jint hz) {
+    ui_frame_hz = hz > 0 ? hz : 0;
+}
+
+// ─────────────────────────────────────────────────────────────────────────────
+// Test history data (JNI call from Java)
+// ─────────────────────────────────────────────────────────────────────────────
+/**
+ * Maps one test's --history data file and returns its interval records
+ * column by column (HISTORY_NUM_COLUMNS arrays of the same length, one
+ * after the other), or null if it can't be read.
+ */
+JNIEXPORT jlongArray JNICALL
+Java_com_abhishek_cellularlab_tests_iperf_IperfRunner_readHistorySeries(JNIEnv *env, jobject thiz,
+                                                                        jstring path) {
+    struct iperf_history_map map;
+    struct iperf_history_record *records;
+    jlongArray result = NULL;
+    jlong *columns;
+    const char *cpath;
+    int n, i, c;
+
+    cpath = (*env)->GetStringUTFChars(env, path, NULL);
+    if (cpath == NULL)
+        return NULL;
+    if (iperf_history_map(cpath, &map) < 0) {
+        (*env)->ReleaseStringUTFChars(env, path, cpath);
+        return NULL;
+    }
+    (*env)->ReleaseStringUTFChars(env, path, cpath);
+
+    n = iperf_history_read(&map, NULL, 0);
+    records = n > 0 ? malloc(n * sizeof(*records)) : NULL;
+    if (n >= 0 && (n == 0 || records != NULL)) {
+        n = n > 0 ? iperf_history_read(&map, records, n) : 0;
+        result = (*env)->NewLongArray(env, n * HISTORY_NUM_COLUMNS);
+        columns = result != NULL ? (*env)->GetLongArrayElements(env, result, NULL) : NULL;
+        if (columns != NULL) {
+            for (c = 0; c < HISTORY_NUM_COLUMNS; c++)
+                for (i = 0; i < n; i++)
+                    columns[c * n + i] = records[i].v[c];
+            (*env)->ReleaseLongArrayElements(env, result, columns, 0);
+        }
+    }
+    free(records);
+    iperf_history_unmap(&map);
+    return result;
+}
+
+// ─────────────────────────────────────────────────────────────────────────────
+// Session log (JNI calls from Java)
+// ─────────────────────────────────────────────────────────────────────────────
+/**
+ * Opens the session's text log, "<prefix><part><suffix>", rotating to a
+ * new part before one grows past maxBytes; closes any log still open.
+ * With compressLevel (1-9) the parts are gzip, deflated on the writer's
+ * thread.  Test output goes into it from the reader thread as it comes,
+ * and the app's own messages through writeLog().
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_abhishek_cellularlab_tests_iperf_IperfRunner_openLog(JNIEnv *env, jobject thiz,
+                                                              jstring prefix, jstring suffix,
+                                                              jlong maxBytes, jint compressLevel) {
+    struct iperf_logwriter *lw, *old;
+    const char *cprefix = (*env)->GetStringUTFChars(env, prefix, NULL);
+    const char *csuffix = (*env)->GetStringUTFChars(env, suffix, NULL);
+
+    lw = iperf_logwriter_open(cprefix, csuffix, (off_t) maxBytes, compressLevel);
+    if (!lw)
+        LOGE("Can't open log %s1%s: %s", cprefix, csuffix, strerror(errno));
+    (*env)->ReleaseStringUTFChars(env, prefix, cprefix);
+    (*env)->ReleaseStringUTFChars(env, suffix, csuffix);
+
+    pthread_mutex_lock(&log_lock);
+    old = session_log;
+    session_log = lw;
+    pthread_mutex_unlock(&log_lock);
+    if (old)
+        iperf_logwriter_close(old);
+    return lw != NULL;
+}
+
+/**
+ * Queues one line of the app's own for the session log.
+ */
+JNIEXPORT void JNICALL
+Java_com_abhishek_cellularlab_tests_iperf_IperfRunner_writeLog(JNIEnv *env, jobject thiz,
+                                                               jstring text) {
+    const char *ctext = (*env)->GetStringUTFChars(env, text, NULL);
+    logLine("", ctext);
+    (*env)->ReleaseStringUTFChars(env, text, ctext);
+}
+
+/**
+ * The parts of the session log written to so far, first and last, or
+ * null if no log is open.
+ */
+JNIEXPORT jintArray JNICALL
+Java_com_abhishek_cellularlab_tests_iperf_IperfRunner_logParts(JNIEnv *env, jobject thiz) {
+    jintArray result = NULL;
+    jint parts[2] = {0, 0};
+
+    pthread_mutex_lock(&log_lock);
+    if (session_log)
+        iperf_logwriter_parts(session_log, &parts[0], &parts[1]);
+    pthread_mutex_unlock(&log_lock);
+    if (parts[0] == 0 && parts[1] == 0)
+        return NULL;
+    result = (*env)->NewIntArray(env, 2);
+    if (result)
+        (*env)->SetIntArrayRegion(env, result, 0, 2, parts);
+    return result;
+}
+
+/**
+ * Writes out and syncs what the session log has queued, and closes it.
+ */
+JNIEXPORT void JNICALL
+Java_com_abhishek_cellularlab_tests_iperf_IperfRunner_closeLog(JNIEnv *env, jobject thiz) {
+    struct iperf_logwriter *lw;
+
+    pthread_mutex_lock(&log_lock);
+    lw = session_log;
+    session_log = NULL;
+    pthread_mutex_unlock(&log_lock);
+    if (lw && iperf_logwriter_close(lw) < 0)
+        LOGE("Writing the log failed: %s", strerror(errno));
+}
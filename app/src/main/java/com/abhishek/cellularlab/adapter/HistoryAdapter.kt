@@ -19,6 +19,7 @@ import com.abhishek.cellularlab.BuildConfig
 import com.abhishek.cellularlab.MarkdownViewerActivity
 import com.abhishek.cellularlab.R
 import com.abhishek.cellularlab.model.LogEntry
+import com.abhishek.cellularlab.tests.iperf.IperfHistory
 import kotlinx.coroutines.CoroutineScope
 import kotlinx.coroutines.Dispatchers
 import kotlinx.coroutines.launch
@@ -170,6 +171,7 @@ class HistoryAdapter(
                                     if (fileToDelete.delete()) {
                                         logs.removeAt(pos)
                                         notifyItemRemoved(pos)
+                                        forgetSessionIfGone(fileToDelete)
                                     } else {
                                         Toast.makeText(
                                             anchor.context,
@@ -193,7 +195,7 @@ class HistoryAdapter(
                         }
 
                         val logFile = entry.file
-                        val aiFile = File(logFile.parent, "AI_${logFile.name}")
+                        val aiFile = File(logFile.parent, "AI_${logFile.name.removeSuffix(".gz")}")
 
                         if (aiFile.exists()) {
                             //onOpen(aiFile)
@@ -203,7 +205,7 @@ class HistoryAdapter(
                             return@setOnMenuItemClickListener true
                         }
 
-                        val logText = logFile.readText()
+                        val logText = IperfHistory.readLog(logFile)
                         if (logText.length > MAX_LOG_CHARS) {
                             Toast.makeText(
                                 anchor.context,
@@ -315,6 +317,27 @@ $logText
         }
     }
 
+    /**
+     * Once the last log part of a session is deleted, deletes its interval data and
+     * its records in the history index too.
+     *
+     * @param deleted The log part just deleted.
+     */
+    private fun forgetSessionIfGone(deleted: File) {
+        val dir = deleted.parentFile ?: return
+        val session = Regex("""iPerf3_(\d{8}_\d{6})_""").find(deleted.name)?.groupValues?.get(1) ?: return
+        CoroutineScope(Dispatchers.IO).launch {
+            val parts = dir.listFiles { _, name -> name.startsWith("iPerf3_${session}_") }
+            if (parts.isNullOrEmpty()) {
+                try {
+                    IperfHistory.deleteSession(dir, session)
+                } catch (e: IOException) {
+                    Log.e("HistoryAdapter", "Failed to delete history of $session", e)
+                }
+            }
+        }
+    }
+
     private fun showUpdateApiKeyDialog(view: View) {
         val context = view.context
         val prefs = context.getSharedPreferences(PREFS_NAME, Context.MODE_PRIVATE)
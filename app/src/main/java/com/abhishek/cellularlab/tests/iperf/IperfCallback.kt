@@ -1,6 +1,8 @@
 package com.abhishek.cellularlab.tests.iperf
 
 interface IperfCallback {
+    /** Put before each of this run's lines in the session log */
+    val logPrefix: String
     fun onOutput(line: String)
     fun onError(error: String)
     fun onComplete()
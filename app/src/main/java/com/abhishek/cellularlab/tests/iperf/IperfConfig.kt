@@ -0,0 +1,72 @@
+package com.abhishek.cellularlab.tests.iperf
+
+/**
+ * An iperf3 test parsed once and kept natively, for sweeps that run the same test many
+ * times with a few options changed: each setter changes the prepared test directly, and
+ * [run] runs a copy of it, with no command line to build and parse again.
+ *
+ * Setters throw [IllegalArgumentException] with iperf's message for values it would
+ * reject on the command line.  [close] frees the native test; a closed config can't be used.
+ */
+class IperfConfig private constructor(private var handle: Long) : AutoCloseable {
+
+    companion object {
+        // Keys, as ConfigKey in iperf_jni.c
+        private const val PORT = 1
+        private const val DURATION = 2
+        private const val OMIT = 3
+        private const val INTERVAL_MS = 4
+        private const val STREAMS = 5
+        private const val RATE = 6
+        private const val BLKSIZE = 7
+        private const val WINDOW = 8
+        private const val MSS = 9
+        private const val TOS = 10
+        private const val REVERSE = 11
+        private const val BIDIRECTIONAL = 12
+        private const val HOST = 101
+        private const val BIND_ADDRESS = 102
+        private const val CONGESTION = 103
+        private const val EXTRA_DATA = 104
+
+        /** Parses iperf3 [arguments], as [IperfRunner.runIperfLive] takes them */
+        fun parse(arguments: Array<String>) = IperfConfig(IperfRunner.newConfig(arguments))
+    }
+
+    fun setPort(port: Int) = set(PORT, port.toLong())
+    fun setDuration(seconds: Int) = set(DURATION, seconds.toLong())
+    fun setOmit(seconds: Int) = set(OMIT, seconds.toLong())
+    fun setIntervalMs(ms: Long) = set(INTERVAL_MS, ms)
+    fun setStreams(streams: Int) = set(STREAMS, streams.toLong())
+    fun setRate(bitsPerSecond: Long) = set(RATE, bitsPerSecond)
+    fun setBlockSize(bytes: Int) = set(BLKSIZE, bytes.toLong())
+    fun setWindow(bytes: Int) = set(WINDOW, bytes.toLong())
+    fun setMss(bytes: Int) = set(MSS, bytes.toLong())
+    fun setTos(tos: Int) = set(TOS, tos.toLong())
+    fun setReverse(reverse: Boolean) = set(REVERSE, if (reverse) 1 else 0)
+    fun setBidirectional(bidirectional: Boolean) = set(BIDIRECTIONAL, if (bidirectional) 1 else 0)
+    fun setHost(host: String) = set(HOST, host)
+    fun setBindAddress(address: String) = set(BIND_ADDRESS, address)
+    fun setCongestion(algorithm: String) = set(CONGESTION, algorithm)
+    fun setExtraData(data: String) = set(EXTRA_DATA, data)
+
+    /** An independent copy, to change without changing this one */
+    fun copy() = IperfConfig(IperfRunner.cloneConfig(checkOpen()))
+
+    /** Runs a copy of the test as it is now; blocks as [IperfRunner.runIperfLive] does */
+    fun run(callback: IperfCallback) = IperfRunner.runIperfConfig(checkOpen(), callback)
+
+    override fun close() {
+        if (handle != 0L) IperfRunner.freeConfig(handle)
+        handle = 0L
+    }
+
+    private fun set(key: Int, value: Long) = IperfRunner.setConfigValue(checkOpen(), key, value)
+
+    private fun set(key: Int, value: String) = IperfRunner.setConfigString(checkOpen(), key, value)
+
+    private fun checkOpen(): Long {
+        check(handle != 0L) { "IperfConfig is closed" }
+        return handle
+    }
+}
@@ -0,0 +1,165 @@
+package com.abhishek.cellularlab.tests.iperf
+
+import java.io.ByteArrayOutputStream
+import java.io.EOFException
+import java.io.File
+import java.io.RandomAccessFile
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+import java.nio.channels.FileChannel
+import java.util.zip.GZIPInputStream
+
+/**
+ * Reads the test history that iperf3 --history keeps: an index with one fixed-size,
+ * little-endian summary per test (or per phase of a session), and a data file per test
+ * with its interval sums.  Layout as in iperf_history.h.
+ */
+object IperfHistory {
+
+    // region Format
+
+    const val INDEX_NAME = "history.ihx"
+    private const val RECORD_SIZE = 256
+    private const val MAGIC = 0x31584849 // "IHX1"
+
+    // Columns of a data file, as readSeries returns them
+    const val COLUMN_START_MS = 0
+    const val COLUMN_END_MS = 1
+    const val COLUMN_BYTES = 2
+    const val COLUMN_RETRANSMITS = 3
+    const val COLUMN_PACKETS = 4
+    const val COLUMN_LOST = 5
+    const val COLUMN_JITTER_US = 6
+    const val COLUMN_FLAGS = 7
+    const val NUM_COLUMNS = 8
+
+    // endregion
+
+    /**
+     * One test from the index.
+     * @property tag The --extra-data it ran with; the app passes its session timestamp.
+     * @property dataFile Its interval data, next to the index; empty if it has none.
+     */
+    data class Summary(
+        val startMs: Long,
+        val durationMs: Long,
+        val complete: Boolean,
+        val numStreams: Int,
+        val phase: Int,
+        val txBytesReceived: Long,
+        val rxBytesReceived: Long,
+        val host: String,
+        val tag: String,
+        val dataFile: String
+    )
+
+    /**
+     * Maps the index in [dir] and decodes every complete record.
+     * @return The tests in the order they ended; empty if there is no index yet
+     */
+    fun readIndex(dir: File): List<Summary> {
+        val file = File(dir, INDEX_NAME)
+        if (!file.exists()) return emptyList()
+        return RandomAccessFile(file, "r").use { raf ->
+            val count = (raf.length() / RECORD_SIZE).toInt()
+            if (count == 0) return emptyList()
+            val buf = raf.channel.map(FileChannel.MapMode.READ_ONLY, 0, count.toLong() * RECORD_SIZE)
+                .order(ByteOrder.LITTLE_ENDIAN)
+            (0 until count).mapNotNull { decode(buf, it * RECORD_SIZE) }
+        }
+    }
+
+    /**
+     * Interval data of [summary], column by column: [NUM_COLUMNS] runs of the same length.
+     * @return null if the test has no data file or it can't be read
+     */
+    fun readSeries(dir: File, summary: Summary): LongArray? {
+        if (summary.dataFile.isEmpty()) return null
+        return IperfRunner.readHistorySeries(File(dir, summary.dataFile).path)
+    }
+
+    /**
+     * Forgets a deleted session: removes the data files of the tests tagged [tag] and
+     * rewrites the index without their records.  The index is written to a temporary
+     * file and renamed over the old one; records a running test appends meanwhile are
+     * carried over, since appends only ever add whole records at the end.
+     * @return How many tests were removed
+     */
+    fun deleteSession(dir: File, tag: String): Int {
+        val file = File(dir, INDEX_NAME)
+        if (tag.isEmpty() || !file.exists()) return 0
+        val bytes = file.readBytes()
+        val count = bytes.size / RECORD_SIZE
+        val buf = ByteBuffer.wrap(bytes).order(ByteOrder.LITTLE_ENDIAN)
+        val kept = ByteArrayOutputStream(bytes.size)
+        var removed = 0
+        for (i in 0 until count) {
+            val test = decode(buf, i * RECORD_SIZE)
+            if (test != null && test.tag == tag) {
+                if (test.dataFile.isNotEmpty()) File(dir, test.dataFile).delete()
+                removed++
+            } else {
+                kept.write(bytes, i * RECORD_SIZE, RECORD_SIZE)
+            }
+        }
+        if (removed == 0) return 0
+
+        val tmp = File(dir, "$INDEX_NAME.tmp")
+        tmp.outputStream().use { out ->
+            kept.writeTo(out)
+            // Anything appended since it was read
+            RandomAccessFile(file, "r").use { raf ->
+                val end = raf.length() / RECORD_SIZE * RECORD_SIZE
+                if (end > count.toLong() * RECORD_SIZE) {
+                    val tail = ByteArray((end - count.toLong() * RECORD_SIZE).toInt())
+                    raf.seek(count.toLong() * RECORD_SIZE)
+                    raf.readFully(tail)
+                    out.write(tail)
+                }
+            }
+        }
+        if (!tmp.renameTo(file)) {
+            tmp.delete()
+            return 0
+        }
+        return removed
+    }
+
+    /**
+     * Text of one session log part, plain (.txt) or compressed (.txt.gz).  A compressed
+     * part cut short by a crash gives everything up to its last batch.
+     */
+    fun readLog(file: File): String {
+        if (!file.name.endsWith(".gz")) return file.readText()
+        val out = ByteArrayOutputStream()
+        try {
+            GZIPInputStream(file.inputStream()).use { it.copyTo(out) }
+        } catch (e: EOFException) {
+            // The member being written when it stopped; what came before it is all there
+        }
+        return out.toString(Charsets.UTF_8.name())
+    }
+
+    private fun decode(buf: ByteBuffer, offset: Int): Summary? {
+        if (buf.getInt(offset) != MAGIC || buf.getShort(offset + 6).toInt() != RECORD_SIZE) return null
+        return Summary(
+            startMs = buf.getLong(offset + 8),
+            durationMs = buf.getInt(offset + 16).toLong() and 0xffffffffL,
+            complete = buf.get(offset + 23).toInt() != 0,
+            numStreams = buf.getShort(offset + 24).toInt() and 0xffff,
+            phase = buf.getShort(offset + 26).toInt() and 0xffff,
+            txBytesReceived = buf.getLong(offset + 32 + 8),
+            rxBytesReceived = buf.getLong(offset + 72 + 8),
+            host = string(buf, offset + 112, 48),
+            tag = string(buf, offset + 160, 48),
+            dataFile = string(buf, offset + 208, 40)
+        )
+    }
+
+    private fun string(buf: ByteBuffer, offset: Int, size: Int): String {
+        val bytes = ByteArray(size)
+        for (i in 0 until size) bytes[i] = buf.get(offset + i)
+        val end = bytes.indexOf(0.toByte()).let { if (it < 0) size else it }
+        return String(bytes, 0, end, Charsets.UTF_8)
+    }
+}
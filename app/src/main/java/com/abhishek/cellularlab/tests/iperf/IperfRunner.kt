@@ -24,9 +24,81 @@ object IperfRunner {
     @JvmStatic
     external fun runIperfLive(arguments: Array<String>, callback: IperfCallback)
 
+    /**
+     * Runs the same test [phases] times over one control connection, [phaseGapSeconds] apart.
+     * Each phase prints "Phase n of N" and its own summary; onComplete comes once, at the end.
+     * Needs an iperf3 server that supports --phases.
+     */
+    @JvmStatic
+    external fun runIperfSession(
+        arguments: Array<String>,
+        phases: Int,
+        phaseGapSeconds: Double,
+        callback: IperfCallback
+    )
+
     @JvmStatic
     external fun forceStopIperfTest(callback: IperfCallback)
 
+    /**
+     * From the next test on, passes interval reports to [IperfCallback.onOutput] as at most
+     * [hz] "[FRAME]" lines per second of test time, each summing all streams since the last
+     * ("TX 45.2 MBytes 1.21 Gbits/sec 3 retr"), whatever -i and -P are.  Every interval line
+     * still goes to the log.  0 passes throttled interval lines instead.
+     */
+    @JvmStatic
+    external fun setUiFrameRate(hz: Int)
+
+    // Prepared configurations: see IperfConfig, which wraps these
+
+    @JvmStatic
+    external fun newConfig(arguments: Array<String>): Long
+
+    @JvmStatic
+    external fun setConfigValue(handle: Long, key: Int, value: Long)
+
+    @JvmStatic
+    external fun setConfigString(handle: Long, key: Int, value: String)
+
+    @JvmStatic
+    external fun cloneConfig(handle: Long): Long
+
+    @JvmStatic
+    external fun freeConfig(handle: Long)
+
+    @JvmStatic
+    external fun runIperfConfig(handle: Long, callback: IperfCallback)
+
+    /**
+     * Maps a --history data file and returns its interval records column by column,
+     * or null if it can't be read.  See [IperfHistory.readSeries].
+     */
+    @JvmStatic
+    external fun readHistorySeries(path: String): LongArray?
+
+    /**
+     * Opens the session log, "<prefix><part><suffix>", in parts of up to [maxBytes]; it
+     * carries on in the last part if that has room.  Closes any log still open.  While it
+     * is open, every line of test output is written to it natively, in batches, and only
+     * some interval lines are passed on to [IperfCallback.onOutput] (all at -i 0.2 or more),
+     * or none, with [setUiFrameRate].
+     * With [compressLevel] (zlib's 1-9) the parts are gzip files; 0 writes plain text.
+     */
+    @JvmStatic
+    external fun openLog(prefix: String, suffix: String, maxBytes: Long, compressLevel: Int): Boolean
+
+    /** Queues one line of the app's own for the session log */
+    @JvmStatic
+    external fun writeLog(text: String)
+
+    /** First and last part of the session log written so far, or null if none is open */
+    @JvmStatic
+    external fun logParts(): IntArray?
+
+    /** Writes out and syncs the session log, and closes it */
+    @JvmStatic
+    external fun closeLog()
+
     // region Timer
     /**
      * Starts a coroutine timer to update elapsed time during the test.
@@ -29,7 +29,8 @@ import java.util.Locale
 
 /**
  * Manages the lifecycle and logic of running iPerf3-based network tests.
- * Supports advanced features like smart ramp-up, hybrid tests, and automatic bandwidth reduction.
+ * Supports advanced features like smart ramp-up (a native --rate-search), hybrid tests, and
+ * automatic bandwidth reduction.
  */
 class IperfTestManage(
     private val context: Context,
@@ -41,19 +42,28 @@ class IperfTestManage(
     private val onTestComplete: () -> Unit,
     private val startTimer: () -> Unit,
     private val stopTimer: () -> Unit,
-    private val isAutoReduceEnabled: () -> Boolean = { false }
+    private val isAutoReduceEnabled: () -> Boolean = { false },
+    private val isLogCompressed: Boolean = false
 ) {
 
     // region Constants & Regex
 
     private val MAX_LOG_SIZE = 5 * 1024 * 1024 // 5 MB per log file
+    private val LOG_COMPRESS_LEVEL = 1 // ~6x smaller for ~5 ms CPU per MB (iperf_logbench)
+    private val UI_FRAME_HZ = 4 // interval output lines per second, however many streams
+    private val RATE_SEARCH_LOSS_PERCENT = 1.0 // smart ramp-up: the most loss a rate may have
     private val throughputRegex = Regex("""\s+(\d+(?:\.\d+)?)\s+(K|M|G)?bits/sec""")
+    private val rateSearchStepRegex =
+        Regex("""rate search:\s+(\d+(?:\.\d+)?) (K|M|G)?bits/sec per stream, .*\(([a-z-]+)\), next""")
+    private val rateSearchResultRegex =
+        Regex("""^Rate search:\s+(\d+(?:\.\d+)?) (K|M|G)?bits/sec per stream .*, (converged|not converged) after (\d+) steps""")
 
     // endregion
 
     // region Internal State
 
-    private val createdLogFiles = mutableListOf<File>()
+    private var logOpen = false
+    private var logFailed = false
     private val packetLossHistory = mutableListOf<Float>()
     private var wasStoppedManually = false
 
@@ -66,7 +76,6 @@ class IperfTestManage(
 
     @Volatile
     private var lastIterationHadError = false
-    private var wasAutoReducedOnPacketLoss = false
 
     private val mainScope = CoroutineScope(Dispatchers.Main)
 
@@ -89,6 +98,7 @@ class IperfTestManage(
     ) {
 
         var currentArgs = args.copyOf()
+        IperfRunner.setUiFrameRate(UI_FRAME_HZ)
 
 
         // region Timing & Config
@@ -99,7 +109,6 @@ class IperfTestManage(
         val waitTimeMillis = waitTime * 1000
         // endregion
 
-        wasAutoReducedOnPacketLoss = false
         lastIterationHadError = false
 
         // region Bandwidth & Loss Config
@@ -140,44 +149,100 @@ class IperfTestManage(
             }
             // endregion
 
-            // region Main Test Loop
-            for (iteration in 0 until testIterations) {
-
-                if (wasStoppedManually) break
-
+            // region Smart Ramp-Up: one native --rate-search run finds the bandwidth
+            var firstIteration = 0
+            if (isSmartIncrementalRampUpTest) {
                 val currentTime = SimpleDateFormat("HH:mm:ss", Locale.getDefault()).format(Date())
-                append("\n\n🕒 [$currentTime] ──🚀 Starting iPerf3 Test ${iteration + 1}/$testIterations ──\n\n$commandStr\n")
-
-                val testCompleted = CompletableDeferred<Unit>()
-                var maxAchievedThisRun = 0
-
-                // region Incremental Ramp-Up Logic
-                if (isIncrementalRampUpTest) {
-                    val targetBandwidth = extractBandwidthMbps(currentArgs)
-                    if (targetBandwidth != null && originalBandwidth > 100) {
-                        val stepSize = 50
-                        val rampBandwidth =
-                            ((iteration + 1) * stepSize).coerceAtMost(originalBandwidth)
-                        currentArgs = updateBandwidth(currentArgs, rampBandwidth)
-                        append("📈 Ramp-up bandwidth set to ${rampBandwidth}M")
-                    } else {
-                        append("ℹ️ Bandwidth too low for ramp-up. Skipping ramp logic.")
-                    }
+                append("\n\n🕒 [$currentTime] ──🔎 Iteration 1/$testIterations: searching for the highest UDP bandwidth losing at most $RATE_SEARCH_LOSS_PERCENT% ──")
+                val foundBandwidth = runRateSearch(currentArgs)
+                if (wasStoppedManually) return@launch
+                firstIteration = 1
+                if (foundBandwidth > 0) {
+                    currentStepBandwidth = foundBandwidth
+                    currentArgs = updateBandwidth(currentArgs, foundBandwidth)
+                    commandStr = currentArgs.joinToString(" ")
+                    if (testIterations > 1) append("\n[New Command :] $commandStr")
+                } else if (!lastIterationHadError) {
+                    append("⚠️ Rate search found no bandwidth within the loss limit. Keeping the original settings.")
+                }
+                if (testIterations == 1) {
+                    finalizeTest()
+                    return@launch
                 }
-                // endregion
+                if (lastIterationHadError) {
+                    append("\n⏳ Error occurred. Waiting ${errorBackoffMs / 1000} seconds before next test...")
+                    if (!safeDelay(errorBackoffMs)) return@launch
+                    lastIterationHadError = false
+                }
+                append("⏳ Waiting $waitTime seconds before next test...")
+                if (!safeDelay(waitTimeMillis.toLong())) return@launch
+            }
+            // endregion
 
-                // region Smart Ramp-Up Logic
-                if (isSmartIncrementalRampUpTest) {
-                    currentArgs = updateBandwidth(currentArgs, currentStepBandwidth)
-                    append("\n\n📶 Set bandwidth: ${currentStepBandwidth}M")
-                    commandStr = currentArgs.joinToString(" ")
-                    append("\n[New Command :] $commandStr")
+            // region Session: identical iterations over one control connection
+            if (testIterations - firstIteration > 1 && !isIncrementalRampUpTest && !isAutoReduceEnabled()) {
+                firstIteration += runIterationsAsSession(currentArgs, commandStr, testIterations - firstIteration, waitTime)
+                if (wasStoppedManually) return@launch
+                if (firstIteration >= testIterations) {
+                    finalizeTest()
+                    return@launch
                 }
-                // endregion
+                append("\n⏳ Session ended after $firstIteration/$testIterations iterations. Waiting ${errorBackoffMs / 1000} seconds, then running the rest one by one...")
+                if (!safeDelay(errorBackoffMs)) return@launch
+                lastIterationHadError = false
+            }
+            // endregion
+
+            // region Main Test Loop: the command parsed once, its bandwidth set per iteration
+            val config = try {
+                IperfConfig.parse(withHistory(currentArgs))
+            } catch (e: IllegalArgumentException) {
+                append("\n❌ Error: ${e.message}")
+                lastIterationHadError = true
+                finalizeTest()
+                return@launch
+            }
+            try {
+                for (iteration in firstIteration until testIterations) {
+
+                    if (wasStoppedManually) break
+
+                    val currentTime = SimpleDateFormat("HH:mm:ss", Locale.getDefault()).format(Date())
+                    append("\n\n🕒 [$currentTime] ──🚀 Starting iPerf3 Test ${iteration + 1}/$testIterations ──\n\n$commandStr\n")
+
+                    val testCompleted = CompletableDeferred<Unit>()
+
+                    // region Incremental Ramp-Up Logic
+                    if (isIncrementalRampUpTest) {
+                        val targetBandwidth = extractBandwidthMbps(currentArgs)
+                        if (targetBandwidth != null && originalBandwidth > 100) {
+                            val stepSize = 50
+                            val rampBandwidth =
+                                ((iteration + 1) * stepSize).coerceAtMost(originalBandwidth)
+                            currentArgs = updateBandwidth(currentArgs, rampBandwidth)
+                            append("📈 Ramp-up bandwidth set to ${rampBandwidth}M")
+                        } else {
+                            append("ℹ️ Bandwidth too low for ramp-up. Skipping ramp logic.")
+                        }
+                    }
+                    // endregion
+
+                    // Ramp-up and auto-reduce change -b in currentArgs; the config follows it
+                    val iterationBandwidth = extractBandwidthMbps(currentArgs)
+                    if (iterationBandwidth != null) {
+                        try {
+                            config.setRate(iterationBandwidth * 1_000_000L)
+                        } catch (e: IllegalArgumentException) {
+                            append("\n❌ Error: ${e.message}")
+                            lastIterationHadError = true
+                            finalizeTest()
+                            break
+                        }
+                    }
 
-                // region Watchdog Launch
-                // Not needed
-                //
+                    // region Watchdog Launch
+                    // Not needed
+                    //
 //                watchdogJob = launch(Dispatchers.IO + handler) {
 //                    append("\n\n🐶 Watchdog launched – I'll jump in if things hang! 🚨\n")
 //                    delay(totalTimeout)
@@ -201,130 +266,157 @@ class IperfTestManage(
 ////                        delay(3000) // allow JNI to shut down
 //                    }
 //                }
-                // endregion
-
-                // region Start Actual iPerf Test
-                val runJob = launch(Dispatchers.IO) {
-                    isIperfRunning = true
-                    val isUdp = currentArgs.contains("-u")
-                    IperfRunner.runIperfLive(currentArgs, createIperfCallback(onLine = { line ->
-                        append("📊 $line")
-
-                        if (isUdp) {
-                            parsePacketLoss(line)?.let { loss ->
-                                if (packetLossHistory.size >= historyWindowSize) {
-                                    packetLossHistory.removeAt(0)
+                    // endregion
+
+                    // region Start Actual iPerf Test
+                    val runJob = launch(Dispatchers.IO) {
+                        isIperfRunning = true
+                        val isUdp = currentArgs.contains("-u")
+                        config.run(createIperfCallback(onLine = { line ->
+                            show("📊 $line")
+
+                            if (isUdp) {
+                                parsePacketLoss(line)?.let { loss ->
+                                    if (packetLossHistory.size >= historyWindowSize) {
+                                        packetLossHistory.removeAt(0)
+                                    }
+                                    packetLossHistory.add(loss)
                                 }
-                                packetLossHistory.add(loss)
                             }
-                        }
-
-
-                        if (isSmartIncrementalRampUpTest) {
-                            parseThroughputMbps(line)?.let {
-                                if (it > maxAchievedThisRun) maxAchievedThisRun = it
+                        }, onError = {
+                            isIperfRunning = false
+                            append("\n❌ Error: $it")
+                            lastIterationHadError = true
+                            testCompleted.complete(Unit)
+                        }, onComplete = {
+                            isIperfRunning = false
+                            append("\n\n🏁 [End] Iteration ${iteration + 1}")
+
+                            if (isUdp && packetLossHistory.isEmpty() && !lastIterationHadError) append("ℹ️ No packet loss stats detected in this run.")
+
+                            if (iteration == testIterations - 1) {
+                                finalizeTest(wasStoppedManually)
                             }
-                        }
-                    }, onError = {
-                        isIperfRunning = false
-                        append("\n❌ Error: $it")
-                        lastIterationHadError = true
-                        testCompleted.complete(Unit)
-                    }, onComplete = {
-                        isIperfRunning = false
-                        append("\n\n🏁 [End] Iteration ${iteration + 1}")
-
-                        if (isUdp && packetLossHistory.isEmpty() && !lastIterationHadError) append("ℹ️ No packet loss stats detected in this run.")
 
-                        if (iteration == testIterations - 1) {
-                            finalizeTest(wasStoppedManually)
-                        }
-
-                        testCompleted.complete(Unit)
+                            testCompleted.complete(Unit)
 
 //                        if(wasStoppedManually){
 //                            clear()
 //                        }
-                    }))
-                }
-                // endregion
-
-                // region Wait for Completion / Timeout
-                try {
-                    withTimeout(totalTimeout) {
-                        while (isActive) {
-                            if (testCompleted.isCompleted || wasStoppedManually) break
-                            delay(200) // check every 200ms
+                        }))
+                    }
+                    // endregion
+
+                    // region Wait for Completion / Timeout
+                    try {
+                        withTimeout(totalTimeout) {
+                            while (isActive) {
+                                if (testCompleted.isCompleted || wasStoppedManually) break
+                                delay(200) // check every 200ms
+                            }
                         }
+                    } catch (e: TimeoutCancellationException) {
+                        isIperfRunning = false
+                        append("⏰ Timeout: iPerf did not respond for iteration ${iteration + 1}")
                     }
-                } catch (e: TimeoutCancellationException) {
-                    isIperfRunning = false
-                    append("⏰ Timeout: iPerf did not respond for iteration ${iteration + 1}")
-                }
-                // endregion
-
-                // region Auto Reduce Bandwidth if High Loss
-                if (isAutoReduceEnabled() && packetLossHistory.size == historyWindowSize && packetLossHistory.count { it > lossThreshold } >= requiredHighLossCount) {
-                    withContext(Dispatchers.Main) {
-                        showReduceBandwidthDialog { reduce ->
-                            if (reduce) {
-                                currentStepBandwidth =
-                                    (currentStepBandwidth * 0.8).toInt().coerceAtLeast(10)
-                                append("📉 High packet loss detected. Reduced bandwidth to ${currentStepBandwidth}M.")
-                                currentArgs = updateBandwidth(currentArgs, currentStepBandwidth)
-                                wasAutoReducedOnPacketLoss = true
-                            } else {
-                                append("⚠️ High packet loss ignored. Keeping current bandwidth.")
+                    // endregion
+
+                    // region Auto Reduce Bandwidth if High Loss
+                    if (isAutoReduceEnabled() && packetLossHistory.size == historyWindowSize && packetLossHistory.count { it > lossThreshold } >= requiredHighLossCount) {
+                        withContext(Dispatchers.Main) {
+                            showReduceBandwidthDialog { reduce ->
+                                if (reduce) {
+                                    currentStepBandwidth =
+                                        (currentStepBandwidth * 0.8).toInt().coerceAtLeast(10)
+                                    append("📉 High packet loss detected. Reduced bandwidth to ${currentStepBandwidth}M.")
+                                    currentArgs = updateBandwidth(currentArgs, currentStepBandwidth)
+                                } else {
+                                    append("⚠️ High packet loss ignored. Keeping current bandwidth.")
+                                }
                             }
                         }
                     }
-                }
-                // endregion
+                    // endregion
 
-                // region Cleanup Run
+                    // region Cleanup Run
 //                val cancelResult = withTimeoutOrNull(3000) {
 //                    runJob.cancelAndJoin()
 //                }
 //                if (cancelResult == null) {
 //                    append("⚠️ Timeout: JNI job did not cancel in time.")
 //                }
-                // Don't force a 3-second timeout, just cancel and allow graceful shutdown
-                runJob.cancel()
+                    // Don't force a 3-second timeout, just cancel and allow graceful shutdown
+                    runJob.cancel()
 
-                if (wasStoppedManually) {
-                    append("\n⏳ Waiting for iPerf JNI to finish cleanup...❗")
-                }
+                    if (wasStoppedManually) {
+                        append("\n⏳ Waiting for iPerf JNI to finish cleanup...❗")
+                    }
 
-                runJob.join()
-                // endregion
+                    runJob.join()
+                    // endregion
 
-                // region Smart Ramp-Up Bandwidth Adjustment
-                if ((isSmartIncrementalRampUpTest || wasAutoReducedOnPacketLoss) && !lastIterationHadError) {
-                    currentStepBandwidth = evaluateBandwidthRampUp(
-                        currentStepBandwidth, iteration, maxAchievedThisRun, originalBandwidth
-                    )
-                }
-                // endregion
-
-                // region Delay Between Iterations or End Summary
-                if (iteration < testIterations - 1 && !wasStoppedManually) {
-                    if (lastIterationHadError) {
-                        append("\n⏳ Error occurred. Waiting ${errorBackoffMs / 1000} seconds before next test...")
-                        val continueAfterError = safeDelay(errorBackoffMs)
-                        if (!continueAfterError) break
-                        lastIterationHadError = false
+                    // region Delay Between Iterations or End Summary
+                    if (iteration < testIterations - 1 && !wasStoppedManually) {
+                        if (lastIterationHadError) {
+                            append("\n⏳ Error occurred. Waiting ${errorBackoffMs / 1000} seconds before next test...")
+                            val continueAfterError = safeDelay(errorBackoffMs)
+                            if (!continueAfterError) break
+                            lastIterationHadError = false
+                        }
+                        append("⏳ Waiting $waitTime seconds before next test...")
+                        val continueTest = safeDelay(waitTimeMillis.toLong())
+                        if (!continueTest) break
                     }
-                    append("⏳ Waiting $waitTime seconds before next test...")
-                    val continueTest = safeDelay(waitTimeMillis.toLong())
-                    if (!continueTest) break
+                    // endregion
                 }
-                // endregion
+                // end repeat
+            } finally {
+                config.close()
             }
-            // end repeat
             // endregion
         }
     }
 
+    /**
+     * Runs all iterations as phases of one iPerf3 session: one control connection, cookie and
+     * parameter exchange for the lot, instead of a full connect and teardown per iteration.
+     * Returns how many iterations completed; if the session fails, the caller runs the rest
+     * one by one (an older server without --phases fails after the first).
+     */
+    private fun runIterationsAsSession(
+        args: Array<String>,
+        commandStr: String,
+        iterations: Int,
+        waitTime: Int
+    ): Int {
+        val phaseRegex = Regex("""^Phase (\d+) of \d+""")
+        var phasesStarted = 0
+        var sessionFailed = false
+
+        val currentTime = SimpleDateFormat("HH:mm:ss", Locale.getDefault()).format(Date())
+        append("\n\n🕒 [$currentTime] ──🚀 Starting iPerf3 session: $iterations iterations over one connection ──\n\n$commandStr\n")
+
+        isIperfRunning = true
+        IperfRunner.runIperfSession(withHistory(args), iterations, waitTime.toDouble(), createIperfCallback(onLine = { line ->
+            phaseRegex.find(line.trim())?.let {
+                phasesStarted = it.groupValues[1].toInt()
+                append("\n🔁 Iteration $phasesStarted/$iterations")
+            }
+            show("📊 $line")
+        }, onError = {
+            isIperfRunning = false
+            append("\n❌ Error: $it")
+            lastIterationHadError = true
+            sessionFailed = true
+        }, onComplete = {
+            isIperfRunning = false
+            append("\n\n🏁 [End] Session")
+        }))
+
+        // The phase that failed is run again
+        return if (sessionFailed) (phasesStarted - 1).coerceAtLeast(0) else iterations
+    }
+
     private suspend fun safeDelay(totalMs: Long, checkIntervalMs: Long = 200): Boolean {
         var waited = 0L
         while (waited < totalMs) {
@@ -347,7 +439,8 @@ class IperfTestManage(
         // Cancel running iperf JNI test
         IperfRunner.forceStopIperfTest(
             createIperfCallback(
-                onLine = { line -> append("➡ $line") },
+                onLine = { line -> show("➡ $line") },
+                logPrefix = "➡ ",
                 onError = {
                     append("\n❌ Error: $it")
                     lastIterationHadError = true
@@ -384,15 +477,19 @@ class IperfTestManage(
                 }
             }
 
-            if (createdLogFiles.isNotEmpty()) {
+            val logFiles = IperfRunner.logParts()?.let { (first, last) ->
+                (first..last).map { "${logPrefix}$it$logSuffix" }
+            } ?: emptyList()
+            if (logFiles.isNotEmpty()) {
                 append("\n📁 Logs saved in app-specific Downloads folder:")
-                createdLogFiles.forEachIndexed { index, file ->
-                    append("   🔹 Part ${index + 1}: ${file.name}")
+                logFiles.forEachIndexed { index, name ->
+                    append("   🔹 Part ${index + 1}: $name")
                 }
 
             } else {
                 append("\n⚠️ No log files were created.")
             }
+            closeLog()
 
             stopTimer()
             startBtn.text = "New Test"
@@ -438,19 +535,63 @@ class IperfTestManage(
         return updatedArgs.toTypedArray()
     }
 
-    private fun evaluateBandwidthRampUp(
-        currentStepBandwidth: Int,
-        iteration: Int,
-        maxAchieved: Int,
-        originalBw: Int
-    ): Int {
-        return if (maxAchieved >= (currentStepBandwidth * 0.9) && currentStepBandwidth < originalBw) {
-            append("\n\n📈 Smart Ramp-up: Achieved ${maxAchieved}M, increasing bandwidth.")
-            (currentStepBandwidth + ((iteration + 1) * 50)).coerceAtMost(originalBw)
-        } else {
-            append("⏸ Holding bandwidth at ${currentStepBandwidth}M.")
-            currentStepBandwidth
+    // endregion
+
+    // region Native Rate Search
+
+    /**
+     * Runs one UDP test with --rate-search, in which iPerf moves -b at every interval until it
+     * finds the highest bandwidth losing at most RATE_SEARCH_LOSS_PERCENT, and shows the steps
+     * it took.  Returns that bandwidth per stream in Mbps, or 0 if it found none.
+     */
+    private suspend fun runRateSearch(args: Array<String>): Int {
+        val searchArgs = args.toMutableList().apply {
+            if (remove("--bidir")) append("\n⚙️ [Rate Search] Removed incompatible flag: --bidir")
+            if (!contains("-u")) add("-u")
+            addAll(listOf("--rate-search", RATE_SEARCH_LOSS_PERCENT.toString()))
+        }.toTypedArray()
+        append("\n${searchArgs.joinToString(" ")}\n")
+
+        // Only the sending side prints the steps, so with -R there is just the result
+        val trajectory = mutableListOf<String>()
+        var foundMbps = 0f
+        var outcome: String? = null
+        val completed = CompletableDeferred<Unit>()
+
+        isIperfRunning = true
+        IperfRunner.runIperfLive(withHistory(searchArgs), createIperfCallback(onLine = { line ->
+            rateSearchStepRegex.find(line)?.let {
+                val mbps = toMbps(it.groupValues[1].toFloatOrNull(), it.groupValues[2]) ?: return@let
+                val mark = when (it.groupValues[3]) {
+                    "good" -> "✅"
+                    "lossy" -> "❌"
+                    else -> "⚠️"
+                }
+                trajectory.add(String.format(Locale.US, "%.1f%s", mbps, mark))
+            }
+            rateSearchResultRegex.find(line.trim())?.let {
+                foundMbps = toMbps(it.groupValues[1].toFloatOrNull(), it.groupValues[2]) ?: 0f
+                outcome = "${it.groupValues[3]} after ${it.groupValues[4]} steps"
+            }
+            show("📊 $line")
+        }, onError = {
+            isIperfRunning = false
+            append("\n❌ Error: $it")
+            lastIterationHadError = true
+            completed.complete(Unit)
+        }, onComplete = {
+            isIperfRunning = false
+            append("\n\n🏁 [End] Rate search")
+            completed.complete(Unit)
+        }))
+
+        withTimeoutOrNull(getTestDurationMillis(args, bufferSeconds = 10)) { completed.await() }
+
+        if (trajectory.isNotEmpty()) append("📈 Search steps (Mbps): ${trajectory.joinToString(" → ")}")
+        outcome?.let {
+            append(String.format(Locale.US, "🎯 Rate search %s: %.1f Mbps per stream", it, foundMbps))
         }
+        return foundMbps.toInt()
     }
 
     // endregion
@@ -496,10 +637,11 @@ class IperfTestManage(
                     parseThroughputMbps(it)?.let { value ->
                         if (value > maxBandwidthMbps) maxBandwidthMbps = value
                     }
-                    append("🧪 $it")
+                    show("🧪 $it")
                 },
                 onError = { append("❌ TCP error: $it"); completed.complete(Unit) },
-                onComplete = { append("✅ TCP bidir test complete.\n"); completed.complete(Unit) }
+                onComplete = { append("✅ TCP bidir test complete.\n"); completed.complete(Unit) },
+                logPrefix = "🧪 "
             ))
 
         val timeout = getTestDurationMillis(args, bufferSeconds = 10)
@@ -523,12 +665,25 @@ class IperfTestManage(
         return (testSeconds + bufferSeconds) * 1000L
     }
 
+    /**
+     * Has the native side index each test for the history screen: --history into the logs
+     * folder, tagged with this session's timestamp (unless the command has its own tag).
+     */
+    private fun withHistory(args: Array<String>): Array<String> {
+        if (args.contains("-s") || args.contains("--history")) return args
+        val dir = context.getExternalFilesDir(Environment.DIRECTORY_DOWNLOADS) ?: return args
+        val tag = if (args.contains("--extra-data")) emptyArray() else arrayOf("--extra-data", timestamp)
+        return args + arrayOf("--history", dir.path) + tag
+    }
+
     private fun createIperfCallback(
         onLine: (String) -> Unit = {},
         onError: (String) -> Unit = {},
-        onComplete: () -> Unit = {}
+        onComplete: () -> Unit = {},
+        logPrefix: String = "📊 "
     ): IperfCallback {
         return object : IperfCallback {
+            override val logPrefix = logPrefix
             override fun onOutput(line: String) = onLine(line)
             override fun onError(error: String) = onError(error)
             override fun onComplete() = onComplete()
@@ -538,7 +693,15 @@ class IperfTestManage(
     // endregion
 
     // region Output & Logging
+
+    /** Shows text and writes it to the session log */
     private fun append(text: String) {
+        writeLog(text)
+        show(text)
+    }
+
+    /** Shows text only: test output, which the native side has logged already */
+    private fun show(text: String) {
         mainScope.launch {
             outputView.append("$text\n")
             if (isAutoScrollEnabled()) {
@@ -546,41 +709,44 @@ class IperfTestManage(
                     scrollView.fullScroll(View.FOCUS_DOWN)
                 }
             }
-
-            try {
-                val file = getWritableLogFile()
-                file.appendText("$text\n")
-            } catch (e: Exception) {
-                e.printStackTrace()
-            }
         }
     }
 
-    private fun getWritableLogFile(): File {
-        val dir = context.getExternalFilesDir(Environment.DIRECTORY_DOWNLOADS)
-        if (dir == null || !dir.exists()) {
-            append("\n\n❌ Logging error: External files dir not available\nt")
-        }
-
-        var part = 1
+    /** Log file name up to the part number: iPerf3_<timestamp>_v<version>_ */
+    private val logPrefix by lazy {
         val versionName = context.packageManager.getPackageInfo(context.packageName, 0).versionName
-        lateinit var logFile: File
-
-        do {
-            val fileName = "iPerf3_${timestamp}_v${versionName}_$part.txt"
-            logFile = File(dir, fileName)
-            if (!logFile.exists() || logFile.length() < MAX_LOG_SIZE) break
-            part++
-        } while (true)
-
-        if (!logFile.exists()) {
-            logFile.createNewFile()
-            createdLogFiles.add(logFile)
-        } else if (!createdLogFiles.contains(logFile)) {
-            createdLogFiles.add(logFile)
+        "iPerf3_${timestamp}_v${versionName}_"
+    }
+    private val logSuffix get() = if (isLogCompressed) ".txt.gz" else ".txt"
+
+    /**
+     * Queues text for the session log, opening it first if need be.  The native writer
+     * batches the writes (deflating them, if isLogCompressed) and rotates parts at
+     * MAX_LOG_SIZE, so this never touches the file.
+     */
+    @Synchronized
+    private fun writeLog(text: String) {
+        if (!logOpen) {
+            if (logFailed) return
+            val dir = context.getExternalFilesDir(Environment.DIRECTORY_DOWNLOADS)
+            logOpen = dir != null && dir.exists() &&
+                    IperfRunner.openLog(
+                        File(dir, logPrefix).path, logSuffix, MAX_LOG_SIZE.toLong(),
+                        if (isLogCompressed) LOG_COMPRESS_LEVEL else 0
+                    )
+            if (!logOpen) {
+                logFailed = true
+                show("\n\n❌ Logging error: External files dir not available\n")
+                return
+            }
         }
+        IperfRunner.writeLog(text)
+    }
 
-        return logFile
+    @Synchronized
+    private fun closeLog() {
+        if (logOpen) IperfRunner.closeLog()
+        logOpen = false
     }
 
     // endregion
@@ -592,14 +758,16 @@ class IperfTestManage(
         val value = match?.groups?.get(1)?.value?.toFloatOrNull()
         val unit = match?.groups?.get(2)?.value
 
-        val throughputMbps = when (unit) {
+        return toMbps(value, unit)?.toInt()
+    }
+
+    private fun toMbps(value: Float?, unit: String?): Float? {
+        return when (unit) {
             "K" -> value?.div(1000)
             "M" -> value
             "G" -> value?.times(1000)
             else -> value?.div(1_000_000)
         }
-
-        return throughputMbps?.toInt()
     }
 
     private fun parsePacketLoss(line: String): Float? {
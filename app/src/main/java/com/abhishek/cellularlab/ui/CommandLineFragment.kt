@@ -170,7 +170,9 @@ class CommandLineFragment : Fragment() {
                 inputCommand.isEnabled = true
                 stopBtn.isEnabled = false
                 stopBtn.visibility = View.GONE
-            }
+            },
+            // Soak tests' JSON event streams run to hundreds of MB
+            isLogCompressed = args.contains("--json-stream")
         )
 
         outputView.text = ""
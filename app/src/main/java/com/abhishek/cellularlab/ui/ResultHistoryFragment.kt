@@ -15,6 +15,7 @@ import androidx.swiperefreshlayout.widget.SwipeRefreshLayout
 import com.abhishek.cellularlab.R
 import com.abhishek.cellularlab.adapter.HistoryAdapter
 import com.abhishek.cellularlab.model.LogEntry
+import com.abhishek.cellularlab.tests.iperf.IperfHistory
 import kotlinx.coroutines.Dispatchers
 import kotlinx.coroutines.launch
 import kotlinx.coroutines.withContext
@@ -123,22 +124,41 @@ class ResultHistoryFragment : Fragment() {
     }
 
     /**
-     * Loads and parses all log files from the app's external downloads directory.
-     * @return List of parsed LogEntry objects, sorted by last modified date (descending)
+     * Lists the log files in the app's external downloads directory and summarizes each.
+     * Sessions in the native test history index are summarized from it alone; only logs
+     * from before it existed are read and parsed.
+     * @return List of LogEntry objects, sorted by last modified date (descending)
      */
     private fun loadLogEntries(): List<LogEntry> {
         val dir = requireContext().getExternalFilesDir(Environment.DIRECTORY_DOWNLOADS)
         val logFiles = dir?.listFiles()
-            ?.filter { it.name.matches(Regex("""iPerf3_\d{8}_\d{6}_v[\d.]+_\d+\.txt""")) }
+            ?.filter { it.name.matches(Regex("""iPerf3_\d{8}_\d{6}_v[\d.]+_\d+\.txt(\.gz)?""")) }
             ?.sortedByDescending { it.lastModified() }
             ?: emptyList()
+        val sessions = dir?.let { IperfHistory.readIndex(it).groupBy { test -> test.tag } } ?: emptyMap()
 
-        return logFiles.map {
-            val (file, timestamp, ip, summaryText, icon) = parseLogDetails(it)
-            LogEntry(file, timestamp, ip, summaryText, icon)
+        return logFiles.map { file ->
+            val session = Regex("""iPerf3_(\d{8}_\d{6})_""").find(file.name)?.groupValues?.get(1)
+            sessions[session]?.let { tests -> summarizeSession(file, tests) } ?: parseLogDetails(file)
         }
     }
 
+    /**
+     * Builds a LogEntry for a session from its tests in the history index.
+     * @param file Log file of the session, for sharing and opening
+     * @param tests The session's tests, in the order they ended
+     * @return LogEntry with the same details parseLogDetails would find
+     */
+    private fun summarizeSession(file: File, tests: List<IperfHistory.Summary>): LogEntry {
+        val tag = tests.first().tag
+        val timestamp = "${tag.substring(0, 4)}-${tag.substring(4, 6)}-${tag.substring(6, 8)} " +
+                "${tag.substring(9, 11)}:${tag.substring(11, 13)}"
+        val ip = tests.first().host.ifEmpty { "Unknown IP" }
+        val successCount = tests.count { it.complete }
+
+        return LogEntry(file, timestamp, ip, "$successCount / ${tests.size}", statusIcon(successCount, tests.size))
+    }
+
 
     /**
      * Parses a single log file to extract:
@@ -161,7 +181,7 @@ class ResultHistoryFragment : Fragment() {
             "$formattedDate $formattedTime"
         } ?: "Unknown"
 
-        val contentLines = file.readLines()
+        val contentLines = IperfHistory.readLog(file).lines()
 
         // Extract IP address from log content
         val ip = contentLines.find { it.contains("Connecting to host") }
@@ -182,14 +202,14 @@ class ResultHistoryFragment : Fragment() {
 
         val ratioText = "$successCount / $totalIterations"
 
-        // Choose emoji based on success percentage
-        val icon = when {
-            successCount == totalIterations -> "✅"
-            successCount.toDouble() / totalIterations >= 0.5 -> "⚠️"
-            else -> "❌"
-        }
+        return LogEntry(file, timestamp, ip, ratioText, statusIcon(successCount, totalIterations))
+    }
 
-        return LogEntry(file, timestamp, ip, ratioText, icon)
+    /** Chooses the emoji for a session based on its success percentage */
+    private fun statusIcon(successCount: Int, total: Int): String = when {
+        successCount == total -> "✅"
+        successCount.toDouble() / total >= 0.5 -> "⚠️"
+        else -> "❌"
     }
 
     //endregion
@@ -208,7 +228,7 @@ class ResultHistoryFragment : Fragment() {
             file
         )
         val intent = Intent(Intent.ACTION_SEND).apply {
-            type = "text/plain"
+            type = logMimeType(file)
             putExtra(Intent.EXTRA_STREAM, uri)
             addFlags(Intent.FLAG_GRANT_READ_URI_PERMISSION)
         }
@@ -227,11 +247,15 @@ class ResultHistoryFragment : Fragment() {
             file
         )
         val intent = Intent(Intent.ACTION_VIEW).apply {
-            setDataAndType(uri, "text/plain")
+            setDataAndType(uri, logMimeType(file))
             addFlags(Intent.FLAG_GRANT_READ_URI_PERMISSION)
         }
         startActivity(intent)
     }
 
+    /** Compressed session logs are shared and opened as what they are */
+    private fun logMimeType(file: File) =
+        if (file.name.endsWith(".gz")) "application/gzip" else "text/plain"
+
     //endregion
 }
\ No newline at end of file